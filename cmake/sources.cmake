@@ -0,0 +1,38 @@
+# SPDX-License-Identifier: Apache-2.0
+#
+# Firmware modules: every source file except main.c, the optional ones
+# by Kconfig, and the include directories. Included by the firmware and
+# the benchmark app, with SEGMENT_APP_DIR pointing at the firmware tree,
+# so the benchmark always builds what the firmware builds.
+
+target_sources(app PRIVATE
+    ${SEGMENT_APP_DIR}/src/network.c
+    ${SEGMENT_APP_DIR}/src/packet.c
+    ${SEGMENT_APP_DIR}/src/imu.c
+    ${SEGMENT_APP_DIR}/src/encoder.c
+    ${SEGMENT_APP_DIR}/src/capgrid.c
+    ${SEGMENT_APP_DIR}/src/calib.c
+    ${SEGMENT_APP_DIR}/src/trace.c
+    ${SEGMENT_APP_DIR}/src/tmc9660.c
+    ${SEGMENT_APP_DIR}/src/control.c
+    ${SEGMENT_APP_DIR}/src/trajectory_buffer.c
+    ${SEGMENT_APP_DIR}/src/trajectory.c
+    ${SEGMENT_APP_DIR}/src/packet_framer.c
+    ${SEGMENT_APP_DIR}/src/crc.c
+    ${SEGMENT_APP_DIR}/src/feedback.c
+    ${SEGMENT_APP_DIR}/src/estop.c
+    ${SEGMENT_APP_DIR}/src/sysmon.c
+    ${SEGMENT_APP_DIR}/src/timesync.c
+    ${SEGMENT_APP_DIR}/src/trajectory_mcast.c
+)
+
+# Optional modules
+target_sources_ifdef(CONFIG_SEGMENT_TMC9660_UART app PRIVATE ${SEGMENT_APP_DIR}/src/tmc9660_uart.c)
+target_sources_ifdef(CONFIG_SEGMENT_TMC9660_SPI app PRIVATE ${SEGMENT_APP_DIR}/src/tmc9660_spi.c)
+target_sources_ifdef(CONFIG_SEGMENT_IMU_FIFO app PRIVATE ${SEGMENT_APP_DIR}/src/lsm6dso_fifo.c)
+target_sources_ifdef(CONFIG_SEGMENT_PERSIST app PRIVATE ${SEGMENT_APP_DIR}/src/persist.c)
+
+target_include_directories(app PRIVATE
+    ${SEGMENT_APP_DIR}/include
+    ${SEGMENT_APP_DIR}/src
+)
@@ -0,0 +1,35 @@
+# SPDX-License-Identifier: Apache-2.0
+#
+# CONFIG_SEGMENT_TCM: control path in the Cortex-M7 tightly coupled
+# memories. Code is copied to ITCM at boot (no flash wait states, no
+# instruction cache misses); its data lives in DTCM (zero wait states,
+# never evicted). Included by the firmware and the benchmark app, with
+# SEGMENT_APP_DIR pointing at the firmware tree.
+#
+# DMA1/DMA2 cannot reach DTCM: only list files whose DMA buffers, if
+# any, are __nocache (that section is not relocated).
+
+if(CONFIG_SEGMENT_TCM)
+  # Run every control tick: loop, set point, encoders, fusion
+  set(SEGMENT_TCM_TEXT
+      ${SEGMENT_APP_DIR}/src/control.c
+      ${SEGMENT_APP_DIR}/src/trajectory.c
+      ${SEGMENT_APP_DIR}/src/trajectory_buffer.c
+      ${SEGMENT_APP_DIR}/src/encoder.c
+      ${SEGMENT_APP_DIR}/src/imu.c
+  )
+
+  # Control-loop state, trajectory ring, encoder tracking, Madgwick
+  # state, and the event trace ring written from all of them
+  set(SEGMENT_TCM_DATA
+      ${SEGMENT_APP_DIR}/src/control.c
+      ${SEGMENT_APP_DIR}/src/trajectory_buffer.c
+      ${SEGMENT_APP_DIR}/src/encoder.c
+      ${SEGMENT_APP_DIR}/src/imu.c
+      ${SEGMENT_APP_DIR}/src/trace.c
+  )
+
+  zephyr_code_relocate(FILES ${SEGMENT_TCM_TEXT} LOCATION ITCM_TEXT)
+  zephyr_code_relocate(FILES ${SEGMENT_TCM_DATA} LOCATION DTCM_DATA)
+  zephyr_code_relocate(FILES ${SEGMENT_TCM_DATA} LOCATION DTCM_BSS)
+endif()
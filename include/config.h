@@ -19,15 +19,46 @@
 
 /* Phase 4: IMU Configuration */
 // #define IMU_I2C_ADDRESS 0x6A
-// #define IMU_SAMPLE_RATE_HZ 100
+#define IMU_SAMPLE_RATE_HZ 100
 
 /* Phase 5: Motor Driver Configuration */
-// #define TMC9660_SPI_FREQUENCY 1000000
+/* TMC9660 SPI clock: spi-max-frequency in tmc9660-spi.overlay (1 MHz) */
 
 /* Phase 6: Trajectory Configuration */
-// #define TRAJECTORY_BUFFER_SIZE 10
+#define TRAJECTORY_BUFFER_SIZE 10
 
 /* Phase 7: Control Loop */
-// #define CONTROL_LOOP_FREQUENCY_HZ 100
+#define CONTROL_LOOP_FREQUENCY_HZ 1000   /* 100 Hz - 1 kHz */
+#define CONTROL_THREAD_PRIORITY   2      /* Cooperative, above network threads */
+#define CONTROL_THREAD_STACK_SIZE 2048
+
+/* Phase 7: Motor state feedback */
+#define FEEDBACK_RATE_HZ            100  /* MOTOR_STATE packets over UDP */
+#define FEEDBACK_THREAD_PRIORITY    10   /* Preemptible, below network threads */
+#define FEEDBACK_THREAD_STACK_SIZE  1024
+
+/* Phase 7: Encoder feedback (see docs/hardware-configuration.yaml) */
+#define ENCODER_COUNTS_PER_MM       14400.0f  /* 576 counts/rev x 50 / 2 mm lead */
+#define ENCODER_FILTER_THETA        0.9f      /* Estimator memory per tick (0 - 1) */
+
+/* Phase 8: Capacitive grid */
+#define CAPGRID_RATE_HZ             30   /* CAPACITIVE_GRID packets over UDP */
+#define CAPGRID_THREAD_PRIORITY     11   /* Preemptible, below motor state feedback */
+#define CAPGRID_THREAD_STACK_SIZE   1024
+#define CAPGRID_THRESHOLD           16   /* Counts above baseline reported as touch */
+#define CAPGRID_BASELINE_FRAMES     16   /* Frames averaged for the startup baseline */
+
+/* Phase 9: Calibration store */
+#define CALIB_HOME_POSITION_MM      10.4f  /* Light barrier + 10.4 mm after homing */
+#define CALIB_WRITE_DELAY_MS        2000   /* Changes in this window share one flash write */
+#define CALIB_THREAD_PRIORITY       14     /* Lowest preemptible: flash erases take seconds */
+#define CALIB_THREAD_STACK_SIZE     1536
+
+/* Phase 10: Event trace */
+#define TRACE_LIVE_PERIOD_MS        20     /* Live stream: new events sent this often */
+#define TRACE_RETRY_MS              5      /* Dump: wait for TCP send buffer space */
+#define TRACE_DUMP_TIMEOUT_MS       1000   /* Dump abandoned (recording resumed) after this */
+#define TRACE_THREAD_PRIORITY       13     /* Preemptible, dumps never delay other work */
+#define TRACE_THREAD_STACK_SIZE     1024
 
 #endif /* CONFIG_H */
@@ -0,0 +1,246 @@
+/*
+ * Calibration Store Implementation
+ *
+ * One persist record per calibration item. Each has a RAM copy, under
+ * calib_lock, and a dirty bit; setters set the bit and schedule the
+ * writer, which is already scheduled during a burst. The writer takes a
+ * snapshot of each dirty record and writes it through persist (ZMS
+ * rather than NVS, see persist.c), which skips data that is already
+ * stored. A failed write stays dirty and is retried after the next
+ * delay.
+ *
+ * The storage partition is in flash bank 2, so erases there do not stall
+ * code running from bank 1.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "calib.h"
+#include "config.h"
+#include "packet.h"
+#include "persist.h"
+#include "log_ratelimit.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include <errno.h>
+
+LOG_MODULE_REGISTER(calib, CONFIG_SEGMENT_CALIB_LOG_LEVEL);
+
+/* RAM copies */
+static calib_zero_offsets_t zero_offsets;
+static bool zero_offsets_valid;
+static uint16_t capgrid_baseline[CAPACITIVE_GRID_POINTS];
+static bool capgrid_baseline_valid;
+static struct k_spinlock calib_lock;
+
+enum calib_record_index {
+	CALIB_ZERO_OFFSETS,
+	CALIB_CAPGRID_BASELINE,
+	CALIB_RECORD_COUNT,
+};
+
+static const struct calib_record {
+	uint16_t id;
+	const char *name;
+	void *data;
+	size_t size;
+	bool *valid;
+} records[CALIB_RECORD_COUNT] = {
+	[CALIB_ZERO_OFFSETS] = { PERSIST_ID_ZERO_OFFSETS, "zero offsets",
+				 &zero_offsets, sizeof(zero_offsets), &zero_offsets_valid },
+	[CALIB_CAPGRID_BASELINE] = { PERSIST_ID_CAPGRID_BASELINE, "capacitive baseline",
+				     capgrid_baseline, sizeof(capgrid_baseline),
+				     &capgrid_baseline_valid },
+};
+
+/* Largest record, for the writer's snapshot */
+#define CALIB_MAX_RECORD sizeof(capgrid_baseline)
+
+BUILD_ASSERT(sizeof(calib_zero_offsets_t) <= CALIB_MAX_RECORD, "Snapshot buffer too small");
+
+static atomic_t dirty = ATOMIC_INIT(0);
+
+static calib_stats_t stats;
+
+#if defined(CONFIG_SEGMENT_PERSIST)
+
+K_THREAD_STACK_DEFINE(calib_workq_stack, CALIB_THREAD_STACK_SIZE);
+static struct k_work_q calib_workq;
+static struct k_work_delayable calib_write_work;
+static bool writer_started;
+
+static void calib_count(uint32_t *counter)
+{
+	k_spinlock_key_t key = k_spin_lock(&calib_lock);
+
+	(*counter)++;
+	k_spin_unlock(&calib_lock, key);
+}
+
+static void calib_write_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	static uint8_t snapshot[CALIB_MAX_RECORD] __aligned(4);
+	atomic_val_t pending = atomic_clear(&dirty);
+
+	for (int i = 0; i < CALIB_RECORD_COUNT; i++) {
+		const struct calib_record *rec = &records[i];
+
+		if (!(pending & BIT(i))) {
+			continue;
+		}
+
+		k_spinlock_key_t key = k_spin_lock(&calib_lock);
+
+		memcpy(snapshot, rec->data, rec->size);
+		k_spin_unlock(&calib_lock, key);
+
+		int ret = persist_write(rec->id, snapshot, rec->size);
+
+		if (ret < 0) {
+			LOG_WRN_RL("Storing %s failed: %d, retrying", rec->name, ret);
+			atomic_or(&dirty, BIT(i));
+			calib_count(&stats.write_errors);
+		} else {
+			LOG_INF("Stored %s", rec->name);
+			calib_count(&stats.writes);
+		}
+	}
+
+	if (atomic_get(&dirty) != 0) {
+		k_work_schedule_for_queue(&calib_workq, &calib_write_work,
+					  K_MSEC(CALIB_WRITE_DELAY_MS));
+	}
+}
+
+/* Load every stored record into its RAM copy (before anyone reads them) */
+static void calib_load(void)
+{
+	for (int i = 0; i < CALIB_RECORD_COUNT; i++) {
+		const struct calib_record *rec = &records[i];
+		int ret = persist_read(rec->id, rec->data, rec->size);
+
+		if (ret == 0) {
+			*rec->valid = true;
+			LOG_INF("Loaded %s", rec->name);
+		} else if (ret != -ENOENT) {
+			/* Partial read or old layout: do not use it */
+			memset(rec->data, 0, rec->size);
+			LOG_WRN("Stored %s unusable: %d", rec->name, ret);
+		}
+	}
+}
+
+int calib_init(void)
+{
+	const struct k_work_queue_config cfg = { .name = "calib" };
+	int ret;
+
+	if (writer_started) {
+		return -EALREADY;
+	}
+
+	ret = persist_init();
+	if (ret < 0) {
+		return ret;
+	}
+
+	calib_load();
+
+	k_work_init_delayable(&calib_write_work, calib_write_handler);
+	k_work_queue_start(&calib_workq, calib_workq_stack,
+			   K_THREAD_STACK_SIZEOF(calib_workq_stack),
+			   K_PRIO_PREEMPT(CALIB_THREAD_PRIORITY), &cfg);
+	writer_started = true;
+
+	return 0;
+}
+
+static void calib_schedule_write(void)
+{
+	if (writer_started) {
+		/* Already scheduled during a burst: the changes join that write */
+		k_work_schedule_for_queue(&calib_workq, &calib_write_work,
+					  K_MSEC(CALIB_WRITE_DELAY_MS));
+	}
+}
+
+#else /* !CONFIG_SEGMENT_PERSIST */
+
+int calib_init(void)
+{
+	return -ENOTSUP;
+}
+
+static void calib_schedule_write(void)
+{
+}
+
+#endif /* CONFIG_SEGMENT_PERSIST */
+
+static void calib_update(int index, const void *data)
+{
+	const struct calib_record *rec = &records[index];
+	k_spinlock_key_t key = k_spin_lock(&calib_lock);
+
+	memcpy(rec->data, data, rec->size);
+	*rec->valid = true;
+	stats.updates++;
+	k_spin_unlock(&calib_lock, key);
+
+	atomic_or(&dirty, BIT(index));
+	calib_schedule_write();
+}
+
+static bool calib_read(int index, void *out)
+{
+	const struct calib_record *rec = &records[index];
+	k_spinlock_key_t key = k_spin_lock(&calib_lock);
+	bool valid = *rec->valid;
+
+	if (valid) {
+		memcpy(out, rec->data, rec->size);
+	}
+	k_spin_unlock(&calib_lock, key);
+
+	return valid;
+}
+
+bool calib_get_zero_offsets(calib_zero_offsets_t *out)
+{
+	return calib_read(CALIB_ZERO_OFFSETS, out);
+}
+
+void calib_set_zero_offsets(const calib_zero_offsets_t *offsets)
+{
+	calib_update(CALIB_ZERO_OFFSETS, offsets);
+}
+
+bool calib_is_valid(void)
+{
+	return zero_offsets_valid;
+}
+
+bool calib_get_capgrid_baseline(uint16_t *baseline)
+{
+	return calib_read(CALIB_CAPGRID_BASELINE, baseline);
+}
+
+void calib_set_capgrid_baseline(const uint16_t *baseline)
+{
+	calib_update(CALIB_CAPGRID_BASELINE, baseline);
+}
+
+void calib_get_stats(calib_stats_t *out)
+{
+	if (!out) {
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&calib_lock);
+	*out = stats;
+	k_spin_unlock(&calib_lock, key);
+}
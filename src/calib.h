@@ -0,0 +1,98 @@
+/*
+ * Calibration Store - Phase 9
+ * Zero offsets and capacitive baseline, persistent across reboots
+ *
+ * Everything is loaded from flash into RAM once by calib_init(); the
+ * getters only read that copy. Setters update the copy and return at
+ * once: a low-priority work queue writes the changed records a short
+ * while later, so a burst of changes costs one flash write per record
+ * and no caller ever waits for an erase.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CALIB_H
+#define CALIB_H
+
+#include "trajectory.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Zero offsets (SET_ZERO_OFFSET), persisted as PERSIST_ID_ZERO_OFFSETS
+ *
+ * The control loop and the encoders work in their own positions; the
+ * master sees positions from the home position. Reported positions are
+ * internal - offset_mm, trajectory positions from the master become
+ * internal + offset_mm. With encoders, encoder_zero is the count latched
+ * at the command and reads as 0 mm (so offset_mm is -home). Counts
+ * restart at 0 on power-up, and encoder_zero is applied again at boot:
+ * it holds after a reboot as long as the axes power up where they did
+ * before, otherwise the segment has to be zeroed again.
+ */
+typedef struct {
+	float offset_mm[TRAJECTORY_NUM_MOTORS];       /* Internal position at the command - home position */
+	int32_t encoder_zero[TRAJECTORY_NUM_MOTORS];  /* Encoder counts at the command (0 without encoders) */
+} calib_zero_offsets_t;
+
+/* Statistics */
+typedef struct {
+	uint32_t updates;        /* Setter calls */
+	uint32_t writes;         /* Records written to flash */
+	uint32_t write_errors;   /* Failed writes (retried) */
+} calib_stats_t;
+
+/**
+ * Load the stored calibration and start the writer
+ * Without CONFIG_SEGMENT_PERSIST the store still works, in RAM only.
+ *
+ * @return 0 on success, -ENOTSUP without CONFIG_SEGMENT_PERSIST,
+ *         other negative errno if the storage cannot be mounted
+ */
+int calib_init(void);
+
+/**
+ * Get the zero offsets
+ *
+ * @param out Output: offsets (unchanged if none are stored)
+ * @return true if offsets are stored
+ */
+bool calib_get_zero_offsets(calib_zero_offsets_t *out);
+
+/**
+ * Set the zero offsets (written to flash in the background)
+ *
+ * @param offsets New offsets
+ */
+void calib_set_zero_offsets(const calib_zero_offsets_t *offsets);
+
+/**
+ * Check if the segment has stored zero offsets
+ *
+ * @return true after SET_ZERO_OFFSET (now or before the last reboot)
+ */
+bool calib_is_valid(void);
+
+/**
+ * Get the capacitive grid baseline
+ *
+ * @param baseline Output: CAPACITIVE_GRID_POINTS values (unchanged if none)
+ * @return true if a baseline is stored
+ */
+bool calib_get_capgrid_baseline(uint16_t *baseline);
+
+/**
+ * Set the capacitive grid baseline (written to flash in the background)
+ *
+ * @param baseline CAPACITIVE_GRID_POINTS no-touch values
+ */
+void calib_set_capgrid_baseline(const uint16_t *baseline);
+
+/**
+ * Get calibration store statistics
+ *
+ * @param stats Output: statistics snapshot
+ */
+void calib_get_stats(calib_stats_t *stats);
+
+#endif /* CALIB_H */
@@ -0,0 +1,350 @@
+/*
+ * Capacitive Sensing Grid Implementation
+ *
+ * Hardware (CONFIG_SEGMENT_CAPGRID): the grid controller is a
+ * "segment,capgrid-spi" device behind the capgrid alias. Every chip
+ * select clocks out its latest frame, 168 little-endian uint16 values;
+ * the STM32 SPI driver moves it by DMA while the grid thread sleeps in
+ * spi_read_dt(). Frames go to alternating halves of a non-cacheable
+ * buffer, so a read never lands on the frame being processed.
+ *
+ * Processing (hardware independent): UQSUB16 subtracts the baseline
+ * from two points at once, saturating at zero; USUB16 against the
+ * threshold sets the per-halfword GE flags and SEL keeps the points at
+ * or above it. 84 iterations for the whole grid, written directly into
+ * the packet that is then sent.
+ *
+ * The baseline is shared with callers of capgrid_set_baseline() and
+ * capgrid_get_baseline() under a spinlock; the pass is short enough to
+ * run under it. A captured baseline goes to the calibration store.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "capgrid.h"
+#include "calib.h"
+#include "config.h"
+#include "crc16.h"
+#include "network.h"
+#include "timesync.h"
+#include "log_ratelimit.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__ARM_FEATURE_DSP)
+#include <cmsis_core.h>
+#endif
+
+LOG_MODULE_REGISTER(capgrid, CONFIG_SEGMENT_CAPGRID_LOG_LEVEL);
+
+BUILD_ASSERT(CAPACITIVE_GRID_POINTS % 2 == 0, "SIMD pass works on pairs of points");
+BUILD_ASSERT(offsetof(capacitive_grid_packet_t, capacitive_values) % 4 == 0,
+	     "Grid values must be word aligned in the packet");
+
+/* Baseline capture state */
+#define CAPTURE_NONE      0
+#define CAPTURE_REQUESTED 1
+#define CAPTURE_RUNNING   2
+
+static uint16_t baseline[CAPACITIVE_GRID_POINTS] __aligned(4);
+static bool baseline_valid;
+static struct k_spinlock baseline_lock;
+
+static atomic_t capture = ATOMIC_INIT(CAPTURE_REQUESTED);
+static bool ready;
+
+static capgrid_stats_t stats;
+static struct k_spinlock stats_lock;
+
+void capgrid_process(const uint16_t *raw, const uint16_t *base, uint16_t threshold,
+		     uint16_t *out)
+{
+#if defined(__ARM_FEATURE_DSP)
+	const uint32_t threshold2 = threshold * 0x00010001U;
+
+	for (size_t i = 0; i < CAPACITIVE_GRID_POINTS; i += 2) {
+		uint32_t r, b, d;
+
+		memcpy(&r, &raw[i], sizeof(r));
+		memcpy(&b, &base[i], sizeof(b));
+
+		d = __UQSUB16(r, b);            /* max(raw - baseline, 0) per point */
+		(void)__USUB16(d, threshold2);  /* GE flags: point >= threshold */
+		d = __SEL(d, 0);
+
+		memcpy(&out[i], &d, sizeof(d));
+	}
+#else
+	for (size_t i = 0; i < CAPACITIVE_GRID_POINTS; i++) {
+		uint16_t d = (raw[i] > base[i]) ? raw[i] - base[i] : 0;
+
+		out[i] = (d >= threshold) ? d : 0;
+	}
+#endif
+}
+
+void capgrid_set_baseline(const uint16_t *values)
+{
+	atomic_set(&capture, CAPTURE_NONE);
+
+	k_spinlock_key_t key = k_spin_lock(&baseline_lock);
+
+	memcpy(baseline, values, sizeof(baseline));
+	baseline_valid = true;
+	k_spin_unlock(&baseline_lock, key);
+}
+
+bool capgrid_get_baseline(uint16_t *values)
+{
+	k_spinlock_key_t key = k_spin_lock(&baseline_lock);
+	bool valid = baseline_valid;
+
+	memcpy(values, baseline, sizeof(baseline));
+	k_spin_unlock(&baseline_lock, key);
+
+	return valid;
+}
+
+void capgrid_capture_baseline(void)
+{
+	atomic_set(&capture, CAPTURE_REQUESTED);
+}
+
+bool capgrid_is_ready(void)
+{
+	return ready;
+}
+
+void capgrid_get_stats(capgrid_stats_t *out)
+{
+	if (!out) {
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	*out = stats;
+	k_spin_unlock(&stats_lock, key);
+}
+
+#if defined(CONFIG_SEGMENT_CAPGRID)
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/linker/section_tags.h>
+
+/* Controller SPI: mode 0, MSB first, 8-bit words */
+#define CAPGRID_SPI_OPERATION (SPI_OP_MODE_MASTER | SPI_WORD_SET(8) | SPI_TRANSFER_MSB)
+
+#define CAPGRID_FRAME_SIZE (CAPACITIVE_GRID_POINTS * sizeof(uint16_t))
+
+K_THREAD_STACK_DEFINE(capgrid_thread_stack, CAPGRID_THREAD_STACK_SIZE);
+static struct k_thread capgrid_thread_data;
+static K_TIMER_DEFINE(capgrid_timer, NULL, NULL);
+static bool running;
+
+static const struct spi_dt_spec grid_spi =
+	SPI_DT_SPEC_GET(DT_ALIAS(capgrid), CAPGRID_SPI_OPERATION, 0);
+
+/*
+ * DMA buffers. The H7 data cache is not coherent with DMA, so these live
+ * in the non-cacheable region (CONFIG_NOCACHE_MEMORY).
+ */
+static uint16_t frames[2][CAPACITIVE_GRID_POINTS] __nocache __aligned(4);
+
+/* Built in place by the processing pass (grid thread only) */
+static capacitive_grid_packet_t grid_pkt __aligned(4);
+
+/* Capture accumulator (grid thread only) */
+static uint32_t capture_sum[CAPACITIVE_GRID_POINTS];
+static uint32_t capture_frames;
+static uint16_t captured[CAPACITIVE_GRID_POINTS];
+
+/* No controller drives MISO: the line reads as all zeros or all ones */
+static bool capgrid_floating(const uint16_t *frame)
+{
+	for (size_t i = 1; i < CAPACITIVE_GRID_POINTS; i++) {
+		if (frame[i] != frame[0]) {
+			return false;
+		}
+	}
+
+	return frame[0] == 0x0000 || frame[0] == 0xFFFF;
+}
+
+static int capgrid_scan(uint16_t *frame)
+{
+	const struct spi_buf rx_buf = { .buf = frame, .len = CAPGRID_FRAME_SIZE };
+	const struct spi_buf_set rx_set = { .buffers = &rx_buf, .count = 1 };
+	int ret = spi_read_dt(&grid_spi, &rx_set);
+
+	if (ret == 0 && capgrid_floating(frame)) {
+		ret = -EIO;
+	}
+
+	return ret;
+}
+
+/* Average frames into a new baseline; true while a capture is running */
+static bool capgrid_calibrate(const uint16_t *frame)
+{
+	atomic_val_t c = atomic_get(&capture);
+
+	if (c == CAPTURE_NONE) {
+		return false;
+	}
+
+	if (c == CAPTURE_REQUESTED) {
+		memset(capture_sum, 0, sizeof(capture_sum));
+		capture_frames = 0;
+		if (!atomic_cas(&capture, CAPTURE_REQUESTED, CAPTURE_RUNNING)) {
+			return true;
+		}
+		ready = false;
+	}
+
+	for (size_t i = 0; i < CAPACITIVE_GRID_POINTS; i++) {
+		capture_sum[i] += frame[i];
+	}
+
+	if (++capture_frames < CAPGRID_BASELINE_FRAMES) {
+		return true;
+	}
+
+	for (size_t i = 0; i < CAPACITIVE_GRID_POINTS; i++) {
+		captured[i] = (uint16_t)((capture_sum[i] + CAPGRID_BASELINE_FRAMES / 2) /
+					 CAPGRID_BASELINE_FRAMES);
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&baseline_lock);
+	bool done = atomic_cas(&capture, CAPTURE_RUNNING, CAPTURE_NONE);
+
+	/* A baseline set meanwhile wins */
+	if (done) {
+		memcpy(baseline, captured, sizeof(baseline));
+		baseline_valid = true;
+	}
+	k_spin_unlock(&baseline_lock, key);
+
+	if (done) {
+		/* Used from flash at the next start instead of a new capture */
+		calib_set_capgrid_baseline(captured);
+		LOG_INF("Baseline captured over %u frames", capture_frames);
+	}
+
+	return false;
+}
+
+static void capgrid_publish(const uint16_t *frame, uint32_t timestamp)
+{
+	/* The values field is word aligned (asserted above) */
+	uint16_t *values = (uint16_t *)((uint8_t *)&grid_pkt +
+					offsetof(capacitive_grid_packet_t, capacitive_values));
+	uint32_t start = k_cycle_get_32();
+	k_spinlock_key_t key = k_spin_lock(&baseline_lock);
+
+	capgrid_process(frame, baseline, CAPGRID_THRESHOLD, values);
+	k_spin_unlock(&baseline_lock, key);
+
+	uint32_t cycles = k_cycle_get_32() - start;
+
+	grid_pkt.timestamp = timestamp;
+	grid_pkt.crc16 = crc16_ccitt_calc((uint8_t *)&grid_pkt, sizeof(grid_pkt) - 2);
+
+	int ret = network_send_udp((const uint8_t *)&grid_pkt, sizeof(grid_pkt));
+
+	key = k_spin_lock(&stats_lock);
+	stats.process_cycles = cycles;
+	if (ret < 0) {
+		stats.send_errors++;
+	} else {
+		stats.sent++;
+	}
+	k_spin_unlock(&stats_lock, key);
+}
+
+static void capgrid_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	int fill = 0;
+
+	k_timer_start(&capgrid_timer, K_NO_WAIT, K_USEC(USEC_PER_SEC / CAPGRID_RATE_HZ));
+
+	while (1) {
+		k_timer_status_sync(&capgrid_timer);
+
+		uint16_t *frame = frames[fill];
+		int ret = capgrid_scan(frame);
+
+		if (ret < 0) {
+			k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+			stats.scan_errors++;
+			k_spin_unlock(&stats_lock, key);
+
+			LOG_WRN_RL("Grid controller read failed: %d", ret);
+			packet_report_error(ERROR_CAPACITIVE_FAULT);
+			continue;
+		}
+
+		uint32_t timestamp = timesync_now_ms();
+
+		fill ^= 1;
+
+		k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+		stats.frames++;
+		k_spin_unlock(&stats_lock, key);
+
+		if (capgrid_calibrate(frame)) {
+			continue;
+		}
+
+		ready = true;
+		capgrid_publish(frame, timestamp);
+	}
+}
+
+int capgrid_start(uint8_t segment_id)
+{
+	if (running) {
+		return -EALREADY;
+	}
+
+	if (!spi_is_ready_dt(&grid_spi)) {
+		LOG_ERR("Grid controller bus not ready");
+		return -ENODEV;
+	}
+
+	grid_pkt.magic_header = PACKET_MAGIC_STM32_TO_MASTER;
+	grid_pkt.packet_type = FEEDBACK_CAPACITIVE_GRID;
+	grid_pkt.segment_id = segment_id;
+
+	k_thread_create(&capgrid_thread_data, capgrid_thread_stack,
+			K_THREAD_STACK_SIZEOF(capgrid_thread_stack),
+			capgrid_thread, NULL, NULL, NULL,
+			K_PRIO_PREEMPT(CAPGRID_THREAD_PRIORITY), 0, K_NO_WAIT);
+	k_thread_name_set(&capgrid_thread_data, "capgrid");
+
+	running = true;
+
+	return 0;
+}
+
+#else /* !CONFIG_SEGMENT_CAPGRID */
+
+int capgrid_start(uint8_t segment_id)
+{
+	ARG_UNUSED(segment_id);
+
+	return -ENOTSUP;
+}
+
+#endif /* CONFIG_SEGMENT_CAPGRID */
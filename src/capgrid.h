@@ -0,0 +1,95 @@
+/*
+ * Capacitive Sensing Grid - Phase 8
+ * 168-point touch grid, streamed to the master at 30 Hz
+ *
+ * A low-priority thread reads one frame of raw values from the grid
+ * controller per period, by DMA while the thread sleeps, into the free
+ * half of a ping-pong buffer. The frame is then baseline-subtracted and
+ * thresholded two points at a time with the Cortex-M7 SIMD instructions,
+ * writing straight into the CAPACITIVE_GRID datagram, which goes out
+ * over UDP from that buffer. The control loop never waits for the grid.
+ *
+ * The baseline (no-touch values) is loaded with capgrid_set_baseline()
+ * from the calibration store, or else averaged over the first frames
+ * after start and then stored.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CAPGRID_H
+#define CAPGRID_H
+
+#include "packet.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Statistics */
+typedef struct {
+	uint32_t frames;         /* Frames read from the controller */
+	uint32_t sent;           /* CAPACITIVE_GRID packets handed to the network stack */
+	uint32_t scan_errors;    /* Failed reads, or no controller answering */
+	uint32_t send_errors;    /* Sends rejected (no master, socket error) */
+	uint32_t process_cycles; /* Last baseline/threshold pass, CPU cycles */
+} capgrid_stats_t;
+
+/**
+ * Start the grid thread
+ * Streaming begins at once with a baseline set before, otherwise once
+ * the startup baseline has been captured.
+ *
+ * @param segment_id This segment's ID (for packet headers)
+ * @return 0 on success, -ENOTSUP without CONFIG_SEGMENT_CAPGRID,
+ *         -ENODEV if the controller bus is not ready, -EALREADY if running
+ */
+int capgrid_start(uint8_t segment_id);
+
+/**
+ * Check if the grid is streaming
+ *
+ * @return true once the baseline is valid and frames are being read
+ */
+bool capgrid_is_ready(void);
+
+/**
+ * Baseline subtraction and thresholding of one frame
+ * out = raw - baseline, clamped at 0; points below the threshold read 0.
+ * All three arrays must be 4-byte aligned.
+ *
+ * @param raw Raw frame, CAPACITIVE_GRID_POINTS values
+ * @param baseline No-touch values
+ * @param threshold Smallest reported rise above the baseline (counts)
+ * @param out Output values (may be raw itself)
+ */
+void capgrid_process(const uint16_t *raw, const uint16_t *baseline, uint16_t threshold,
+		     uint16_t *out);
+
+/**
+ * Replace the baseline (e.g. with a stored calibration)
+ * Ends a startup capture that is still running.
+ *
+ * @param baseline CAPACITIVE_GRID_POINTS no-touch values
+ */
+void capgrid_set_baseline(const uint16_t *baseline);
+
+/**
+ * Get the baseline in use
+ *
+ * @param baseline Output: CAPACITIVE_GRID_POINTS values
+ * @return true if the baseline is valid (captured or set)
+ */
+bool capgrid_get_baseline(uint16_t *baseline);
+
+/**
+ * Capture a new baseline from the next frames (no touch while it runs)
+ * Streaming pauses for the capture; the result replaces the stored one.
+ */
+void capgrid_capture_baseline(void);
+
+/**
+ * Get grid statistics
+ *
+ * @param stats Output: statistics snapshot
+ */
+void capgrid_get_stats(capgrid_stats_t *stats);
+
+#endif /* CAPGRID_H */
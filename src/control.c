@@ -0,0 +1,312 @@
+/*
+ * Real-Time Control Loop - Phase 7
+ *
+ * A periodic k_timer paces a cooperative high-priority thread. Each tick
+ * measures its own start jitter and execution time; periods that were
+ * skipped (timer expired more than once) or ticks that ran longer than
+ * the period are counted as missed deadlines.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "control.h"
+#include "config.h"
+#include "imu.h"
+#include "encoder.h"
+#include "feedback.h"
+#include "trajectory_buffer.h"
+#include "trajectory.h"
+#include "seqlock.h"
+#include "timesync.h"
+#include "trace.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/printk.h>
+#include <string.h>
+
+#define CONTROL_PERIOD_US (1000000U / CONTROL_LOOP_FREQUENCY_HZ)
+
+/* Sub-rate dividers (tasks that run every N control ticks) */
+#define IMU_TICK_DIVIDER (CONTROL_LOOP_FREQUENCY_HZ / IMU_SAMPLE_RATE_HZ)
+#define FEEDBACK_TICK_DIVIDER (CONTROL_LOOP_FREQUENCY_HZ / FEEDBACK_RATE_HZ)
+
+BUILD_ASSERT(CONTROL_LOOP_FREQUENCY_HZ >= 100 && CONTROL_LOOP_FREQUENCY_HZ <= 1000,
+	     "Control loop must run between 100 Hz and 1 kHz");
+BUILD_ASSERT(CONTROL_LOOP_FREQUENCY_HZ % IMU_SAMPLE_RATE_HZ == 0,
+	     "IMU rate must divide the control loop rate");
+
+/* Exponential moving average weight (1/2^N) for execution time */
+#define EXEC_AVG_SHIFT 4
+
+K_THREAD_STACK_DEFINE(control_thread_stack, CONTROL_THREAD_STACK_SIZE);
+static struct k_thread control_thread_data;
+
+static struct k_timer control_timer;
+static bool running = false;
+
+/* Set by the E-stop path: stop consuming segments, hold position */
+static atomic_t estop_latched = ATOMIC_INIT(0);
+
+/* Segment being executed; its ring slot stays ours until popped */
+static const trajectory_packet_t *active_segment = NULL;
+
+/* Active segment converted for evaluation, and the resulting set point */
+static trajectory_segment_t active_traj;
+static bool active_traj_valid = false;
+static trajectory_point_t setpoint;  /* Written only by the control thread */
+static seqlock_t setpoint_lock = SEQLOCK_INIT;
+
+/* Statistics (written by control thread, read by others) */
+static control_stats_t stats;
+static uint32_t exec_avg_acc;  /* Average scaled by 2^EXEC_AVG_SHIFT */
+static struct k_spinlock stats_lock;
+
+/**
+ * Pick the segment that covers the current time from the rolling buffer
+ * Segments whose window has already passed are retired in O(1) each.
+ */
+static void control_update_segment(uint32_t now_ms)
+{
+	const trajectory_packet_t *seg = trajectory_buffer_peek();
+
+	if (atomic_get(&estop_latched)) {
+		/* Discard everything queued; the set point holds position */
+		while (seg) {
+			trajectory_buffer_pop();
+			seg = trajectory_buffer_peek();
+		}
+		active_segment = NULL;
+		return;
+	}
+
+	while (seg && (int32_t)(now_ms - (seg->start_timestamp + seg->duration_ms)) >= 0) {
+		trajectory_buffer_pop();
+		seg = trajectory_buffer_peek();
+	}
+
+	/* Next segment may be queued ahead of its start time */
+	if (seg && (int32_t)(now_ms - seg->start_timestamp) >= 0) {
+		if (seg != active_segment || !active_traj_valid ||
+		    seg->trajectory_id != active_traj.trajectory_id) {
+			/* Newly accepted segment: convert coefficients once */
+			active_traj_valid = (trajectory_prepare(&active_traj, seg) == 0);
+		}
+		active_segment = seg;
+	} else {
+		active_segment = NULL;
+	}
+}
+
+/**
+ * Evaluate the active segment into the set point
+ * Without a segment the last position is held with zero derivatives.
+ */
+static void control_update_setpoint(uint32_t now_ms)
+{
+	trajectory_point_t next;
+
+	if (active_segment && active_traj_valid) {
+		trajectory_evaluate_at(&active_traj, now_ms, &next);
+	} else {
+		next = setpoint;
+		for (int m = 0; m < TRAJECTORY_NUM_MOTORS; m++) {
+			next.velocity[m] = 0.0f;
+			next.acceleration[m] = 0.0f;
+			next.jerk[m] = 0.0f;
+		}
+	}
+
+	k_spinlock_key_t key = seqlock_write_begin(&setpoint_lock);
+	setpoint = next;
+	seqlock_write_end(&setpoint_lock, key);
+}
+
+/**
+ * Work done once per tick
+ */
+static void control_tick(uint32_t cycle)
+{
+	/* Shared clock: trajectory start times are on the master's clock */
+	uint32_t now_ms = timesync_now_ms();
+
+	/* Encoders first, so the feedback below sees this tick's sample */
+	encoder_sample();
+
+	/*
+	 * IMU fusion at IMU_SAMPLE_RATE_HZ: the bus read is done by the IMU
+	 * work queue, never here (FIFO mode fuses in its own thread)
+	 */
+	if (!IS_ENABLED(CONFIG_SEGMENT_IMU_FIFO) && (cycle % IMU_TICK_DIVIDER) == 0) {
+		imu_request_update();
+	}
+
+	/* Phase 6: Trajectory segment selection and evaluation */
+	control_update_segment(now_ms);
+	control_update_setpoint(now_ms);
+
+	/* Phase 7: Motor state feedback at FEEDBACK_RATE_HZ (never blocks) */
+	if ((cycle % FEEDBACK_TICK_DIVIDER) == 0) {
+		feedback_publish();
+	}
+}
+
+static void control_record(uint32_t expiries, uint32_t start, uint32_t last_start,
+			   uint32_t end)
+{
+	uint32_t exec_us = k_cyc_to_us_floor32(end - start);
+	uint32_t jitter_us = 0;
+
+	if (stats.cycle_count > 0) {
+		/* Deviation of the actual interval from the expected one */
+		uint32_t interval_us = k_cyc_to_us_floor32(start - last_start);
+		uint32_t expected_us = CONTROL_PERIOD_US * expiries;
+
+		jitter_us = (interval_us > expected_us) ? (interval_us - expected_us)
+							: (expected_us - interval_us);
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	stats.cycle_count++;
+
+	/* Timer fired more than once while we were busy: periods were lost */
+	if (expiries > 1) {
+		stats.missed_deadlines += expiries - 1;
+	}
+
+	/* Tick itself overran its period */
+	if (exec_us > CONTROL_PERIOD_US) {
+		stats.missed_deadlines++;
+	}
+
+	stats.exec_time_us = exec_us;
+	if (exec_us > stats.exec_time_max_us) {
+		stats.exec_time_max_us = exec_us;
+	}
+
+	exec_avg_acc += exec_us - (exec_avg_acc >> EXEC_AVG_SHIFT);
+	stats.exec_time_avg_us = exec_avg_acc >> EXEC_AVG_SHIFT;
+
+	stats.jitter_us = jitter_us;
+	if (jitter_us > stats.jitter_max_us) {
+		stats.jitter_max_us = jitter_us;
+	}
+
+	uint32_t bin = (exec_us * CONTROL_HIST_BINS) / CONTROL_PERIOD_US;
+
+	stats.exec_hist[MIN(bin, CONTROL_HIST_BINS - 1)]++;
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+static void control_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	uint32_t cycle = 0;
+	uint32_t last_start = 0;
+
+	printk("[Control] Loop running at %d Hz (period %u us)\n",
+	       CONTROL_LOOP_FREQUENCY_HZ, CONTROL_PERIOD_US);
+
+	k_timer_start(&control_timer, K_USEC(CONTROL_PERIOD_US), K_USEC(CONTROL_PERIOD_US));
+
+	while (1) {
+		/* Block until the next period; returns number of expiries */
+		uint32_t expiries = k_timer_status_sync(&control_timer);
+		uint32_t start = k_cycle_get_32();
+
+		trace_record(TRACE_EVT_CTRL_START, (uint8_t)MIN(expiries, UINT8_MAX), (uint16_t)cycle);
+		control_tick(cycle);
+		trace_record(TRACE_EVT_CTRL_END, 0, (uint16_t)cycle);
+
+		uint32_t end = k_cycle_get_32();
+
+		control_record(expiries, start, last_start, end);
+
+		last_start = start;
+		cycle += expiries;
+	}
+}
+
+int control_start(void)
+{
+	if (running) {
+		return -EALREADY;
+	}
+
+	k_timer_init(&control_timer, NULL, NULL);
+
+	memset(&stats, 0, sizeof(stats));
+	stats.period_us = CONTROL_PERIOD_US;
+	exec_avg_acc = 0;
+
+	k_thread_create(&control_thread_data, control_thread_stack,
+			K_THREAD_STACK_SIZEOF(control_thread_stack),
+			control_thread, NULL, NULL, NULL,
+			K_PRIO_COOP(CONTROL_THREAD_PRIORITY), 0, K_NO_WAIT);
+	k_thread_name_set(&control_thread_data, "control");
+
+	running = true;
+
+	return 0;
+}
+
+void control_get_setpoint(trajectory_point_t *out)
+{
+	if (!out) {
+		return;
+	}
+
+	uint32_t seq;
+
+	do {
+		seq = seqlock_read_begin(&setpoint_lock);
+		*out = setpoint;
+	} while (seqlock_read_retry(&setpoint_lock, seq));
+}
+
+void control_emergency_stop(void)
+{
+	atomic_set(&estop_latched, 1);
+}
+
+void control_clear_emergency_stop(void)
+{
+	atomic_set(&estop_latched, 0);
+}
+
+bool control_trajectory_active(void)
+{
+	return active_segment != NULL;
+}
+
+bool control_is_running(void)
+{
+	return running;
+}
+
+void control_get_stats(control_stats_t *out)
+{
+	if (!out) {
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	memcpy(out, &stats, sizeof(*out));
+	k_spin_unlock(&stats_lock, key);
+}
+
+void control_reset_stats(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	stats.missed_deadlines = 0;
+	stats.exec_time_max_us = 0;
+	stats.jitter_max_us = 0;
+	memset(stats.exec_hist, 0, sizeof(stats.exec_hist));
+
+	k_spin_unlock(&stats_lock, key);
+}
@@ -0,0 +1,85 @@
+/*
+ * Real-Time Control Loop - Phase 7
+ * Fixed-rate control thread driven by a k_timer
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "trajectory.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Execution time histogram: bin i counts ticks that used i/8 - (i+1)/8
+ * of the period; the last bin also holds overruns */
+#define CONTROL_HIST_BINS 8
+
+/* Control loop timing statistics */
+typedef struct {
+	uint32_t cycle_count;        /* Ticks executed since start */
+	uint32_t missed_deadlines;   /* Timer periods skipped + ticks that overran */
+	uint32_t exec_time_us;       /* Execution time of last tick */
+	uint32_t exec_time_max_us;   /* Worst-case execution time */
+	uint32_t exec_time_avg_us;   /* Running average execution time */
+	uint32_t jitter_us;          /* Start-time deviation of last tick */
+	uint32_t jitter_max_us;      /* Worst-case start-time deviation */
+	uint32_t period_us;          /* Nominal tick period */
+	uint32_t exec_hist[CONTROL_HIST_BINS];  /* Execution time distribution */
+} control_stats_t;
+
+/**
+ * Start the control loop thread
+ * Runs at CONTROL_LOOP_FREQUENCY_HZ (see config.h)
+ *
+ * @return 0 on success, negative errno on error
+ */
+int control_start(void);
+
+/**
+ * Get the current trajectory set point of all motors
+ *
+ * @param point Output: position/velocity/acceleration/jerk set point
+ */
+void control_get_setpoint(trajectory_point_t *point);
+
+/**
+ * Stop trajectory execution (emergency stop)
+ * Queued segments are discarded and the set point holds position until
+ * control_clear_emergency_stop(). Safe to call from any thread.
+ */
+void control_emergency_stop(void);
+
+/**
+ * Resume accepting trajectory segments after an emergency stop
+ */
+void control_clear_emergency_stop(void);
+
+/**
+ * Check if a trajectory segment is being executed
+ *
+ * @return true if the current time falls inside a buffered segment
+ */
+bool control_trajectory_active(void);
+
+/**
+ * Check if the control loop is running
+ *
+ * @return true if the control thread has been started
+ */
+bool control_is_running(void);
+
+/**
+ * Get control loop timing statistics
+ *
+ * @param stats Output: current statistics
+ */
+void control_get_stats(control_stats_t *stats);
+
+/**
+ * Reset worst-case, deadline and histogram statistics
+ */
+void control_reset_stats(void);
+
+#endif /* CONTROL_H */
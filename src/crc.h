@@ -0,0 +1,41 @@
+/*
+ * CRC Engine - Packet CRC16 and TMC9660 CRC8
+ *
+ * Backend is selected with Kconfig:
+ *   CONFIG_SEGMENT_CRC_HW    - STM32 hardware CRC unit
+ *   CONFIG_SEGMENT_CRC_TABLE - 256-entry lookup tables
+ *
+ * Both backends are bit-exact with the algorithms used on the wire:
+ *   CRC16: Zephyr crc16_ccitt(0xFFFF, ...) - poly 0x1021, reflected, no xorout
+ *   CRC8:  TMC9660 UART - poly 0x07, init 0x00, not reflected
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CRC_H
+#define CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Calculate packet CRC16 (initial value 0xFFFF)
+ * Safe to call from any thread or ISR.
+ *
+ * @param data Pointer to data buffer (may be unaligned)
+ * @param length Length of data in bytes
+ * @return CRC16 value
+ */
+uint16_t crc_packet16(const uint8_t *data, size_t length);
+
+/**
+ * Calculate TMC9660 CRC8 (initial value 0x00)
+ * Safe to call from any thread or ISR.
+ *
+ * @param data Pointer to data buffer
+ * @param length Length of data in bytes
+ * @return CRC8 value
+ */
+uint8_t crc_tmc8(const uint8_t *data, size_t length);
+
+#endif /* CRC_H */
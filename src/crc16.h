@@ -1,5 +1,8 @@
 /*
- * CRC16-CCITT Header - Wrapper for Zephyr's Built-in CRC16
+ * CRC16-CCITT Header - Packet CRC helpers
+ *
+ * Uses the CRC engine selected by CONFIG_SEGMENT_CRC_* (see crc.h); the
+ * result is identical to Zephyr's crc16_ccitt(0xFFFF, ...).
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -10,11 +13,11 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
-#include <zephyr/sys/crc.h>  /* Zephyr's built-in CRC functions */
+#include "crc.h"
 
 /**
  * Calculate CRC16-CCITT checksum
- * Wrapper for Zephyr's crc16_ccitt with standard initial value
+ * Standard initial value 0xFFFF
  *
  * @param data Pointer to data buffer
  * @param length Length of data in bytes
@@ -22,7 +25,7 @@
  */
 static inline uint16_t crc16_ccitt_calc(const uint8_t *data, size_t length)
 {
-	return crc16_ccitt(0xFFFF, data, length);
+	return crc_packet16(data, length);
 }
 
 /**
@@ -39,7 +42,7 @@ static inline bool crc16_verify(const uint8_t *data, size_t length)
 	}
 
 	/* Calculate CRC of data (excluding last 2 bytes which are the CRC) */
-	uint16_t calculated_crc = crc16_ccitt(0xFFFF, data, length - 2);
+	uint16_t calculated_crc = crc_packet16(data, length - 2);
 
 	/* Extract CRC from packet (little-endian) */
 	uint16_t packet_crc = data[length - 2] | (data[length - 1] << 8);
@@ -0,0 +1,469 @@
+/*
+ * Quadrature Encoder Implementation
+ *
+ * Hardware (CONFIG_SEGMENT_ENCODER): per motor, a "segment,stm32-encoder"
+ * device tree node names the timer, its pins and the DMAMUX channel and
+ * request line of the timer's CC1 event. The timers count in encoder
+ * mode 3 with a 16-bit range (extended in software; at most ~82 counts
+ * per tick). The shared timebase is a 32-bit timer at
+ * ENCODER_TIMEBASE_HZ. The DMA streams are programmed directly, in
+ * circular mode with interrupts off - the Zephyr DMA driver would take
+ * an interrupt per edge.
+ *
+ * Estimation (hardware independent): fading-memory alpha-beta-gamma filter with a
+ * single parameter theta; with theta = 0.9 at 1 kHz the estimates
+ * settle in about 10 ms.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "encoder.h"
+#include "config.h"
+#include "seqlock.h"
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include <errno.h>
+
+LOG_MODULE_REGISTER(encoder, CONFIG_SEGMENT_ENCODER_LOG_LEVEL);
+
+#define ENCODER_TIMEBASE_HZ      10000000U  /* Edge timestamps: 0.1 µs, wraps after 429 s */
+#define ENCODER_COUNTS_PER_EDGE  4.0f       /* Counts per A period (x4 decoding) */
+#define ENCODER_STALL_S          0.1f       /* No edge for this long: standing still */
+
+#define ENCODER_DT (1.0f / (float)CONTROL_LOOP_FREQUENCY_HZ)
+
+/* Fading-memory alpha-beta-gamma gains */
+#define ENCODER_ALPHA (1.0f - ENCODER_FILTER_THETA * ENCODER_FILTER_THETA * ENCODER_FILTER_THETA)
+#define ENCODER_BETA  (1.5f * (1.0f - ENCODER_FILTER_THETA) * (1.0f - ENCODER_FILTER_THETA) * \
+		       (1.0f + ENCODER_FILTER_THETA))
+#define ENCODER_GAMMA (0.5f * (1.0f - ENCODER_FILTER_THETA) * (1.0f - ENCODER_FILTER_THETA) * \
+		       (1.0f - ENCODER_FILTER_THETA))
+
+/* One hardware sample */
+typedef struct {
+	uint16_t count;          /* Counter now */
+	uint16_t edge_count;     /* Counter at the last A edge (CCR1) */
+	uint32_t edge_time;      /* Timebase at the last A edge (DMA) */
+	uint32_t now;            /* Timebase now */
+} encoder_raw_t;
+
+/* Per-motor tracking state (control thread only), counts and seconds */
+typedef struct {
+	int32_t position;        /* Extended count */
+	uint16_t count;          /* Last hardware count */
+	int32_t edge_position;   /* Extended count at the last A edge */
+	uint32_t edge_time;
+	float v_meas;            /* Last M/T velocity */
+	float v;                 /* Filtered velocity */
+	float a;
+	float j;
+} encoder_track_t;
+
+static encoder_track_t track[TRAJECTORY_NUM_MOTORS];
+static bool ready;
+
+static trajectory_point_t state;
+static int32_t state_counts[TRAJECTORY_NUM_MOTORS];
+static seqlock_t state_lock = SEQLOCK_INIT;
+
+/* Counts reported as position 0 (encoder_set_zero) */
+static int32_t zero[TRAJECTORY_NUM_MOTORS];
+static struct k_spinlock zero_lock;
+
+#if defined(CONFIG_SEGMENT_ENCODER)
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/clock_control.h>
+#include <zephyr/drivers/clock_control/stm32_clock_control.h>
+#include <zephyr/drivers/pinctrl.h>
+#include <zephyr/linker/section_tags.h>
+#include <soc.h>
+#include <stm32_ll_bus.h>
+
+#define ENCODER_INPUT_FILTER 3U  /* IC1F/IC2F: f_CK_INT, N = 8 */
+
+#define ENCODER_TIMEBASE_NODE DT_NODELABEL(timers5)
+
+#define ENCODER_TIMER(node) DT_PHANDLE(node, timer)
+
+#define ENCODER_HW(node)                                                              \
+	{                                                                             \
+		.tim = (TIM_TypeDef *)DT_REG_ADDR(ENCODER_TIMER(node)),               \
+		.pclken = { .bus = DT_CLOCKS_CELL(ENCODER_TIMER(node), bus),          \
+			    .enr = DT_CLOCKS_CELL(ENCODER_TIMER(node), bits) },       \
+		.pcfg = PINCTRL_DT_DEV_CONFIG_GET(node),                              \
+		.dma_channel = DT_DMAS_CELL_BY_NAME(node, capture, channel),          \
+		.dma_request = DT_DMAS_CELL_BY_NAME(node, capture, slot),             \
+	}
+
+struct encoder_hw {
+	TIM_TypeDef *tim;
+	struct stm32_pclken pclken;
+	const struct pinctrl_dev_config *pcfg;
+	uint8_t dma_channel;     /* DMAMUX1 channel: 0-7 DMA1, 8-15 DMA2 streams */
+	uint8_t dma_request;     /* DMAMUX1 request line of TIMx_CH1 */
+};
+
+PINCTRL_DT_DEFINE(DT_ALIAS(encoder1));
+PINCTRL_DT_DEFINE(DT_ALIAS(encoder2));
+PINCTRL_DT_DEFINE(DT_ALIAS(encoder3));
+
+static const struct encoder_hw hw[TRAJECTORY_NUM_MOTORS] = {
+	ENCODER_HW(DT_ALIAS(encoder1)),
+	ENCODER_HW(DT_ALIAS(encoder2)),
+	ENCODER_HW(DT_ALIAS(encoder3)),
+};
+
+static const struct stm32_pclken timebase_pclken = {
+	.bus = DT_CLOCKS_CELL(ENCODER_TIMEBASE_NODE, bus),
+	.enr = DT_CLOCKS_CELL(ENCODER_TIMEBASE_NODE, bits),
+};
+
+#define ENCODER_TIMEBASE ((TIM_TypeDef *)DT_REG_ADDR(ENCODER_TIMEBASE_NODE))
+
+/* DMA target: the timebase at each A edge (non-cacheable, see tmc9660_uart.c) */
+static volatile uint32_t edge_times[TRAJECTORY_NUM_MOTORS] __nocache;
+
+static DMA_Stream_TypeDef *const dma_streams[16] = {
+	DMA1_Stream0, DMA1_Stream1, DMA1_Stream2, DMA1_Stream3,
+	DMA1_Stream4, DMA1_Stream5, DMA1_Stream6, DMA1_Stream7,
+	DMA2_Stream0, DMA2_Stream1, DMA2_Stream2, DMA2_Stream3,
+	DMA2_Stream4, DMA2_Stream5, DMA2_Stream6, DMA2_Stream7,
+};
+
+/* Timer kernel clock: twice a divided APB clock (RCC_CFGR.TIMPRE = 0) */
+static int encoder_timer_rate(const struct device *clk, const struct stm32_pclken *pclken,
+			      uint32_t *rate)
+{
+	uint32_t bus_rate;
+	int ret = clock_control_get_rate(clk, (clock_control_subsys_t)pclken, &bus_rate);
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	uint32_t apb_psc = (pclken->bus == STM32_CLOCK_BUS_APB1) ? STM32_D2PPRE1 : STM32_D2PPRE2;
+
+	*rate = (apb_psc == 1U) ? bus_rate : bus_rate * 2U;
+
+	return 0;
+}
+
+static int encoder_start_timebase(const struct device *clk)
+{
+	TIM_TypeDef *tb = ENCODER_TIMEBASE;
+	uint32_t rate;
+	int ret;
+
+	ret = clock_control_on(clk, (clock_control_subsys_t)&timebase_pclken);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = encoder_timer_rate(clk, &timebase_pclken, &rate);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (rate % ENCODER_TIMEBASE_HZ != 0) {
+		LOG_ERR("Timebase clock %u Hz is not a multiple of %u Hz", rate,
+			ENCODER_TIMEBASE_HZ);
+		return -EINVAL;
+	}
+
+	tb->CR1 = 0;
+	tb->PSC = rate / ENCODER_TIMEBASE_HZ - 1U;
+	tb->ARR = UINT32_MAX;
+	tb->EGR = TIM_EGR_UG;    /* Load the prescaler */
+	tb->CR1 = TIM_CR1_CEN;
+
+	return 0;
+}
+
+/* Copy the timebase into edge_times[motor] on every CC1 event */
+static int encoder_start_dma(int motor)
+{
+	const struct encoder_hw *e = &hw[motor];
+
+	if (e->dma_channel >= ARRAY_SIZE(dma_streams)) {
+		return -EINVAL;
+	}
+
+	DMA_Stream_TypeDef *stream = dma_streams[e->dma_channel];
+
+	stream->CR = 0;
+	while (stream->CR & DMA_SxCR_EN) {
+	}
+
+	stream->PAR = (uint32_t)(uintptr_t)&ENCODER_TIMEBASE->CNT;
+	stream->M0AR = (uint32_t)(uintptr_t)&edge_times[motor];
+	stream->NDTR = 1;
+	stream->FCR = 0;         /* Direct mode */
+	(DMAMUX1_Channel0 + e->dma_channel)->CCR = e->dma_request;
+
+	/* Peripheral to memory, 32-bit, no increment, circular, no interrupts */
+	stream->CR = DMA_SxCR_CIRC | DMA_SxCR_PSIZE_1 | DMA_SxCR_MSIZE_1 | DMA_SxCR_PL_1 |
+		     DMA_SxCR_EN;
+
+	return 0;
+}
+
+static int encoder_start_timer(const struct device *clk, int motor)
+{
+	const struct encoder_hw *e = &hw[motor];
+	TIM_TypeDef *tim = e->tim;
+	int ret;
+
+	ret = pinctrl_apply_state(e->pcfg, PINCTRL_STATE_DEFAULT);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = clock_control_on(clk, (clock_control_subsys_t)&e->pclken);
+	if (ret < 0) {
+		return ret;
+	}
+
+	tim->CR1 = 0;
+	tim->SMCR = 0;
+	tim->PSC = 0;
+	tim->ARR = UINT16_MAX;   /* 16 bits on every timer, so one extension fits all */
+
+	/* IC1 = TI1 (A), IC2 = TI2 (B), both filtered, not inverted */
+	tim->CCMR1 = TIM_CCMR1_CC1S_0 | TIM_CCMR1_CC2S_0 |
+		     (ENCODER_INPUT_FILTER << TIM_CCMR1_IC1F_Pos) |
+		     (ENCODER_INPUT_FILTER << TIM_CCMR1_IC2F_Pos);
+
+	/* Capture the count on rising A; DMA request with each capture */
+	tim->CCER = TIM_CCER_CC1E;
+	tim->DIER = TIM_DIER_CC1DE;
+
+	/* Encoder mode 3: count on both edges of both inputs */
+	tim->SMCR = TIM_SMCR_SMS_0 | TIM_SMCR_SMS_1;
+	tim->EGR = TIM_EGR_UG;   /* Count starts at 0 */
+	tim->CR1 = TIM_CR1_CEN;
+
+	return 0;
+}
+
+static int encoder_hw_init(void)
+{
+	const struct device *clk = DEVICE_DT_GET(STM32_CLOCK_CONTROL_NODE);
+	int ret;
+
+	if (!device_is_ready(clk)) {
+		return -ENODEV;
+	}
+
+	/* DMAMUX1 is clocked with DMA1/DMA2 */
+	LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_DMA1 | LL_AHB1_GRP1_PERIPH_DMA2);
+
+	ret = encoder_start_timebase(clk);
+	if (ret < 0) {
+		return ret;
+	}
+
+	for (int i = 0; i < TRAJECTORY_NUM_MOTORS; i++) {
+		ret = encoder_start_dma(i);
+		if (ret == 0) {
+			ret = encoder_start_timer(clk, i);
+		}
+		if (ret < 0) {
+			LOG_ERR("Encoder %d: setup failed: %d", i + 1, ret);
+			return ret;
+		}
+
+		/* Software capture: the first edge reference is "here, now" */
+		hw[i].tim->EGR = TIM_EGR_CC1G;
+	}
+
+	return 0;
+}
+
+static void encoder_hw_read(int motor, encoder_raw_t *raw)
+{
+	TIM_TypeDef *tim = hw[motor].tim;
+	uint16_t edge_count;
+
+	/* An edge between the two CCR1 reads may have left a stale time */
+	do {
+		edge_count = (uint16_t)tim->CCR1;
+		raw->edge_time = edge_times[motor];
+		raw->edge_count = (uint16_t)tim->CCR1;
+	} while (raw->edge_count != edge_count);
+
+	raw->count = (uint16_t)tim->CNT;
+	raw->now = ENCODER_TIMEBASE->CNT;
+}
+
+#else /* !CONFIG_SEGMENT_ENCODER */
+
+static int encoder_hw_init(void)
+{
+	return -ENOTSUP;
+}
+
+static void encoder_hw_read(int motor, encoder_raw_t *raw)
+{
+	ARG_UNUSED(motor);
+	ARG_UNUSED(raw);
+}
+
+#endif /* CONFIG_SEGMENT_ENCODER */
+
+/**
+ * Measured velocity from the last A edges (counts/s)
+ */
+static float encoder_measure(encoder_track_t *t, const encoder_raw_t *raw)
+{
+	int32_t edge_position = t->position + (int16_t)(raw->edge_count - raw->count);
+
+	if (raw->edge_time != t->edge_time) {
+		/* M/T: counts between the edges over the time between them */
+		float dt = (float)(raw->edge_time - t->edge_time) / (float)ENCODER_TIMEBASE_HZ;
+		float v = (float)(edge_position - t->edge_position) / dt;
+
+		t->edge_position = edge_position;
+		t->edge_time = raw->edge_time;
+
+		return v;
+	}
+
+	float idle = (float)(raw->now - raw->edge_time) / (float)ENCODER_TIMEBASE_HZ;
+
+	if (idle >= ENCODER_STALL_S) {
+		return 0.0f;
+	}
+
+	/* No edge yet: at most one A period in the time since the last one */
+	float bound = ENCODER_COUNTS_PER_EDGE / idle;
+
+	return CLAMP(t->v_meas, -bound, bound);
+}
+
+/**
+ * Alpha-beta-gamma update of velocity, acceleration and jerk
+ */
+static void encoder_filter(encoder_track_t *t, float v_meas)
+{
+	const float dt = ENCODER_DT;
+
+	float v_pred = t->v + t->a * dt + 0.5f * t->j * dt * dt;
+	float a_pred = t->a + t->j * dt;
+	float r = v_meas - v_pred;
+
+	t->v = v_pred + ENCODER_ALPHA * r;
+	t->a = a_pred + ENCODER_BETA * r / dt;
+	t->j += 2.0f * ENCODER_GAMMA * r / (dt * dt);
+}
+
+void encoder_sample(void)
+{
+	trajectory_point_t next;
+	int32_t next_counts[TRAJECTORY_NUM_MOTORS];
+	int32_t z[TRAJECTORY_NUM_MOTORS];
+	encoder_raw_t raw;
+
+	if (!ready) {
+		return;
+	}
+
+	k_spinlock_key_t zkey = k_spin_lock(&zero_lock);
+	memcpy(z, zero, sizeof(z));
+	k_spin_unlock(&zero_lock, zkey);
+
+	for (int i = 0; i < TRAJECTORY_NUM_MOTORS; i++) {
+		encoder_track_t *t = &track[i];
+
+		encoder_hw_read(i, &raw);
+
+		/* Extend the 16-bit count */
+		t->position += (int16_t)(raw.count - t->count);
+		t->count = raw.count;
+
+		t->v_meas = encoder_measure(t, &raw);
+		encoder_filter(t, t->v_meas);
+
+		next_counts[i] = t->position;
+		next.position[i] = (float)(t->position - z[i]) / ENCODER_COUNTS_PER_MM;
+		next.velocity[i] = t->v / ENCODER_COUNTS_PER_MM;
+		next.acceleration[i] = t->a / ENCODER_COUNTS_PER_MM;
+		next.jerk[i] = t->j / ENCODER_COUNTS_PER_MM;
+	}
+
+	k_spinlock_key_t key = seqlock_write_begin(&state_lock);
+	state = next;
+	memcpy(state_counts, next_counts, sizeof(state_counts));
+	seqlock_write_end(&state_lock, key);
+}
+
+int encoder_init(void)
+{
+	encoder_raw_t raw;
+	int ret;
+
+	ret = encoder_hw_init();
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* Reference sample: position 0 at the software capture */
+	for (int i = 0; i < TRAJECTORY_NUM_MOTORS; i++) {
+		encoder_hw_read(i, &raw);
+		track[i] = (encoder_track_t){
+			.count = raw.count,
+			.edge_position = (int16_t)(raw.edge_count - raw.count),
+			.edge_time = raw.edge_time,
+		};
+	}
+
+	ready = true;
+
+	LOG_INF("Encoders running (%u counts/mm, timebase %u Hz)",
+		(uint32_t)ENCODER_COUNTS_PER_MM, ENCODER_TIMEBASE_HZ);
+
+	return 0;
+}
+
+bool encoder_is_ready(void)
+{
+	return ready;
+}
+
+void encoder_get_state(trajectory_point_t *out)
+{
+	if (!out) {
+		return;
+	}
+
+	uint32_t seq;
+
+	do {
+		seq = seqlock_read_begin(&state_lock);
+		*out = state;
+	} while (seqlock_read_retry(&state_lock, seq));
+}
+
+void encoder_get_counts(int32_t *counts)
+{
+	if (!counts) {
+		return;
+	}
+
+	uint32_t seq;
+
+	do {
+		seq = seqlock_read_begin(&state_lock);
+		memcpy(counts, state_counts, sizeof(state_counts));
+	} while (seqlock_read_retry(&state_lock, seq));
+}
+
+void encoder_set_zero(const int32_t *counts)
+{
+	k_spinlock_key_t key = k_spin_lock(&zero_lock);
+
+	memcpy(zero, counts, sizeof(zero));
+	k_spin_unlock(&zero_lock, key);
+}
@@ -0,0 +1,76 @@
+/*
+ * Quadrature Encoders - Phase 7
+ * Measured position, velocity, acceleration and jerk of all motors
+ *
+ * Each encoder runs on an STM32 timer in encoder mode (x4, 576 counts
+ * per motor revolution), so counting needs no interrupts. Every rising
+ * edge of channel A also latches the count into CCR1 and, through a
+ * DMA request, copies a free-running 32-bit timebase into memory: the
+ * control loop sees the exact count and time of the last A edge.
+ *
+ * Velocity is measured M/T style: counts between the last A edges of
+ * two ticks over the time between those edges. That is exact at high
+ * speed and still resolves one edge every few ticks at low speed; with
+ * no edge the speed is bounded by one A period over the time since the
+ * last edge. Acceleration and jerk come from an alpha-beta-gamma filter
+ * over the measured velocity, not from differencing it.
+ *
+ * Everything is sampled once per control tick by encoder_sample().
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include "trajectory.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Set up the encoder timers, the timebase and the capture DMA
+ * Counts start at zero at power-up; position 0 mm is count 0 until
+ * encoder_set_zero().
+ *
+ * @return 0 on success, -ENOTSUP without CONFIG_SEGMENT_ENCODER,
+ *         other negative errno on error
+ */
+int encoder_init(void);
+
+/**
+ * Sample all encoders and update the estimates (control thread only)
+ * Call once per control tick; a no-op until encoder_init() succeeded.
+ */
+void encoder_sample(void);
+
+/**
+ * Check if encoder feedback is available
+ *
+ * @return true once encoder_init() succeeded
+ */
+bool encoder_is_ready(void);
+
+/**
+ * Get the latest estimates of all motors
+ *
+ * @param state Output: position (counts from the zero, exact), filtered
+ *              velocity, acceleration and jerk, in mm units like the set point
+ */
+void encoder_get_state(trajectory_point_t *state);
+
+/**
+ * Get the extended counts of the latest sample
+ *
+ * @param counts Output: TRAJECTORY_NUM_MOTORS counts since power-up
+ */
+void encoder_get_counts(int32_t *counts);
+
+/**
+ * Set the counts that read as position 0
+ * Takes effect from the next sample.
+ *
+ * @param counts TRAJECTORY_NUM_MOTORS counts (encoder_get_counts())
+ */
+void encoder_set_zero(const int32_t *counts);
+
+#endif /* ENCODER_H */
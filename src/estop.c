@@ -0,0 +1,178 @@
+/*
+ * Emergency Stop Implementation
+ *
+ * Safe state is the hardware driver enable line of the TMC9660s
+ * (zephyr,user drv-enable-gpios): releasing it turns the bridges off
+ * regardless of what the chips are doing, and is a single GPIO write.
+ * The line is held inactive from boot until the master first enables
+ * motion, so the bridges are never live before a master is connected.
+ * Latency is measured from recvfrom() returning to that write; time
+ * spent in the Ethernet driver and IP stack is not included.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "estop.h"
+#include "packet.h"
+#include "crc16.h"
+#include "control.h"
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/printk.h>
+
+static const struct gpio_dt_spec drv_enable =
+	GPIO_DT_SPEC_GET_OR(DT_PATH(zephyr_user), drv_enable_gpios, {0});
+
+static atomic_t active = ATOMIC_INIT(0);
+static estop_stats_t stats;
+static struct k_spinlock stats_lock;
+
+/* Orders enable against trigger so a stop always wins */
+static struct k_spinlock drv_lock;
+static bool drivers_on;
+
+/* Deferred banner (printk is far too slow for the stop path) */
+static void estop_log_handler(struct k_work *work)
+{
+	estop_stats_t s;
+
+	ARG_UNUSED(work);
+	estop_get_stats(&s);
+
+	printk("\n");
+	printk("╔═══════════════════════════════╗\n");
+	printk("║   EMERGENCY STOP ACTIVATED    ║\n");
+	printk("╚═══════════════════════════════╝\n");
+	printk("Reason: 0x%02X\n", s.last_reason);
+	printk(">>> Motors DISABLED <<< (%u us after receive, max %u us)\n",
+	       s.last_latency_us, s.max_latency_us);
+	printk("\n");
+}
+
+static K_WORK_DEFINE(estop_log_work, estop_log_handler);
+
+int estop_init(void)
+{
+	if (drv_enable.port == NULL) {
+		printk("[E-Stop] Warning: no drv-enable-gpios, stop is software-only\n");
+		return 0;
+	}
+
+	if (!gpio_is_ready_dt(&drv_enable)) {
+		printk("[E-Stop] ERROR: driver enable GPIO not ready\n");
+		return -ENODEV;
+	}
+
+	return gpio_pin_configure_dt(&drv_enable, GPIO_OUTPUT_INACTIVE);
+}
+
+void estop_trigger(uint8_t reason, uint32_t rx_cycles)
+{
+	/* 1. Hardware safe state first, latch before anyone can re-enable */
+	k_spinlock_key_t dkey = k_spin_lock(&drv_lock);
+
+	if (drv_enable.port != NULL) {
+		gpio_pin_set_dt(&drv_enable, 0);
+	}
+	drivers_on = false;
+	atomic_set(&active, 1);
+
+	k_spin_unlock(&drv_lock, dkey);
+
+	uint32_t latency_us = k_cyc_to_us_floor32(k_cycle_get_32() - rx_cycles);
+
+	/* 2. Stop consuming trajectory segments */
+	control_emergency_stop();
+	packet_set_emergency_stop();
+
+	/* 3. Bookkeeping */
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	stats.count++;
+	stats.last_reason = reason;
+	stats.last_latency_us = latency_us;
+	if (latency_us > stats.max_latency_us) {
+		stats.max_latency_us = latency_us;
+	}
+
+	k_spin_unlock(&stats_lock, key);
+
+	k_work_submit(&estop_log_work);
+}
+
+bool estop_fast_path(const uint8_t *data, size_t length, uint32_t rx_cycles)
+{
+	if (length != sizeof(emergency_stop_packet_t) ||
+	    data[2] != CMD_EMERGENCY_STOP ||
+	    (data[0] | (data[1] << 8)) != PACKET_MAGIC_MASTER_TO_STM32 ||
+	    !crc16_verify(data, length)) {
+		return false;
+	}
+
+	const emergency_stop_packet_t *pkt = (const emergency_stop_packet_t *)data;
+
+	if (pkt->segment_id != 0xFF && pkt->segment_id != packet_get_segment_id()) {
+		/* Valid stop for another segment: consumed, nothing to do */
+		return true;
+	}
+
+	estop_trigger(pkt->stop_reason, rx_cycles);
+
+	return true;
+}
+
+void estop_clear(void)
+{
+	if (!atomic_cas(&active, 1, 0)) {
+		return;
+	}
+
+	control_clear_emergency_stop();
+
+	printk("[E-Stop] Cleared\n");
+}
+
+int estop_enable_drivers(void)
+{
+	bool turned_on = false;
+	k_spinlock_key_t key = k_spin_lock(&drv_lock);
+
+	if (atomic_get(&active)) {
+		k_spin_unlock(&drv_lock, key);
+		return -EBUSY;
+	}
+
+	if (!drivers_on) {
+		if (drv_enable.port != NULL) {
+			gpio_pin_set_dt(&drv_enable, 1);
+		}
+		drivers_on = true;
+		turned_on = true;
+	}
+
+	k_spin_unlock(&drv_lock, key);
+
+	if (turned_on && drv_enable.port != NULL) {
+		printk("[E-Stop] Drivers enabled\n");
+	}
+
+	return 0;
+}
+
+bool estop_is_active(void)
+{
+	return atomic_get(&active) != 0;
+}
+
+void estop_get_stats(estop_stats_t *out)
+{
+	if (!out) {
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	*out = stats;
+	k_spin_unlock(&stats_lock, key);
+}
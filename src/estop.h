@@ -0,0 +1,85 @@
+/*
+ * Emergency Stop - Phase 7
+ * Fast path from UDP datagram to motor driver disable
+ *
+ * The UDP thread checks every datagram for a valid EMERGENCY_STOP packet
+ * before anything else and, for a match, releases the TMC9660 driver
+ * enable line immediately. Logging is deferred to the system workqueue
+ * so nothing slow runs between packet arrival and disable.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ESTOP_H
+#define ESTOP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Emergency stop statistics */
+typedef struct {
+	uint32_t count;            /* Stops triggered since boot */
+	uint32_t last_latency_us;  /* Packet handed to app -> drivers disabled */
+	uint32_t max_latency_us;   /* Worst-case latency */
+	uint8_t last_reason;       /* stop_reason of last stop */
+} estop_stats_t;
+
+/**
+ * Initialize emergency stop output (drivers disabled until
+ * estop_enable_drivers())
+ *
+ * @return 0 on success, negative errno on error
+ */
+int estop_init(void);
+
+/**
+ * Handle a datagram if it is an emergency stop for this segment
+ * Called first thing after recvfrom(); validates length, magic, type,
+ * CRC and target, then triggers the stop.
+ *
+ * @param data Received datagram
+ * @param length Length of datagram
+ * @param rx_cycles k_cycle_get_32() when the datagram was received
+ * @return true if the datagram was a valid stop and has been handled
+ */
+bool estop_fast_path(const uint8_t *data, size_t length, uint32_t rx_cycles);
+
+/**
+ * Trigger an emergency stop
+ * Disables the drivers, stops trajectory execution and latches the stop.
+ *
+ * @param reason stop_reason from the packet
+ * @param rx_cycles k_cycle_get_32() when the request was received
+ */
+void estop_trigger(uint8_t reason, uint32_t rx_cycles);
+
+/**
+ * Release a latched emergency stop
+ * The drivers stay off until estop_enable_drivers() is called.
+ */
+void estop_clear(void);
+
+/**
+ * Turn the drivers on when the master enables motion
+ * Refused while a stop is latched; a no-op if they are already on.
+ *
+ * @return 0 on success, -EBUSY if an emergency stop is latched
+ */
+int estop_enable_drivers(void);
+
+/**
+ * Check if an emergency stop is latched
+ *
+ * @return true if stopped
+ */
+bool estop_is_active(void);
+
+/**
+ * Get emergency stop statistics
+ *
+ * @param stats Output: current statistics
+ */
+void estop_get_stats(estop_stats_t *stats);
+
+#endif /* ESTOP_H */
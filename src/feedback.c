@@ -0,0 +1,232 @@
+/*
+ * Motor State Feedback Streamer Implementation
+ *
+ * Two static packets are handed between the control thread (producer)
+ * and the sender thread (consumer) through one atomic state word holding
+ * the index of the packet waiting to be sent and the index of the packet
+ * being sent. Both sides move ownership with compare-and-swap, so neither
+ * ever takes a lock the other might hold.
+ *
+ * In compact mode the control thread keeps the samples of the batch
+ * being collected to itself and only claims a packet buffer once the
+ * batch is complete.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "feedback.h"
+#include "config.h"
+#include "network.h"
+#include "packet.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/printk.h>
+
+/*
+ * State word layout: bits 0-1 pending slot, bits 2-3 in-flight slot.
+ * Slot 0 means none, 1/2 mean packet buffer 0/1.
+ */
+#define SLOT_NONE            0
+#define STATE_PENDING(s)     ((int)((s) & 0x3))
+#define STATE_INFLIGHT(s)    ((int)(((s) >> 2) & 0x3))
+#define STATE_MAKE(p, f)     ((atomic_val_t)((p) | ((f) << 2)))
+
+K_THREAD_STACK_DEFINE(feedback_thread_stack, FEEDBACK_THREAD_STACK_SIZE);
+static struct k_thread feedback_thread_data;
+
+#define FEEDBACK_PACKET_SIZE MAX(sizeof(motor_state_packet_t), COMPACT_MAX_SIZE)
+
+static uint8_t packets[2][FEEDBACK_PACKET_SIZE];
+static size_t packet_len[2];
+static atomic_t state = ATOMIC_INIT(0);
+static K_SEM_DEFINE(packet_ready, 0, 1);
+
+static uint8_t my_segment_id;
+static bool running = false;
+
+/* Requested format: bits 0-7 format, bits 8-15 batch size */
+#define FORMAT_MAKE(f, b)    ((atomic_val_t)((f) | ((b) << 8)))
+#define FORMAT_TYPE(c)       ((uint8_t)((c) & 0xFF))
+#define FORMAT_BATCH(c)      ((uint8_t)(((c) >> 8) & 0xFF))
+
+static atomic_t format_cfg = ATOMIC_INIT(FORMAT_MAKE(FEEDBACK_FORMAT_FULL, 1));
+
+/* Control thread only: batch being collected */
+static atomic_val_t active_cfg = FORMAT_MAKE(FEEDBACK_FORMAT_FULL, 1);
+static motor_sample_t batch[COMPACT_MAX_SAMPLES];
+static uint8_t batch_count;
+static uint16_t compact_sequence;
+
+/* Statistics */
+static atomic_t stat_published;
+static atomic_t stat_sent;
+static atomic_t stat_dropped;
+static atomic_t stat_send_errors;
+
+/**
+ * Take a packet buffer the sender is not using
+ * An unsent pending packet is reclaimed (and counted as dropped).
+ */
+static int feedback_claim(void)
+{
+	atomic_val_t s, next;
+	int buf;
+	bool reclaimed;
+
+	do {
+		s = atomic_get(&state);
+		int pending = STATE_PENDING(s);
+		int inflight = STATE_INFLIGHT(s);
+
+		if (pending != SLOT_NONE) {
+			buf = pending - 1;
+			next = STATE_MAKE(SLOT_NONE, inflight);
+			reclaimed = true;
+		} else {
+			/* Whichever buffer is not on the wire */
+			buf = (inflight == 1) ? 1 : 0;
+			next = s;
+			reclaimed = false;
+		}
+	} while (!atomic_cas(&state, s, next));
+
+	if (reclaimed) {
+		atomic_inc(&stat_dropped);
+	}
+
+	return buf;
+}
+
+void feedback_publish(void)
+{
+	if (!running) {
+		return;
+	}
+
+	atomic_val_t cfg = atomic_get(&format_cfg);
+
+	if (cfg != active_cfg) {
+		active_cfg = cfg;
+		batch_count = 0;
+	}
+
+	if (FORMAT_TYPE(cfg) == FEEDBACK_FORMAT_COMPACT) {
+		packet_sample_motor_state(&batch[batch_count++]);
+		if (batch_count < FORMAT_BATCH(cfg)) {
+			return;
+		}
+	}
+
+	int buf = feedback_claim();
+
+	if (FORMAT_TYPE(cfg) == FEEDBACK_FORMAT_COMPACT) {
+		packet_len[buf] = packet_build_motor_state_compact(packets[buf], batch, batch_count,
+								   1000 / FEEDBACK_RATE_HZ,
+								   my_segment_id,
+								   compact_sequence++);
+		batch_count = 0;
+	} else {
+		packet_build_motor_state((motor_state_packet_t *)packets[buf], my_segment_id);
+		packet_len[buf] = sizeof(motor_state_packet_t);
+	}
+
+	/* Mark pending; the sender may have changed the in-flight slot meanwhile */
+	atomic_val_t s;
+
+	do {
+		s = atomic_get(&state);
+	} while (!atomic_cas(&state, s, STATE_MAKE(buf + 1, STATE_INFLIGHT(s))));
+
+	atomic_inc(&stat_published);
+	k_sem_give(&packet_ready);
+}
+
+static void feedback_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	printk("[Feedback] Motor state streaming at %d Hz\n", FEEDBACK_RATE_HZ);
+
+	while (1) {
+		k_sem_take(&packet_ready, K_FOREVER);
+
+		/* Move pending packet to in-flight */
+		atomic_val_t s;
+		int pending;
+
+		do {
+			s = atomic_get(&state);
+			pending = STATE_PENDING(s);
+			if (pending == SLOT_NONE) {
+				break;
+			}
+		} while (!atomic_cas(&state, s, STATE_MAKE(SLOT_NONE, pending)));
+
+		if (pending == SLOT_NONE) {
+			continue;
+		}
+
+		int ret = network_send_udp(packets[pending - 1], packet_len[pending - 1]);
+		if (ret > 0) {
+			atomic_inc(&stat_sent);
+		} else {
+			atomic_inc(&stat_send_errors);
+		}
+
+		/* Release in-flight slot */
+		atomic_and(&state, 0x3);
+	}
+}
+
+int feedback_start(uint8_t segment_id)
+{
+	if (running) {
+		return -EALREADY;
+	}
+
+	my_segment_id = segment_id;
+
+	k_thread_create(&feedback_thread_data, feedback_thread_stack,
+			K_THREAD_STACK_SIZEOF(feedback_thread_stack),
+			feedback_thread, NULL, NULL, NULL,
+			K_PRIO_PREEMPT(FEEDBACK_THREAD_PRIORITY), 0, K_NO_WAIT);
+	k_thread_name_set(&feedback_thread_data, "feedback");
+
+	running = true;
+
+	return 0;
+}
+
+int feedback_set_format(uint8_t format, uint8_t batch)
+{
+	switch (format) {
+	case FEEDBACK_FORMAT_FULL:
+		batch = 1;
+		break;
+	case FEEDBACK_FORMAT_COMPACT:
+		if (batch < 1 || batch > COMPACT_MAX_SAMPLES) {
+			return -EINVAL;
+		}
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	atomic_set(&format_cfg, FORMAT_MAKE(format, batch));
+
+	return 0;
+}
+
+void feedback_get_stats(feedback_stats_t *out)
+{
+	if (!out) {
+		return;
+	}
+
+	out->published = (uint32_t)atomic_get(&stat_published);
+	out->sent = (uint32_t)atomic_get(&stat_sent);
+	out->dropped = (uint32_t)atomic_get(&stat_dropped);
+	out->send_errors = (uint32_t)atomic_get(&stat_send_errors);
+}
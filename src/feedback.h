@@ -0,0 +1,59 @@
+/*
+ * Motor State Feedback Streamer - Phase 7
+ * 100 Hz MOTOR_STATE packets over UDP, or MOTOR_STATE_COMPACT datagrams
+ * of 1-4 samples once the master asks for them (SET_FEEDBACK_FORMAT)
+ *
+ * The control loop fills one of two preallocated packets and hands it to
+ * a low-priority sender thread. The control loop never waits on the
+ * network: if the sender is still busy with the previous packet, an
+ * older unsent packet is replaced by the newest one.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FEEDBACK_H
+#define FEEDBACK_H
+
+#include <stdint.h>
+
+/* Streamer statistics */
+typedef struct {
+	uint32_t published;      /* Datagrams built by the control loop */
+	uint32_t sent;           /* Packets handed to the network stack */
+	uint32_t dropped;        /* Unsent packets superseded by a newer one */
+	uint32_t send_errors;    /* Sends rejected (no master, socket error) */
+} feedback_stats_t;
+
+/**
+ * Start the feedback sender thread
+ *
+ * @param segment_id Segment ID written into every packet
+ * @return 0 on success, negative errno on error
+ */
+int feedback_start(uint8_t segment_id);
+
+/**
+ * Sample the motor state and queue a packet for sending
+ * In compact mode a datagram is queued once every batch samples.
+ * Called from the control loop; never blocks.
+ */
+void feedback_publish(void);
+
+/**
+ * Select the motor state format
+ * Takes effect at the next sample; a partly filled batch is discarded.
+ *
+ * @param format FEEDBACK_FORMAT_FULL or FEEDBACK_FORMAT_COMPACT
+ * @param batch Samples per datagram (1 to COMPACT_MAX_SAMPLES), ignored for FULL
+ * @return 0 on success, -EINVAL for an unknown format or batch size
+ */
+int feedback_set_format(uint8_t format, uint8_t batch);
+
+/**
+ * Get streamer statistics
+ *
+ * @param stats Output: current statistics
+ */
+void feedback_get_stats(feedback_stats_t *stats);
+
+#endif /* FEEDBACK_H */
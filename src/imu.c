@@ -7,29 +7,335 @@
 
 #include "imu.h"
 #include "madgwick.h"
+#include "config.h"
+#include "seqlock.h"
+#include "log_ratelimit.h"
+#include "trace.h"
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/sys/printk.h>
+#include <zephyr/logging/log.h>
 #include <math.h>
+#include <string.h>
+
+#if defined(CONFIG_SEGMENT_IMU_FIFO)
+#include "lsm6dso_fifo.h"
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/sys/byteorder.h>
+#endif
+
+LOG_MODULE_REGISTER(imu, CONFIG_SEGMENT_IMU_LOG_LEVEL);
 
 /* LSM6DSO device */
 static const struct device *lsm6dso_dev = NULL;
 
-/* Current IMU data */
+/* Current IMU data (private to the fusion path) */
 static imu_data_t current_data = {0};
 
 /* Madgwick filter instance */
 static madgwick_t madgwick;
 
+/* Snapshot published for readers (feedback, diagnostics) */
+static struct {
+	imu_data_t data;
+	madgwick_t filter;
+} shared;
+static seqlock_t shared_lock = SEQLOCK_INIT;
+
+/* Sample path statistics */
+static imu_stats_t stats;
+
+/**
+ * Publish sensor data and filter state as one consistent snapshot
+ */
+static void imu_publish(void)
+{
+	k_spinlock_key_t key = seqlock_write_begin(&shared_lock);
+
+	shared.data = current_data;
+	shared.filter = madgwick;
+
+	seqlock_write_end(&shared_lock, key);
+}
+
+/**
+ * Sanity-check a measured sample interval
+ * Falls back to the nominal period for the first sample or after a gap.
+ */
+static inline float imu_checked_dt(float dt, float nominal)
+{
+	if (dt > 0.25f * nominal && dt < 4.0f * nominal) {
+		return dt;
+	}
+
+	return nominal;
+}
+
 /* IMU configuration */
-#define IMU_SAMPLE_FREQ 100.0f   /* 100 Hz update rate */
+#define IMU_SAMPLE_FREQ ((float)IMU_SAMPLE_RATE_HZ)  /* Requested by the control loop */
+#define IMU_NOMINAL_DT  (1.0f / IMU_SAMPLE_FREQ)
 #define MADGWICK_BETA   0.1f     /* Filter gain */
 
+/* Cycle counter at last polled update (measured dt) */
+static uint32_t last_update_cycles;
+
+/* IMU thread (FIFO mode) or polled-read work queue */
+#define IMU_THREAD_STACK_SIZE 1536
+#define IMU_THREAD_PRIORITY   5  /* Preemptible, above network threads */
+
 /* Conversion factors */
 #define ACCEL_SENSITIVITY_2G  0.000061f  /* LSM6DSO: 0.061 mg/LSB for ±2g */
 #define GYRO_SENSITIVITY_2000DPS  0.070f  /* LSM6DSO: 70 mdps/LSB for ±2000dps */
 #define DEG_TO_RAD  (M_PI / 180.0f)
+#define STANDARD_GRAVITY  9.80665f
+
+#if defined(CONFIG_SEGMENT_IMU_FIFO)
+
+/*
+ * FIFO mode: each batch is one accel word, one gyro word and one
+ * timestamp word. The thread drains at most two watermarks per burst.
+ */
+#define IMU_FIFO_ODR_HZ        CONFIG_SEGMENT_IMU_FIFO_ODR
+#define IMU_FIFO_WORDS_PER_SET 3
+#define IMU_FIFO_WATERMARK     (CONFIG_SEGMENT_IMU_FIFO_BATCH * IMU_FIFO_WORDS_PER_SET)
+#define IMU_FIFO_MAX_BURST     (IMU_FIFO_WATERMARK * 2)
+#define IMU_FIFO_NOMINAL_DT    (1.0f / (float)IMU_FIFO_ODR_HZ)
+
+/* Raw FIFO counts to SI units (folded to single float constants) */
+#define GYRO_LSB_TO_RAD_S   ((float)(GYRO_SENSITIVITY_2000DPS * DEG_TO_RAD))
+#define ACCEL_LSB_TO_MS2    ((float)(ACCEL_SENSITIVITY_2G * STANDARD_GRAVITY))
+
+/* Wait for the watermark at most two batch periods (covers a missed edge) */
+#define IMU_FIFO_TIMEOUT_MS \
+	(2 * 1000 * CONFIG_SEGMENT_IMU_FIFO_BATCH / IMU_FIFO_ODR_HZ + 1)
+
+BUILD_ASSERT(IMU_FIFO_WATERMARK <= LSM6DSO_FIFO_MAX_WTM, "FIFO batch too large");
+
+static const struct gpio_dt_spec imu_int1 = GPIO_DT_SPEC_GET(DT_NODELABEL(lsm6dso), irq_gpios);
+static struct gpio_callback imu_int1_cb;
+static K_SEM_DEFINE(imu_fifo_sem, 0, 1);
+
+K_THREAD_STACK_DEFINE(imu_thread_stack, IMU_THREAD_STACK_SIZE);
+static struct k_thread imu_thread_data;
+
+/* Burst buffer (static: too large for the thread stack) */
+static uint8_t fifo_buf[IMU_FIFO_MAX_BURST * LSM6DSO_FIFO_WORD_SIZE];
+
+/* Sample assembly state carried across bursts */
+static bool have_accel;
+static bool have_gyro;
+static bool have_timestamp;
+static uint32_t batch_timestamp;
+static uint32_t last_fused_timestamp;
+static bool last_fused_valid;
+
+#else
+
+/*
+ * Polled mode: sensor_sample_fetch() is a blocking I2C transfer, so it
+ * runs on a preemptible work queue and never in the cooperative control
+ * thread, which only submits the work item.
+ */
+K_THREAD_STACK_DEFINE(imu_workq_stack, IMU_THREAD_STACK_SIZE);
+static struct k_work_q imu_workq;
+static struct k_work imu_work;
+
+#endif /* CONFIG_SEGMENT_IMU_FIFO */
+
+#if defined(CONFIG_SEGMENT_IMU_FIFO)
+
+/**
+ * INT1 watermark interrupt: wake the IMU thread
+ */
+static void imu_int1_handler(const struct device *dev, struct gpio_callback *cb,
+			     gpio_port_pins_t pins)
+{
+	ARG_UNUSED(dev);
+	ARG_UNUSED(cb);
+	ARG_UNUSED(pins);
+
+	k_sem_give(&imu_fifo_sem);
+}
+
+/**
+ * Run one fusion step once an accel/gyro pair is complete
+ * dt comes from the FIFO timestamps; the nominal period is used when no
+ * timestamp is available or the difference is implausible.
+ */
+static void imu_fifo_fuse(void)
+{
+	float dt = IMU_FIFO_NOMINAL_DT;
+
+	if (have_timestamp && last_fused_valid) {
+		dt = imu_checked_dt((float)(batch_timestamp - last_fused_timestamp) *
+				    LSM6DSO_TIMESTAMP_LSB_S, IMU_FIFO_NOMINAL_DT);
+	}
+
+	if (have_timestamp) {
+		last_fused_timestamp = batch_timestamp;
+		last_fused_valid = true;
+	}
+
+	madgwick_update_dt(&madgwick,
+	                   current_data.gyro_x, current_data.gyro_y, current_data.gyro_z,
+	                   current_data.accel_x, current_data.accel_y, current_data.accel_z,
+	                   dt);
+
+	have_accel = false;
+	have_gyro = false;
+	stats.samples++;
+}
+
+/**
+ * Decode a burst of FIFO words
+ */
+static void imu_fifo_process(const uint8_t *buf, uint16_t words)
+{
+	for (uint16_t i = 0; i < words; i++, buf += LSM6DSO_FIFO_WORD_SIZE) {
+		uint8_t tag = buf[0] >> 3;
+		int16_t x = (int16_t)sys_get_le16(&buf[1]);
+		int16_t y = (int16_t)sys_get_le16(&buf[3]);
+		int16_t z = (int16_t)sys_get_le16(&buf[5]);
+
+		switch (tag) {
+		case LSM6DSO_TAG_GYRO:
+			current_data.gyro_x = x * GYRO_LSB_TO_RAD_S;
+			current_data.gyro_y = y * GYRO_LSB_TO_RAD_S;
+			current_data.gyro_z = z * GYRO_LSB_TO_RAD_S;
+			have_gyro = true;
+			break;
+
+		case LSM6DSO_TAG_ACCEL:
+			current_data.accel_x = x * ACCEL_LSB_TO_MS2;
+			current_data.accel_y = y * ACCEL_LSB_TO_MS2;
+			current_data.accel_z = z * ACCEL_LSB_TO_MS2;
+			have_accel = true;
+			break;
+
+		case LSM6DSO_TAG_TIMESTAMP:
+			batch_timestamp = sys_get_le32(&buf[1]);
+			have_timestamp = true;
+			break;
+
+		default:
+			/* Not batched in this configuration */
+			break;
+		}
+
+		if (have_accel && have_gyro) {
+			imu_fifo_fuse();
+		}
+	}
+}
+
+static void imu_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (1) {
+		k_sem_take(&imu_fifo_sem, K_MSEC(IMU_FIFO_TIMEOUT_MS));
+
+		uint16_t words;
+		bool overrun;
+
+		int ret = lsm6dso_fifo_level(&words, &overrun);
+
+		if (ret < 0) {
+			LOG_ERR_RL("FIFO status read failed: %d", ret);
+			stats.errors++;
+			continue;
+		}
+
+		if (overrun) {
+			LOG_WRN_RL("FIFO overrun, samples lost");
+			stats.overruns++;
+		}
+
+		while (words > 0) {
+			uint16_t n = MIN(words, IMU_FIFO_MAX_BURST);
+
+			ret = lsm6dso_fifo_read(fifo_buf, n);
+			trace_record(TRACE_EVT_IMU_READ, ret < 0, n);
+			if (ret < 0) {
+				LOG_ERR_RL("FIFO burst read failed: %d", ret);
+				stats.errors++;
+				break;
+			}
+
+			imu_fifo_process(fifo_buf, n);
+			stats.bursts++;
+			words -= n;
+		}
+
+		current_data.last_update_ms = k_uptime_get_32();
+		imu_publish();
+	}
+}
+
+static int imu_fifo_start(void)
+{
+	int ret;
+
+	madgwick_init(&madgwick, (float)IMU_FIFO_ODR_HZ, MADGWICK_BETA);
+	printk("Madgwick filter initialized (beta=%.2f, freq=%d Hz, per-sample dt)\n",
+	       MADGWICK_BETA, IMU_FIFO_ODR_HZ);
+
+	if (!gpio_is_ready_dt(&imu_int1)) {
+		printk("ERROR: LSM6DSO INT1 GPIO not ready\n");
+		return -ENODEV;
+	}
+
+	ret = lsm6dso_fifo_configure(IMU_FIFO_ODR_HZ, IMU_FIFO_WATERMARK);
+	if (ret < 0) {
+		printk("ERROR: Failed to configure LSM6DSO FIFO: %d\n", ret);
+		return ret;
+	}
+
+	ret = gpio_pin_configure_dt(&imu_int1, GPIO_INPUT);
+	if (ret < 0) {
+		return ret;
+	}
+
+	gpio_init_callback(&imu_int1_cb, imu_int1_handler, BIT(imu_int1.pin));
+	ret = gpio_add_callback_dt(&imu_int1, &imu_int1_cb);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = gpio_pin_interrupt_configure_dt(&imu_int1, GPIO_INT_EDGE_TO_ACTIVE);
+	if (ret < 0) {
+		return ret;
+	}
+
+	current_data.valid = true;
+	current_data.last_update_ms = k_uptime_get_32();
+	imu_publish();
+
+	k_thread_create(&imu_thread_data, imu_thread_stack,
+			K_THREAD_STACK_SIZEOF(imu_thread_stack),
+			imu_thread, NULL, NULL, NULL,
+			K_PRIO_PREEMPT(IMU_THREAD_PRIORITY), 0, K_NO_WAIT);
+	k_thread_name_set(&imu_thread_data, "imu");
+
+	printk("[Phase 4] IMU FIFO mode: %d Hz, %d samples per interrupt\n",
+	       IMU_FIFO_ODR_HZ, CONFIG_SEGMENT_IMU_FIFO_BATCH);
+
+	return 0;
+}
+
+#endif /* CONFIG_SEGMENT_IMU_FIFO */
+
+#if !defined(CONFIG_SEGMENT_IMU_FIFO)
+static void imu_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	imu_update();
+}
+#endif
 
 int imu_init(void)
 {
@@ -50,6 +356,9 @@ int imu_init(void)
 
 	printk("LSM6DSO device found: %s\n", lsm6dso_dev->name);
 
+#if defined(CONFIG_SEGMENT_IMU_FIFO)
+	return imu_fifo_start();
+#else
 	/* Initialize Madgwick filter */
 	madgwick_init(&madgwick, IMU_SAMPLE_FREQ, MADGWICK_BETA);
 	printk("Madgwick filter initialized (beta=%.2f, freq=%.0f Hz)\n",
@@ -77,14 +386,24 @@ int imu_init(void)
 	if (ret < 0) {
 		printk("ERROR: Failed to fetch initial sample: %d\n", ret);
 		current_data.valid = false;
+		imu_publish();
 		return ret;
 	}
 
 	printk("[Phase 4] IMU initialized successfully\n");
 	current_data.valid = true;
 	current_data.last_update_ms = k_uptime_get_32();
+	imu_publish();
+
+	const struct k_work_queue_config cfg = { .name = "imu" };
+
+	k_work_init(&imu_work, imu_work_handler);
+	k_work_queue_start(&imu_workq, imu_workq_stack,
+			   K_THREAD_STACK_SIZEOF(imu_workq_stack),
+			   K_PRIO_PREEMPT(IMU_THREAD_PRIORITY), &cfg);
 
 	return 0;
+#endif
 }
 
 int imu_update(void)
@@ -93,11 +412,19 @@ int imu_update(void)
 		return -ENODEV;
 	}
 
+#if defined(CONFIG_SEGMENT_IMU_FIFO)
+	/* Samples are consumed by the IMU thread */
+	return 0;
+#else
+
 	/* Fetch new sensor data */
 	int ret = sensor_sample_fetch(lsm6dso_dev);
+
+	trace_record(TRACE_EVT_IMU_READ, ret < 0, 1);
 	if (ret < 0) {
-		printk("IMU: Sample fetch failed: %d\n", ret);
+		LOG_ERR_RL("Sample fetch failed: %d", ret);
 		current_data.valid = false;
+		imu_publish();
 		return ret;
 	}
 
@@ -105,7 +432,7 @@ int imu_update(void)
 	struct sensor_value accel[3];
 	ret = sensor_channel_get(lsm6dso_dev, SENSOR_CHAN_ACCEL_XYZ, accel);
 	if (ret < 0) {
-		printk("IMU: Accel read failed: %d\n", ret);
+		LOG_ERR_RL("Accel read failed: %d", ret);
 		return ret;
 	}
 
@@ -113,7 +440,7 @@ int imu_update(void)
 	struct sensor_value gyro[3];
 	ret = sensor_channel_get(lsm6dso_dev, SENSOR_CHAN_GYRO_XYZ, gyro);
 	if (ret < 0) {
-		printk("IMU: Gyro read failed: %d\n", ret);
+		LOG_ERR_RL("Gyro read failed: %d", ret);
 		return ret;
 	}
 
@@ -128,43 +455,92 @@ int imu_update(void)
 	current_data.gyro_y = sensor_value_to_float(&gyro[1]);
 	current_data.gyro_z = sensor_value_to_float(&gyro[2]);
 
-	/* Update Madgwick filter */
-	madgwick_update(&madgwick,
-	                current_data.gyro_x, current_data.gyro_y, current_data.gyro_z,
-	                current_data.accel_x, current_data.accel_y, current_data.accel_z);
+	/* Update Madgwick filter with the measured interval */
+	uint32_t now_cycles = k_cycle_get_32();
+	float dt = IMU_NOMINAL_DT;
 
-	/* Get orientation from quaternion */
-	madgwick_get_euler(&madgwick,
-	                   &current_data.roll,
-	                   &current_data.pitch,
-	                   &current_data.yaw);
+	if (stats.samples > 0) {
+		dt = imu_checked_dt((float)k_cyc_to_us_floor32(now_cycles - last_update_cycles) *
+				    1e-6f, IMU_NOMINAL_DT);
+	}
+	last_update_cycles = now_cycles;
+
+	madgwick_update_dt(&madgwick,
+	                   current_data.gyro_x, current_data.gyro_y, current_data.gyro_z,
+	                   current_data.accel_x, current_data.accel_y, current_data.accel_z,
+	                   dt);
 
+	/* Euler angles are derived on demand (imu_get_orientation) */
 	current_data.last_update_ms = k_uptime_get_32();
+	imu_publish();
+	stats.samples++;
+	stats.bursts++;
 
 	return 0;
+#endif
+}
+
+void imu_request_update(void)
+{
+#if !defined(CONFIG_SEGMENT_IMU_FIFO)
+	/* Still busy with the last read: it is queued once more at most */
+	if (lsm6dso_dev && imu_is_valid()) {
+		k_work_submit_to_queue(&imu_workq, &imu_work);
+	}
+#endif
 }
 
 void imu_get_data(imu_data_t *data)
 {
-	if (data) {
-		memcpy(data, &current_data, sizeof(imu_data_t));
+	if (!data) {
+		return;
 	}
+
+	madgwick_t q;
+	uint32_t seq;
+
+	do {
+		seq = seqlock_read_begin(&shared_lock);
+		*data = shared.data;
+		q = shared.filter;
+	} while (seqlock_read_retry(&shared_lock, seq));
+
+	madgwick_get_euler(&q, &data->roll, &data->pitch, &data->yaw);
 }
 
 void imu_get_orientation(float *roll, float *pitch, float *yaw)
 {
+	/* Snapshot the quaternion, then convert outside the fusion path */
+	madgwick_t q;
+	uint32_t seq;
+	float r, p, y;
+
+	do {
+		seq = seqlock_read_begin(&shared_lock);
+		q = shared.filter;
+	} while (seqlock_read_retry(&shared_lock, seq));
+
+	madgwick_get_euler(&q, &r, &p, &y);
+
 	if (roll) {
-		*roll = current_data.roll;
+		*roll = r;
 	}
 	if (pitch) {
-		*pitch = current_data.pitch;
+		*pitch = p;
 	}
 	if (yaw) {
-		*yaw = current_data.yaw;
+		*yaw = y;
 	}
 }
 
 bool imu_is_valid(void)
 {
-	return current_data.valid;
+	return shared.data.valid;
+}
+
+void imu_get_stats(imu_stats_t *out)
+{
+	if (out) {
+		memcpy(out, &stats, sizeof(*out));
+	}
 }
@@ -22,7 +22,7 @@ typedef struct {
 	float gyro_y;
 	float gyro_z;
 
-	/* Fused orientation (Madgwick filter output) */
+	/* Fused orientation (computed from the quaternion when read) */
 	float roll;     /* radians */
 	float pitch;    /* radians */
 	float yaw;      /* radians */
@@ -32,6 +32,14 @@ typedef struct {
 	uint32_t last_update_ms;  /* Timestamp of last update */
 } imu_data_t;
 
+/* Sample path statistics */
+typedef struct {
+	uint32_t samples;   /* Samples fused */
+	uint32_t bursts;    /* Sensor reads (one per sample when polled) */
+	uint32_t overruns;  /* FIFO overflows (samples lost) */
+	uint32_t errors;    /* Bus errors */
+} imu_stats_t;
+
 /**
  * Initialize IMU subsystem
  *
@@ -40,13 +48,23 @@ typedef struct {
 int imu_init(void);
 
 /**
- * Update IMU readings (call at 100 Hz from control loop)
- * Reads accelerometer and gyroscope, runs Madgwick filter
+ * Update IMU readings
+ * Reads accelerometer and gyroscope (a blocking bus transfer), runs the
+ * Madgwick filter. Called by the IMU work queue; never from the control
+ * thread. With CONFIG_SEGMENT_IMU_FIFO the IMU thread does this and the
+ * call is a no-op.
  *
  * @return 0 on success, negative on error
  */
 int imu_update(void);
 
+/**
+ * Ask for a polled update (call at 100 Hz from control loop)
+ * Returns at once: imu_update() runs on the preemptible IMU work queue.
+ * A no-op with CONFIG_SEGMENT_IMU_FIFO or while the IMU is not working.
+ */
+void imu_request_update(void);
+
 /**
  * Get current IMU data
  *
@@ -56,6 +74,7 @@ void imu_get_data(imu_data_t *data);
 
 /**
  * Get orientation in radians
+ * Converted from the filter quaternion at call time.
  *
  * @param roll Output roll angle
  * @param pitch Output pitch angle
@@ -70,4 +89,11 @@ void imu_get_orientation(float *roll, float *pitch, float *yaw);
  */
 bool imu_is_valid(void);
 
+/**
+ * Get sample path statistics
+ *
+ * @param stats Output: current statistics
+ */
+void imu_get_stats(imu_stats_t *stats);
+
 #endif /* IMU_H */
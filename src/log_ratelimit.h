@@ -0,0 +1,50 @@
+/*
+ * Rate-Limited Logging - For messages that can repeat at packet rate
+ *
+ * LOG_ERR_RL() / LOG_WRN_RL() / LOG_INF_RL() behave like the Zephyr
+ * LOG_* macros but let at most one message per LOG_RATELIMIT_INTERVAL_MS
+ * through per call site. Suppressed messages are counted and the count
+ * is logged with the next message that passes. Messages below the
+ * module's compile-time level are removed by the LOG_* macro itself.
+ *
+ * The per-site state is not locked; racing callers may at worst let an
+ * extra message through or miscount suppressed ones.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LOG_RATELIMIT_H
+#define LOG_RATELIMIT_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LOG_RATELIMIT_INTERVAL_MS 1000
+
+#define Z_SEGMENT_LOG_RL(_log, ...)                                                   \
+	do {                                                                           \
+		static uint32_t _rl_last_ms;                                           \
+		static uint32_t _rl_suppressed;                                        \
+		static bool _rl_started;                                               \
+		uint32_t _rl_now = k_uptime_get_32();                                  \
+                                                                                       \
+		if (!_rl_started || (_rl_now - _rl_last_ms) >= LOG_RATELIMIT_INTERVAL_MS) { \
+			if (_rl_suppressed > 0) {                                      \
+				_log("%u similar messages suppressed", _rl_suppressed); \
+			}                                                              \
+			_log(__VA_ARGS__);                                             \
+			_rl_last_ms = _rl_now;                                         \
+			_rl_suppressed = 0;                                            \
+			_rl_started = true;                                            \
+		} else {                                                               \
+			_rl_suppressed++;                                              \
+		}                                                                      \
+	} while (0)
+
+#define LOG_ERR_RL(...) Z_SEGMENT_LOG_RL(LOG_ERR, __VA_ARGS__)
+#define LOG_WRN_RL(...) Z_SEGMENT_LOG_RL(LOG_WRN, __VA_ARGS__)
+#define LOG_INF_RL(...) Z_SEGMENT_LOG_RL(LOG_INF, __VA_ARGS__)
+
+#endif /* LOG_RATELIMIT_H */
@@ -0,0 +1,124 @@
+/*
+ * LSM6DSO Hardware FIFO Implementation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "lsm6dso_fifo.h"
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/sys/util.h>
+#include <errno.h>
+
+static const struct i2c_dt_spec imu_i2c = I2C_DT_SPEC_GET(DT_NODELABEL(lsm6dso));
+
+uint8_t lsm6dso_odr_code(uint32_t odr_hz)
+{
+	switch (odr_hz) {
+	case 12:   return 0x1;
+	case 26:   return 0x2;
+	case 52:   return 0x3;
+	case 104:  return 0x4;
+	case 208:  return 0x5;
+	case 416:  return 0x6;
+	case 833:  return 0x7;
+	case 1666: return 0x8;
+	default:   return 0;
+	}
+}
+
+int lsm6dso_fifo_configure(uint32_t odr_hz, uint16_t watermark)
+{
+	uint8_t odr = lsm6dso_odr_code(odr_hz);
+	int ret;
+
+	if (odr == 0 || watermark == 0 || watermark > LSM6DSO_FIFO_MAX_WTM) {
+		return -EINVAL;
+	}
+
+	if (!i2c_is_ready_dt(&imu_i2c)) {
+		return -ENODEV;
+	}
+
+	/* Flush anything batched so far by switching to bypass */
+	ret = i2c_reg_write_byte_dt(&imu_i2c, LSM6DSO_REG_FIFO_CTRL4, LSM6DSO_FIFO_MODE_BYPASS);
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* Block data update, auto-increment for burst reads */
+	ret = i2c_reg_write_byte_dt(&imu_i2c, LSM6DSO_REG_CTRL3_C,
+				    LSM6DSO_CTRL3_BDU | LSM6DSO_CTRL3_IF_INC);
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* Same full-scale ranges as the sensitivities used in imu.c */
+	ret = i2c_reg_write_byte_dt(&imu_i2c, LSM6DSO_REG_CTRL1_XL,
+				    (odr << 4) | LSM6DSO_FS_XL_2G);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = i2c_reg_write_byte_dt(&imu_i2c, LSM6DSO_REG_CTRL2_G,
+				    (odr << 4) | LSM6DSO_FS_G_2000DPS);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = i2c_reg_write_byte_dt(&imu_i2c, LSM6DSO_REG_CTRL10_C, LSM6DSO_CTRL10_TIMESTAMP_EN);
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* Watermark */
+	ret = i2c_reg_write_byte_dt(&imu_i2c, LSM6DSO_REG_FIFO_CTRL1, watermark & 0xFF);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = i2c_reg_write_byte_dt(&imu_i2c, LSM6DSO_REG_FIFO_CTRL2, (watermark >> 8) & 0x01);
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* Batch both sensors at the ODR */
+	ret = i2c_reg_write_byte_dt(&imu_i2c, LSM6DSO_REG_FIFO_CTRL3, (odr << 4) | odr);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = i2c_reg_write_byte_dt(&imu_i2c, LSM6DSO_REG_INT1_CTRL, LSM6DSO_INT1_FIFO_TH);
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* Continuous mode, timestamp word with every batch */
+	return i2c_reg_write_byte_dt(&imu_i2c, LSM6DSO_REG_FIFO_CTRL4,
+				     LSM6DSO_DEC_TS_BATCH_1 | LSM6DSO_FIFO_MODE_CONTINUOUS);
+}
+
+int lsm6dso_fifo_level(uint16_t *words, bool *overrun)
+{
+	uint8_t status[2];
+	int ret;
+
+	ret = i2c_burst_read_dt(&imu_i2c, LSM6DSO_REG_FIFO_STATUS1, status, sizeof(status));
+	if (ret < 0) {
+		return ret;
+	}
+
+	*words = status[0] | ((status[1] & LSM6DSO_STATUS2_DIFF_MASK) << 8);
+	*overrun = (status[1] & LSM6DSO_STATUS2_OVR_IA) != 0;
+
+	return 0;
+}
+
+int lsm6dso_fifo_read(uint8_t *buf, uint16_t words)
+{
+	/* Address rolls back to the tag register after each word */
+	return i2c_burst_read_dt(&imu_i2c, LSM6DSO_REG_FIFO_DATA_OUT, buf,
+				 (uint32_t)words * LSM6DSO_FIFO_WORD_SIZE);
+}
@@ -0,0 +1,97 @@
+/*
+ * LSM6DSO Hardware FIFO - Raw register access
+ * Phase 4: IMU Integration
+ *
+ * The Zephyr sensor driver brings the chip up; FIFO mode then takes over
+ * the sample path with direct register access, because the driver has no
+ * FIFO batching API. Every FIFO word is 7 bytes: a tag and a 3-axis
+ * 16-bit sample.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LSM6DSO_FIFO_H
+#define LSM6DSO_FIFO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <zephyr/sys/util.h>
+
+/* Register map (subset) */
+#define LSM6DSO_REG_FIFO_CTRL1       0x07  /* WTM[7:0] */
+#define LSM6DSO_REG_FIFO_CTRL2       0x08  /* WTM[8] */
+#define LSM6DSO_REG_FIFO_CTRL3       0x09  /* BDR_GY[7:4] BDR_XL[3:0] */
+#define LSM6DSO_REG_FIFO_CTRL4       0x0A  /* DEC_TS_BATCH[7:6] FIFO_MODE[2:0] */
+#define LSM6DSO_REG_INT1_CTRL        0x0D
+#define LSM6DSO_REG_CTRL1_XL         0x10
+#define LSM6DSO_REG_CTRL2_G          0x11
+#define LSM6DSO_REG_CTRL3_C          0x12
+#define LSM6DSO_REG_CTRL10_C         0x19
+#define LSM6DSO_REG_FIFO_STATUS1     0x3A  /* DIFF_FIFO[7:0] */
+#define LSM6DSO_REG_FIFO_STATUS2     0x3B  /* Flags, DIFF_FIFO[9:8] */
+#define LSM6DSO_REG_FIFO_DATA_OUT    0x78  /* TAG, then X/Y/Z (rolls back) */
+
+/* Field values */
+#define LSM6DSO_FIFO_MODE_BYPASS     0x00
+#define LSM6DSO_FIFO_MODE_CONTINUOUS 0x06
+#define LSM6DSO_DEC_TS_BATCH_1       (0x01 << 6)
+#define LSM6DSO_INT1_FIFO_TH         BIT(3)
+#define LSM6DSO_CTRL3_BDU            BIT(6)
+#define LSM6DSO_CTRL3_IF_INC         BIT(2)
+#define LSM6DSO_CTRL10_TIMESTAMP_EN  BIT(5)
+#define LSM6DSO_FS_XL_2G             (0x0 << 2)
+#define LSM6DSO_FS_G_2000DPS         (0x3 << 2)
+#define LSM6DSO_STATUS2_WTM_IA       BIT(7)
+#define LSM6DSO_STATUS2_OVR_IA       BIT(6)
+#define LSM6DSO_STATUS2_DIFF_MASK    0x03
+
+/* FIFO word tags (TAG_SENSOR, upper 5 bits of tag byte) */
+#define LSM6DSO_TAG_GYRO             0x01
+#define LSM6DSO_TAG_ACCEL            0x02
+#define LSM6DSO_TAG_TIMESTAMP        0x04
+
+#define LSM6DSO_FIFO_WORD_SIZE       7
+#define LSM6DSO_FIFO_MAX_WTM         511
+
+/* Timestamp resolution (typical, 25 us/LSB) */
+#define LSM6DSO_TIMESTAMP_LSB_S      25e-6f
+
+/**
+ * Get the ODR/BDR register code for a rate
+ *
+ * @param odr_hz Rate in Hz (12, 26, 52, 104, 208, 416, 833, 1666)
+ * @return 4-bit code, 0 for unsupported rates
+ */
+uint8_t lsm6dso_odr_code(uint32_t odr_hz);
+
+/**
+ * Configure sensors and FIFO for continuous batching
+ * Accel ±2g and gyro ±2000 dps at odr_hz, both batched at odr_hz, one
+ * timestamp word per batch, watermark routed to INT1.
+ *
+ * @param odr_hz Output/batch data rate (see lsm6dso_odr_code)
+ * @param watermark FIFO threshold in words (1 - LSM6DSO_FIFO_MAX_WTM)
+ * @return 0 on success, negative errno on error
+ */
+int lsm6dso_fifo_configure(uint32_t odr_hz, uint16_t watermark);
+
+/**
+ * Read FIFO fill level
+ *
+ * @param words Output: number of unread words
+ * @param overrun Output: true if samples were lost since last read
+ * @return 0 on success, negative errno on error
+ */
+int lsm6dso_fifo_level(uint16_t *words, bool *overrun);
+
+/**
+ * Read words from the FIFO in one I2C burst
+ *
+ * @param buf Output buffer (words * LSM6DSO_FIFO_WORD_SIZE bytes)
+ * @param words Number of words to read
+ * @return 0 on success, negative errno on error
+ */
+int lsm6dso_fifo_read(uint8_t *buf, uint16_t words);
+
+#endif /* LSM6DSO_FIFO_H */
@@ -9,6 +9,7 @@
 #define MADGWICK_H
 
 #include <math.h>
+#include <stdint.h>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -38,7 +39,42 @@ static inline void madgwick_init(madgwick_t *m, float sample_freq, float beta)
 }
 
 /**
- * Update filter with gyroscope and accelerometer data
+ * Fast approximate 1/sqrt(x)
+ * Bit-level initial guess plus one Newton step, relative error < 0.18%.
+ * Good enough for normalizing directions (accelerometer, gradient step).
+ *
+ * @param x Input (> 0)
+ * @return Approximate 1/sqrt(x)
+ */
+static inline float madgwick_inv_sqrt(float x)
+{
+	union {
+		float f;
+		uint32_t i;
+	} conv = { .f = x };
+
+	conv.i = 0x5F3759DFu - (conv.i >> 1);
+
+	return conv.f * (1.5f - 0.5f * x * conv.f * conv.f);
+}
+
+/**
+ * Fast 1/sqrt(x) with a second Newton step (relative error < 5e-6)
+ * Used for the quaternion, whose norm would otherwise settle slightly
+ * below 1 and bias the Euler angles.
+ *
+ * @param x Input (> 0)
+ * @return Approximate 1/sqrt(x)
+ */
+static inline float madgwick_inv_sqrt_refined(float x)
+{
+	float y = madgwick_inv_sqrt(x);
+
+	return y * (1.5f - 0.5f * x * y * y);
+}
+
+/**
+ * Update filter with gyroscope and accelerometer data over a measured interval
  *
  * @param m Pointer to Madgwick structure
  * @param gx Gyroscope x-axis (rad/s)
@@ -47,9 +83,10 @@ static inline void madgwick_init(madgwick_t *m, float sample_freq, float beta)
  * @param ax Accelerometer x-axis (any units, will be normalized)
  * @param ay Accelerometer y-axis
  * @param az Accelerometer z-axis
+ * @param dt Time since previous update (seconds)
  */
-static inline void madgwick_update(madgwick_t *m, float gx, float gy, float gz,
-                                    float ax, float ay, float az)
+static inline void madgwick_update_dt(madgwick_t *m, float gx, float gy, float gz,
+                                      float ax, float ay, float az, float dt)
 {
 	float recip_norm;
 	float s0, s1, s2, s3;
@@ -65,7 +102,7 @@ static inline void madgwick_update(madgwick_t *m, float gx, float gy, float gz,
 	/* Compute feedback only if accelerometer measurement valid */
 	if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
 		/* Normalize accelerometer measurement */
-		recip_norm = 1.0f / sqrtf(ax * ax + ay * ay + az * az);
+		recip_norm = madgwick_inv_sqrt(ax * ax + ay * ay + az * az);
 		ax *= recip_norm;
 		ay *= recip_norm;
 		az *= recip_norm;
@@ -94,7 +131,7 @@ static inline void madgwick_update(madgwick_t *m, float gx, float gy, float gz,
 		s3 = 4.0f * q1q1 * m->q3 - _2q1 * ax + 4.0f * q2q2 * m->q3 - _2q2 * ay;
 
 		/* Normalize step magnitude */
-		recip_norm = 1.0f / sqrtf(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+		recip_norm = madgwick_inv_sqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
 		s0 *= recip_norm;
 		s1 *= recip_norm;
 		s2 *= recip_norm;
@@ -108,28 +145,48 @@ static inline void madgwick_update(madgwick_t *m, float gx, float gy, float gz,
 	}
 
 	/* Integrate rate of change of quaternion to yield quaternion */
-	m->q0 += q_dot1 * (1.0f / m->sample_freq);
-	m->q1 += q_dot2 * (1.0f / m->sample_freq);
-	m->q2 += q_dot3 * (1.0f / m->sample_freq);
-	m->q3 += q_dot4 * (1.0f / m->sample_freq);
+	m->q0 += q_dot1 * dt;
+	m->q1 += q_dot2 * dt;
+	m->q2 += q_dot3 * dt;
+	m->q3 += q_dot4 * dt;
 
 	/* Normalize quaternion */
-	recip_norm = 1.0f / sqrtf(m->q0 * m->q0 + m->q1 * m->q1 + m->q2 * m->q2 + m->q3 * m->q3);
+	recip_norm = madgwick_inv_sqrt_refined(m->q0 * m->q0 + m->q1 * m->q1 +
+					       m->q2 * m->q2 + m->q3 * m->q3);
 	m->q0 *= recip_norm;
 	m->q1 *= recip_norm;
 	m->q2 *= recip_norm;
 	m->q3 *= recip_norm;
 }
 
+/**
+ * Update filter with gyroscope and accelerometer data at the nominal rate
+ *
+ * @param m Pointer to Madgwick structure
+ * @param gx Gyroscope x-axis (rad/s)
+ * @param gy Gyroscope y-axis (rad/s)
+ * @param gz Gyroscope z-axis (rad/s)
+ * @param ax Accelerometer x-axis (any units, will be normalized)
+ * @param ay Accelerometer y-axis
+ * @param az Accelerometer z-axis
+ */
+static inline void madgwick_update(madgwick_t *m, float gx, float gy, float gz,
+                                    float ax, float ay, float az)
+{
+	madgwick_update_dt(m, gx, gy, gz, ax, ay, az, 1.0f / m->sample_freq);
+}
+
 /**
  * Get Euler angles from quaternion
+ * Costs two atan2f and one asinf; call when the angles are needed, not
+ * after every update.
  *
  * @param m Pointer to Madgwick structure
  * @param roll Output roll angle (radians)
  * @param pitch Output pitch angle (radians)
  * @param yaw Output yaw angle (radians)
  */
-static inline void madgwick_get_euler(madgwick_t *m, float *roll, float *pitch, float *yaw)
+static inline void madgwick_get_euler(const madgwick_t *m, float *roll, float *pitch, float *yaw)
 {
 	/* Roll (x-axis rotation) */
 	float sinr_cosp = 2.0f * (m->q0 * m->q1 + m->q2 * m->q3);
@@ -1,5 +1,5 @@
 /*
- * Segment Controller Firmware - Phase 5: TMC9660 Motor Driver
+ * Segment Controller Firmware - Phase 7: Real-Time Control Loop
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -7,26 +7,41 @@
 #include <zephyr/kernel.h>
 #include <zephyr/sys/printk.h>
 #include <zephyr/version.h>
+#include "config.h"
 #include "network.h"
 #include "packet.h"
 #include "imu.h"
+#include "encoder.h"
+#include "capgrid.h"
+#include "calib.h"
+#include "trace.h"
 #include "tmc9660.h"
+#include "control.h"
+#include "feedback.h"
+#include "estop.h"
+#include "sysmon.h"
+#include "timesync.h"
+#include "trajectory_mcast.h"
+#include "trajectory_buffer.h"
 
 /* Segment ID - default 0 (unconfigured) */
 #define MY_SEGMENT_ID 0
 
 /* Feedback thread timing */
 #define DIAGNOSTICS_INTERVAL_MS 1000  /* 1 Hz */
-#define IMU_UPDATE_INTERVAL_MS 100     /* 10 Hz (will be 100 Hz in Phase 7) */
+#define CONTROL_STATS_INTERVAL_MS 10000  /* 0.1 Hz */
 
-static bool servers_started = false;
+static bool ready_reported = false;
 
 int main(void)
 {
 	int ret;
 	char ip_addr[32];
 	uint32_t last_diag_time = 0;
-	uint32_t last_imu_time = 0;
+	uint32_t last_stats_time = 0;
+	calib_zero_offsets_t zero_offsets;
+	static uint16_t baseline[CAPACITIVE_GRID_POINTS];  /* Off the 2 KB main stack */
+	bool have_baseline;
 
 	printk("\n");
 	printk("========================================\n");
@@ -41,8 +56,14 @@ int main(void)
 	/* Set segment ID */
 	packet_set_segment_id(MY_SEGMENT_ID);
 
+	/* Phase 10: Event trace, first so that bring-up traffic is recorded */
+	ret = trace_start(MY_SEGMENT_ID);
+	if (ret == 0) {
+		printk("[Phase 10] Event trace: OK (TRACE_CONTROL to dump or stream)\n");
+	}
+
 	/* Phase 2: Initialize networking */
-	ret = network_init();
+	ret = network_init(MY_SEGMENT_ID);
 	if (ret < 0) {
 		printk("ERROR: Network initialization failed: %d\n", ret);
 		printk("Phase 2 FAILED - stopping here\n");
@@ -50,7 +71,20 @@ int main(void)
 	}
 
 	printk("[Phase 2] Network initialization started\n");
-	printk("Waiting for DHCP to assign IP address...\n\n");
+	printk("Waiting for an IP address...\n\n");
+
+	/* Phase 7: Shared clock with the master (requests start once there is one) */
+	timesync_start();
+
+	/* Phase 9: Calibration from flash (later changes are written in the background) */
+	ret = calib_init();
+	if (ret == 0) {
+		printk("[Phase 9] Calibration: zero offsets %s, capacitive baseline %s\n",
+		       calib_get_zero_offsets(&zero_offsets) ? "stored" : "not set",
+		       calib_get_capgrid_baseline(baseline) ? "stored" : "not set");
+	} else if (ret != -ENOTSUP) {
+		printk("Warning: Calibration store unavailable: %d - RAM only\n", ret);
+	}
 
 	/* Phase 4: Initialize IMU */
 	ret = imu_init();
@@ -73,31 +107,82 @@ int main(void)
 		if (tmc9660_is_ready((tmc9660_motor_id_t)i)) {
 			tmc9660_state_t tmc_state;
 			tmc9660_get_state((tmc9660_motor_id_t)i, &tmc_state);
-			printk("  Motor %s: OK (type=0x%08X, v%u, BL=%u.%u)\n",
+			printk("  Motor %s: OK (type=0x%08X, v%u, BL=%u.%u, %u %s)\n",
 			       motor_names[i],
 			       tmc_state.chip_type,
 			       tmc_state.chip_version,
 			       (tmc_state.bootloader_version >> 16) & 0xFFFF,
-			       tmc_state.bootloader_version & 0xFFFF);
+			       tmc_state.bootloader_version & 0xFFFF,
+			       tmc_state.baud,
+			       IS_ENABLED(CONFIG_SEGMENT_TMC9660_SPI) ? "Hz SPI" : "baud");
 		} else {
 			printk("  Motor %s: NOT CONNECTED\n", motor_names[i]);
 		}
 	}
 	printk("\n");
 
+	/* Phase 7: Driver enable line for emergency stop */
+	ret = estop_init();
+	if (ret < 0) {
+		printk("ERROR: Failed to initialize emergency stop: %d\n", ret);
+		return ret;
+	}
+
+	/* Phase 7: Encoder feedback (sampled by the control loop) */
+	ret = encoder_init();
+	if (ret == 0) {
+		printk("[Phase 7] Encoders: OK (M/T velocity, alpha-beta-gamma filter)\n");
+
+		/* Phase 9: stored zero, from the counts at the last SET_ZERO_OFFSET */
+		if (calib_get_zero_offsets(&zero_offsets)) {
+			encoder_set_zero(zero_offsets.encoder_zero);
+		}
+	} else if (ret != -ENOTSUP) {
+		printk("Warning: Encoder init failed: %d - reporting set point\n", ret);
+	}
+
+	/* Phase 6: Empty trajectory buffer before producer/consumer start */
+	trajectory_buffer_init();
+
+	/* Phase 7: Motor state streamer (fed by the control loop) */
+	ret = feedback_start(MY_SEGMENT_ID);
+	if (ret < 0) {
+		printk("ERROR: Failed to start feedback streamer: %d\n", ret);
+		return ret;
+	}
+
+	/* Phase 8: Capacitive grid streamer (own thread, below feedback) */
+	have_baseline = calib_get_capgrid_baseline(baseline);
+	if (have_baseline) {
+		capgrid_set_baseline(baseline);
+	}
+	ret = capgrid_start(MY_SEGMENT_ID);
+	if (ret == 0) {
+		printk("[Phase 8] Capacitive grid: OK (%u points at %u Hz, %s baseline)\n",
+		       CAPACITIVE_GRID_POINTS, CAPGRID_RATE_HZ,
+		       have_baseline ? "stored" : "startup");
+	} else if (ret != -ENOTSUP) {
+		printk("Warning: Capacitive grid init failed: %d - not streaming\n", ret);
+	}
+
+	/* Phase 7: Start fixed-rate control loop (IMU fusion runs in it) */
+	ret = control_start();
+	if (ret < 0) {
+		printk("ERROR: Failed to start control loop: %d\n", ret);
+		return ret;
+	}
+
 	/* Main loop */
 	while (1) {
 		k_sleep(K_SECONDS(1));
 
+		/* Phase 7: CPU load, stack headroom, temperatures (1 Hz) */
+		sysmon_update();
+
 		if (network_is_ready()) {
-			/* Start servers once after DHCP success */
-			if (!servers_started) {
-				ret = network_start_servers();
-				if (ret < 0) {
-					printk("ERROR: Failed to start servers: %d\n", ret);
-					return ret;
-				}
-				servers_started = true;
+			/* Servers are started by the network layer once bound */
+			if (!ready_reported) {
+				ready_reported = true;
 
 				printk("[Phase 3] Packet Protocol - READY\n");
 				printk("Listening for commands on:\n");
@@ -111,26 +196,20 @@ int main(void)
 
 			uint32_t now = k_uptime_get_32();
 
-			/* Update IMU periodically (10 Hz for now) */
-			if (now - last_imu_time >= IMU_UPDATE_INTERVAL_MS) {
-				if (imu_is_valid()) {
-					ret = imu_update();
-					if (ret < 0) {
-						printk("Warning: IMU update failed: %d\n", ret);
-					}
-				}
-				last_imu_time = now;
-			}
-
 			/* Send diagnostics packet periodically (1 Hz) */
 			if (now - last_diag_time >= DIAGNOSTICS_INTERVAL_MS) {
 				diagnostics_packet_t diag_pkt;
+				diagnostics_ext_packet_t diag_ext_pkt;
+
 				packet_build_diagnostics(&diag_pkt, MY_SEGMENT_ID);
+				packet_build_diagnostics_ext(&diag_ext_pkt, MY_SEGMENT_ID);
 
 				/* Try to send via TCP (will fail if no client connected) */
 				ret = network_send_tcp((uint8_t *)&diag_pkt, sizeof(diag_pkt));
 				if (ret > 0) {
-					printk("[Feedback] Sent DIAGNOSTICS packet (%d bytes)\n", ret);
+					printk("[Feedback] Sent DIAGNOSTICS packet (%zu bytes, %d masters)\n",
+					       sizeof(diag_pkt), ret);
+					network_send_tcp((uint8_t *)&diag_ext_pkt, sizeof(diag_ext_pkt));
 				}
 
 				last_diag_time = now;
@@ -140,6 +219,108 @@ int main(void)
 			/* Still waiting for network */
 			printk("Heartbeat: Waiting for network...\n");
 		}
+
+		/* Report control loop timing periodically */
+		uint32_t now_ms = k_uptime_get_32();
+
+		if (now_ms - last_stats_time >= CONTROL_STATS_INTERVAL_MS) {
+			control_stats_t cs;
+
+			control_get_stats(&cs);
+			printk("[Control] cycles=%u missed=%u exec=%u/%u/%u us (last/avg/max) "
+			       "jitter=%u/%u us (last/max)\n",
+			       cs.cycle_count, cs.missed_deadlines,
+			       cs.exec_time_us, cs.exec_time_avg_us, cs.exec_time_max_us,
+			       cs.jitter_us, cs.jitter_max_us);
+
+			feedback_stats_t fs;
+
+			feedback_get_stats(&fs);
+			printk("[Feedback] published=%u sent=%u dropped=%u errors=%u\n",
+			       fs.published, fs.sent, fs.dropped, fs.send_errors);
+
+			timesync_stats_t ts;
+
+			timesync_get_stats(&ts);
+			printk("[Sync] state=%u offset=%d us delay=%u us rate=%d ppb "
+			       "samples=%u rejected=%u steps=%u\n",
+			       ts.state, ts.offset_us, ts.delay_us, ts.rate_ppb,
+			       ts.accepted, ts.rejected, ts.steps);
+
+			if (IS_ENABLED(CONFIG_SEGMENT_TRAJ_MULTICAST)) {
+				trajectory_mcast_stats_t ms;
+
+				trajectory_mcast_get_stats(&ms);
+				printk("[MCAST] frames=%u slices=%u invalid=%u gaps=%u lost=%u "
+				       "resent=%u timeouts=%u late=%u\n",
+				       ms.frames, ms.slices, ms.invalid, ms.gaps, ms.lost,
+				       ms.retransmits, ms.timeouts, ms.late);
+			}
+
+			if (IS_ENABLED(CONFIG_SEGMENT_CAPGRID)) {
+				capgrid_stats_t gs;
+
+				capgrid_get_stats(&gs);
+				printk("[Grid] frames=%u sent=%u scan_errors=%u send_errors=%u "
+				       "process=%u cycles\n",
+				       gs.frames, gs.sent, gs.scan_errors, gs.send_errors,
+				       gs.process_cycles);
+			}
+
+			calib_stats_t cal;
+
+			calib_get_stats(&cal);
+			printk("[Calib] updates=%u writes=%u write_errors=%u\n",
+			       cal.updates, cal.writes, cal.write_errors);
+
+			if (IS_ENABLED(CONFIG_SEGMENT_TRACE)) {
+				trace_stats_t ts;
+
+				trace_get_stats(&ts);
+				printk("[Trace] recorded=%u dumps=%u sent=%u send_errors=%u lost=%u\n",
+				       ts.recorded, ts.dumps, ts.sent, ts.send_errors, ts.lost);
+			}
+
+			estop_stats_t es;
+
+			estop_get_stats(&es);
+			printk("[E-Stop] count=%u latency=%u/%u us (last/max)\n",
+			       es.count, es.last_latency_us, es.max_latency_us);
+
+			imu_stats_t is;
+
+			imu_get_stats(&is);
+			printk("[IMU] samples=%u reads=%u overruns=%u errors=%u\n",
+			       is.samples, is.bursts, is.overruns, is.errors);
+
+			network_pool_stats_t ns;
+
+			if (network_get_pool_stats(&ns) == 0) {
+				printk("[Net] pkt rx %u/%u tx %u/%u (max used/total), "
+				       "buf rx %u/%u tx %u/%u (used/total)\n",
+				       ns.rx_pkt_max_used, ns.rx_pkt_count,
+				       ns.tx_pkt_max_used, ns.tx_pkt_count,
+				       ns.rx_buf_used, ns.rx_buf_count,
+				       ns.tx_buf_used, ns.tx_buf_count);
+			}
+
+			sysmon_data_t sd;
+
+			sysmon_get(&sd);
+			printk("[System] cpu=%u%% stack free=%u/%u/%u/%u/%u bytes "
+			       "(net/control/feedback/imu/main)\n",
+			       sd.cpu_usage,
+			       sd.stack_unused[SYSMON_THREAD_NET],
+			       sd.stack_unused[SYSMON_THREAD_CONTROL],
+			       sd.stack_unused[SYSMON_THREAD_FEEDBACK],
+			       sd.stack_unused[SYSMON_THREAD_IMU],
+			       sd.stack_unused[SYSMON_THREAD_MAIN]);
+
+			if (IS_ENABLED(CONFIG_SEGMENT_FOOTPRINT_AUDIT)) {
+				sysmon_print_stacks();
+			}
+			last_stats_time = now_ms;
+		}
 	}
 
 	return 0;
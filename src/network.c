@@ -1,11 +1,26 @@
 /*
  * Network Layer - Phase 3: TCP/UDP Sockets
  *
+ * One thread polls the UDP socket, the TCP listener and up to
+ * NETWORK_MAX_CLIENTS master connections, so a standby master can stay
+ * connected and take over by sending its first command. With
+ * CONFIG_SEGMENT_TRAJ_MULTICAST it also polls the multicast trajectory
+ * socket.
+ *
  * SPDX-License-Identifier: Apache-2.0
  */
 
 #include "network.h"
 #include "packet.h"
+#include "packet_framer.h"
+#include "estop.h"
+#include "feedback.h"
+#include "timesync.h"
+#include "trajectory_mcast.h"
+#include "trace.h"
+#include "seqlock.h"
+#include "persist.h"
+#include "log_ratelimit.h"
 #include <zephyr/kernel.h>
 #include <zephyr/net/net_if.h>
 #include <zephyr/net/net_core.h>
@@ -14,63 +29,221 @@
 #include <zephyr/net/dhcpv4.h>
 #include <zephyr/net/net_ip.h>
 #include <zephyr/net/socket.h>
+#include <zephyr/net/net_pkt.h>
 #include <zephyr/sys/printk.h>
+#include <zephyr/logging/log.h>
 #include <zephyr/posix/arpa/inet.h>
 #include <string.h>
 #include <errno.h>
 
+LOG_MODULE_REGISTER(net_srv, CONFIG_SEGMENT_NET_LOG_LEVEL);
+
 /* Network interface */
 static struct net_if *iface = NULL;
 
 /* Network management event handler */
 static struct net_mgmt_event_callback mgmt_cb;
 
-/* Network ready flag */
+/* Network ready flag (address bound and servers running) */
 static bool net_ready = false;
 
+/* Address in use, and a static/cached one added before DHCP confirmed it */
+static struct in_addr bound_addr;
+static struct in_addr fast_boot_addr;
+
+/* Servers are started from the system work queue once an address is bound */
+static void network_bound_work_handler(struct k_work *work);
+static K_WORK_DEFINE(network_bound_work, network_bound_work_handler);
+static atomic_t servers_started = ATOMIC_INIT(0);
+
+static int network_start_servers(void);
+
+#ifdef CONFIG_SEGMENT_NET_CACHED_LEASE
+/* PERSIST_ID_NET_LEASE record; addresses in network byte order */
+typedef struct {
+	uint32_t addr;
+	uint32_t netmask;
+} network_lease_t;
+
+static network_lease_t pending_lease;
+static atomic_t lease_pending = ATOMIC_INIT(0);
+#endif
+
 /* Sockets */
 static int tcp_sock = -1;
 static int udp_sock = -1;
-static int tcp_client_sock = -1;
+static int mcast_sock = -1;
+
+/*
+ * Connected masters. Only the server thread opens and closes client
+ * sockets; clients_lock keeps network_send_tcp() from using a socket
+ * while it is being closed, and guards the unsent tails.
+ *
+ * A non-blocking send() can take only part of a packet when the TCP
+ * window is nearly full. The rest is kept as the client's tail and goes
+ * out before anything else, so the master never sees a cut packet
+ * followed by the start of another one. While a tail is waiting, new
+ * packets for that client are refused whole (-EAGAIN).
+ */
+typedef struct {
+	int sock;
+	struct sockaddr_in addr;
+	packet_framer_t framer;  /* TCP stream reassembly (too large for a stack) */
+	uint8_t tail[NETWORK_TCP_MAX_SIZE];
+	size_t tail_len;         /* Unsent end of the last packet */
+	bool broken;             /* Tail lost to a send error: closed by the server thread */
+} network_client_t;
+
+static network_client_t clients[NETWORK_MAX_CLIENTS];
+static K_MUTEX_DEFINE(clients_lock);
 
-/* Master address (for sending feedback) */
+static int network_flush_tail(network_client_t *c);
+
+/*
+ * Feedback destination: the TCP master that sent the last command (or
+ * connected first), else the last UDP sender. Read by the feedback
+ * thread on every packet, so it is published through a seqlock.
+ */
 static struct sockaddr_in master_addr;
-static bool master_connected = false;
+static seqlock_t master_lock = SEQLOCK_INIT;
+static int active_client = -1;
+
+/* Client whose packets are being dispatched (server thread only) */
+static int command_client = -1;
+
+/* Single server thread: UDP (emergency stop) needs the highest
+ * preemptible priority, and TCP is serviced by the same loop */
+#define NET_THREAD_STACK_SIZE 2048
+#define NET_THREAD_PRIORITY   1
+
+K_THREAD_STACK_DEFINE(net_thread_stack, NET_THREAD_STACK_SIZE);
+static struct k_thread net_thread_data;
+
+/* Poll set: UDP first so an emergency stop is always handled first */
+enum {
+	POLL_UDP = 0,
+	POLL_MCAST,
+	POLL_LISTEN,
+	POLL_CLIENTS,
+	POLL_COUNT = POLL_CLIENTS + NETWORK_MAX_CLIENTS,
+};
+
+/* Keepalive: a dead master is detected after idle + intvl * cnt seconds */
+#define TCP_KEEPALIVE_IDLE_S  2
+#define TCP_KEEPALIVE_INTVL_S 1
+#define TCP_KEEPALIVE_CNT     3
+
+static void network_bound_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
 
-/* Thread stacks */
-#define TCP_THREAD_STACK_SIZE 2048
-#define UDP_THREAD_STACK_SIZE 2048
+	if (atomic_cas(&servers_started, 0, 1)) {
+		int ret = network_start_servers();
 
-K_THREAD_STACK_DEFINE(tcp_thread_stack, TCP_THREAD_STACK_SIZE);
-K_THREAD_STACK_DEFINE(udp_thread_stack, UDP_THREAD_STACK_SIZE);
+		if (ret < 0) {
+			printk("ERROR: Failed to start servers: %d\n", ret);
+			atomic_set(&servers_started, 0);
+		} else {
+			net_ready = true;
+		}
+	}
 
-static struct k_thread tcp_thread_data;
-static struct k_thread udp_thread_data;
+#ifdef CONFIG_SEGMENT_NET_CACHED_LEASE
+	/* Flash write: kept out of the net_mgmt callback */
+	if (atomic_cas(&lease_pending, 1, 0)) {
+		int ret = persist_write(PERSIST_ID_NET_LEASE, &pending_lease,
+					sizeof(pending_lease));
 
-/* DHCP event handler */
-static void dhcp_event_handler(struct net_mgmt_event_callback *cb,
-			       uint64_t mgmt_event, struct net_if *iface_cb)
+		if (ret < 0) {
+			LOG_WRN("Lease not cached: %d", ret);
+		}
+	}
+#endif
+}
+
+/* An address is usable: report it once and start the servers */
+static void network_address_bound(const struct in_addr *addr, const char *source)
 {
-	if (mgmt_event == NET_EVENT_IPV4_DHCP_BOUND) {
+	if (bound_addr.s_addr != addr->s_addr) {
 		char addr_str[INET_ADDRSTRLEN];
 
-		/* Get the assigned IP address */
-		struct in_addr *addr = &iface_cb->config.dhcpv4.requested_ip;
-
 		net_addr_ntop(AF_INET, addr, addr_str, sizeof(addr_str));
 
-		printk("\n=== DHCP Success ===\n");
+		printk("\n=== Address Bound (%s) ===\n", source);
 		printk("IP Address assigned: %s\n", addr_str);
 		printk("Network is ready!\n");
 		printk("====================\n\n");
 
-		net_ready = true;
+		bound_addr = *addr;
+	}
+
+	k_work_submit(&network_bound_work);
+}
+
+static void network_add_manual_address(const struct in_addr *addr,
+				       const struct in_addr *netmask)
+{
+	struct in_addr a = *addr;
+
+	if (net_if_ipv4_addr_add(iface, &a, NET_ADDR_MANUAL, 0) == NULL) {
+		printk("ERROR: Could not add address\n");
+		return;
+	}
+
+	net_if_ipv4_set_netmask_by_addr(iface, &a, netmask);
+	fast_boot_addr = a;
+}
+
+/* Segment N (1-8) gets EXPECTED_IP_RANGE_START + N - 1 */
+static bool network_static_address(uint8_t segment_id, struct in_addr *addr)
+{
+	struct in_addr first, last;
+
+	if (segment_id == 0 ||
+	    net_addr_pton(AF_INET, EXPECTED_IP_RANGE_START, &first) < 0 ||
+	    net_addr_pton(AF_INET, EXPECTED_IP_RANGE_END, &last) < 0) {
+		return false;
+	}
+
+	uint32_t host = ntohl(first.s_addr) + segment_id - 1;
+
+	if (host > ntohl(last.s_addr)) {
+		return false;
+	}
+
+	addr->s_addr = htonl(host);
+
+	return true;
+}
+
+/* DHCP event handler */
+static void dhcp_event_handler(struct net_mgmt_event_callback *cb,
+			       uint64_t mgmt_event, struct net_if *iface_cb)
+{
+	if (mgmt_event == NET_EVENT_IPV4_DHCP_BOUND) {
+		/* Get the assigned IP address */
+		struct in_addr addr = iface_cb->config.dhcpv4.requested_ip;
+
+		/* DHCP disagrees with the cached lease: drop the cached address */
+		if (fast_boot_addr.s_addr != 0 && fast_boot_addr.s_addr != addr.s_addr) {
+			printk("Cached address replaced by DHCP lease\n");
+			net_if_ipv4_addr_rm(iface_cb, &fast_boot_addr);
+		}
+		fast_boot_addr.s_addr = 0;
+
+#ifdef CONFIG_SEGMENT_NET_CACHED_LEASE
+		pending_lease.addr = addr.s_addr;
+		pending_lease.netmask = net_if_ipv4_get_netmask_by_addr(iface_cb, &addr).s_addr;
+		atomic_set(&lease_pending, 1);
+#endif
+
+		network_address_bound(&addr, "DHCP");
 	} else if (mgmt_event == NET_EVENT_IPV4_ADDR_ADD) {
 		printk("IPv4 address added to interface\n");
 	}
 }
 
-int network_init(void)
+int network_init(uint8_t segment_id)
 {
 	printk("\n[Phase 2] Initializing Network...\n");
 
@@ -91,9 +264,35 @@ int network_init(void)
 
 	printk("DHCP event handler registered\n");
 
+	if (IS_ENABLED(CONFIG_SEGMENT_NET_STATIC)) {
+		struct in_addr addr, netmask;
+
+		if (network_static_address(segment_id, &addr)) {
+			net_addr_pton(AF_INET, NETWORK_STATIC_NETMASK, &netmask);
+			network_add_manual_address(&addr, &netmask);
+			network_address_bound(&addr, "static");
+			return 0;
+		}
+
+		printk("WARNING: No static address for segment %u, using DHCP\n", segment_id);
+	}
+
+#ifdef CONFIG_SEGMENT_NET_CACHED_LEASE
+	network_lease_t lease;
+
+	if (persist_init() == 0 &&
+	    persist_read(PERSIST_ID_NET_LEASE, &lease, sizeof(lease)) == 0) {
+		struct in_addr addr = { .s_addr = lease.addr };
+		struct in_addr netmask = { .s_addr = lease.netmask };
+
+		/* Usable now; DHCP below confirms or replaces it */
+		network_add_manual_address(&addr, &netmask);
+		network_address_bound(&addr, "cached lease");
+	}
+#endif
+
 	/* Start DHCP */
 	printk("Starting DHCP client...\n");
-	printk("Waiting for IP address (this may take 10-30 seconds)...\n");
 
 	net_dhcpv4_start(iface);
 
@@ -106,9 +305,7 @@ int network_get_ip_address(char *buf, size_t buflen)
 		return -EAGAIN;
 	}
 
-	struct in_addr *addr = &iface->config.dhcpv4.requested_ip;
-
-	if (net_addr_ntop(AF_INET, addr, buf, buflen) == NULL) {
+	if (net_addr_ntop(AF_INET, &bound_addr, buf, buflen) == NULL) {
 		return -EINVAL;
 	}
 
@@ -120,109 +317,367 @@ bool network_is_ready(void)
 	return net_ready;
 }
 
-/* TCP server thread */
-static void tcp_server_thread(void *p1, void *p2, void *p3)
+static void network_set_master(const struct sockaddr_in *addr)
 {
-	ARG_UNUSED(p1);
-	ARG_UNUSED(p2);
-	ARG_UNUSED(p3);
+	k_spinlock_key_t key = seqlock_write_begin(&master_lock);
 
-	uint8_t rx_buffer[NETWORK_RX_BUFFER_SIZE];
-	int ret;
+	if (addr) {
+		master_addr = *addr;
+	} else {
+		memset(&master_addr, 0, sizeof(master_addr));
+	}
 
-	printk("[TCP] Server thread started\n");
+	seqlock_write_end(&master_lock, key);
+}
 
-	while (1) {
-		/* Wait for client connection */
-		struct sockaddr_in client_addr;
-		socklen_t client_addr_len = sizeof(client_addr);
+static void network_get_master(struct sockaddr_in *out)
+{
+	uint32_t seq;
+
+	do {
+		seq = seqlock_read_begin(&master_lock);
+		*out = master_addr;
+	} while (seqlock_read_retry(&master_lock, seq));
+}
+
+static void network_set_active_client(int idx)
+{
+	if (idx == active_client) {
+		return;
+	}
 
-		printk("[TCP] Waiting for client connection on port %d...\n", TCP_LISTEN_PORT);
+	active_client = idx;
+	network_set_master(idx >= 0 ? &clients[idx].addr : NULL);
 
-		tcp_client_sock = accept(tcp_sock, (struct sockaddr *)&client_addr,
-					 &client_addr_len);
+	if (idx >= 0) {
+		char addr_str[INET_ADDRSTRLEN];
 
-		if (tcp_client_sock < 0) {
-			printk("[TCP] Accept failed: %d\n", errno);
-			k_sleep(K_SECONDS(1));
-			continue;
+		inet_ntop(AF_INET, &clients[idx].addr.sin_addr, addr_str, sizeof(addr_str));
+		LOG_INF("Active master: %s:%d", addr_str, ntohs(clients[idx].addr.sin_port));
+	} else {
+		/* A new master has to negotiate the compact format again */
+		feedback_set_format(FEEDBACK_FORMAT_FULL, 1);
+	}
+}
+
+static void network_configure_client(int sock)
+{
+	int one = 1;
+	int idle = TCP_KEEPALIVE_IDLE_S;
+	int intvl = TCP_KEEPALIVE_INTVL_S;
+	int cnt = TCP_KEEPALIVE_CNT;
+
+	/* Commands are small: send replies immediately */
+	if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0) {
+		LOG_WRN("TCP_NODELAY failed: %d", errno);
+	}
+
+	if (setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one)) < 0 ||
+	    setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) < 0 ||
+	    setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &intvl, sizeof(intvl)) < 0 ||
+	    setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &cnt, sizeof(cnt)) < 0) {
+		LOG_WRN("TCP keepalive setup failed: %d", errno);
+	}
+}
+
+static void network_accept_client(void)
+{
+	struct sockaddr_in client_addr;
+	socklen_t client_addr_len = sizeof(client_addr);
+	char addr_str[INET_ADDRSTRLEN];
+	int idx = -1;
+
+	int sock = accept(tcp_sock, (struct sockaddr *)&client_addr, &client_addr_len);
+
+	if (sock < 0) {
+		LOG_ERR_RL("TCP accept failed: %d", errno);
+		return;
+	}
+
+	inet_ntop(AF_INET, &client_addr.sin_addr, addr_str, sizeof(addr_str));
+
+	for (int i = 0; i < NETWORK_MAX_CLIENTS; i++) {
+		if (clients[i].sock < 0) {
+			idx = i;
+			break;
 		}
+	}
 
-		/* Save master address for sending feedback */
-		memcpy(&master_addr, &client_addr, sizeof(master_addr));
-		master_connected = true;
+	if (idx < 0) {
+		LOG_WRN("TCP client %s rejected: %d masters connected",
+			addr_str, NETWORK_MAX_CLIENTS);
+		close(sock);
+		return;
+	}
 
-		char addr_str[INET_ADDRSTRLEN];
-		inet_ntop(AF_INET, &client_addr.sin_addr, addr_str, sizeof(addr_str));
-		printk("[TCP] Client connected from %s:%d\n", addr_str,
-		       ntohs(client_addr.sin_port));
-
-		/* Handle client connection */
-		while (1) {
-			ret = recv(tcp_client_sock, rx_buffer, sizeof(rx_buffer), 0);
-
-			if (ret <= 0) {
-				if (ret < 0) {
-					printk("[TCP] Receive error: %d\n", errno);
-				} else {
-					printk("[TCP] Client disconnected\n");
-				}
-				break;
-			}
+	network_configure_client(sock);
+
+	k_mutex_lock(&clients_lock, K_FOREVER);
+	clients[idx].sock = sock;
+	clients[idx].addr = client_addr;
+	clients[idx].tail_len = 0;
+	clients[idx].broken = false;
+	k_mutex_unlock(&clients_lock);
+
+	packet_framer_init(&clients[idx].framer);
+
+	LOG_INF("TCP client connected from %s:%d", addr_str, ntohs(client_addr.sin_port));
+
+	/* First master gets feedback until another one sends a command */
+	if (active_client < 0) {
+		network_set_active_client(idx);
+	}
+}
+
+static void network_close_client(int idx)
+{
+	network_client_t *c = &clients[idx];
+
+	LOG_INF("TCP session: %u packets, %u bytes skipped, %u CRC errors",
+		c->framer.frames, c->framer.resync_bytes, c->framer.crc_errors);
 
-			printk("[TCP] Received %d bytes\n", ret);
+	k_mutex_lock(&clients_lock, K_FOREVER);
+	close(c->sock);
+	c->sock = -1;
+	c->tail_len = 0;
+	k_mutex_unlock(&clients_lock);
 
-			/* Parse and handle packet */
-			packet_parse_command(rx_buffer, ret);
+	if (idx != active_client) {
+		return;
+	}
+
+	/* Hand over to a standby master without waiting for a command */
+	int next = -1;
+
+	for (int i = 0; i < NETWORK_MAX_CLIENTS; i++) {
+		if (clients[i].sock >= 0) {
+			next = i;
+			break;
 		}
+	}
 
-		/* Close client socket */
-		close(tcp_client_sock);
-		tcp_client_sock = -1;
-		master_connected = false;
+	network_set_active_client(next);
+}
+
+static void network_service_client(int idx)
+{
+	network_client_t *c = &clients[idx];
+	size_t avail;
+	uint8_t *wp = packet_framer_write_ptr(&c->framer, &avail);
+
+	int ret = recv(c->sock, wp, avail, MSG_DONTWAIT);
+
+	if (ret <= 0) {
+		if (ret == 0) {
+			LOG_INF("TCP client disconnected");
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return;
+		} else {
+			LOG_ERR("TCP receive error: %d", errno);
+		}
+		network_close_client(idx);
+		return;
+	}
+
+	trace_record(TRACE_EVT_PKT_RX, TRACE_TRANSPORT_TCP, (uint16_t)ret);
+
+	/* Reassemble and dispatch every complete packet */
+	packet_framer_commit(&c->framer, ret);
+	command_client = idx;
+	ret = packet_framer_process(&c->framer);
+	command_client = -1;
+	if (ret > 0) {
+		/* A master that sends commands is the one in charge */
+		network_set_active_client(idx);
 	}
 }
 
-/* UDP server thread */
-static void udp_server_thread(void *p1, void *p2, void *p3)
+static void network_service_udp(void)
+{
+	/* A quarter of the server stack: only this thread uses it */
+	static uint8_t rx_buffer[NETWORK_RX_BUFFER_SIZE];
+	struct sockaddr_in src_addr;
+	socklen_t src_addr_len = sizeof(src_addr);
+
+	int ret = recvfrom(udp_sock, rx_buffer, sizeof(rx_buffer), MSG_DONTWAIT,
+			   (struct sockaddr *)&src_addr, &src_addr_len);
+
+	uint32_t rx_cycles = k_cycle_get_32();
+
+	if (ret <= 0) {
+		if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			LOG_ERR_RL("UDP receive error: %d", errno);
+		}
+		return;
+	}
+
+	trace_record(TRACE_EVT_PKT_RX, TRACE_TRANSPORT_UDP, (uint16_t)ret);
+
+	/* Emergency stop first: no logging before the motors are off */
+	if (estop_fast_path(rx_buffer, ret, rx_cycles)) {
+		return;
+	}
+
+	/* Time sync replies next: the arrival time is part of the measurement */
+	if (timesync_fast_path(rx_buffer, ret, rx_cycles)) {
+		return;
+	}
+
+	LOG_DBG("UDP received %d bytes", ret);
+
+	/* Without a TCP master, feedback goes to whoever talks UDP */
+	if (active_client < 0) {
+		network_set_master(&src_addr);
+	}
+
+	/* Parse and handle packet */
+	packet_parse_command(rx_buffer, ret);
+}
+
+#ifdef CONFIG_SEGMENT_TRAJ_MULTICAST
+static void network_service_mcast(void)
+{
+	/* Too large for the stack: only this thread uses it */
+	static uint8_t rx_buffer[MULTICAST_MAX_SIZE];
+
+	int ret = recv(mcast_sock, rx_buffer, sizeof(rx_buffer), MSG_DONTWAIT);
+
+	if (ret <= 0) {
+		if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			LOG_ERR_RL("Multicast receive error: %d", errno);
+		}
+		return;
+	}
+
+	if (trajectory_mcast_receive(rx_buffer, ret) < 0) {
+		LOG_WRN_RL("Invalid multicast frame (%d bytes)", ret);
+	}
+}
+
+/* Join the trajectory group; failure leaves the TCP path working */
+static void network_start_mcast(void)
+{
+	struct sockaddr_in bind_addr;
+	struct ip_mreqn mreq;
+
+	memset(&bind_addr, 0, sizeof(bind_addr));
+	memset(&mreq, 0, sizeof(mreq));
+
+	if (net_addr_pton(AF_INET, CONFIG_SEGMENT_TRAJ_MULTICAST_GROUP,
+			  &mreq.imr_multiaddr) < 0 ||
+	    !net_ipv4_is_addr_mcast(&mreq.imr_multiaddr)) {
+		printk("[MCAST] Invalid group %s\n", CONFIG_SEGMENT_TRAJ_MULTICAST_GROUP);
+		return;
+	}
+	mreq.imr_ifindex = net_if_get_by_iface(iface);
+
+	mcast_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (mcast_sock < 0) {
+		printk("[MCAST] Socket creation failed: %d\n", errno);
+		return;
+	}
+
+	bind_addr.sin_family = AF_INET;
+	bind_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	bind_addr.sin_port = htons(CONFIG_SEGMENT_TRAJ_MULTICAST_PORT);
+
+	if (bind(mcast_sock, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) < 0 ||
+	    setsockopt(mcast_sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+		printk("[MCAST] Join failed: %d\n", errno);
+		close(mcast_sock);
+		mcast_sock = -1;
+		return;
+	}
+
+	printk("[MCAST] Trajectories from %s port %d\n",
+	       CONFIG_SEGMENT_TRAJ_MULTICAST_GROUP, CONFIG_SEGMENT_TRAJ_MULTICAST_PORT);
+}
+#endif
+
+/* Server thread: one poll loop for UDP, the listener and all masters */
+static void network_server_thread(void *p1, void *p2, void *p3)
 {
 	ARG_UNUSED(p1);
 	ARG_UNUSED(p2);
 	ARG_UNUSED(p3);
 
-	uint8_t rx_buffer[NETWORK_RX_BUFFER_SIZE];
-	struct sockaddr_in src_addr;
-	socklen_t src_addr_len;
-	int ret;
+	struct zsock_pollfd fds[POLL_COUNT];
 
-	printk("[UDP] Server thread started on port %d\n", UDP_LISTEN_PORT);
+	printk("[Network] Server thread started (UDP %d, TCP %d, %d masters)\n",
+	       UDP_LISTEN_PORT, TCP_LISTEN_PORT, NETWORK_MAX_CLIENTS);
 
 	while (1) {
-		src_addr_len = sizeof(src_addr);
-		ret = recvfrom(udp_sock, rx_buffer, sizeof(rx_buffer), 0,
-			       (struct sockaddr *)&src_addr, &src_addr_len);
+		fds[POLL_UDP].fd = udp_sock;
+		fds[POLL_UDP].events = ZSOCK_POLLIN;
+		fds[POLL_MCAST].fd = mcast_sock;
+		fds[POLL_MCAST].events = ZSOCK_POLLIN;
+		fds[POLL_LISTEN].fd = tcp_sock;
+		fds[POLL_LISTEN].events = ZSOCK_POLLIN;
+		for (int i = 0; i < NETWORK_MAX_CLIENTS; i++) {
+			if (clients[i].broken && clients[i].sock >= 0) {
+				network_close_client(i);
+			}
+
+			/* Negative fd: entry ignored by poll */
+			fds[POLL_CLIENTS + i].fd = clients[i].sock;
+			fds[POLL_CLIENTS + i].events = ZSOCK_POLLIN;
 
-		if (ret <= 0) {
-			if (ret < 0) {
-				printk("[UDP] Receive error: %d\n", errno);
+			/* A tail waiting for window space goes out from here too */
+			if (clients[i].tail_len > 0) {
+				fds[POLL_CLIENTS + i].events |= ZSOCK_POLLOUT;
 			}
+		}
+
+		/* Finite only while multicast slices wait for a resend */
+		int ret = zsock_poll(fds, POLL_COUNT, trajectory_mcast_poll_timeout());
+
+		if (ret < 0) {
+			LOG_ERR_RL("Poll failed: %d", errno);
 			k_sleep(K_MSEC(10));
 			continue;
 		}
 
-		printk("[UDP] Received %d bytes\n", ret);
+		if (fds[POLL_UDP].revents & ZSOCK_POLLIN) {
+			network_service_udp();
+		}
 
-		/* Save master address for sending feedback */
-		if (!master_connected) {
-			memcpy(&master_addr, &src_addr, sizeof(master_addr));
+#ifdef CONFIG_SEGMENT_TRAJ_MULTICAST
+		if (fds[POLL_MCAST].revents & ZSOCK_POLLIN) {
+			network_service_mcast();
 		}
+#endif
 
-		/* Parse and handle packet */
-		packet_parse_command(rx_buffer, ret);
+		for (int i = 0; i < NETWORK_MAX_CLIENTS; i++) {
+			short revents = fds[POLL_CLIENTS + i].revents;
+
+			if (clients[i].sock < 0 || revents == 0) {
+				continue;
+			}
+
+			if (revents & ZSOCK_POLLOUT) {
+				k_mutex_lock(&clients_lock, K_FOREVER);
+				network_flush_tail(&clients[i]);
+				k_mutex_unlock(&clients_lock);
+			}
+
+			if (revents & ZSOCK_POLLIN) {
+				/* recv() reports both data and orderly shutdown */
+				network_service_client(i);
+			} else if (revents & (ZSOCK_POLLERR | ZSOCK_POLLHUP | ZSOCK_POLLNVAL)) {
+				LOG_INF("TCP client connection lost");
+				network_close_client(i);
+			}
+		}
+
+		if (fds[POLL_LISTEN].revents & ZSOCK_POLLIN) {
+			network_accept_client();
+		}
+
+		trajectory_mcast_tick();
 	}
 }
 
-int network_start_servers(void)
+static int network_start_servers(void)
 {
 	int ret;
 	struct sockaddr_in bind_addr;
@@ -249,8 +704,8 @@ int network_start_servers(void)
 		return -errno;
 	}
 
-	/* Listen on TCP socket */
-	ret = listen(tcp_sock, 1);
+	/* Listen on TCP socket (primary and standby masters) */
+	ret = listen(tcp_sock, NETWORK_MAX_CLIENTS);
 	if (ret < 0) {
 		printk("[TCP] Listen failed: %d\n", errno);
 		close(tcp_sock);
@@ -279,19 +734,20 @@ int network_start_servers(void)
 
 	printk("[UDP] Listening on port %d\n", UDP_LISTEN_PORT);
 
-	/* Start TCP server thread */
-	k_thread_create(&tcp_thread_data, tcp_thread_stack,
-			K_THREAD_STACK_SIZEOF(tcp_thread_stack),
-			tcp_server_thread, NULL, NULL, NULL,
-			K_PRIO_COOP(7), 0, K_NO_WAIT);
-	k_thread_name_set(&tcp_thread_data, "tcp_server");
+#ifdef CONFIG_SEGMENT_TRAJ_MULTICAST
+	network_start_mcast();
+#endif
 
-	/* Start UDP server thread */
-	k_thread_create(&udp_thread_data, udp_thread_stack,
-			K_THREAD_STACK_SIZEOF(udp_thread_stack),
-			udp_server_thread, NULL, NULL, NULL,
-			K_PRIO_COOP(7), 0, K_NO_WAIT);
-	k_thread_name_set(&udp_thread_data, "udp_server");
+	for (int i = 0; i < NETWORK_MAX_CLIENTS; i++) {
+		clients[i].sock = -1;
+	}
+
+	/* Start server thread */
+	k_thread_create(&net_thread_data, net_thread_stack,
+			K_THREAD_STACK_SIZEOF(net_thread_stack),
+			network_server_thread, NULL, NULL, NULL,
+			K_PRIO_PREEMPT(NET_THREAD_PRIORITY), 0, K_NO_WAIT);
+	k_thread_name_set(&net_thread_data, "net_server");
 
 	printk("[Phase 3] TCP/UDP servers started successfully\n\n");
 
@@ -300,25 +756,164 @@ int network_start_servers(void)
 
 int network_send_udp(const uint8_t *data, size_t length)
 {
+	struct sockaddr_in dest;
+
 	if (udp_sock < 0) {
 		return -ENOTCONN;
 	}
 
-	/* Use master address if we know it */
-	if (master_connected || master_addr.sin_addr.s_addr != 0) {
-		return sendto(udp_sock, data, length, 0,
-			      (struct sockaddr *)&master_addr,
-			      sizeof(master_addr));
+	network_get_master(&dest);
+	if (dest.sin_addr.s_addr == 0) {
+		return -ENOTCONN;
 	}
 
-	return -ENOTCONN;
+	int ret = sendto(udp_sock, data, length, 0, (struct sockaddr *)&dest, sizeof(dest));
+
+	trace_record(TRACE_EVT_UDP_SEND, (length > 2) ? data[2] : 0,
+		     (uint16_t)((ret < 0) ? -errno : ret));
+
+	return ret;
 }
 
-int network_send_tcp(const uint8_t *data, size_t length)
+/*
+ * Send what is left of the client's last packet; clients_lock held.
+ * A tail that cannot be sent leaves the stream cut, so the client is
+ * marked for closing.
+ */
+static int network_flush_tail(network_client_t *c)
+{
+	while (c->tail_len > 0) {
+		int sent = send(c->sock, c->tail, c->tail_len, MSG_DONTWAIT);
+
+		if (sent < 0) {
+			int err = errno;
+
+			if (err == EAGAIN || err == EWOULDBLOCK) {
+				return -EAGAIN;
+			}
+
+			LOG_WRN_RL("TCP send failed with %zu bytes pending: %d", c->tail_len, err);
+			c->tail_len = 0;
+			c->broken = true;
+			return -err;
+		}
+
+		if (sent == 0) {
+			return -EAGAIN;
+		}
+
+		memmove(c->tail, c->tail + sent, c->tail_len - sent);
+		c->tail_len -= sent;
+	}
+
+	return 0;
+}
+
+/* Send one whole packet to a client, or nothing of it; clients_lock held */
+static int network_send_client(network_client_t *c, const uint8_t *data, size_t length)
 {
-	if (tcp_client_sock < 0 || !master_connected) {
+	if (c->sock < 0) {
 		return -ENOTCONN;
 	}
 
-	return send(tcp_client_sock, data, length, 0);
+	if (c->broken) {
+		return -EPIPE;
+	}
+
+	int ret = network_flush_tail(c);
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* Never block: a stalled master must not hold up the caller */
+	int sent = send(c->sock, data, length, MSG_DONTWAIT);
+
+	if (sent < 0) {
+		return (errno == EWOULDBLOCK) ? -EAGAIN : -errno;
+	}
+
+	/* The TCP window took only part of it: the rest goes out first next time */
+	if ((size_t)sent < length) {
+		memcpy(c->tail, data + sent, length - sent);
+		c->tail_len = length - sent;
+	}
+
+	return (int)length;
+}
+
+int network_send_tcp(const uint8_t *data, size_t length)
+{
+	int taken = 0;
+	int err = -ENOTCONN;
+
+	if (length > NETWORK_TCP_MAX_SIZE) {
+		return -EMSGSIZE;
+	}
+
+	k_mutex_lock(&clients_lock, K_FOREVER);
+
+	for (int i = 0; i < NETWORK_MAX_CLIENTS; i++) {
+		int ret = network_send_client(&clients[i], data, length);
+
+		if (ret >= 0) {
+			taken++;
+		} else if (ret != -ENOTCONN && err != -EAGAIN) {
+			/* A busy master is worth a retry: report that over other errors */
+			err = ret;
+		}
+	}
+
+	k_mutex_unlock(&clients_lock);
+
+	return (taken > 0) ? taken : err;
+}
+
+int network_send_tcp_client(int client, const uint8_t *data, size_t length)
+{
+	int ret;
+
+	if (client < 0 || client >= NETWORK_MAX_CLIENTS) {
+		return -EINVAL;
+	}
+
+	if (length > NETWORK_TCP_MAX_SIZE) {
+		return -EMSGSIZE;
+	}
+
+	k_mutex_lock(&clients_lock, K_FOREVER);
+	ret = network_send_client(&clients[client], data, length);
+	k_mutex_unlock(&clients_lock);
+
+	return ret;
+}
+
+int network_command_client(void)
+{
+	return command_client;
+}
+
+int network_get_pool_stats(network_pool_stats_t *stats)
+{
+#if defined(CONFIG_NET_BUF_POOL_USAGE) && defined(CONFIG_MEM_SLAB_TRACE_MAX_UTILIZATION)
+	struct k_mem_slab *rx, *tx;
+	struct net_buf_pool *rx_data, *tx_data;
+
+	net_pkt_get_info(&rx, &tx, &rx_data, &tx_data);
+
+	stats->rx_pkt_count = k_mem_slab_num_used_get(rx) + k_mem_slab_num_free_get(rx);
+	stats->tx_pkt_count = k_mem_slab_num_used_get(tx) + k_mem_slab_num_free_get(tx);
+	stats->rx_pkt_max_used = k_mem_slab_max_used_get(rx);
+	stats->tx_pkt_max_used = k_mem_slab_max_used_get(tx);
+	stats->rx_buf_count = rx_data->buf_count;
+	stats->tx_buf_count = tx_data->buf_count;
+	stats->rx_buf_used = rx_data->buf_count - atomic_get(&rx_data->avail_count);
+	stats->tx_buf_used = tx_data->buf_count - atomic_get(&tx_data->avail_count);
+
+	return 0;
+#else
+	ARG_UNUSED(stats);
+
+	return -ENOTSUP;
+#endif
 }
@@ -17,29 +17,43 @@
 #define UDP_LISTEN_PORT 6000
 #define MASTER_TCP_PORT 5000
 
-/* DHCP configuration */
+/* DHCP configuration (also the static address plan: segment N gets START + N - 1) */
 #define EXPECTED_IP_RANGE_START "192.168.1.100"
 #define EXPECTED_IP_RANGE_END   "192.168.1.107"
+#define NETWORK_STATIC_NETMASK  "255.255.255.0"
 
 /* Receive buffer size */
 #define NETWORK_RX_BUFFER_SIZE 512
 
+/* Simultaneous TCP masters (primary + hot standby) */
+#define NETWORK_MAX_CLIENTS 2
+
+/* Largest packet network_send_tcp() takes (a full TRACE packet) */
+#define NETWORK_TCP_MAX_SIZE 544
+
+/* Network buffer pool usage (for sizing the pools in prj_rt.conf) */
+typedef struct {
+	uint16_t rx_pkt_count;      /* net_pkt slab sizes */
+	uint16_t tx_pkt_count;
+	uint16_t rx_pkt_max_used;   /* High-water marks since boot */
+	uint16_t tx_pkt_max_used;
+	uint16_t rx_buf_count;      /* net_buf data pool sizes */
+	uint16_t tx_buf_count;
+	uint16_t rx_buf_used;       /* In use right now */
+	uint16_t tx_buf_used;
+} network_pool_stats_t;
+
 /**
  * Initialize network subsystem
  * - Brings up Ethernet interface
- * - Starts DHCP client
- * - Creates UDP and TCP sockets
- *
- * @return 0 on success, negative errno on failure
- */
-int network_init(void);
-
-/**
- * Start TCP/UDP servers (call after DHCP succeeds)
+ * - Assigns the address (CONFIG_SEGMENT_NET_ADDRESS): static from the
+ *   segment ID, cached DHCP lease, or DHCP
+ * - Starts the TCP/UDP servers as soon as an address is bound
  *
+ * @param segment_id Segment ID (1-8), selects the static address
  * @return 0 on success, negative errno on failure
  */
-int network_start_servers(void);
+int network_init(uint8_t segment_id);
 
 /**
  * Get current IP address as string
@@ -59,6 +73,8 @@ bool network_is_ready(void);
 
 /**
  * Send UDP packet to master
+ * Goes to the active TCP master (last one to send a command), or to the
+ * last UDP sender if no master is connected.
  *
  * @param data Pointer to packet data
  * @param length Length of data in bytes
@@ -67,12 +83,46 @@ bool network_is_ready(void);
 int network_send_udp(const uint8_t *data, size_t length);
 
 /**
- * Send TCP packet to master
+ * Send TCP packet to all connected masters
+ * Never blocks, and never leaves a cut packet in a stream: a master takes
+ * the whole packet (the part its TCP window has no room for is sent
+ * before anything else) or none of it, while its send buffer is full.
  *
  * @param data Pointer to packet data
- * @param length Length of data in bytes
- * @return Number of bytes sent, or negative errno on failure
+ * @param length Length of data in bytes, at most NETWORK_TCP_MAX_SIZE
+ * @return Number of masters that took the packet, or negative errno if
+ *         none did: -ENOTCONN none connected, -EAGAIN a master is busy
  */
 int network_send_tcp(const uint8_t *data, size_t length);
 
+/**
+ * Send TCP packet to one master
+ * Same rules as network_send_tcp().
+ *
+ * @param client Master index (network_command_client())
+ * @param data Pointer to packet data
+ * @param length Length of data in bytes, at most NETWORK_TCP_MAX_SIZE
+ * @return length if the master took the packet, -EAGAIN if its send
+ *         buffer is full (retry later), -ENOTCONN if it has disconnected,
+ *         other negative errno on failure
+ */
+int network_send_tcp_client(int client, const uint8_t *data, size_t length);
+
+/**
+ * Get the master whose command is being handled
+ * Valid in command handlers only (they run on the network thread).
+ *
+ * @return Master index for a TCP command, -1 for a UDP command
+ */
+int network_command_client(void);
+
+/**
+ * Get network buffer pool usage
+ * Needs CONFIG_NET_BUF_POOL_USAGE and CONFIG_MEM_SLAB_TRACE_MAX_UTILIZATION.
+ *
+ * @param stats Output: pool sizes and usage
+ * @return 0 on success, -ENOTSUP if usage tracking is disabled
+ */
+int network_get_pool_stats(network_pool_stats_t *stats);
+
 #endif /* NETWORK_H */
@@ -7,15 +7,56 @@
 #include "packet.h"
 #include "crc16.h"
 #include "imu.h"
+#include "encoder.h"
+#include "calib.h"
+#include "config.h"
+#include "trajectory_buffer.h"
+#include "control.h"
+#include "seqlock.h"
+#include "estop.h"
+#include "feedback.h"
+#include "network.h"
+#include "sysmon.h"
+#include "timesync.h"
+#include "trajectory_mcast.h"
+#include "trace.h"
+#include "log_ratelimit.h"
 #include <zephyr/kernel.h>
-#include <zephyr/sys/printk.h>
+#include <zephyr/logging/log.h>
 #include <string.h>
+#include <math.h>
 
-/* Current system state */
-static uint8_t current_mode = MODE_IDLE;
-static bool emergency_stop_active = false;
-static uint16_t error_count = 0;
-static uint8_t last_error = ERROR_NO_ERROR;
+LOG_MODULE_REGISTER(packet, CONFIG_SEGMENT_PACKET_LOG_LEVEL);
+
+/*
+ * Current system state
+ * Written by the network threads, read by the feedback and diagnostics
+ * builders; the seqlock gives readers a consistent copy without a mutex.
+ */
+typedef struct {
+	uint8_t mode;
+	bool emergency_stop_active;
+	uint16_t error_count;
+	uint8_t last_error;
+} packet_state_t;
+
+static packet_state_t state = {
+	.mode = MODE_IDLE,
+	.emergency_stop_active = false,
+	.error_count = 0,
+	.last_error = ERROR_NO_ERROR,
+};
+static seqlock_t state_lock = SEQLOCK_INIT;
+
+static void packet_get_state(packet_state_t *out)
+{
+	uint32_t seq;
+
+	do {
+		seq = seqlock_read_begin(&state_lock);
+		*out = state;
+	} while (seqlock_read_retry(&state_lock, seq));
+}
 
 /* Segment ID (configured at runtime, default 0) */
 static uint8_t my_segment_id = 0;
@@ -25,45 +66,98 @@ void packet_set_segment_id(uint8_t id)
 	my_segment_id = id;
 }
 
+uint8_t packet_get_segment_id(void)
+{
+	return my_segment_id;
+}
+
+void packet_set_emergency_stop(void)
+{
+	k_spinlock_key_t key = seqlock_write_begin(&state_lock);
+
+	state.emergency_stop_active = true;
+	state.mode = MODE_IDLE;
+
+	seqlock_write_end(&state_lock, key);
+}
+
 int packet_parse_command(const uint8_t *data, size_t length)
 {
 	if (length < 6) {
-		printk("[Packet] Error: Packet too short (%zu bytes)\n", length);
-		error_count++;
-		last_error = ERROR_CRC_ERROR;
+		LOG_WRN_RL("Packet too short (%zu bytes)", length);
+		packet_report_error(ERROR_CRC_ERROR);
 		return -1;
 	}
 
 	/* Check magic header */
 	uint16_t magic = data[0] | (data[1] << 8);
 	if (magic != PACKET_MAGIC_MASTER_TO_STM32) {
-		printk("[Packet] Error: Invalid magic header 0x%04X\n", magic);
-		error_count++;
-		last_error = ERROR_CRC_ERROR;
+		LOG_WRN_RL("Invalid magic header 0x%04X", magic);
+		packet_report_error(ERROR_CRC_ERROR);
 		return -1;
 	}
 
 	/* Verify CRC */
 	if (!crc16_verify(data, length)) {
-		printk("[Packet] Error: CRC check failed\n");
-		error_count++;
-		last_error = ERROR_CRC_ERROR;
+		LOG_WRN_RL("CRC check failed");
+		packet_report_error(ERROR_CRC_ERROR);
 		return -1;
 	}
 
+	return packet_dispatch_command(data, length);
+}
+
+void packet_report_error(uint8_t error_code)
+{
+	k_spinlock_key_t key = seqlock_write_begin(&state_lock);
+
+	state.error_count++;
+	state.last_error = error_code;
+
+	seqlock_write_end(&state_lock, key);
+}
+
+size_t packet_command_length(uint8_t packet_type)
+{
+	switch (packet_type) {
+	case CMD_TRAJECTORY:
+		return sizeof(trajectory_packet_t);
+	case CMD_EMERGENCY_STOP:
+		return sizeof(emergency_stop_packet_t);
+	case CMD_START_HOMING:
+		return sizeof(start_homing_packet_t);
+	case CMD_JOG_MOTOR:
+		return sizeof(jog_motor_packet_t);
+	case CMD_SET_MODE:
+		return sizeof(set_mode_packet_t);
+	case CMD_SET_ZERO_OFFSET:
+		return sizeof(set_zero_offset_packet_t);
+	case CMD_SET_FEEDBACK_FORMAT:
+		return sizeof(set_feedback_format_packet_t);
+	case CMD_TIME_SYNC_REPLY:
+		return sizeof(time_sync_reply_packet_t);
+	case CMD_TRACE_CONTROL:
+		return sizeof(trace_control_packet_t);
+	default:
+		return 0;
+	}
+}
+
+static int packet_handle_command(const uint8_t *data, size_t length)
+{
 	/* Get packet type */
 	uint8_t packet_type = data[2];
 
-	printk("[Packet] Received valid packet: type=0x%02X, length=%zu\n",
-	       packet_type, length);
+	LOG_DBG("Received valid packet: type=0x%02X, length=%zu", packet_type, length);
 
 	/* Handle based on packet type */
 	switch (packet_type) {
 	case CMD_TRAJECTORY:
 		if (length == sizeof(trajectory_packet_t)) {
-			packet_handle_trajectory((const trajectory_packet_t *)data);
+			/* May be a resend of a lost multicast frame, or a repeat of one */
+			trajectory_mcast_unicast((const trajectory_packet_t *)data);
 		} else {
-			printk("[Packet] Error: TRAJECTORY size mismatch\n");
+			LOG_WRN_RL("TRAJECTORY size mismatch");
 			return -1;
 		}
 		break;
@@ -72,7 +166,7 @@ int packet_parse_command(const uint8_t *data, size_t length)
 		if (length == sizeof(emergency_stop_packet_t)) {
 			packet_handle_emergency_stop((const emergency_stop_packet_t *)data);
 		} else {
-			printk("[Packet] Error: EMERGENCY_STOP size mismatch\n");
+			LOG_WRN_RL("EMERGENCY_STOP size mismatch");
 			return -1;
 		}
 		break;
@@ -80,16 +174,23 @@ int packet_parse_command(const uint8_t *data, size_t length)
 	case CMD_START_HOMING:
 		if (length == sizeof(start_homing_packet_t)) {
 			const start_homing_packet_t *pkt = (const start_homing_packet_t *)data;
-			printk("[Packet] START_HOMING: mode=%d\n", pkt->homing_mode);
-			current_mode = MODE_HOMING;
+			LOG_INF("START_HOMING: mode=%d", pkt->homing_mode);
+
+			k_spinlock_key_t key = seqlock_write_begin(&state_lock);
+			state.mode = MODE_HOMING;
+			seqlock_write_end(&state_lock, key);
+
+			if (estop_enable_drivers() < 0) {
+				LOG_WRN("START_HOMING: emergency stop latched, drivers stay off");
+			}
 		}
 		break;
 
 	case CMD_JOG_MOTOR:
 		if (length == sizeof(jog_motor_packet_t)) {
 			const jog_motor_packet_t *pkt = (const jog_motor_packet_t *)data;
-			printk("[Packet] JOG_MOTOR: motor=%d, value=%.2f, speed=%d%%\n",
-			       pkt->motor_id, pkt->value, pkt->speed_percent);
+			LOG_INF("JOG_MOTOR: motor=%d, value=%.2f, speed=%d%%",
+				pkt->motor_id, (double)pkt->value, pkt->speed_percent);
 		}
 		break;
 
@@ -101,37 +202,70 @@ int packet_parse_command(const uint8_t *data, size_t length)
 
 	case CMD_SET_ZERO_OFFSET:
 		if (length == sizeof(set_zero_offset_packet_t)) {
-			printk("[Packet] SET_ZERO_OFFSET command received\n");
-			/* Phase 9: Save zero offsets to flash */
+			packet_handle_set_zero_offset((const set_zero_offset_packet_t *)data);
+		}
+		break;
+
+	case CMD_SET_FEEDBACK_FORMAT:
+		if (length == sizeof(set_feedback_format_packet_t)) {
+			const set_feedback_format_packet_t *pkt =
+				(const set_feedback_format_packet_t *)data;
+
+			if (feedback_set_format(pkt->format, pkt->batch) < 0) {
+				LOG_WRN_RL("SET_FEEDBACK_FORMAT: invalid format 0x%02X batch %u",
+					   pkt->format, pkt->batch);
+				return -1;
+			}
+			LOG_INF("SET_FEEDBACK_FORMAT: format=0x%02X, batch=%u",
+				pkt->format, pkt->batch);
+		}
+		break;
+
+	case CMD_TIME_SYNC_REPLY:
+		/* Only meaningful with the UDP arrival time (timesync_fast_path) */
+		LOG_WRN_RL("TIME_SYNC_REPLY over TCP ignored");
+		break;
+
+	case CMD_TRACE_CONTROL:
+		if (length == sizeof(trace_control_packet_t)) {
+			const trace_control_packet_t *pkt = (const trace_control_packet_t *)data;
+			int ret = trace_control(pkt->action, network_command_client());
+
+			if (ret < 0) {
+				LOG_WRN_RL("TRACE_CONTROL: action 0x%02X failed: %d", pkt->action, ret);
+				return -1;
+			}
+			LOG_INF("TRACE_CONTROL: action=0x%02X", pkt->action);
 		}
 		break;
 
 	default:
-		printk("[Packet] Warning: Unknown packet type 0x%02X\n", packet_type);
+		LOG_WRN_RL("Unknown packet type 0x%02X", packet_type);
 		return -1;
 	}
 
 	return packet_type;
 }
 
-void packet_handle_emergency_stop(const emergency_stop_packet_t *pkt)
+int packet_dispatch_command(const uint8_t *data, size_t length)
 {
-	printk("\n");
-	printk("╔═══════════════════════════════╗\n");
-	printk("║   EMERGENCY STOP ACTIVATED    ║\n");
-	printk("╚═══════════════════════════════╝\n");
-	printk("Reason: 0x%02X\n", pkt->stop_reason);
-	printk("Target: segment %d\n", pkt->segment_id);
+	trace_record(TRACE_EVT_PKT_DISPATCH, data[2], (uint16_t)length);
 
-	/* Check if broadcast or targeted to us */
-	if (pkt->segment_id == 0xFF || pkt->segment_id == my_segment_id) {
-		emergency_stop_active = true;
-		current_mode = MODE_IDLE;
+	int ret = packet_handle_command(data, length);
+
+	trace_record(TRACE_EVT_PKT_DONE, data[2], ret < 0);
 
-		printk(">>> Motors DISABLED <<<\n");
-		printk("\n");
+	return ret;
+}
 
-		/* Phase 7: Actually stop motors here */
+void packet_handle_emergency_stop(const emergency_stop_packet_t *pkt)
+{
+	/* Check if broadcast or targeted to us */
+	if (pkt->segment_id == 0xFF || pkt->segment_id == my_segment_id) {
+		/* Motors off first; the banner is printed from a work item */
+		estop_trigger(pkt->stop_reason, k_cycle_get_32());
+	} else {
+		LOG_INF("EMERGENCY_STOP for segment %d ignored", pkt->segment_id);
 	}
 }
 
@@ -154,58 +288,135 @@ void packet_handle_set_mode(const set_mode_packet_t *pkt)
 		break;
 	}
 
-	printk("[Packet] SET_MODE: %s (0x%02X)\n", mode_name, pkt->mode);
+	LOG_INF("SET_MODE: %s (0x%02X)", mode_name, pkt->mode);
+
+	k_spinlock_key_t key = seqlock_write_begin(&state_lock);
 
-	current_mode = pkt->mode;
+	state.mode = pkt->mode;
 
 	if (pkt->mode == MODE_OPERATION) {
-		emergency_stop_active = false;
+		state.emergency_stop_active = false;
+	}
+
+	seqlock_write_end(&state_lock, key);
+
+	if (pkt->mode == MODE_OPERATION) {
+		estop_clear();
+	}
+
+	/* Drivers stay off from boot until motion is first enabled */
+	if (pkt->mode == MODE_OPERATION || pkt->mode == MODE_HOMING) {
+		if (estop_enable_drivers() < 0) {
+			LOG_WRN("SET_MODE: emergency stop latched, drivers stay off");
+		}
 	}
 }
 
 void packet_handle_trajectory(const trajectory_packet_t *pkt)
 {
-	printk("[Packet] TRAJECTORY: id=%u, start=%u, duration=%u ms\n",
-	       pkt->trajectory_id, pkt->start_timestamp, pkt->duration_ms);
-
-	/* Phase 6: Add to trajectory buffer */
-	/* For now, just print first coefficient of each motor */
-	printk("  Motor 1 a0=%.3f, Motor 2 a0=%.3f, Motor 3 a0=%.3f\n",
-	       pkt->motor_1_coeffs[0],
-	       pkt->motor_2_coeffs[0],
-	       pkt->motor_3_coeffs[0]);
+	trajectory_packet_t seg;
+	calib_zero_offsets_t z;
+
+	LOG_DBG("TRAJECTORY: id=%u, start=%u, duration=%u ms",
+		pkt->trajectory_id, pkt->start_timestamp, pkt->duration_ms);
+
+	/* Phase 9: master positions are from home; the control loop's are not */
+	if (calib_get_zero_offsets(&z)) {
+		seg = *pkt;
+		seg.motor_1_coeffs[0] += z.offset_mm[0];
+		seg.motor_2_coeffs[0] += z.offset_mm[1];
+		seg.motor_3_coeffs[0] += z.offset_mm[2];
+		pkt = &seg;
+	}
+
+	/* Phase 6: Hand segment to control loop (lock-free, never blocks) */
+	if (trajectory_buffer_push(pkt) < 0) {
+		LOG_WRN_RL("Trajectory buffer full, segment %u dropped", pkt->trajectory_id);
+		packet_report_error(ERROR_BUFFER_OVERRUN);
+	}
+}
+
+/*
+ * Encoder feedback when available, otherwise the commanded set point,
+ * with the zero offsets taken out (positions from home, like the master's)
+ */
+static void packet_get_motion(trajectory_point_t *sp)
+{
+	calib_zero_offsets_t z;
+
+	if (encoder_is_ready()) {
+		encoder_get_state(sp);
+	} else {
+		control_get_setpoint(sp);
+	}
+
+	if (calib_get_zero_offsets(&z)) {
+		for (int i = 0; i < TRAJECTORY_NUM_MOTORS; i++) {
+			sp->position[i] -= z.offset_mm[i];
+		}
+	}
+}
+
+void packet_handle_set_zero_offset(const set_zero_offset_packet_t *pkt)
+{
+	ARG_UNUSED(pkt);
+
+	trajectory_point_t sp;
+	calib_zero_offsets_t z = { 0 };
+
+	/* Phase 9: the current position becomes the home position */
+	if (encoder_is_ready()) {
+		/* Latch the exact counts; the encoders read 0 mm there from now on */
+		encoder_get_counts(z.encoder_zero);
+		encoder_set_zero(z.encoder_zero);
+
+		for (int i = 0; i < TRAJECTORY_NUM_MOTORS; i++) {
+			z.offset_mm[i] = -CALIB_HOME_POSITION_MM;
+		}
+	} else {
+		control_get_setpoint(&sp);
+
+		for (int i = 0; i < TRAJECTORY_NUM_MOTORS; i++) {
+			z.offset_mm[i] = sp.position[i] - CALIB_HOME_POSITION_MM;
+		}
+	}
+
+	/* RAM copy now, flash write in the background */
+	calib_set_zero_offsets(&z);
+
+	LOG_INF("SET_ZERO_OFFSET: %.3f %.3f %.3f mm", (double)z.offset_mm[0],
+		(double)z.offset_mm[1], (double)z.offset_mm[2]);
 }
 
 void packet_build_motor_state(motor_state_packet_t *pkt, uint8_t segment_id)
 {
-	memset(pkt, 0, sizeof(*pkt));
+	trajectory_point_t sp;
 
+	/* Every field is written below, so no memset */
 	pkt->magic_header = PACKET_MAGIC_STM32_TO_MASTER;
 	pkt->packet_type = FEEDBACK_MOTOR_STATE;
 	pkt->segment_id = segment_id;
-	pkt->timestamp = k_uptime_get_32();
-
-	/* Phase 4: Get real IMU data */
-	/* Phase 5: Get real motor positions/velocities */
-	/* Phase 7: Get real currents and calculated values */
-
-	/* For now, fill with zeros (placeholders) */
-	pkt->motor_1_position = 0.0f;
-	pkt->motor_1_velocity = 0.0f;
-	pkt->motor_1_acceleration = 0.0f;
-	pkt->motor_1_jerk = 0.0f;
-	pkt->motor_1_current = 0.0f;
-
-	pkt->motor_2_position = 0.0f;
-	pkt->motor_2_velocity = 0.0f;
-	pkt->motor_2_acceleration = 0.0f;
-	pkt->motor_2_jerk = 0.0f;
+	pkt->timestamp = timesync_now_ms();
+
+	/* Phase 7: Measured state; the commanded set point without encoders */
+	packet_get_motion(&sp);
+
+	pkt->motor_1_position = sp.position[0];
+	pkt->motor_1_velocity = sp.velocity[0];
+	pkt->motor_1_acceleration = sp.acceleration[0];
+	pkt->motor_1_jerk = sp.jerk[0];
+	pkt->motor_1_current = 0.0f;  /* Phase 7: TMC9660 current readback */
+
+	pkt->motor_2_position = sp.position[1];
+	pkt->motor_2_velocity = sp.velocity[1];
+	pkt->motor_2_acceleration = sp.acceleration[1];
+	pkt->motor_2_jerk = sp.jerk[1];
 	pkt->motor_2_current = 0.0f;
 
-	pkt->motor_3_position = 0.0f;
-	pkt->motor_3_velocity = 0.0f;
-	pkt->motor_3_acceleration = 0.0f;
-	pkt->motor_3_jerk = 0.0f;
+	pkt->motor_3_position = sp.position[2];
+	pkt->motor_3_velocity = sp.velocity[2];
+	pkt->motor_3_acceleration = sp.acceleration[2];
+	pkt->motor_3_jerk = sp.jerk[2];
 	pkt->motor_3_current = 0.0f;
 
 	/* Phase 4: Get real IMU orientation */
@@ -220,7 +431,140 @@ void packet_build_motor_state(motor_state_packet_t *pkt, uint8_t segment_id)
 	pkt->status_flags = packet_get_status_flags();
 
 	/* Calculate CRC */
-	pkt->crc16 = crc16_ccitt(0xFFFF, (uint8_t *)pkt, sizeof(*pkt) - 2);
+	pkt->crc16 = crc16_ccitt_calc((uint8_t *)pkt, sizeof(*pkt) - 2);
+}
+
+void packet_sample_motor_state(motor_sample_t *s)
+{
+	trajectory_point_t sp;
+
+	s->timestamp = timesync_now_ms();
+
+	packet_get_motion(&sp);
+
+	for (int i = 0; i < 3; i++) {
+		s->position[i] = sp.position[i];
+		s->velocity[i] = sp.velocity[i];
+		s->acceleration[i] = sp.acceleration[i];
+		s->current[i] = 0.0f;  /* Phase 7: TMC9660 current readback */
+	}
+
+	if (imu_is_valid()) {
+		imu_get_orientation(&s->imu[0], &s->imu[1], &s->imu[2]);
+	} else {
+		s->imu[0] = 0.0f;
+		s->imu[1] = 0.0f;
+		s->imu[2] = 0.0f;
+	}
+
+	s->status_flags = packet_get_status_flags();
+}
+
+/* Round to nearest, saturating */
+static int32_t compact_q32(float v)
+{
+	if (v >= 2147483520.0f) {
+		return INT32_MAX;
+	}
+	if (v <= -2147483520.0f) {
+		return INT32_MIN;
+	}
+	return (int32_t)((v < 0.0f) ? v - 0.5f : v + 0.5f);
+}
+
+static int16_t compact_q16(float v)
+{
+	return (int16_t)CLAMP(compact_q32(v), INT16_MIN, INT16_MAX);
+}
+
+static bool compact_fits16(int64_t v)
+{
+	return v >= INT16_MIN && v <= INT16_MAX;
+}
+
+/* Quantized sample; deltas are taken between these so the master's sums are exact */
+typedef struct {
+	int32_t position[3];
+	int32_t velocity[3];
+	int32_t acceleration[3];
+} compact_q_t;
+
+size_t packet_build_motor_state_compact(uint8_t *buf, const motor_sample_t *samples,
+					uint8_t count, uint8_t period_ms,
+					uint8_t segment_id, uint16_t sequence)
+{
+	motor_state_compact_header_t hdr;
+	compact_q_t prev, q;
+	size_t len = sizeof(hdr);
+
+	count = CLAMP(count, 1, COMPACT_MAX_SAMPLES);
+
+	hdr.magic_header = PACKET_MAGIC_STM32_TO_MASTER;
+	hdr.packet_type = FEEDBACK_MOTOR_STATE_COMPACT;
+	hdr.segment_id = segment_id;
+	hdr.timestamp = samples[0].timestamp;
+	hdr.sequence = sequence;
+	hdr.sample_count = count;
+	hdr.sample_period_ms = period_ms;
+	memcpy(buf, &hdr, sizeof(hdr));
+
+	for (int n = 0; n < count; n++) {
+		const motor_sample_t *s = &samples[n];
+		bool key = (n == 0);
+
+		for (int i = 0; i < 3; i++) {
+			q.position[i] = compact_q32(s->position[i] * COMPACT_COUNTS_PER_MM);
+			q.velocity[i] = compact_q32(s->velocity[i] * COMPACT_COUNTS_PER_MM);
+			q.acceleration[i] = compact_q32(s->acceleration[i] * COMPACT_COUNTS_PER_MM);
+
+			/* int64: the difference of two saturated values may not fit int32 */
+			if (!key &&
+			    (!compact_fits16((int64_t)q.position[i] - prev.position[i]) ||
+			     !compact_fits16((int64_t)q.velocity[i] - prev.velocity[i]) ||
+			     !compact_fits16((int64_t)q.acceleration[i] - prev.acceleration[i]))) {
+				key = true;
+			}
+		}
+
+		if (key) {
+			motor_state_key_sample_t ks;
+
+			ks.kind = COMPACT_SAMPLE_KEY;
+			ks.status_flags = s->status_flags;
+			for (int i = 0; i < 3; i++) {
+				ks.position[i] = q.position[i];
+				ks.velocity[i] = q.velocity[i];
+				ks.acceleration[i] = q.acceleration[i];
+				ks.current[i] = compact_q16(s->current[i] * COMPACT_CURRENT_SCALE);
+				ks.imu[i] = compact_q16(s->imu[i] * COMPACT_ANGLE_SCALE);
+			}
+			memcpy(buf + len, &ks, sizeof(ks));
+			len += sizeof(ks);
+		} else {
+			motor_state_delta_sample_t ds;
+
+			ds.kind = COMPACT_SAMPLE_DELTA;
+			ds.status_flags = s->status_flags;
+			for (int i = 0; i < 3; i++) {
+				ds.d_position[i] = (int16_t)(q.position[i] - prev.position[i]);
+				ds.d_velocity[i] = (int16_t)(q.velocity[i] - prev.velocity[i]);
+				ds.d_acceleration[i] = (int16_t)(q.acceleration[i] - prev.acceleration[i]);
+				ds.current[i] = compact_q16(s->current[i] * COMPACT_CURRENT_SCALE);
+				ds.imu[i] = compact_q16(s->imu[i] * COMPACT_ANGLE_SCALE);
+			}
+			memcpy(buf + len, &ds, sizeof(ds));
+			len += sizeof(ds);
+		}
+
+		prev = q;
+	}
+
+	uint16_t crc = crc16_ccitt_calc(buf, len);
+
+	buf[len++] = crc & 0xFF;
+	buf[len++] = crc >> 8;
+
+	return len;
 }
 
 void packet_build_diagnostics(diagnostics_packet_t *pkt, uint8_t segment_id)
@@ -230,45 +574,117 @@ void packet_build_diagnostics(diagnostics_packet_t *pkt, uint8_t segment_id)
 	pkt->magic_header = PACKET_MAGIC_STM32_TO_MASTER;
 	pkt->packet_type = FEEDBACK_DIAGNOSTICS;
 	pkt->segment_id = segment_id;
-	pkt->timestamp = k_uptime_get_32();
+	pkt->timestamp = timesync_now_ms();
 
-	/* Phase 5: Get real TMC9660 temperatures */
-	pkt->tmc9660_temp_avg = 25.0f;  /* Placeholder */
+	sysmon_data_t sys;
 
-	/* STM32 internal temperature (could implement in Phase 3) */
-	pkt->stm32_temp = 30.0f;  /* Placeholder */
+	sysmon_get(&sys);
+	pkt->tmc9660_temp_avg = NAN;  /* No readout over the bootloader protocol */
+	pkt->stm32_temp = sys.stm32_temp;
 
-	pkt->error_count = error_count;
-	pkt->last_error_code = last_error;
+	packet_state_t st;
 
-	/* CPU usage - Zephyr can provide this */
-	pkt->cpu_usage = 10;  /* Placeholder */
+	packet_get_state(&st);
+	pkt->error_count = st.error_count;
+	pkt->last_error_code = st.last_error;
+
+	pkt->cpu_usage = sys.cpu_usage;
 
 	/* Calculate CRC */
-	pkt->crc16 = crc16_ccitt(0xFFFF, (uint8_t *)pkt, sizeof(*pkt) - 2);
+	pkt->crc16 = crc16_ccitt_calc((uint8_t *)pkt, sizeof(*pkt) - 2);
+}
+
+BUILD_ASSERT(sizeof(motor_state_key_sample_t) == 50, "key sample layout");
+BUILD_ASSERT(sizeof(motor_state_delta_sample_t) == 32, "delta sample layout");
+
+/* The wire layout fixes these array sizes */
+BUILD_ASSERT(sizeof(((diagnostics_ext_packet_t *)0)->exec_hist) ==
+	     CONTROL_HIST_BINS * sizeof(uint32_t), "exec_hist size mismatch");
+BUILD_ASSERT(sizeof(((diagnostics_ext_packet_t *)0)->stack_unused) ==
+	     SYSMON_NUM_THREADS * sizeof(uint16_t), "stack_unused size mismatch");
+
+void packet_build_diagnostics_ext(diagnostics_ext_packet_t *pkt, uint8_t segment_id)
+{
+	sysmon_data_t sys;
+	control_stats_t cs;
+	estop_stats_t es;
+	feedback_stats_t fs;
+	timesync_stats_t ts;
+
+	memset(pkt, 0, sizeof(*pkt));
+
+	pkt->magic_header = PACKET_MAGIC_STM32_TO_MASTER;
+	pkt->packet_type = FEEDBACK_DIAGNOSTICS_EXT;
+	pkt->segment_id = segment_id;
+	pkt->timestamp = timesync_now_ms();
+
+	sysmon_get(&sys);
+	pkt->cpu_usage = sys.cpu_usage;
+	pkt->stm32_temp = sys.stm32_temp;
+	for (int i = 0; i < 3; i++) {
+		pkt->tmc9660_temp_reserved[i] = NAN;
+	}
+	for (int i = 0; i < SYSMON_NUM_THREADS; i++) {
+		pkt->stack_unused[i] = sys.stack_unused[i];
+	}
+
+	control_get_stats(&cs);
+	pkt->control_cycles = cs.cycle_count;
+	pkt->missed_deadlines = cs.missed_deadlines;
+	pkt->exec_avg_us = (uint16_t)MIN(cs.exec_time_avg_us, UINT16_MAX);
+	pkt->exec_max_us = (uint16_t)MIN(cs.exec_time_max_us, UINT16_MAX);
+	pkt->jitter_max_us = (uint16_t)MIN(cs.jitter_max_us, UINT16_MAX);
+	for (int i = 0; i < CONTROL_HIST_BINS; i++) {
+		pkt->exec_hist[i] = cs.exec_hist[i];
+	}
+
+	estop_get_stats(&es);
+	pkt->estop_count = (uint16_t)MIN(es.count, UINT16_MAX);
+	pkt->estop_max_latency_us = (uint16_t)MIN(es.max_latency_us, UINT16_MAX);
+
+	feedback_get_stats(&fs);
+	pkt->feedback_sent = fs.sent;
+	pkt->feedback_dropped = fs.dropped;
+
+	timesync_get_stats(&ts);
+	pkt->sync_state = ts.state;
+	pkt->sync_offset_us = ts.offset_us;
+	pkt->sync_delay_us = ts.delay_us;
+	pkt->sync_rate_ppb = ts.rate_ppb;
+
+	pkt->crc16 = crc16_ccitt_calc((uint8_t *)pkt, sizeof(*pkt) - 2);
 }
 
 uint8_t packet_get_status_flags(void)
 {
 	uint8_t flags = 0;
+	packet_state_t st;
+
+	packet_get_state(&st);
 
-	if (emergency_stop_active) {
+	if (st.emergency_stop_active) {
 		flags |= STATUS_E_STOP_ACTIVE;
 	}
 
-	if (current_mode == MODE_HOMING) {
+	if (st.mode == MODE_HOMING) {
 		flags |= STATUS_HOMING_IN_PROGRESS;
 	}
 
-	if (current_mode == MODE_OPERATION) {
+	if (st.mode == MODE_OPERATION) {
 		flags |= STATUS_TRAJECTORY_EXECUTING;
 	}
 
-	/* Phase 9: Add calibration valid flag */
-	/* Phase 6: Add buffer empty flag */
+	if (trajectory_buffer_is_empty()) {
+		flags |= STATUS_BUFFER_EMPTY;
+	}
+
+	if (calib_is_valid()) {
+		flags |= STATUS_CALIBRATION_VALID;
+	}
+
 	/* Phase 7: Add position/force limit flags */
 
-	if (last_error != ERROR_NO_ERROR) {
+	if (st.last_error != ERROR_NO_ERROR) {
 		flags |= STATUS_ERROR_PRESENT;
 	}
 
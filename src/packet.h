@@ -23,11 +23,44 @@
 #define CMD_JOG_MOTOR         0x07
 #define CMD_SET_MODE          0x08
 #define CMD_SET_ZERO_OFFSET   0x09
+#define CMD_SET_FEEDBACK_FORMAT 0x0A
+#define CMD_TIME_SYNC_REPLY   0x0B
+#define CMD_MULTICAST_TRAJECTORY 0x0C
+#define CMD_TRACE_CONTROL     0x0F
 
 /* Feedback packet types (STM32 → Master) */
 #define FEEDBACK_MOTOR_STATE     0x01
 #define FEEDBACK_CAPACITIVE_GRID 0x02
 #define FEEDBACK_DIAGNOSTICS     0x03
+#define FEEDBACK_DIAGNOSTICS_EXT 0x04
+#define FEEDBACK_MOTOR_STATE_COMPACT 0x05
+#define FEEDBACK_TIME_SYNC_REQUEST   0x06
+#define FEEDBACK_MULTICAST_NACK      0x07
+#define FEEDBACK_TRACE               0x08
+
+/* Motor state formats (SET_FEEDBACK_FORMAT) */
+#define FEEDBACK_FORMAT_FULL     0x01    /* MOTOR_STATE, one per datagram */
+#define FEEDBACK_FORMAT_COMPACT  0x02    /* MOTOR_STATE_COMPACT, batched */
+
+/* Compact motor state encoding */
+#define COMPACT_MAX_SAMPLES      4       /* Usually 160 bytes: one 192-byte net_buf */
+#define COMPACT_COUNTS_PER_MM    14400.0f  /* Encoder counts, see hardware doc */
+#define COMPACT_CURRENT_SCALE    1000.0f   /* mA */
+#define COMPACT_ANGLE_SCALE      10000.0f  /* 1e-4 rad */
+#define COMPACT_SAMPLE_KEY       0x01
+#define COMPACT_SAMPLE_DELTA     0x02
+
+/* Capacitive grid */
+#define CAPACITIVE_GRID_POINTS   168     /* docs/hardware-configuration.yaml */
+
+/* Event trace (TRACE_CONTROL actions, TRACE flags) */
+#define TRACE_ACTION_DUMP        0x01    /* Send the ring over TCP, recording paused */
+#define TRACE_ACTION_LIVE_START  0x02    /* Stream new events over UDP */
+#define TRACE_ACTION_LIVE_STOP   0x03
+#define TRACE_ACTION_CLEAR       0x04    /* Forget the recorded events */
+#define TRACE_FLAG_LIVE          0x01    /* Live stream packet (else dump) */
+#define TRACE_FLAG_LAST          0x02    /* Last packet of a dump */
+#define TRACE_MAX_EVENTS         64      /* Events per TRACE packet */
 
 /* Operating modes */
 #define MODE_IDLE       0x01
@@ -143,6 +176,82 @@ typedef struct __attribute__((packed)) {
 	uint16_t crc16;
 } set_zero_offset_packet_t;
 
+/**
+ * Set Feedback Format (0x0A) - 8 bytes
+ * TCP, once per connection; reverts to FULL when the last master leaves
+ */
+typedef struct __attribute__((packed)) {
+	uint16_t magic_header;           /* 0xAA55 */
+	uint8_t  packet_type;            /* 0x0A */
+	uint8_t  segment_id;
+	uint8_t  format;                 /* FEEDBACK_FORMAT_* */
+	uint8_t  batch;                  /* Samples per datagram, 1-4 (COMPACT only) */
+	uint16_t crc16;
+} set_feedback_format_packet_t;
+
+/**
+ * Time Sync Reply (0x0B) - 30 bytes
+ * UDP, answer to TIME_SYNC_REQUEST; times in µs on the master clock
+ */
+typedef struct __attribute__((packed)) {
+	uint16_t magic_header;           /* 0xAA55 */
+	uint8_t  packet_type;            /* 0x0B */
+	uint8_t  segment_id;
+	uint16_t sequence;               /* Copied from the request */
+	uint64_t origin_us;              /* t1, copied from the request */
+	uint64_t receive_us;             /* t2, master clock at request arrival */
+	uint64_t transmit_us;            /* t3, master clock when sending this */
+	uint16_t crc16;
+} time_sync_reply_packet_t;
+
+/*
+ * Multicast Trajectory (0x0C) - 16 + 101 * n + 2 bytes
+ * UDP multicast, 5 Hz: one frame carries the next segment for up to
+ * MULTICAST_MAX_SLICES segments, all with the same start and duration
+ *
+ * Each controller keeps the slice with its own segment_id (or a 0xFF
+ * slice, which applies to every segment). Frames are numbered; a gap
+ * is reported with MULTICAST_NACK over TCP and the master resends the
+ * missing segments as ordinary TRAJECTORY packets on the TCP connection.
+ * The header segment_id is 0xFF, one CRC covers the whole frame.
+ */
+#define MULTICAST_MAX_SLICES 8
+
+typedef struct __attribute__((packed)) {
+	uint16_t magic_header;           /* 0xAA55 */
+	uint8_t  packet_type;            /* 0x0C */
+	uint8_t  segment_id;             /* 0xFF */
+	uint32_t sequence;               /* Frame number, +1 per frame */
+	uint32_t start_timestamp;        /* ms, shared clock */
+	uint16_t duration_ms;
+	uint8_t  slice_count;            /* 1-MULTICAST_MAX_SLICES */
+	uint8_t  reserved;
+} multicast_trajectory_header_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t  segment_id;             /* 1-8, 0xFF = all segments */
+	uint32_t trajectory_id;
+	float    motor_1_coeffs[8];      /* As in TRAJECTORY */
+	float    motor_2_coeffs[8];
+	float    motor_3_coeffs[8];
+} multicast_trajectory_slice_t;
+
+/* Largest MULTICAST_TRAJECTORY frame (all segments) */
+#define MULTICAST_MAX_SIZE (sizeof(multicast_trajectory_header_t) + \
+			    MULTICAST_MAX_SLICES * sizeof(multicast_trajectory_slice_t) + 2)
+
+/**
+ * Trace Control (0x0F) - 7 bytes
+ * TCP: dump, stream or clear the event trace
+ */
+typedef struct __attribute__((packed)) {
+	uint16_t magic_header;           /* 0xAA55 */
+	uint8_t  packet_type;            /* 0x0F */
+	uint8_t  segment_id;
+	uint8_t  action;                 /* TRACE_ACTION_* */
+	uint16_t crc16;
+} trace_control_packet_t;
+
 /* ========================================
  * FEEDBACK PACKETS (STM32 → Master)
  * ======================================== */
@@ -187,8 +296,146 @@ typedef struct __attribute__((packed)) {
 	uint16_t crc16;
 } motor_state_packet_t;
 
+/*
+ * Motor State Compact (0x05) - 12 + 50 + 32 * (n - 1) + 2 bytes
+ * (up to 12 + 50 * n + 2 when deltas do not fit)
+ * UDP, 100 Hz samples in datagrams of n (batch) samples
+ *
+ * The header is followed by n samples at sample_period_ms spacing
+ * starting at timestamp, then the CRC. The first sample of every
+ * datagram is a key sample; later ones are deltas against the previous
+ * sample of the same datagram (or key samples when a delta would not
+ * fit), so a lost datagram never affects the next one. Positions,
+ * velocities and accelerations are in encoder counts (x14400 per mm).
+ */
+typedef struct __attribute__((packed)) {
+	uint16_t magic_header;           /* 0xBB55 */
+	uint8_t  packet_type;            /* 0x05 */
+	uint8_t  segment_id;
+	uint32_t timestamp;              /* ms since boot, first sample */
+	uint16_t sequence;               /* Datagram counter, for loss detection */
+	uint8_t  sample_count;           /* 1-4 */
+	uint8_t  sample_period_ms;
+} motor_state_compact_header_t;
+
+/* Key sample - 50 bytes */
+typedef struct __attribute__((packed)) {
+	uint8_t  kind;                   /* COMPACT_SAMPLE_KEY */
+	uint8_t  status_flags;
+	int32_t  position[3];            /* counts */
+	int32_t  velocity[3];            /* counts/s */
+	int32_t  acceleration[3];        /* counts/s² */
+	int16_t  current[3];             /* mA */
+	int16_t  imu[3];                 /* roll, pitch, yaw in 1e-4 rad */
+} motor_state_key_sample_t;
+
+/* Delta sample - 32 bytes, differences to the previous sample */
+typedef struct __attribute__((packed)) {
+	uint8_t  kind;                   /* COMPACT_SAMPLE_DELTA */
+	uint8_t  status_flags;
+	int16_t  d_position[3];          /* counts */
+	int16_t  d_velocity[3];          /* counts/s */
+	int16_t  d_acceleration[3];      /* counts/s² */
+	int16_t  current[3];             /* mA, absolute */
+	int16_t  imu[3];                 /* 1e-4 rad, absolute */
+} motor_state_delta_sample_t;
+
+/* Largest MOTOR_STATE_COMPACT datagram (all key samples) */
+#define COMPACT_MAX_SIZE (sizeof(motor_state_compact_header_t) + \
+			  COMPACT_MAX_SAMPLES * sizeof(motor_state_key_sample_t) + 2)
+
+/* One motor state sample, as captured by the control loop */
+typedef struct {
+	uint32_t timestamp;              /* ms since boot */
+	float    position[3];            /* mm */
+	float    velocity[3];            /* mm/s */
+	float    acceleration[3];        /* mm/s² */
+	float    current[3];             /* Amps */
+	float    imu[3];                 /* roll, pitch, yaw in radians */
+	uint8_t  status_flags;
+} motor_sample_t;
+
+/**
+ * Time Sync Request (0x06) - 18 bytes
+ * UDP to the master, 8 Hz while acquiring, then 1 Hz
+ */
+typedef struct __attribute__((packed)) {
+	uint16_t magic_header;           /* 0xBB55 */
+	uint8_t  packet_type;            /* 0x06 */
+	uint8_t  segment_id;
+	uint16_t sequence;
+	uint8_t  sync_state;             /* 0=unsynced, 1=synced, 2=holdover */
+	uint8_t  reserved;
+	uint64_t origin_us;              /* t1, segment local clock */
+	uint16_t crc16;
+} time_sync_request_packet_t;
+
+/**
+ * Multicast NACK (0x07) - 12 bytes
+ * TCP to the masters, when MULTICAST_TRAJECTORY frames were lost; the
+ * master resends this segment's slices of those frames as TRAJECTORY
+ */
+typedef struct __attribute__((packed)) {
+	uint16_t magic_header;           /* 0xBB55 */
+	uint8_t  packet_type;            /* 0x07 */
+	uint8_t  segment_id;
+	uint32_t first_sequence;         /* First missing frame */
+	uint16_t count;                  /* Missing frames from there on */
+	uint16_t crc16;
+} multicast_nack_packet_t;
+
+/*
+ * Trace (0x08) - 24 + 8 * n + 2 bytes
+ * TCP for a dump, UDP while streaming live
+ *
+ * The header is followed by n events, then the CRC. Event numbers count
+ * every event recorded since boot, so a gap between packets shows lost
+ * events. ref_cycles and ref_time_ms were taken at the same moment and
+ * map event cycle counts (which wrap every few seconds) onto the packet
+ * timestamps. Event IDs and arguments: src/trace.h.
+ */
+typedef struct __attribute__((packed)) {
+	uint16_t magic_header;           /* 0xBB55 */
+	uint8_t  packet_type;            /* 0x08 */
+	uint8_t  segment_id;
+	uint32_t first_event;            /* Number of the first event */
+	uint32_t ref_cycles;             /* Cycle counter at ref_time_ms */
+	uint32_t ref_time_ms;            /* ms, shared clock */
+	uint32_t cycles_per_sec;         /* Cycle counter rate */
+	uint8_t  event_count;            /* 0-TRACE_MAX_EVENTS */
+	uint8_t  flags;                  /* TRACE_FLAG_* */
+	uint16_t lost;                   /* Events overwritten before they were sent */
+} trace_packet_header_t;
+
+/* One event - 8 bytes */
+typedef struct __attribute__((packed)) {
+	uint32_t cycles;                 /* Cycle counter when recorded */
+	uint8_t  id;                     /* TRACE_EVT_* */
+	uint8_t  arg8;
+	uint16_t arg16;
+} trace_event_t;
+
+/* Largest TRACE packet */
+#define TRACE_MAX_SIZE (sizeof(trace_packet_header_t) + \
+			TRACE_MAX_EVENTS * sizeof(trace_event_t) + 2)
+
+/**
+ * Capacitive Grid (0x02) - 346 bytes
+ * UDP, 30 Hz
+ * Values are counts above the no-touch baseline; points that rose less
+ * than the touch threshold read 0.
+ */
+typedef struct __attribute__((packed)) {
+	uint16_t magic_header;           /* 0xBB55 */
+	uint8_t  packet_type;            /* 0x02 */
+	uint8_t  segment_id;
+	uint32_t timestamp;              /* ms since boot, end of the scan */
+	uint16_t capacitive_values[CAPACITIVE_GRID_POINTS];
+	uint16_t crc16;
+} capacitive_grid_packet_t;
+
 /**
- * Diagnostics (0x03) - 26 bytes
+ * Diagnostics (0x03) - 22 bytes
  * TCP, 1 Hz
  */
 typedef struct __attribute__((packed)) {
@@ -196,7 +443,7 @@ typedef struct __attribute__((packed)) {
 	uint8_t  packet_type;            /* 0x03 */
 	uint8_t  segment_id;
 	uint32_t timestamp;              /* ms since boot */
-	float    tmc9660_temp_avg;       /* °C */
+	float    tmc9660_temp_avg;       /* °C; NaN, no readout in bootloader mode */
 	float    stm32_temp;             /* °C */
 	uint16_t error_count;
 	uint8_t  last_error_code;
@@ -204,6 +451,43 @@ typedef struct __attribute__((packed)) {
 	uint16_t crc16;
 } diagnostics_packet_t;
 
+/**
+ * Extended Diagnostics (0x04) - 110 bytes
+ * TCP, 1 Hz, sent after DIAGNOSTICS
+ * stm32_temp is NaN when the die sensor is not available. The TMC9660
+ * temperatures are reserved and always NaN: the bootloader protocol the
+ * drivers are run with has no temperature readout.
+ */
+typedef struct __attribute__((packed)) {
+	uint16_t magic_header;           /* 0xBB55 */
+	uint8_t  packet_type;            /* 0x04 */
+	uint8_t  segment_id;
+	uint32_t timestamp;              /* ms since boot */
+	uint8_t  cpu_usage;              /* 0-100% */
+	uint8_t  sync_state;             /* 0=unsynced, 1=synced, 2=holdover */
+	uint8_t  reserved[2];
+	uint32_t control_cycles;         /* Control ticks since start */
+	uint32_t missed_deadlines;       /* Ticks that overran their period */
+	uint16_t exec_avg_us;            /* Control tick execution time */
+	uint16_t exec_max_us;
+	uint16_t jitter_max_us;          /* Worst tick start deviation */
+	uint16_t stack_unused[5];        /* Bytes: net, control, feedback, imu, main */
+	uint32_t exec_hist[8];           /* Execution time in 1/8 period bins */
+	float    stm32_temp;             /* °C */
+	float    tmc9660_temp_reserved[3]; /* Always NaN (no readout in bootloader mode) */
+	uint16_t estop_count;
+	uint16_t estop_max_latency_us;
+	uint32_t feedback_sent;
+	uint32_t feedback_dropped;
+	int32_t  sync_offset_us;         /* Last measured master - segment clock */
+	uint32_t sync_delay_us;          /* Round trip of the last sync sample */
+	int32_t  sync_rate_ppb;          /* Local clock frequency correction */
+	uint16_t crc16;
+} diagnostics_ext_packet_t;
+
+/* Largest command packet (TRAJECTORY) */
+#define PACKET_MAX_COMMAND_SIZE  sizeof(trajectory_packet_t)
+
 /* ========================================
  * PACKET HANDLING FUNCTIONS
  * ======================================== */
@@ -215,6 +499,19 @@ typedef struct __attribute__((packed)) {
  */
 void packet_set_segment_id(uint8_t id);
 
+/**
+ * Get this segment's ID
+ *
+ * @return Segment ID
+ */
+uint8_t packet_get_segment_id(void);
+
+/**
+ * Latch emergency stop in the reported state (mode IDLE, E-stop flag)
+ * Called by the E-stop path after the drivers have been disabled.
+ */
+void packet_set_emergency_stop(void);
+
 /**
  * Parse and validate received command packet
  *
@@ -224,6 +521,31 @@ void packet_set_segment_id(uint8_t id);
  */
 int packet_parse_command(const uint8_t *data, size_t length);
 
+/**
+ * Dispatch an already validated command packet to its handler
+ * Caller guarantees magic header and CRC have been checked.
+ *
+ * @param data Pointer to complete packet (may be unaligned)
+ * @param length Length of packet
+ * @return Packet type on success, -1 on error
+ */
+int packet_dispatch_command(const uint8_t *data, size_t length);
+
+/**
+ * Get the wire length of a command packet type
+ *
+ * @param packet_type Command type (CMD_*)
+ * @return Packet size in bytes, 0 for unknown types
+ */
+size_t packet_command_length(uint8_t packet_type);
+
+/**
+ * Record an error for the diagnostics packet
+ *
+ * @param error_code Error code (ERROR_*)
+ */
+void packet_report_error(uint8_t error_code);
+
 /**
  * Build motor state feedback packet
  *
@@ -232,6 +554,29 @@ int packet_parse_command(const uint8_t *data, size_t length);
  */
 void packet_build_motor_state(motor_state_packet_t *pkt, uint8_t segment_id);
 
+/**
+ * Capture the current motor state for a compact packet
+ *
+ * @param sample Output: current motor state (encoders, else set point),
+ *               IMU orientation and status
+ */
+void packet_sample_motor_state(motor_sample_t *sample);
+
+/**
+ * Build a compact motor state packet from captured samples
+ *
+ * @param buf Output buffer, at least COMPACT_MAX_SIZE bytes
+ * @param samples Samples, oldest first
+ * @param count Number of samples (1 to COMPACT_MAX_SAMPLES)
+ * @param period_ms Sample spacing
+ * @param segment_id This segment's ID
+ * @param sequence Datagram counter
+ * @return Packet length in bytes
+ */
+size_t packet_build_motor_state_compact(uint8_t *buf, const motor_sample_t *samples,
+					uint8_t count, uint8_t period_ms,
+					uint8_t segment_id, uint16_t sequence);
+
 /**
  * Build diagnostics feedback packet
  *
@@ -240,6 +585,15 @@ void packet_build_motor_state(motor_state_packet_t *pkt, uint8_t segment_id);
  */
 void packet_build_diagnostics(diagnostics_packet_t *pkt, uint8_t segment_id);
 
+/**
+ * Build extended diagnostics feedback packet
+ * Control loop timing, stack headroom and per-chip temperatures.
+ *
+ * @param pkt Pointer to packet structure to fill
+ * @param segment_id This segment's ID
+ */
+void packet_build_diagnostics_ext(diagnostics_ext_packet_t *pkt, uint8_t segment_id);
+
 /**
  * Handle EMERGENCY_STOP command
  *
@@ -254,6 +608,15 @@ void packet_handle_emergency_stop(const emergency_stop_packet_t *pkt);
  */
 void packet_handle_set_mode(const set_mode_packet_t *pkt);
 
+/**
+ * Handle SET_ZERO_OFFSET command
+ * Takes the current positions as the zero offsets; they are stored in
+ * flash in the background.
+ *
+ * @param pkt Pointer to parsed packet
+ */
+void packet_handle_set_zero_offset(const set_zero_offset_packet_t *pkt);
+
 /**
  * Handle TRAJECTORY command
  *
@@ -0,0 +1,129 @@
+/*
+ * Packet Stream Framer Implementation
+ *
+ * Bytes are received directly into the ring and parsed in place, so each
+ * byte is copied at most once (by the network stack). Only a frame that
+ * straddles the end of the ring is touched again: its head (at most
+ * PACKET_MAX_COMMAND_SIZE bytes) is mirrored behind the ring end.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "packet_framer.h"
+#include "crc16.h"
+#include "log_ratelimit.h"
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+BUILD_ASSERT((PACKET_FRAMER_BUFFER_SIZE & (PACKET_FRAMER_BUFFER_SIZE - 1)) == 0,
+	     "Framer buffer size must be a power of two");
+BUILD_ASSERT(PACKET_FRAMER_BUFFER_SIZE >= 2 * PACKET_MAX_COMMAND_SIZE,
+	     "Framer buffer must hold at least two maximum-size frames");
+
+LOG_MODULE_DECLARE(packet, CONFIG_SEGMENT_PACKET_LOG_LEVEL);
+
+#define FRAMER_MASK (PACKET_FRAMER_BUFFER_SIZE - 1)
+
+/* Magic, type - enough to determine the frame length */
+#define FRAMER_HEADER_SIZE 3
+
+static inline uint8_t framer_byte(const packet_framer_t *f, size_t offset)
+{
+	return f->buf[(f->rd + offset) & FRAMER_MASK];
+}
+
+void packet_framer_init(packet_framer_t *f)
+{
+	f->rd = 0;
+	f->wr = 0;
+	f->frames = 0;
+	f->resync_bytes = 0;
+	f->crc_errors = 0;
+}
+
+uint8_t *packet_framer_write_ptr(packet_framer_t *f, size_t *avail)
+{
+	size_t used = f->wr - f->rd;
+	size_t off = f->wr & FRAMER_MASK;
+	size_t contig = PACKET_FRAMER_BUFFER_SIZE - off;
+	size_t space = PACKET_FRAMER_BUFFER_SIZE - used;
+
+	*avail = MIN(contig, space);
+
+	return &f->buf[off];
+}
+
+void packet_framer_commit(packet_framer_t *f, size_t len)
+{
+	f->wr += len;
+}
+
+/**
+ * Get a frame as one contiguous block
+ * Mirrors the wrapped part of the frame behind the ring end if needed.
+ */
+static const uint8_t *framer_frame(packet_framer_t *f, size_t len)
+{
+	size_t off = f->rd & FRAMER_MASK;
+
+	if (off + len > PACKET_FRAMER_BUFFER_SIZE) {
+		size_t wrapped = off + len - PACKET_FRAMER_BUFFER_SIZE;
+
+		memcpy(&f->buf[PACKET_FRAMER_BUFFER_SIZE], &f->buf[0], wrapped);
+	}
+
+	return &f->buf[off];
+}
+
+int packet_framer_process(packet_framer_t *f)
+{
+	int dispatched = 0;
+
+	while (f->wr - f->rd >= FRAMER_HEADER_SIZE) {
+		/* Hunt for magic header (0xAA55, little-endian) */
+		if (framer_byte(f, 0) != (PACKET_MAGIC_MASTER_TO_STM32 & 0xFF) ||
+		    framer_byte(f, 1) != (PACKET_MAGIC_MASTER_TO_STM32 >> 8)) {
+			f->rd++;
+			f->resync_bytes++;
+			continue;
+		}
+
+		size_t len = packet_command_length(framer_byte(f, 2));
+
+		if (len == 0) {
+			/* Unknown type: this was not a real header */
+			f->rd++;
+			f->resync_bytes++;
+			continue;
+		}
+
+		if (f->wr - f->rd < len) {
+			/* Incomplete frame: wait for more data */
+			break;
+		}
+
+		const uint8_t *frame = framer_frame(f, len);
+
+		if (!crc16_verify(frame, len)) {
+			/*
+			 * Either corrupted or a false magic match inside payload.
+			 * Skip only the first byte so a real header within the
+			 * candidate frame is still found.
+			 */
+			LOG_WRN_RL("Framer: CRC check failed (type 0x%02X)", frame[2]);
+			packet_report_error(ERROR_CRC_ERROR);
+			f->crc_errors++;
+			f->rd++;
+			f->resync_bytes++;
+			continue;
+		}
+
+		packet_dispatch_command(frame, len);
+		f->rd += len;
+		f->frames++;
+		dispatched++;
+	}
+
+	return dispatched;
+}
@@ -0,0 +1,74 @@
+/*
+ * Packet Stream Framer - TCP byte stream to command packets
+ *
+ * TCP delivers a byte stream, not packets: the master may coalesce two
+ * trajectories into one segment or split one across segments. The framer
+ * receives straight into a ring buffer, resynchronizes on the 0xAA55
+ * magic, uses the per-type packet length to find frame boundaries, and
+ * dispatches complete frames in place.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef PACKET_FRAMER_H
+#define PACKET_FRAMER_H
+
+#include "packet.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/* Ring size (power of two, several max-size frames) */
+#define PACKET_FRAMER_BUFFER_SIZE 1024
+
+/* Framer state - one per TCP connection */
+typedef struct {
+	/*
+	 * Ring storage plus a mirror area: a frame that wraps around the end
+	 * has its head bytes mirrored behind the ring so it can be handed to
+	 * the dispatcher as one contiguous block.
+	 */
+	uint8_t buf[PACKET_FRAMER_BUFFER_SIZE + PACKET_MAX_COMMAND_SIZE];
+	size_t rd;               /* Free-running read index */
+	size_t wr;               /* Free-running write index */
+
+	/* Statistics */
+	uint32_t frames;         /* Frames dispatched */
+	uint32_t resync_bytes;   /* Bytes skipped while hunting for magic */
+	uint32_t crc_errors;     /* Candidate frames with bad CRC */
+} packet_framer_t;
+
+/**
+ * Reset framer (call on every new connection)
+ *
+ * @param f Framer instance
+ */
+void packet_framer_init(packet_framer_t *f);
+
+/**
+ * Get the contiguous free region to receive into
+ * Pass the result straight to recv() - no intermediate buffer.
+ *
+ * @param f Framer instance
+ * @param avail Output: number of bytes that can be written
+ * @return Pointer to free region
+ */
+uint8_t *packet_framer_write_ptr(packet_framer_t *f, size_t *avail);
+
+/**
+ * Account for bytes written at the pointer from packet_framer_write_ptr()
+ *
+ * @param f Framer instance
+ * @param len Number of bytes received
+ */
+void packet_framer_commit(packet_framer_t *f, size_t len);
+
+/**
+ * Dispatch every complete frame currently buffered
+ * A trailing partial frame stays buffered for the next receive.
+ *
+ * @param f Framer instance
+ * @return Number of frames dispatched
+ */
+int packet_framer_process(packet_framer_t *f);
+
+#endif /* PACKET_FRAMER_H */
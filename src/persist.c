@@ -0,0 +1,101 @@
+/*
+ * Persistent Storage Implementation
+ *
+ * Uses ZMS rather than NVS: the STM32H7 erases in 128 KB sectors, which
+ * NVS (16-bit sector size) cannot address.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "persist.h"
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/fs/zms.h>
+#include <zephyr/sys/printk.h>
+#include <errno.h>
+
+#define PERSIST_PARTITION storage_partition
+
+static struct zms_fs fs;
+static bool mounted;
+static K_MUTEX_DEFINE(persist_lock);
+
+int persist_init(void)
+{
+	struct flash_pages_info info;
+	int ret = 0;
+
+	k_mutex_lock(&persist_lock, K_FOREVER);
+
+	if (mounted) {
+		goto out;
+	}
+
+	fs.flash_device = FIXED_PARTITION_DEVICE(PERSIST_PARTITION);
+	if (!device_is_ready(fs.flash_device)) {
+		printk("[Persist] ERROR: flash device not ready\n");
+		ret = -ENODEV;
+		goto out;
+	}
+
+	fs.offset = FIXED_PARTITION_OFFSET(PERSIST_PARTITION);
+	ret = flash_get_page_info_by_offs(fs.flash_device, fs.offset, &info);
+	if (ret < 0) {
+		printk("[Persist] ERROR: no flash page info: %d\n", ret);
+		goto out;
+	}
+
+	fs.sector_size = info.size;
+	fs.sector_count = FIXED_PARTITION_SIZE(PERSIST_PARTITION) / info.size;
+
+	ret = zms_mount(&fs);
+	if (ret < 0) {
+		printk("[Persist] ERROR: ZMS mount failed: %d\n", ret);
+		goto out;
+	}
+
+	mounted = true;
+	printk("[Persist] ZMS mounted: %u sectors of %u bytes\n",
+	       fs.sector_count, fs.sector_size);
+
+out:
+	k_mutex_unlock(&persist_lock);
+	return ret;
+}
+
+int persist_read(uint16_t id, void *data, size_t length)
+{
+	if (!mounted) {
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&persist_lock, K_FOREVER);
+	ssize_t ret = zms_read(&fs, id, data, length);
+	k_mutex_unlock(&persist_lock);
+
+	if (ret == -ENOENT) {
+		return -ENOENT;
+	}
+	if (ret < 0) {
+		return (int)ret;
+	}
+
+	/* zms_read returns the bytes read: a shorter record has another layout */
+	return (ret == (ssize_t)length) ? 0 : -EINVAL;
+}
+
+int persist_write(uint16_t id, const void *data, size_t length)
+{
+	if (!mounted) {
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&persist_lock, K_FOREVER);
+	ssize_t ret = zms_write(&fs, id, data, length);
+	k_mutex_unlock(&persist_lock);
+
+	/* CONFIG_ZMS_NO_DOUBLE_WRITE: identical data is not rewritten */
+	return (ret < 0) ? (int)ret : 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * Persistent Storage - Small records in flash (Zephyr ZMS)
+ *
+ * Each record is a fixed-size struct under a numeric ID on the
+ * storage_partition. Writes of unchanged data do not touch the flash.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Record IDs (never reuse an ID for a different layout) */
+enum persist_id {
+	PERSIST_ID_NET_LEASE = 1,          /* network_lease_t */
+	PERSIST_ID_ZERO_OFFSETS = 2,       /* calib_zero_offsets_t */
+	PERSIST_ID_CAPGRID_BASELINE = 3,   /* uint16_t[CAPACITIVE_GRID_POINTS] */
+};
+
+/**
+ * Mount the storage partition
+ * Safe to call more than once.
+ *
+ * @return 0 on success, negative errno on failure
+ */
+int persist_init(void);
+
+/**
+ * Read a record
+ *
+ * @param id Record ID
+ * @param data Output buffer
+ * @param length Expected record size
+ * @return 0 on success, -ENOENT if not stored, -EINVAL on size mismatch
+ */
+int persist_read(uint16_t id, void *data, size_t length);
+
+/**
+ * Write a record
+ * Blocks for the flash write (and a sector erase when needed), so do not
+ * call from time-critical threads.
+ *
+ * @param id Record ID
+ * @param data Record contents
+ * @param length Record size
+ * @return 0 on success, negative errno on failure
+ */
+int persist_write(uint16_t id, const void *data, size_t length);
+
+#endif /* PERSIST_H */
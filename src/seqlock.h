@@ -0,0 +1,108 @@
+/*
+ * Sequence Lock - Consistent snapshots of shared state without blocking
+ *
+ * Writers bump the sequence counter to odd before modifying the data and
+ * back to even afterwards; readers copy the data and retry if the counter
+ * was odd or changed meanwhile. Readers never block and never disable
+ * interrupts, so a low-priority reader cannot delay the control thread.
+ *
+ * Writers are serialized with a spinlock held for the (short) copy. On a
+ * single core this also guarantees that no reader ever runs while a write
+ * is half done, so readers do not spin; the retry loop only matters on
+ * SMP. Do not read from an ISR that can preempt the writer on the same
+ * CPU while the writer does not hold the lock.
+ *
+ * Usage:
+ *   k_spinlock_key_t key = seqlock_write_begin(&sl);
+ *   shared = local;
+ *   seqlock_write_end(&sl, key);
+ *
+ *   uint32_t seq;
+ *   do {
+ *           seq = seqlock_read_begin(&sl);
+ *           local = shared;
+ *   } while (seqlock_read_retry(&sl, seq));
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/barrier.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+	atomic_t seq;               /* Odd while a write is in progress */
+	struct k_spinlock lock;     /* Serializes writers */
+} seqlock_t;
+
+#define SEQLOCK_INIT { .seq = ATOMIC_INIT(0) }
+
+/**
+ * Start modifying the protected data
+ *
+ * @param sl Sequence lock
+ * @return Spinlock key to pass to seqlock_write_end()
+ */
+static inline k_spinlock_key_t seqlock_write_begin(seqlock_t *sl)
+{
+	k_spinlock_key_t key = k_spin_lock(&sl->lock);
+
+	atomic_inc(&sl->seq);
+	barrier_dmem_fence_full();
+
+	return key;
+}
+
+/**
+ * Finish modifying the protected data
+ *
+ * @param sl Sequence lock
+ * @param key Key from seqlock_write_begin()
+ */
+static inline void seqlock_write_end(seqlock_t *sl, k_spinlock_key_t key)
+{
+	barrier_dmem_fence_full();
+	atomic_inc(&sl->seq);
+
+	k_spin_unlock(&sl->lock, key);
+}
+
+/**
+ * Start reading the protected data
+ *
+ * @param sl Sequence lock
+ * @return Sequence value to pass to seqlock_read_retry()
+ */
+static inline uint32_t seqlock_read_begin(seqlock_t *sl)
+{
+	uint32_t seq;
+
+	while ((seq = (uint32_t)atomic_get(&sl->seq)) & 1U) {
+		/* Writer active on another CPU */
+	}
+
+	barrier_dmem_fence_full();
+
+	return seq;
+}
+
+/**
+ * Check whether the data read since seqlock_read_begin() is consistent
+ *
+ * @param sl Sequence lock
+ * @param seq Value returned by seqlock_read_begin()
+ * @return true if a write intervened and the read must be repeated
+ */
+static inline bool seqlock_read_retry(seqlock_t *sl, uint32_t seq)
+{
+	barrier_dmem_fence_full();
+
+	return (uint32_t)atomic_get(&sl->seq) != seq;
+}
+
+#endif /* SEQLOCK_H */
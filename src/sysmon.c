@@ -0,0 +1,162 @@
+/*
+ * System Monitor Implementation
+ *
+ * CPU load comes from the scheduler's per-thread usage accounting
+ * (CONFIG_SCHED_THREAD_USAGE_ALL): busy cycles over elapsed cycles
+ * between two updates. Stack headroom needs CONFIG_INIT_STACKS and is
+ * found by scanning for the unused fill pattern, which is why this is
+ * only done at the diagnostics rate.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "sysmon.h"
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/sys/printk.h>
+#include <string.h>
+#include <math.h>
+
+#if DT_NODE_HAS_STATUS_OKAY(DT_NODELABEL(die_temp))
+static const struct device *const die_temp_dev = DEVICE_DT_GET(DT_NODELABEL(die_temp));
+#else
+static const struct device *const die_temp_dev = NULL;
+#endif
+
+/* Names as set with k_thread_name_set(), indexed by enum sysmon_thread */
+static const char *const thread_names[SYSMON_NUM_THREADS] = {
+	[SYSMON_THREAD_NET] = "net_server",
+	[SYSMON_THREAD_CONTROL] = "control",
+	[SYSMON_THREAD_FEEDBACK] = "feedback",
+	[SYSMON_THREAD_IMU] = "imu",
+	[SYSMON_THREAD_MAIN] = "main",
+};
+
+static sysmon_data_t data = {
+	.stm32_temp = NAN,
+	.stack_unused = {SYSMON_STACK_UNKNOWN, SYSMON_STACK_UNKNOWN, SYSMON_STACK_UNKNOWN,
+			 SYSMON_STACK_UNKNOWN, SYSMON_STACK_UNKNOWN},
+};
+static struct k_spinlock data_lock;
+
+/* Previous runtime sample for the CPU load delta */
+static uint64_t last_busy_cycles;
+static uint64_t last_total_cycles;
+
+static uint8_t sysmon_cpu_usage(void)
+{
+	k_thread_runtime_stats_t rt;
+
+	if (k_thread_runtime_stats_all_get(&rt) != 0) {
+		return 0;
+	}
+
+	uint64_t busy = rt.total_cycles - last_busy_cycles;
+	uint64_t total = rt.execution_cycles - last_total_cycles;
+
+	last_busy_cycles = rt.total_cycles;
+	last_total_cycles = rt.execution_cycles;
+
+	if (total == 0) {
+		return 0;
+	}
+
+	return (uint8_t)MIN(busy * 100 / total, 100);
+}
+
+static void sysmon_stack_cb(const struct k_thread *thread, void *user_data)
+{
+	uint16_t *unused = user_data;
+	const char *name = k_thread_name_get((k_tid_t)thread);
+	size_t space;
+
+	if (name == NULL) {
+		return;
+	}
+
+	for (int i = 0; i < SYSMON_NUM_THREADS; i++) {
+		if (strcmp(name, thread_names[i]) != 0) {
+			continue;
+		}
+
+		if (k_thread_stack_space_get(thread, &space) == 0) {
+			unused[i] = (uint16_t)MIN(space, SYSMON_STACK_UNKNOWN - 1);
+		}
+		break;
+	}
+}
+
+static float sysmon_die_temp(void)
+{
+	struct sensor_value val;
+
+	if (die_temp_dev == NULL || !device_is_ready(die_temp_dev)) {
+		return NAN;
+	}
+
+	if (sensor_sample_fetch(die_temp_dev) != 0 ||
+	    sensor_channel_get(die_temp_dev, SENSOR_CHAN_DIE_TEMP, &val) != 0) {
+		return NAN;
+	}
+
+	return (float)sensor_value_to_double(&val);
+}
+
+void sysmon_update(void)
+{
+	sysmon_data_t s;
+
+	s.cpu_usage = sysmon_cpu_usage();
+	s.stm32_temp = sysmon_die_temp();
+
+	for (int i = 0; i < SYSMON_NUM_THREADS; i++) {
+		s.stack_unused[i] = SYSMON_STACK_UNKNOWN;
+	}
+	/* Unlocked: the stack scans must not hold off the control timer */
+	k_thread_foreach_unlocked(sysmon_stack_cb, s.stack_unused);
+
+	k_spinlock_key_t key = k_spin_lock(&data_lock);
+	data = s;
+	k_spin_unlock(&data_lock, key);
+}
+
+void sysmon_get(sysmon_data_t *out)
+{
+	if (!out) {
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&data_lock);
+	*out = data;
+	k_spin_unlock(&data_lock, key);
+}
+
+static void sysmon_print_stack_cb(const struct k_thread *thread, void *user_data)
+{
+	size_t *total = user_data;
+	const char *name = k_thread_name_get((k_tid_t)thread);
+	size_t size = thread->stack_info.size;
+	size_t space;
+
+	*total += size;
+
+	if (k_thread_stack_space_get(thread, &space) != 0) {
+		printk("  %-12s %5u bytes\n", name ? name : "?", (unsigned int)size);
+		return;
+	}
+
+	printk("  %-12s %5u bytes, peak %5u, free %5u (%u%%)\n",
+	       name ? name : "?", (unsigned int)size, (unsigned int)(size - space),
+	       (unsigned int)space, size ? (unsigned int)(space * 100 / size) : 0U);
+}
+
+void sysmon_print_stacks(void)
+{
+	size_t total = 0;
+
+	/* Unlocked: scanning every stack and printk() run with interrupts on */
+	printk("[Stacks]\n");
+	k_thread_foreach_unlocked(sysmon_print_stack_cb, &total);
+	printk("  total        %5u bytes\n", (unsigned int)total);
+}
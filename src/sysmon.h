@@ -0,0 +1,57 @@
+/*
+ * System Monitor - Phase 7
+ * CPU load, thread stack usage and temperatures for diagnostics
+ *
+ * sysmon_update() samples everything and is meant to run at the
+ * diagnostics rate (1 Hz) from a low-priority thread; readers get the
+ * last sample without touching any hardware.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SYSMON_H
+#define SYSMON_H
+
+#include <stdint.h>
+
+/* Threads whose stack usage is tracked (index into stack_unused[]) */
+enum sysmon_thread {
+	SYSMON_THREAD_NET = 0,
+	SYSMON_THREAD_CONTROL,
+	SYSMON_THREAD_FEEDBACK,
+	SYSMON_THREAD_IMU,
+	SYSMON_THREAD_MAIN,
+	SYSMON_NUM_THREADS,
+};
+
+/* Unknown stack headroom (thread not running or stack info disabled) */
+#define SYSMON_STACK_UNKNOWN 0xFFFF
+
+/* Last monitoring sample */
+typedef struct {
+	uint8_t cpu_usage;                          /* 0-100 % since last update */
+	float stm32_temp;                           /* °C, NaN if unavailable */
+	uint16_t stack_unused[SYSMON_NUM_THREADS];  /* Bytes never used */
+} sysmon_data_t;
+
+/**
+ * Sample CPU load, stack headroom and temperatures
+ * Reads the die temperature sensor (ADC conversion), so do not call
+ * from time-critical threads.
+ */
+void sysmon_update(void);
+
+/**
+ * Get the last monitoring sample
+ *
+ * @param data Output: last sample
+ */
+void sysmon_get(sysmon_data_t *data);
+
+/**
+ * Print size, peak use and headroom of every thread stack (footprint audit)
+ * Walks all threads and scans their stacks: diagnostics rate at most.
+ */
+void sysmon_print_stacks(void);
+
+#endif /* SYSMON_H */
@@ -0,0 +1,310 @@
+/*
+ * Time Synchronisation Implementation
+ *
+ * Local time is a 64-bit extension of the 32-bit cycle counter (µs
+ * resolution, unlike the 100 µs system tick). The extension has to be
+ * read at least once per counter wrap (8.9 s at 480 MHz); the request
+ * work item runs at least once a second, which guarantees that.
+ *
+ * The shared clock is a linear model of the local clock, published
+ * through a seqlock so the control loop reads it without blocking:
+ *
+ *   shared = base_shared + d + d * rate_ppb / 1e9,  d = local - base_local
+ *
+ * Each accepted sample rebases the model at its arrival time and sets
+ * the rate to the frequency estimate plus a correction that removes
+ * half of the measured phase error over the next interval.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "timesync.h"
+#include "packet.h"
+#include "network.h"
+#include "crc16.h"
+#include "seqlock.h"
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+LOG_MODULE_DECLARE(net_srv, CONFIG_SEGMENT_NET_LOG_LEVEL);
+
+#define TIMESYNC_FAST_INTERVAL_MS  125      /* While acquiring */
+#define TIMESYNC_INTERVAL_MS       1000
+#define TIMESYNC_FAST_SAMPLES      8        /* Samples (or unanswered requests) at the fast rate */
+#define TIMESYNC_HOLDOVER_MS       10000    /* No reply for this long: holdover */
+#define TIMESYNC_STEP_US           1000     /* Larger errors are stepped, not slewed */
+#define TIMESYNC_DELAY_WINDOW      8        /* Samples in the minimum delay window */
+#define TIMESYNC_DELAY_MARGIN_US   200      /* Accepted round trip above the minimum */
+#define TIMESYNC_MAX_RATE_PPB      500000   /* ±500 ppm total correction */
+#define TIMESYNC_PHASE_DIV         2        /* Phase error removed per interval: 1/2 */
+#define TIMESYNC_FREQ_DIV          8        /* Frequency gain: 1/8 of the error rate */
+
+/* Local clock: 64-bit cycle count, congruent to k_cycle_get_32() */
+static uint64_t local_cycles;
+static uint32_t local_last;
+static struct k_spinlock local_lock;
+
+/* Shared clock model (written by the UDP server thread only) */
+typedef struct {
+	uint64_t base_local_us;
+	int64_t base_shared_us;
+	int32_t rate_ppb;
+} timesync_model_t;
+
+static timesync_model_t model;
+static seqlock_t model_lock = SEQLOCK_INIT;
+
+/* Request/reply matching and loop state */
+static struct k_spinlock sync_lock;
+static uint16_t req_sequence;
+static uint64_t req_origin_us;
+static bool req_outstanding;
+static uint32_t unanswered;
+static uint32_t acquire_count;
+static uint32_t delay_window[TIMESYNC_DELAY_WINDOW];
+static uint32_t delay_count;
+static int32_t freq_ppb;
+static uint64_t last_sample_us;
+static uint32_t last_reply_ms;
+static timesync_stats_t stats;
+
+static void timesync_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(timesync_work, timesync_work_handler);
+
+static uint64_t timesync_local_cycles(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&local_lock);
+	uint32_t now = k_cycle_get_32();
+
+	local_cycles += (uint32_t)(now - local_last);
+	local_last = now;
+
+	uint64_t cycles = local_cycles;
+
+	k_spin_unlock(&local_lock, key);
+
+	return cycles;
+}
+
+static int64_t timesync_model_apply(const timesync_model_t *m, uint64_t local_us)
+{
+	int64_t d = (int64_t)(local_us - m->base_local_us);
+
+	return m->base_shared_us + d + d * m->rate_ppb / 1000000000LL;
+}
+
+uint64_t timesync_now_us(void)
+{
+	timesync_model_t m;
+	uint32_t seq;
+
+	do {
+		seq = seqlock_read_begin(&model_lock);
+		m = model;
+	} while (seqlock_read_retry(&model_lock, seq));
+
+	return (uint64_t)timesync_model_apply(&m, k_cyc_to_us_floor64(timesync_local_cycles()));
+}
+
+uint32_t timesync_now_ms(void)
+{
+	return (uint32_t)(timesync_now_us() / 1000U);
+}
+
+static void timesync_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	time_sync_request_packet_t pkt;
+	uint32_t interval_ms;
+
+	pkt.magic_header = PACKET_MAGIC_STM32_TO_MASTER;
+	pkt.packet_type = FEEDBACK_TIME_SYNC_REQUEST;
+	pkt.segment_id = packet_get_segment_id();
+	pkt.reserved = 0;
+
+	k_spinlock_key_t key = k_spin_lock(&sync_lock);
+
+	if (stats.state == TIMESYNC_STATE_SYNCED &&
+	    k_uptime_get_32() - last_reply_ms > TIMESYNC_HOLDOVER_MS) {
+		stats.state = TIMESYNC_STATE_HOLDOVER;
+	}
+
+	if (req_outstanding) {
+		unanswered++;
+	}
+
+	pkt.sequence = ++req_sequence;
+	pkt.sync_state = stats.state;
+	pkt.origin_us = k_cyc_to_us_floor64(timesync_local_cycles());
+	req_origin_us = pkt.origin_us;
+	req_outstanding = true;
+
+	/* Fast until locked; a master that never answers gets the slow rate */
+	interval_ms = (acquire_count < TIMESYNC_FAST_SAMPLES && unanswered < TIMESYNC_FAST_SAMPLES) ?
+		      TIMESYNC_FAST_INTERVAL_MS : TIMESYNC_INTERVAL_MS;
+
+	k_spin_unlock(&sync_lock, key);
+
+	pkt.crc16 = crc16_ccitt_calc((uint8_t *)&pkt, sizeof(pkt) - 2);
+
+	/* Fails harmlessly until there is a master */
+	network_send_udp((const uint8_t *)&pkt, sizeof(pkt));
+
+	k_work_reschedule(&timesync_work, K_MSEC(interval_ms));
+}
+
+/* Smallest round trip in the window, including the new sample */
+static uint32_t timesync_min_delay(uint32_t delay_us)
+{
+	uint32_t n = MIN(delay_count, TIMESYNC_DELAY_WINDOW);
+	uint32_t min = delay_us;
+
+	delay_window[delay_count % TIMESYNC_DELAY_WINDOW] = delay_us;
+	delay_count++;
+
+	for (uint32_t i = 0; i < n; i++) {
+		min = MIN(min, delay_window[i]);
+	}
+
+	return min;
+}
+
+/**
+ * Update the clock model from one reply (sync_lock held)
+ *
+ * @return 1 if the clock was stepped, 0 if slewed, -1 if the sample was rejected
+ */
+static int timesync_sample(const time_sync_reply_packet_t *pkt, uint64_t t4, int64_t *err_out)
+{
+	int ret = 0;
+
+	if (!req_outstanding || pkt->sequence != req_sequence ||
+	    pkt->origin_us != req_origin_us) {
+		/* Late or duplicate reply */
+		stats.rejected++;
+		return -1;
+	}
+	req_outstanding = false;
+	unanswered = 0;
+
+	int64_t rtt = (int64_t)(t4 - pkt->origin_us) -
+		      (int64_t)(pkt->transmit_us - pkt->receive_us);
+	uint32_t delay_us = (uint32_t)CLAMP(rtt, 0, INT32_MAX);
+
+	if (delay_us > timesync_min_delay(delay_us) + TIMESYNC_DELAY_MARGIN_US) {
+		/* Queued somewhere on the way: the split is unknown */
+		stats.rejected++;
+		return -1;
+	}
+
+	int64_t master_us = (int64_t)pkt->transmit_us + delay_us / 2;
+	int64_t shared_us = timesync_model_apply(&model, t4);
+	int64_t err = master_us - shared_us;
+	timesync_model_t next;
+
+	if (stats.state == TIMESYNC_STATE_UNSYNCED || llabs(err) > TIMESYNC_STEP_US) {
+		next.base_local_us = t4;
+		next.base_shared_us = master_us;
+		next.rate_ppb = freq_ppb;
+		acquire_count = 0;
+		stats.steps++;
+		ret = 1;
+	} else {
+		int64_t interval_us = MAX((int64_t)(t4 - last_sample_us), 1);
+		int64_t err_ppb = err * 1000000000LL / interval_us;
+
+		freq_ppb = (int32_t)CLAMP(freq_ppb + err_ppb / TIMESYNC_FREQ_DIV,
+					  -TIMESYNC_MAX_RATE_PPB, TIMESYNC_MAX_RATE_PPB);
+
+		/* Rebase where the clock is now: continuous, never backwards */
+		next.base_local_us = t4;
+		next.base_shared_us = shared_us;
+		next.rate_ppb = (int32_t)CLAMP(freq_ppb + err_ppb / TIMESYNC_PHASE_DIV,
+					       -TIMESYNC_MAX_RATE_PPB, TIMESYNC_MAX_RATE_PPB);
+		acquire_count++;
+	}
+
+	k_spinlock_key_t mkey = seqlock_write_begin(&model_lock);
+
+	model = next;
+	seqlock_write_end(&model_lock, mkey);
+
+	last_sample_us = t4;
+	last_reply_ms = k_uptime_get_32();
+
+	stats.state = TIMESYNC_STATE_SYNCED;
+	stats.offset_us = (int32_t)CLAMP(err, INT32_MIN, INT32_MAX);
+	stats.delay_us = delay_us;
+	stats.rate_ppb = freq_ppb;
+	stats.accepted++;
+
+	*err_out = err;
+
+	return ret;
+}
+
+static void timesync_process(const time_sync_reply_packet_t *pkt, uint64_t t4)
+{
+	int64_t err = 0;
+
+	k_spinlock_key_t key = k_spin_lock(&sync_lock);
+	int ret = timesync_sample(pkt, t4, &err);
+
+	k_spin_unlock(&sync_lock, key);
+
+	if (ret == 1) {
+		LOG_INF("Clock stepped to master time (error %lld us)", (long long)err);
+	}
+}
+
+bool timesync_fast_path(const uint8_t *data, size_t length, uint32_t rx_cycles)
+{
+	if (length != sizeof(time_sync_reply_packet_t) ||
+	    data[2] != CMD_TIME_SYNC_REPLY ||
+	    (data[0] | (data[1] << 8)) != PACKET_MAGIC_MASTER_TO_STM32 ||
+	    !crc16_verify(data, length)) {
+		return false;
+	}
+
+	/* Arrival time: now, less the cycles since recvfrom() returned */
+	uint64_t cycles = timesync_local_cycles();
+	uint64_t t4 = k_cyc_to_us_floor64(cycles - (uint32_t)((uint32_t)cycles - rx_cycles));
+
+	time_sync_reply_packet_t pkt;
+
+	memcpy(&pkt, data, sizeof(pkt));
+
+	if (pkt.segment_id == 0xFF || pkt.segment_id == packet_get_segment_id()) {
+		timesync_process(&pkt, t4);
+	}
+
+	return true;
+}
+
+void timesync_start(void)
+{
+	/* Align the extension with the hardware counter before it first wraps */
+	timesync_local_cycles();
+
+	k_work_schedule(&timesync_work, K_NO_WAIT);
+}
+
+void timesync_get_stats(timesync_stats_t *out)
+{
+	if (!out) {
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&sync_lock);
+
+	if (stats.state == TIMESYNC_STATE_SYNCED &&
+	    k_uptime_get_32() - last_reply_ms > TIMESYNC_HOLDOVER_MS) {
+		stats.state = TIMESYNC_STATE_HOLDOVER;
+	}
+	*out = stats;
+
+	k_spin_unlock(&sync_lock, key);
+}
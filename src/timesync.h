@@ -0,0 +1,82 @@
+/*
+ * Time Synchronisation - Phase 7
+ * Shared µs clock between the master and all segments
+ *
+ * Two-way exchange over UDP: the segment sends TIME_SYNC_REQUEST with
+ * its local send time t1, the master answers TIME_SYNC_REPLY with its
+ * receive and send times t2/t3, the segment notes the arrival time t4.
+ * The master clock at t4 is t3 + delay / 2, with
+ * delay = (t4 - t1) - (t3 - t2). Samples with a queueing delay well
+ * above the recent minimum are discarded.
+ *
+ * The shared clock steps to the master clock on the first sample and
+ * after large errors; otherwise it is slewed by adjusting its rate, so
+ * it never runs backwards. Without a master reply it runs as the local
+ * uptime, so trajectory and feedback timestamps keep their old meaning
+ * ("ms since boot") on an unsynchronised system.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Synchronisation state (TIME_SYNC_REQUEST, DIAGNOSTICS_EXT) */
+#define TIMESYNC_STATE_UNSYNCED  0x00   /* Local uptime, no master reply yet */
+#define TIMESYNC_STATE_SYNCED    0x01   /* Disciplined to the master clock */
+#define TIMESYNC_STATE_HOLDOVER  0x02   /* Synced before, no reply for a while */
+
+/* Synchronisation statistics */
+typedef struct {
+	uint8_t state;              /* TIMESYNC_STATE_* */
+	int32_t offset_us;          /* Last measured error: master - shared clock */
+	uint32_t delay_us;          /* Round trip of the last accepted sample */
+	int32_t rate_ppb;           /* Frequency correction of the local clock */
+	uint32_t accepted;          /* Samples used */
+	uint32_t rejected;          /* Samples discarded (delay, stale reply) */
+	uint32_t steps;             /* Clock steps (first sync, large errors) */
+} timesync_stats_t;
+
+/**
+ * Start periodic sync requests (system workqueue)
+ * Requests go to the current master; none are sent without one.
+ */
+void timesync_start(void);
+
+/**
+ * Handle a datagram if it is a TIME_SYNC_REPLY
+ * Called right after recvfrom() so the arrival time is accurate.
+ *
+ * @param data Received datagram
+ * @param length Length of datagram
+ * @param rx_cycles k_cycle_get_32() when the datagram was received
+ * @return true if the datagram was a time sync reply (valid or not)
+ */
+bool timesync_fast_path(const uint8_t *data, size_t length, uint32_t rx_cycles);
+
+/**
+ * Get the shared clock
+ *
+ * @return µs on the master clock (local uptime until synchronised)
+ */
+uint64_t timesync_now_us(void);
+
+/**
+ * Get the shared clock in ms, as used in packet timestamps
+ *
+ * @return ms on the master clock (wraps like k_uptime_get_32())
+ */
+uint32_t timesync_now_ms(void);
+
+/**
+ * Get synchronisation statistics
+ *
+ * @param stats Output: current statistics
+ */
+void timesync_get_stats(timesync_stats_t *stats);
+
+#endif /* TIMESYNC_H */
@@ -1,26 +1,41 @@
 /*
- * TMC9660 UART Driver Implementation - Multi-Motor Support
+ * TMC9660 Driver Implementation - Multi-Motor Support
+ * Bootloader protocol; the UART or SPI transport is in tmc9660_bus.h.
  *
  * SPDX-License-Identifier: Apache-2.0
  */
 
 #include "tmc9660.h"
+#include "tmc9660_bus.h"
+#include "crc.h"
+#include "trace.h"
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
-#include <zephyr/drivers/uart.h>
 #include <zephyr/logging/log.h>
 #include <string.h>
 
-LOG_MODULE_REGISTER(tmc9660, LOG_LEVEL_INF);
+LOG_MODULE_REGISTER(tmc9660, CONFIG_SEGMENT_TMC9660_LOG_LEVEL);
 
 /* Per-motor instance data */
 typedef struct {
-	const struct device *uart_dev;
+	struct tmc9660_bus bus;
 	tmc9660_state_t state;
 	struct k_mutex mutex;
 	const char *name;
+
+	/* CONFIG memory shadow; dirty words are staged, not yet written */
+	uint32_t shadow[TMC9660_CONFIG_WORDS];
+	uint16_t shadow_valid;   /* Bit per word: shadow holds the chip's value */
+	uint16_t shadow_dirty;   /* Bit per word: shadow holds a staged write */
+
+	/* Link rate: index into baud_ladder[] */
+	uint8_t baud_rung;
+	uint8_t link_errors;     /* Consecutive CRC errors/timeouts */
+	bool negotiating;        /* Probing: no automatic fallback */
 } tmc9660_instance_t;
 
+BUILD_ASSERT(TMC9660_CONFIG_WORDS <= 16, "shadow bitmaps are 16 bits");
+
 /* Array of motor instances */
 static tmc9660_instance_t motors[TMC9660_NUM_MOTORS] = {
 	[TMC9660_MOTOR_A] = {
@@ -29,7 +44,9 @@ static tmc9660_instance_t motors[TMC9660_NUM_MOTORS] = {
 			.device_addr = TMC9660_DEFAULT_DEVICE_ADDR,
 			.host_addr = TMC9660_DEFAULT_HOST_ADDR,
 			.current_bank = 0xFF,
+			.current_addr = TMC9660_ADDR_UNKNOWN,
 			.initialized = false,
+			.baud = TMC9660_BAUD_DEFAULT,
 		},
 	},
 	[TMC9660_MOTOR_B] = {
@@ -38,7 +55,9 @@ static tmc9660_instance_t motors[TMC9660_NUM_MOTORS] = {
 			.device_addr = TMC9660_DEFAULT_DEVICE_ADDR,
 			.host_addr = TMC9660_DEFAULT_HOST_ADDR,
 			.current_bank = 0xFF,
+			.current_addr = TMC9660_ADDR_UNKNOWN,
 			.initialized = false,
+			.baud = TMC9660_BAUD_DEFAULT,
 		},
 	},
 	[TMC9660_MOTOR_C] = {
@@ -47,37 +66,28 @@ static tmc9660_instance_t motors[TMC9660_NUM_MOTORS] = {
 			.device_addr = TMC9660_DEFAULT_DEVICE_ADDR,
 			.host_addr = TMC9660_DEFAULT_HOST_ADDR,
 			.current_bank = 0xFF,
+			.current_addr = TMC9660_ADDR_UNKNOWN,
 			.initialized = false,
+			.baud = TMC9660_BAUD_DEFAULT,
 		},
 	},
 };
 
 /* Timeouts */
 #define TMC9660_REPLY_TIMEOUT_MS  100
-#define TMC9660_BYTE_TIMEOUT_MS   10
 
-/**
- * Calculate CRC8 checksum for TMC9660 protocol
- * Polynomial: x^8 + x^2 + x + 1 (0x07)
- * Initial value: 0x00
+/*
+ * Link rates, slowest first; rung 0 is the autobaud default. 8 bytes
+ * each way cost 1.4 ms of line time at 115200 and 53 µs at 3 Mbaud.
  */
-static uint8_t tmc9660_crc8(const uint8_t *data, size_t len)
-{
-	uint8_t crc = 0;
+static const uint32_t baud_ladder[] = {
+	TMC9660_BAUD_DEFAULT, 460800, 1000000, 2000000, 3000000,
+};
 
-	for (size_t i = 0; i < len; i++) {
-		crc ^= data[i];
-		for (int j = 0; j < 8; j++) {
-			if (crc & 0x80) {
-				crc = (crc << 1) ^ 0x07;
-			} else {
-				crc <<= 1;
-			}
-		}
-	}
+#define TMC9660_BAUD_PROBES           32  /* NO_OPs that must all pass on a new rung */
+#define TMC9660_BAUD_FALLBACK_ERRORS  3   /* Consecutive link errors before stepping down */
 
-	return crc;
-}
+static int tmc9660_set_rung(tmc9660_instance_t *inst, uint8_t rung);
 
 /**
  * Pack 32-bit value into message data field (MSB first)
@@ -102,75 +112,77 @@ static uint32_t unpack_u32_msb(const uint8_t *src)
 }
 
 /**
- * Send UART data
+ * Build request message and start the exchange on the transport
  */
-static int uart_send(const struct device *uart, const uint8_t *data, size_t len)
+static int tmc9660_request_start(tmc9660_instance_t *inst, uint8_t cmd, uint32_t req_value)
 {
-	for (size_t i = 0; i < len; i++) {
-		uart_poll_out(uart, data[i]);
-	}
-	return 0;
+	tmc9660_msg_t req;
+
+	/* Build request message */
+	req.sync_or_host = TMC9660_SYNC_BYTE;
+	req.device_addr = inst->state.device_addr;
+	req.cmd_or_status = cmd;
+	pack_u32_msb(req.data, req_value);
+	req.crc8 = crc_tmc8((uint8_t *)&req, TMC9660_MSG_SIZE - 1);
+
+	inst->state.transactions++;
+	trace_record(TRACE_EVT_TMC_START, (uint8_t)(inst - motors), cmd);
+
+	/* Send request (reply reception is armed before the first byte goes out) */
+	return tmc9660_bus_start(&inst->bus, (uint8_t *)&req, TMC9660_MSG_SIZE,
+				 TMC9660_MSG_SIZE);
 }
 
 /**
- * Receive UART data with timeout
+ * Count a failed exchange; persistent errors step the link rate down
  */
-static int uart_recv(const struct device *uart, uint8_t *data, size_t len, k_timeout_t timeout)
+static void tmc9660_link_error(tmc9660_instance_t *inst, int err)
 {
-	int64_t end_time = k_uptime_get() + timeout.ticks;
+	if (err == -ETIMEDOUT) {
+		inst->state.timeouts++;
+	} else {
+		inst->state.crc_errors++;
+	}
 
-	for (size_t i = 0; i < len; i++) {
-		int ret;
-		do {
-			ret = uart_poll_in(uart, &data[i]);
-			if (ret == 0) {
-				break;  /* Byte received */
-			}
-			if (k_uptime_get() >= end_time) {
-				return -ETIMEDOUT;
-			}
-			k_sleep(K_USEC(100));
-		} while (ret != 0);
+	if (inst->negotiating || inst->baud_rung == 0 ||
+	    ++inst->link_errors < TMC9660_BAUD_FALLBACK_ERRORS) {
+		return;
 	}
 
-	return 0;
+	LOG_WRN("%s: %u link errors in a row at %u baud, stepping down",
+		inst->name, inst->link_errors, inst->state.baud);
+	inst->state.baud_fallbacks++;
+	tmc9660_set_rung(inst, inst->baud_rung - 1);
 }
 
 /**
- * Send command and receive reply
+ * Wait for the reply of a started exchange and validate it
  */
-static int tmc9660_transact(tmc9660_instance_t *inst, uint8_t cmd, uint32_t req_value,
-			     uint32_t *reply_value, uint8_t *reply_status)
+static int tmc9660_request_finish(tmc9660_instance_t *inst, uint32_t *reply_value,
+				  uint8_t *reply_status)
 {
-	tmc9660_msg_t req, reply;
+	tmc9660_msg_t reply;
 	int ret;
 
-	/* Build request message */
-	req.sync_or_host = TMC9660_SYNC_BYTE;
-	req.device_addr = inst->state.device_addr;
-	req.cmd_or_status = cmd;
-	pack_u32_msb(req.data, req_value);
-	req.crc8 = tmc9660_crc8((uint8_t *)&req, TMC9660_MSG_SIZE - 1);
-
-	/* Send request */
-	ret = uart_send(inst->uart_dev, (uint8_t *)&req, TMC9660_MSG_SIZE);
-	if (ret < 0) {
-		return ret;
-	}
-
-	/* Receive reply */
-	ret = uart_recv(inst->uart_dev, (uint8_t *)&reply, TMC9660_MSG_SIZE,
-			K_MSEC(TMC9660_REPLY_TIMEOUT_MS));
+	/* Sleep until the reply is complete */
+	ret = tmc9660_bus_finish(&inst->bus, (uint8_t *)&reply,
+				 K_MSEC(TMC9660_REPLY_TIMEOUT_MS));
+	trace_record(TRACE_EVT_TMC_DONE, (uint8_t)(inst - motors), (uint16_t)ret);
 	if (ret < 0) {
+		tmc9660_link_error(inst, ret);
 		return ret;
 	}
 
 	/* Verify CRC */
-	uint8_t expected_crc = tmc9660_crc8((uint8_t *)&reply, TMC9660_MSG_SIZE - 1);
+	uint8_t expected_crc = crc_tmc8((uint8_t *)&reply, TMC9660_MSG_SIZE - 1);
 	if (reply.crc8 != expected_crc) {
+		tmc9660_link_error(inst, -EBADMSG);
 		return -EBADMSG;
 	}
 
+	/* A valid reply, even with an error status, proves the link */
+	inst->link_errors = 0;
+
 	/* Extract reply data */
 	if (reply_value) {
 		*reply_value = unpack_u32_msb(reply.data);
@@ -187,56 +199,337 @@ static int tmc9660_transact(tmc9660_instance_t *inst, uint8_t cmd, uint32_t req_
 	return 0;
 }
 
-int tmc9660_init(tmc9660_motor_id_t motor)
+/**
+ * Get the CONFIG shadow word at the current address pointer
+ *
+ * @return Word index, -1 if the pointer is outside CONFIG memory
+ */
+static int tmc9660_shadow_word(const tmc9660_instance_t *inst)
 {
-	int ret;
-	uint32_t value;
-	tmc9660_instance_t *inst;
+	uint32_t addr = inst->state.current_addr;
 
-	if (motor >= TMC9660_NUM_MOTORS) {
-		return -EINVAL;
+	if (inst->state.current_bank != TMC9660_BANK_CONFIG ||
+	    addr == TMC9660_ADDR_UNKNOWN || addr < TMC9660_CONFIG_BASE_ADDR ||
+	    addr >= TMC9660_CONFIG_BASE_ADDR + TMC9660_CONFIG_SIZE || (addr & 0x03)) {
+		return -1;
 	}
 
-	inst = &motors[motor];
+	return (int)((addr - TMC9660_CONFIG_BASE_ADDR) / 4);
+}
 
-	k_mutex_init(&inst->mutex);
-	k_mutex_lock(&inst->mutex, K_FOREVER);
+/**
+ * Keep the cached bank/address and the shadow in sync after a successful command
+ */
+static void tmc9660_track_state(tmc9660_instance_t *inst, uint8_t cmd, uint32_t req_value)
+{
+	int word;
 
-	/* Get UART device */
-	switch (motor) {
-	case TMC9660_MOTOR_A:
-		inst->uart_dev = DEVICE_DT_GET(DT_ALIAS(tmc9660a));
+	switch (cmd) {
+	case TMC9660_CMD_SET_BANK:
+		inst->state.current_bank = (uint8_t)req_value;
 		break;
-	case TMC9660_MOTOR_B:
-		inst->uart_dev = DEVICE_DT_GET(DT_ALIAS(tmc9660b));
+	case TMC9660_CMD_SET_ADDRESS:
+		inst->state.current_addr = req_value;
+		break;
+	case TMC9660_CMD_WRITE_32:
+	case TMC9660_CMD_WRITE_32_INC:
+		word = tmc9660_shadow_word(inst);
+		if (word >= 0) {
+			inst->shadow[word] = req_value;
+			inst->shadow_valid |= BIT(word);
+			inst->shadow_dirty &= ~BIT(word);
+		}
+		if (cmd == TMC9660_CMD_WRITE_32_INC) {
+			inst->state.current_addr += 4;
+		}
 		break;
-	case TMC9660_MOTOR_C:
-		inst->uart_dev = DEVICE_DT_GET(DT_ALIAS(tmc9660c));
+	case TMC9660_CMD_READ_32_INC:
+		inst->state.current_addr += 4;
 		break;
 	default:
-		LOG_ERR("%s: Invalid motor ID", inst->name);
-		k_mutex_unlock(&inst->mutex);
-		return -EINVAL;
+		break;
 	}
+}
 
-	if (!inst->uart_dev || !device_is_ready(inst->uart_dev)) {
-		LOG_ERR("%s: UART device not ready", inst->name);
-		k_mutex_unlock(&inst->mutex);
-		return -ENODEV;
+/**
+ * Forget what a failed command may have changed
+ * A lost reply does not mean the chip did not execute the request.
+ */
+static void tmc9660_track_failure(tmc9660_instance_t *inst, uint8_t cmd)
+{
+	int word;
+
+	switch (cmd) {
+	case TMC9660_CMD_SET_BANK:
+		inst->state.current_bank = 0xFF;
+		break;
+	case TMC9660_CMD_WRITE_32:
+	case TMC9660_CMD_WRITE_32_INC:
+		word = tmc9660_shadow_word(inst);
+		if (word >= 0) {
+			inst->shadow_valid &= ~BIT(word);
+		}
+		inst->state.current_addr = TMC9660_ADDR_UNKNOWN;
+		break;
+	case TMC9660_CMD_SET_ADDRESS:
+	case TMC9660_CMD_READ_32_INC:
+		inst->state.current_addr = TMC9660_ADDR_UNKNOWN;
+		break;
+	default:
+		break;
 	}
+}
 
-	LOG_INF("%s: UART initialized", inst->name);
+/**
+ * Send command and receive reply
+ */
+static int tmc9660_transact(tmc9660_instance_t *inst, uint8_t cmd, uint32_t req_value,
+			     uint32_t *reply_value, uint8_t *reply_status)
+{
+	int ret;
 
-	/* Small delay for chip startup */
-	k_sleep(K_MSEC(10));
+	ret = tmc9660_request_start(inst, cmd, req_value);
+	if (ret < 0) {
+		return ret;
+	}
 
-	/* Verify chip type */
-	ret = tmc9660_transact(inst, TMC9660_CMD_GET_INFO, TMC9660_INFO_CHIP_TYPE,
-			       &value, NULL);
+	ret = tmc9660_request_finish(inst, reply_value, reply_status);
+	if (ret == 0) {
+		tmc9660_track_state(inst, cmd, req_value);
+	} else {
+		tmc9660_track_failure(inst, cmd);
+	}
+
+	return ret;
+}
+
+/**
+ * Fan one request out to every motor in the mask, then collect the replies
+ * Caller must hold the mutex of every motor in the mask.
+ */
+static int tmc9660_transact_batch(uint8_t motor_mask, tmc9660_xfer_t xfers[TMC9660_NUM_MOTORS])
+{
+	int ret = 0;
+
+	/* Issue all requests - the three USARTs transfer concurrently */
+	for (int i = 0; i < TMC9660_NUM_MOTORS; i++) {
+		if (motor_mask & TMC9660_MOTOR_MASK(i)) {
+			xfers[i].status = 0xFF;
+			xfers[i].result = tmc9660_request_start(&motors[i], xfers[i].cmd,
+							       xfers[i].value);
+		}
+	}
+
+	/* Collect replies - total wait is the slowest link, not the sum */
+	for (int i = 0; i < TMC9660_NUM_MOTORS; i++) {
+		if (!(motor_mask & TMC9660_MOTOR_MASK(i)) || xfers[i].result < 0) {
+			continue;
+		}
+
+		xfers[i].result = tmc9660_request_finish(&motors[i], &xfers[i].reply,
+							 &xfers[i].status);
+		if (xfers[i].result == 0) {
+			tmc9660_track_state(&motors[i], xfers[i].cmd, xfers[i].value);
+		} else {
+			tmc9660_track_failure(&motors[i], xfers[i].cmd);
+		}
+	}
+
+	for (int i = 0; i < TMC9660_NUM_MOTORS; i++) {
+		if ((motor_mask & TMC9660_MOTOR_MASK(i)) && xfers[i].result < 0 && ret == 0) {
+			ret = xfers[i].result;
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * Point the chip at bank/addr, sending only what differs (mutex held)
+ */
+static int tmc9660_seek(tmc9660_instance_t *inst, uint8_t bank, uint32_t addr)
+{
+	int ret;
+
+	if (inst->state.current_bank != bank) {
+		ret = tmc9660_transact(inst, TMC9660_CMD_SET_BANK, bank, NULL, NULL);
+		if (ret < 0) {
+			return ret;
+		}
+	} else {
+		inst->state.elided++;
+	}
+
+	if (inst->state.current_addr != addr) {
+		return tmc9660_transact(inst, TMC9660_CMD_SET_ADDRESS, addr, NULL, NULL);
+	}
+
+	inst->state.elided++;
+	return 0;
+}
+
+/**
+ * Switch the host UART to a ladder rung (between exchanges, mutex held)
+ * Garbled traffic may have moved the chip's pointers, so they are
+ * forgotten; the CONFIG shadow stays (writes are CRC protected).
+ */
+static int tmc9660_set_rung(tmc9660_instance_t *inst, uint8_t rung)
+{
+	int ret = tmc9660_bus_set_baud(&inst->bus, baud_ladder[rung]);
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	inst->baud_rung = rung;
+	inst->link_errors = 0;
+	inst->state.baud = inst->bus.rate;
+	inst->state.current_bank = 0xFF;
+	inst->state.current_addr = TMC9660_ADDR_UNKNOWN;
+
+	return 0;
+}
+
+/* Run NO_OPs at the current rate; any failure rejects it (mutex held) */
+static int tmc9660_probe_link(tmc9660_instance_t *inst)
+{
+	for (int i = 0; i < TMC9660_BAUD_PROBES; i++) {
+		int ret = tmc9660_transact(inst, TMC9660_CMD_NO_OP, 0, NULL, NULL);
+
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Climb the baud ladder while each rung verifies (mutex held)
+ * A rejected rung drops back to the last good one, which is verified
+ * again; if even that fails the link returns to the autobaud default.
+ */
+static void tmc9660_negotiate_baud(tmc9660_instance_t *inst)
+{
+	uint8_t good = inst->baud_rung;
+
+	if (IS_ENABLED(CONFIG_SEGMENT_TMC9660_SPI)) {
+		LOG_INF("%s: SPI link at %u Hz", inst->name, inst->state.baud);
+		return;
+	}
+
+	inst->negotiating = true;
+
+	for (uint8_t rung = good + 1; rung < ARRAY_SIZE(baud_ladder) &&
+	     baud_ladder[rung] <= CONFIG_SEGMENT_TMC9660_MAX_BAUD; rung++) {
+		if (tmc9660_set_rung(inst, rung) < 0 || tmc9660_probe_link(inst) < 0) {
+			break;
+		}
+		good = rung;
+	}
+
+	if (inst->baud_rung != good &&
+	    (tmc9660_set_rung(inst, good) < 0 || tmc9660_probe_link(inst) < 0)) {
+		LOG_WRN("%s: %u baud lost after probing, back to %u", inst->name,
+			baud_ladder[good], TMC9660_BAUD_DEFAULT);
+		tmc9660_set_rung(inst, 0);
+	}
+
+	inst->negotiating = false;
+
+	LOG_INF("%s: link at %u baud", inst->name, inst->state.baud);
+}
+
+static void tmc9660_invalidate(tmc9660_instance_t *inst)
+{
+	inst->state.current_bank = 0xFF;
+	inst->state.current_addr = TMC9660_ADDR_UNKNOWN;
+	inst->shadow_valid = 0;
+	inst->shadow_dirty = 0;
+}
+
+/**
+ * Stage a CONFIG word (mutex held); unchanged values are not staged
+ */
+static void tmc9660_stage(tmc9660_instance_t *inst, uint8_t word, uint32_t value)
+{
+	uint16_t bit = BIT(word);
+
+	if ((inst->shadow_valid & bit) && !(inst->shadow_dirty & bit) &&
+	    inst->shadow[word] == value) {
+		inst->state.elided++;
+		return;
+	}
+
+	inst->shadow[word] = value;
+	inst->shadow_dirty |= bit;
+}
+
+/**
+ * Write staged CONFIG words, one WRITE_32_INC burst per run (mutex held)
+ */
+static int tmc9660_flush(tmc9660_instance_t *inst)
+{
+	int ret;
+
+	while (inst->shadow_dirty) {
+		uint8_t word = (uint8_t)(find_lsb_set(inst->shadow_dirty) - 1);
+
+		ret = tmc9660_seek(inst, TMC9660_BANK_CONFIG,
+				   TMC9660_CONFIG_BASE_ADDR + word * 4U);
+		if (ret < 0) {
+			return ret;
+		}
+
+		/* track_state() marks each word clean and advances the pointer */
+		while (word < TMC9660_CONFIG_WORDS && (inst->shadow_dirty & BIT(word))) {
+			ret = tmc9660_transact(inst, TMC9660_CMD_WRITE_32_INC,
+					       inst->shadow[word], NULL, NULL);
+			if (ret < 0) {
+				return ret;
+			}
+			word++;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Bring up the transport (no chip traffic)
+ */
+static int tmc9660_open(tmc9660_motor_id_t motor)
+{
+	tmc9660_instance_t *inst = &motors[motor];
+	int ret;
+
+	k_mutex_init(&inst->mutex);
+	tmc9660_invalidate(inst);
+
+	ret = tmc9660_bus_init(&inst->bus, (uint8_t)motor);
+	if (ret == -ENODEV) {
+		LOG_ERR("%s: transport device not ready", inst->name);
+		return ret;
+	}
+	if (ret < 0) {
+		LOG_ERR("%s: transport init failed: %d", inst->name, ret);
+		return ret;
+	}
+
+	inst->state.baud = inst->bus.rate;
+
+	LOG_INF("%s: transport initialized", inst->name);
+	return 0;
+}
+
+/**
+ * Check the reply to GET_INFO(CHIP_TYPE)
+ */
+static int tmc9660_check_chip_type(tmc9660_instance_t *inst, int ret, uint32_t value)
+{
 	if (ret < 0) {
 		LOG_WRN("%s: Failed to read chip type: %d (chip may not be connected)",
 			inst->name, ret);
-		k_mutex_unlock(&inst->mutex);
 		return ret;
 	}
 
@@ -244,51 +537,139 @@ int tmc9660_init(tmc9660_motor_id_t motor)
 	if (value != TMC9660_CHIP_TYPE_EXPECTED) {
 		LOG_ERR("%s: Unexpected chip type: 0x%08X (expected 0x%08X)",
 			inst->name, value, TMC9660_CHIP_TYPE_EXPECTED);
-		k_mutex_unlock(&inst->mutex);
 		return -ENODEV;
 	}
 
 	LOG_INF("%s: Chip type verified: 0x%08X", inst->name, value);
+	return 0;
+}
 
-	/* Read chip version */
-	ret = tmc9660_transact(inst, TMC9660_CMD_GET_INFO, TMC9660_INFO_CHIP_VERSION,
-			       &value, NULL);
-	if (ret == 0) {
-		inst->state.chip_version = value;
-		LOG_INF("%s: Chip version: %u", inst->name, value);
+/**
+ * Store the replies to GET_INFO(CHIP_VERSION) and GET_INFO(BL_VERSION)
+ */
+static void tmc9660_store_versions(tmc9660_instance_t *inst, int ver_ret, uint32_t version,
+				   int bl_ret, uint32_t bl_version)
+{
+	if (ver_ret == 0) {
+		inst->state.chip_version = version;
+		LOG_INF("%s: Chip version: %u", inst->name, version);
 	}
 
-	/* Read bootloader version */
-	ret = tmc9660_transact(inst, TMC9660_CMD_GET_INFO, TMC9660_INFO_BL_VERSION,
-			       &value, NULL);
-	if (ret == 0) {
-		inst->state.bootloader_version = value;
-		uint16_t major = (value >> 16) & 0xFFFF;
-		uint16_t minor = value & 0xFFFF;
+	if (bl_ret == 0) {
+		inst->state.bootloader_version = bl_version;
+		uint16_t major = (bl_version >> 16) & 0xFFFF;
+		uint16_t minor = bl_version & 0xFFFF;
 		LOG_INF("%s: Bootloader version: %u.%u", inst->name, major, minor);
 	}
 
 	inst->state.initialized = true;
+	LOG_INF("%s: initialized successfully", inst->name);
+}
+
+int tmc9660_init(tmc9660_motor_id_t motor)
+{
+	int ret, ver_ret, bl_ret;
+	uint32_t value = 0, version = 0, bl_version = 0;
+	tmc9660_instance_t *inst;
+
+	if (motor >= TMC9660_NUM_MOTORS) {
+		return -EINVAL;
+	}
+
+	inst = &motors[motor];
+
+	ret = tmc9660_open(motor);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_mutex_lock(&inst->mutex, K_FOREVER);
+
+	/* Small delay for chip startup */
+	k_sleep(K_MSEC(10));
+
+	/* Verify chip type */
+	ret = tmc9660_transact(inst, TMC9660_CMD_GET_INFO, TMC9660_INFO_CHIP_TYPE,
+			       &value, NULL);
+	ret = tmc9660_check_chip_type(inst, ret, value);
+	if (ret < 0) {
+		k_mutex_unlock(&inst->mutex);
+		return ret;
+	}
+
+	/* Read chip and bootloader version */
+	ver_ret = tmc9660_transact(inst, TMC9660_CMD_GET_INFO, TMC9660_INFO_CHIP_VERSION,
+				   &version, NULL);
+	bl_ret = tmc9660_transact(inst, TMC9660_CMD_GET_INFO, TMC9660_INFO_BL_VERSION,
+				  &bl_version, NULL);
+
+	tmc9660_store_versions(inst, ver_ret, version, bl_ret, bl_version);
+	tmc9660_negotiate_baud(inst);
 	k_mutex_unlock(&inst->mutex);
 
-	LOG_INF("%s: initialized successfully", inst->name);
 	return 0;
 }
 
 int tmc9660_init_all(void)
 {
-	int ret;
+	tmc9660_xfer_t xfers[TMC9660_NUM_MOTORS];
+	tmc9660_xfer_t bl_xfers[TMC9660_NUM_MOTORS];
+	uint8_t mask = 0;
 	int success_count = 0;
 
 	LOG_INF("Initializing all TMC9660 motors...");
 
 	for (int i = 0; i < TMC9660_NUM_MOTORS; i++) {
-		ret = tmc9660_init((tmc9660_motor_id_t)i);
-		if (ret == 0) {
+		if (tmc9660_open((tmc9660_motor_id_t)i) == 0) {
+			mask |= TMC9660_MOTOR_MASK(i);
+		}
+	}
+
+	/* Small delay for chip startup (once for all chips) */
+	k_sleep(K_MSEC(10));
+
+	/* Probe all chips in parallel: one round trip per step instead of three */
+	for (int i = 0; i < TMC9660_NUM_MOTORS; i++) {
+		xfers[i].cmd = TMC9660_CMD_GET_INFO;
+		xfers[i].value = TMC9660_INFO_CHIP_TYPE;
+		xfers[i].reply = 0;
+	}
+	tmc9660_transact_all(mask, xfers);
+
+	for (int i = 0; i < TMC9660_NUM_MOTORS; i++) {
+		if ((mask & TMC9660_MOTOR_MASK(i)) &&
+		    tmc9660_check_chip_type(&motors[i], xfers[i].result, xfers[i].reply) < 0) {
+			mask &= ~TMC9660_MOTOR_MASK(i);
+		}
+	}
+
+	/* Read chip and bootloader version */
+	for (int i = 0; i < TMC9660_NUM_MOTORS; i++) {
+		xfers[i].cmd = TMC9660_CMD_GET_INFO;
+		xfers[i].value = TMC9660_INFO_CHIP_VERSION;
+		bl_xfers[i].cmd = TMC9660_CMD_GET_INFO;
+		bl_xfers[i].value = TMC9660_INFO_BL_VERSION;
+	}
+	tmc9660_transact_all(mask, xfers);
+	tmc9660_transact_all(mask, bl_xfers);
+
+	for (int i = 0; i < TMC9660_NUM_MOTORS; i++) {
+		if (mask & TMC9660_MOTOR_MASK(i)) {
+			tmc9660_store_versions(&motors[i], xfers[i].result, xfers[i].reply,
+					       bl_xfers[i].result, bl_xfers[i].reply);
 			success_count++;
 		}
 	}
 
+	/* Raise each link (a few ms per chip; a rejected rung costs one timeout) */
+	for (int i = 0; i < TMC9660_NUM_MOTORS; i++) {
+		if (mask & TMC9660_MOTOR_MASK(i)) {
+			k_mutex_lock(&motors[i].mutex, K_FOREVER);
+			tmc9660_negotiate_baud(&motors[i]);
+			k_mutex_unlock(&motors[i].mutex);
+		}
+	}
+
 	if (success_count == 0) {
 		LOG_ERR("No TMC9660 motors initialized");
 		return -ENODEV;
@@ -300,6 +681,36 @@ int tmc9660_init_all(void)
 	return (success_count == TMC9660_NUM_MOTORS) ? 0 : -ENODEV;
 }
 
+int tmc9660_transact_all(uint8_t motor_mask, tmc9660_xfer_t xfers[TMC9660_NUM_MOTORS])
+{
+	int ret;
+
+	if (!xfers || (motor_mask & ~TMC9660_MOTOR_MASK_ALL)) {
+		return -EINVAL;
+	}
+
+	if (motor_mask == 0) {
+		return 0;
+	}
+
+	/* Lock in motor order so concurrent batches cannot deadlock */
+	for (int i = 0; i < TMC9660_NUM_MOTORS; i++) {
+		if (motor_mask & TMC9660_MOTOR_MASK(i)) {
+			k_mutex_lock(&motors[i].mutex, K_FOREVER);
+		}
+	}
+
+	ret = tmc9660_transact_batch(motor_mask, xfers);
+
+	for (int i = TMC9660_NUM_MOTORS - 1; i >= 0; i--) {
+		if (motor_mask & TMC9660_MOTOR_MASK(i)) {
+			k_mutex_unlock(&motors[i].mutex);
+		}
+	}
+
+	return ret;
+}
+
 bool tmc9660_is_ready(tmc9660_motor_id_t motor)
 {
 	if (motor >= TMC9660_NUM_MOTORS) {
@@ -340,14 +751,12 @@ int tmc9660_set_bank(tmc9660_motor_id_t motor, uint8_t bank)
 
 	/* Only send if bank is different */
 	if (inst->state.current_bank == bank) {
+		inst->state.elided++;
 		k_mutex_unlock(&inst->mutex);
 		return 0;
 	}
 
 	ret = tmc9660_transact(inst, TMC9660_CMD_SET_BANK, bank, &reply_value, NULL);
-	if (ret == 0) {
-		inst->state.current_bank = bank;
-	}
 
 	k_mutex_unlock(&inst->mutex);
 	return ret;
@@ -366,11 +775,15 @@ int tmc9660_set_address(tmc9660_motor_id_t motor, uint32_t addr)
 	inst = &motors[motor];
 	k_mutex_lock(&inst->mutex, K_FOREVER);
 
-	ret = tmc9660_transact(inst, TMC9660_CMD_SET_ADDRESS, addr, &reply_value, NULL);
-	if (ret == 0) {
-		inst->state.current_addr = addr;
+	/* Only send if the pointer is elsewhere (or unknown) */
+	if (inst->state.current_addr == addr) {
+		inst->state.elided++;
+		k_mutex_unlock(&inst->mutex);
+		return 0;
 	}
 
+	ret = tmc9660_transact(inst, TMC9660_CMD_SET_ADDRESS, addr, &reply_value, NULL);
+
 	k_mutex_unlock(&inst->mutex);
 	return ret;
 }
@@ -410,62 +823,107 @@ int tmc9660_write_32(tmc9660_motor_id_t motor, uint32_t value)
 	return ret;
 }
 
+/* CONFIG offset check: in range and 4-byte aligned */
+static bool tmc9660_config_offset_ok(uint8_t offset)
+{
+	return offset < TMC9660_CONFIG_SIZE && (offset & 0x03) == 0;
+}
+
 int tmc9660_read_config(tmc9660_motor_id_t motor, uint8_t offset, uint32_t *value)
 {
+	tmc9660_instance_t *inst;
+	uint8_t word = offset / 4;
 	int ret;
 
-	if (motor >= TMC9660_NUM_MOTORS || !value || offset >= TMC9660_CONFIG_SIZE) {
+	if (motor >= TMC9660_NUM_MOTORS || !value || !tmc9660_config_offset_ok(offset)) {
 		return -EINVAL;
 	}
 
-	/* Ensure offset is 4-byte aligned */
-	if (offset & 0x03) {
-		return -EINVAL;
-	}
+	inst = &motors[motor];
+	k_mutex_lock(&inst->mutex, K_FOREVER);
 
-	/* Set bank to CONFIG */
-	ret = tmc9660_set_bank(motor, TMC9660_BANK_CONFIG);
-	if (ret < 0) {
-		return ret;
+	/* Shadow hit (including staged writes) */
+	if ((inst->shadow_valid | inst->shadow_dirty) & BIT(word)) {
+		*value = inst->shadow[word];
+		inst->state.elided++;
+		k_mutex_unlock(&inst->mutex);
+		return 0;
 	}
 
-	/* Set address */
-	ret = tmc9660_set_address(motor, TMC9660_CONFIG_BASE_ADDR + offset);
-	if (ret < 0) {
-		return ret;
+	ret = tmc9660_seek(inst, TMC9660_BANK_CONFIG, TMC9660_CONFIG_BASE_ADDR + offset);
+	if (ret == 0) {
+		/* Auto-increment: the next word needs no SET_ADDRESS */
+		ret = tmc9660_transact(inst, TMC9660_CMD_READ_32_INC, 0, value, NULL);
+	}
+	if (ret == 0) {
+		inst->shadow[word] = *value;
+		inst->shadow_valid |= BIT(word);
 	}
 
-	/* Read value */
-	return tmc9660_read_32(motor, value);
+	k_mutex_unlock(&inst->mutex);
+	return ret;
 }
 
 int tmc9660_write_config(tmc9660_motor_id_t motor, uint8_t offset, uint32_t value)
 {
+	tmc9660_instance_t *inst;
 	int ret;
 
-	if (motor >= TMC9660_NUM_MOTORS || offset >= TMC9660_CONFIG_SIZE) {
+	if (motor >= TMC9660_NUM_MOTORS || !tmc9660_config_offset_ok(offset)) {
 		return -EINVAL;
 	}
 
-	/* Ensure offset is 4-byte aligned */
-	if (offset & 0x03) {
+	inst = &motors[motor];
+	k_mutex_lock(&inst->mutex, K_FOREVER);
+	tmc9660_stage(inst, offset / 4, value);
+	ret = tmc9660_flush(inst);
+	k_mutex_unlock(&inst->mutex);
+
+	return ret;
+}
+
+int tmc9660_config_stage(tmc9660_motor_id_t motor, uint8_t offset, uint32_t value)
+{
+	tmc9660_instance_t *inst;
+
+	if (motor >= TMC9660_NUM_MOTORS || !tmc9660_config_offset_ok(offset)) {
 		return -EINVAL;
 	}
 
-	/* Set bank to CONFIG */
-	ret = tmc9660_set_bank(motor, TMC9660_BANK_CONFIG);
-	if (ret < 0) {
-		return ret;
+	inst = &motors[motor];
+	k_mutex_lock(&inst->mutex, K_FOREVER);
+	tmc9660_stage(inst, offset / 4, value);
+	k_mutex_unlock(&inst->mutex);
+
+	return 0;
+}
+
+int tmc9660_config_flush(tmc9660_motor_id_t motor)
+{
+	tmc9660_instance_t *inst;
+	int ret;
+
+	if (motor >= TMC9660_NUM_MOTORS) {
+		return -EINVAL;
 	}
 
-	/* Set address */
-	ret = tmc9660_set_address(motor, TMC9660_CONFIG_BASE_ADDR + offset);
-	if (ret < 0) {
-		return ret;
+	inst = &motors[motor];
+	k_mutex_lock(&inst->mutex, K_FOREVER);
+	ret = tmc9660_flush(inst);
+	k_mutex_unlock(&inst->mutex);
+
+	return ret;
+}
+
+void tmc9660_config_invalidate(tmc9660_motor_id_t motor)
+{
+	if (motor >= TMC9660_NUM_MOTORS) {
+		return;
 	}
 
-	/* Write value */
-	return tmc9660_write_32(motor, value);
+	k_mutex_lock(&motors[motor].mutex, K_FOREVER);
+	tmc9660_invalidate(&motors[motor]);
+	k_mutex_unlock(&motors[motor].mutex);
 }
 
 void tmc9660_get_state(tmc9660_motor_id_t motor, tmc9660_state_t *state_out)
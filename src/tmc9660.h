@@ -1,7 +1,8 @@
 /*
- * TMC9660 UART Driver - Multi-Motor Support
+ * TMC9660 Driver - Multi-Motor Support
  * Smart gate driver with FOC controller
- * Communication via UART bootloader protocol
+ * Communication via bootloader protocol, over UART or SPI
+ * (CONFIG_SEGMENT_TMC9660_TRANSPORT)
  *
  * Supports 3 independent TMC9660 chips (motors A, B, C)
  *
@@ -30,6 +31,9 @@ typedef enum {
 #define TMC9660_DEFAULT_HOST_ADDR   0xFF
 #define TMC9660_MSG_SIZE            8
 
+/* Link rate the chip's autobaud starts at (device tree current-speed) */
+#define TMC9660_BAUD_DEFAULT        115200
+
 /* TMC9660 Bootloader Commands */
 #define TMC9660_CMD_GET_INFO        0x00
 #define TMC9660_CMD_GET_BANK        0x08
@@ -73,6 +77,10 @@ typedef enum {
 /* TMC9660 Configuration Memory */
 #define TMC9660_CONFIG_BASE_ADDR    0x00020000
 #define TMC9660_CONFIG_SIZE         64
+#define TMC9660_CONFIG_WORDS        (TMC9660_CONFIG_SIZE / 4)
+
+/* current_addr value while the chip's address pointer is unknown */
+#define TMC9660_ADDR_UNKNOWN        0xFFFFFFFFU
 
 /* Expected chip identification */
 #define TMC9660_CHIP_TYPE_EXPECTED  0x544D0001
@@ -91,16 +99,50 @@ typedef struct __attribute__((packed)) {
 typedef struct {
 	uint8_t device_addr;     /* Current device address */
 	uint8_t host_addr;       /* Current host address */
-	uint8_t current_bank;    /* Currently selected memory bank */
-	uint32_t current_addr;   /* Current memory address */
+	uint8_t current_bank;    /* Currently selected memory bank (0xFF = unknown) */
+	uint32_t current_addr;   /* Current memory address (TMC9660_ADDR_UNKNOWN) */
 	bool initialized;        /* Initialization status */
 	uint32_t chip_type;      /* Chip type ID */
 	uint32_t chip_version;   /* Silicon revision */
 	uint32_t bootloader_version; /* Bootloader version */
+	uint32_t transactions;   /* Requests sent */
+	uint32_t elided;         /* Requests saved by the bank/address/CONFIG caches */
+	uint32_t baud;           /* Current link rate: UART baud, SPI clock (Hz) */
+	uint32_t crc_errors;     /* Replies with bad CRC or framing errors */
+	uint32_t timeouts;       /* Requests without a (complete) reply */
+	uint32_t baud_fallbacks; /* Rate reductions after persistent link errors */
 } tmc9660_state_t;
 
+/* One request/reply slot of a batched transaction (see tmc9660_transact_all) */
+typedef struct {
+	uint8_t cmd;             /* Request: command (TMC9660_CMD_*) */
+	uint32_t value;          /* Request: 32-bit data */
+	uint32_t reply;          /* Reply: 32-bit data */
+	uint8_t status;          /* Reply: status (TMC9660_STATUS_*) */
+	int result;              /* 0 on success, negative errno on error */
+} tmc9660_xfer_t;
+
+/* Motor selection mask for batched transactions */
+#define TMC9660_MOTOR_MASK(motor)   (1U << (motor))
+#define TMC9660_MOTOR_MASK_ALL      ((1U << TMC9660_NUM_MOTORS) - 1U)
+
+/*
+ * Link rate: every request starts with the 0x55 sync byte, from which
+ * the TMC9660 measures the host's baud rate, so the host can change its
+ * UART rate between requests. After a chip is identified at
+ * TMC9660_BAUD_DEFAULT the driver climbs a ladder of faster rates up to
+ * CONFIG_SEGMENT_TMC9660_MAX_BAUD, keeping each rung only if a run of
+ * NO_OPs passes without a CRC error or timeout. At run time a few link
+ * errors in a row step the rate down one rung.
+ *
+ * On the SPI transport the clock is fixed by spi-max-frequency and
+ * there is no ladder.
+ */
+
 /**
  * Initialize all TMC9660 UART drivers
+ * Chips are probed in parallel (one round trip per probe step), then
+ * each link is raised to the fastest rate that verifies.
  *
  * @return 0 on success, negative errno on error
  */
@@ -108,6 +150,7 @@ int tmc9660_init_all(void);
 
 /**
  * Initialize specific TMC9660 motor
+ * Identifies the chip at TMC9660_BAUD_DEFAULT, then raises the link rate.
  *
  * @param motor Motor ID (MOTOR_A, MOTOR_B, or MOTOR_C)
  * @return 0 on success, negative errno on error
@@ -168,12 +211,29 @@ int tmc9660_read_32(tmc9660_motor_id_t motor, uint32_t *value);
  */
 int tmc9660_write_32(tmc9660_motor_id_t motor, uint32_t value);
 
+/*
+ * CONFIG memory access goes through a per-motor shadow of the 64-byte
+ * region. The driver also remembers the selected bank and the chip's
+ * address pointer (which READ_32_INC/WRITE_32_INC advance), so
+ * SET_BANK and SET_ADDRESS are only sent when they change something:
+ *
+ *   - A read of a word already in the shadow costs no UART traffic
+ *   - A write of the value already in the shadow is skipped
+ *   - Staged writes are flushed in ascending address runs, one
+ *     SET_ADDRESS per run followed by WRITE_32_INC per word
+ *   - Sequential accesses need one transaction each
+ *
+ * Raw tmc9660_write_32() calls into CONFIG memory update the shadow as
+ * well. A failed transaction forgets the state it may have changed.
+ */
+
 /**
  * Read register from CONFIG memory
- * Automatically handles bank selection and address setting
+ * Served from the shadow when cached; otherwise read with READ_32_INC
+ * (bank and address only sent if they differ) and cached.
  *
  * @param motor Motor ID
- * @param offset Offset within CONFIG memory (0-63)
+ * @param offset Offset within CONFIG memory (0-63, 4-byte aligned)
  * @param value Output: 32-bit value read
  * @return 0 on success, negative errno on error
  */
@@ -181,16 +241,45 @@ int tmc9660_read_config(tmc9660_motor_id_t motor, uint8_t offset, uint32_t *valu
 
 /**
  * Write register to CONFIG memory
- * Automatically handles bank selection and address setting
+ * Stages the value and flushes everything staged for this motor.
  * Note: Writing to CONFIG triggers runtime reconfiguration
  *
  * @param motor Motor ID
- * @param offset Offset within CONFIG memory (0-63)
+ * @param offset Offset within CONFIG memory (0-63, 4-byte aligned)
  * @param value 32-bit value to write
  * @return 0 on success, negative errno on error
  */
 int tmc9660_write_config(tmc9660_motor_id_t motor, uint8_t offset, uint32_t value);
 
+/**
+ * Stage a CONFIG register write without sending it
+ * Reads return the staged value; tmc9660_config_flush() sends it.
+ *
+ * @param motor Motor ID
+ * @param offset Offset within CONFIG memory (0-63, 4-byte aligned)
+ * @param value 32-bit value to write
+ * @return 0 on success, -EINVAL on bad arguments
+ */
+int tmc9660_config_stage(tmc9660_motor_id_t motor, uint8_t offset, uint32_t value);
+
+/**
+ * Write all staged CONFIG registers as WRITE_32_INC bursts
+ * Words that fail stay staged for the next flush.
+ *
+ * @param motor Motor ID
+ * @return 0 on success, negative errno on the first failed transaction
+ */
+int tmc9660_config_flush(tmc9660_motor_id_t motor);
+
+/**
+ * Forget the CONFIG shadow and the bank/address cache
+ * Call after anything that changes the chip behind the driver's back
+ * (chip reset, direct bootloader use). Staged writes are dropped.
+ *
+ * @param motor Motor ID
+ */
+void tmc9660_config_invalidate(tmc9660_motor_id_t motor);
+
 /**
  * Get current TMC9660 state information
  *
@@ -207,4 +296,19 @@ void tmc9660_get_state(tmc9660_motor_id_t motor, tmc9660_state_t *state);
  */
 int tmc9660_no_op(tmc9660_motor_id_t motor);
 
+/**
+ * Issue one request to several motors at once and collect the replies
+ * On UART the three drivers sit on separate USARTs, so all requests are
+ * started before the first reply is awaited: the batch costs one UART
+ * round trip instead of one per motor. On SPI the exchanges run back to
+ * back on the shared bus, two short DMA frames per motor.
+ *
+ * @param motor_mask Motors to address (TMC9660_MOTOR_MASK_* bits)
+ * @param xfers Per-motor request/reply slots, indexed by motor ID;
+ *              only slots selected by motor_mask are used
+ * @return 0 if every selected motor succeeded, otherwise the first
+ *         negative errno (per-motor results are in xfers[i].result)
+ */
+int tmc9660_transact_all(uint8_t motor_mask, tmc9660_xfer_t xfers[TMC9660_NUM_MOTORS]);
+
 #endif /* TMC9660_H */
@@ -0,0 +1,94 @@
+/*
+ * TMC9660 Transport Layer - Internal Interface
+ * Moves one request/reply exchange between the host and a TMC9660
+ *
+ * Two backends, selected by CONFIG_SEGMENT_TMC9660_TRANSPORT:
+ *
+ * - UART (tmc9660_uart.c): one USART per driver. Uses the Zephyr async
+ *   UART API (DMA TX/RX) when CONFIG_UART_ASYNC_API is enabled, so the
+ *   calling thread sleeps on a semaphore while the bytes are on the
+ *   wire. Without it, the backend falls back to polled I/O.
+ * - SPI (tmc9660_spi.c): all drivers on one SPI bus, a chip select per
+ *   driver, DMA full-duplex transfers.
+ *
+ * Only used by tmc9660.c - not part of the public driver API.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TMC9660_BUS_H
+#define TMC9660_BUS_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Largest exchange the transport has to carry (one protocol message) */
+#define TMC9660_BUS_MAX_XFER 8
+
+/* Per-motor transport state */
+struct tmc9660_bus {
+	const struct device *dev;
+	uint8_t index;           /* Motor index, selects the DMA buffers */
+	size_t rx_expected;      /* Reply length armed by tmc9660_bus_start() */
+	uint32_t rate;           /* Line rate: UART baud or SPI clock (Hz) */
+#if defined(CONFIG_SEGMENT_TMC9660_SPI)
+	const struct spi_dt_spec *spi; /* Bus, clock, mode and chip select */
+	int result;              /* Outcome of the exchange, for tmc9660_bus_finish() */
+#elif defined(CONFIG_UART_ASYNC_API)
+	struct k_sem tx_done;    /* Given on UART_TX_DONE / UART_TX_ABORTED */
+	struct k_sem rx_done;    /* Given on UART_RX_DISABLED */
+	volatile size_t rx_len;  /* Bytes received so far */
+	volatile int tx_err;
+	volatile int rx_err;
+#endif
+};
+
+/**
+ * Bind a transport instance to the device behind alias tmc9660a/b/c
+ *
+ * @param bus Transport instance
+ * @param index Motor index (0 .. TMC9660_NUM_MOTORS-1)
+ * @return 0 on success, -ENODEV if the device is not ready,
+ *         other negative errno on error
+ */
+int tmc9660_bus_init(struct tmc9660_bus *bus, uint8_t index);
+
+/**
+ * Start an exchange: arm reception of the reply, then transmit the request
+ * Returns as soon as the transfer is queued (async) or sent (polled).
+ *
+ * @param bus Transport instance
+ * @param tx Request bytes
+ * @param tx_len Request length (max TMC9660_BUS_MAX_XFER)
+ * @param rx_len Expected reply length (max TMC9660_BUS_MAX_XFER)
+ * @return 0 on success, negative errno on error
+ */
+int tmc9660_bus_start(struct tmc9660_bus *bus, const uint8_t *tx, size_t tx_len,
+		      size_t rx_len);
+
+/**
+ * Wait for the reply of an exchange started with tmc9660_bus_start()
+ * The calling thread blocks on the completion event, not on a poll loop.
+ *
+ * @param bus Transport instance
+ * @param rx Output: reply bytes (rx_len from tmc9660_bus_start())
+ * @param timeout Maximum time to wait for the complete reply
+ * @return 0 on success, -ETIMEDOUT if the reply did not arrive,
+ *         other negative errno on error
+ */
+int tmc9660_bus_finish(struct tmc9660_bus *bus, uint8_t *rx, k_timeout_t timeout);
+
+/**
+ * Change the line rate (between exchanges only)
+ * UART backend only; needs CONFIG_UART_USE_RUNTIME_CONFIGURE.
+ *
+ * @param bus Transport instance
+ * @param baud New baud rate
+ * @return 0 on success, -ENOTSUP on SPI, other negative errno if the
+ *         UART cannot run at that rate
+ */
+int tmc9660_bus_set_baud(struct tmc9660_bus *bus, uint32_t baud);
+
+#endif /* TMC9660_BUS_H */
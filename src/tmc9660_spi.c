@@ -0,0 +1,157 @@
+/*
+ * TMC9660 Transport Layer - SPI Backend
+ *
+ * All three drivers share one SPI bus with a chip select each. The
+ * request is the same 8-byte message as on the UART; SPI is full duplex
+ * and the TMC9660 answers a datagram during the next one, so each
+ * exchange is two frames: the request, then a NO_OP whose MISO bytes
+ * are the reply. The NO_OP's own (discarded) reply is shifted out by the
+ * next request.
+ *
+ * Both frames are clocked by DMA while the calling thread sleeps in
+ * spi_transceive_dt(), so tmc9660_bus_start() returns with the reply
+ * already in hand and tmc9660_bus_finish() only reports it. A batch
+ * over all three drivers is six frames back to back: about 0.6 ms at
+ * the 1 MHz bus clock, inside one control tick.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "tmc9660_bus.h"
+#include "tmc9660.h"
+#include "crc.h"
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/linker/section_tags.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+LOG_MODULE_DECLARE(tmc9660, CONFIG_SEGMENT_TMC9660_LOG_LEVEL);
+
+/* TMC9660 SPI: mode 3, MSB first, 8-bit words */
+#define TMC9660_SPI_OPERATION \
+	(SPI_OP_MODE_MASTER | SPI_WORD_SET(8) | SPI_TRANSFER_MSB | SPI_MODE_CPOL | SPI_MODE_CPHA)
+
+/* Frame length: one protocol message each way */
+#define TMC9660_SPI_FRAME TMC9660_MSG_SIZE
+
+BUILD_ASSERT(TMC9660_SPI_FRAME <= TMC9660_BUS_MAX_XFER, "SPI frame exceeds transport limit");
+
+static const struct spi_dt_spec bus_spis[TMC9660_NUM_MOTORS] = {
+	[TMC9660_MOTOR_A] = SPI_DT_SPEC_GET(DT_ALIAS(tmc9660a), TMC9660_SPI_OPERATION, 0),
+	[TMC9660_MOTOR_B] = SPI_DT_SPEC_GET(DT_ALIAS(tmc9660b), TMC9660_SPI_OPERATION, 0),
+	[TMC9660_MOTOR_C] = SPI_DT_SPEC_GET(DT_ALIAS(tmc9660c), TMC9660_SPI_OPERATION, 0),
+};
+
+/*
+ * DMA buffers. The H7 data cache is not coherent with DMA, so these live
+ * in the non-cacheable region (CONFIG_NOCACHE_MEMORY).
+ */
+struct tmc9660_bus_dma {
+	uint8_t tx[TMC9660_SPI_FRAME];
+	uint8_t fetch[TMC9660_SPI_FRAME]; /* NO_OP that clocks the reply out */
+	uint8_t rx[TMC9660_SPI_FRAME];
+};
+
+static struct tmc9660_bus_dma dma_bufs[TMC9660_NUM_MOTORS] __nocache;
+
+/* One chip-select frame: tx out, rx in (NULL: discard) */
+static int bus_frame(struct tmc9660_bus *bus, const uint8_t *tx, uint8_t *rx)
+{
+	const struct spi_buf tx_buf = { .buf = (void *)tx, .len = TMC9660_SPI_FRAME };
+	const struct spi_buf rx_buf = { .buf = rx, .len = rx ? TMC9660_SPI_FRAME : 0 };
+	const struct spi_buf_set tx_set = { .buffers = &tx_buf, .count = 1 };
+	const struct spi_buf_set rx_set = { .buffers = &rx_buf, .count = 1 };
+
+	return spi_transceive_dt(bus->spi, &tx_set, rx ? &rx_set : NULL);
+}
+
+/* No chip drives MISO: the line reads as all zeros or all ones */
+static bool bus_floating(const uint8_t *rx)
+{
+	for (size_t i = 1; i < TMC9660_SPI_FRAME; i++) {
+		if (rx[i] != rx[0]) {
+			return false;
+		}
+	}
+
+	return rx[0] == 0x00 || rx[0] == 0xFF;
+}
+
+int tmc9660_bus_init(struct tmc9660_bus *bus, uint8_t index)
+{
+	if (index >= TMC9660_NUM_MOTORS) {
+		return -EINVAL;
+	}
+
+	bus->spi = &bus_spis[index];
+	bus->dev = bus->spi->bus;
+	bus->index = index;
+	bus->rx_expected = 0;
+	bus->rate = bus->spi->config.frequency;
+	bus->result = -EIO;
+
+	if (!spi_is_ready_dt(bus->spi)) {
+		return -ENODEV;
+	}
+
+	return 0;
+}
+
+int tmc9660_bus_start(struct tmc9660_bus *bus, const uint8_t *tx, size_t tx_len,
+		      size_t rx_len)
+{
+	struct tmc9660_bus_dma *dma = &dma_bufs[bus->index];
+	tmc9660_msg_t *fetch = (tmc9660_msg_t *)dma->fetch;
+	int ret;
+
+	if (tx_len != TMC9660_SPI_FRAME || rx_len == 0 || rx_len > TMC9660_SPI_FRAME) {
+		return -EINVAL;
+	}
+
+	bus->rx_expected = rx_len;
+	memcpy(dma->tx, tx, tx_len);
+
+	/* Same device address as the request, so the right chip answers */
+	memcpy(fetch, tx, tx_len);
+	fetch->cmd_or_status = TMC9660_CMD_NO_OP;
+	memset(fetch->data, 0, sizeof(fetch->data));
+	fetch->crc8 = crc_tmc8(dma->fetch, TMC9660_SPI_FRAME - 1);
+
+	/* The reply to whatever came before is stale: drop it */
+	ret = bus_frame(bus, dma->tx, NULL);
+	if (ret == 0) {
+		ret = bus_frame(bus, dma->fetch, dma->rx);
+	}
+	if (ret == 0 && bus_floating(dma->rx)) {
+		ret = -ETIMEDOUT;
+	}
+
+	bus->result = ret;
+
+	/* Transfer errors are reported by tmc9660_bus_finish(), like a lost reply */
+	return 0;
+}
+
+int tmc9660_bus_finish(struct tmc9660_bus *bus, uint8_t *rx, k_timeout_t timeout)
+{
+	ARG_UNUSED(timeout);
+
+	if (bus->result < 0) {
+		return bus->result;
+	}
+
+	memcpy(rx, dma_bufs[bus->index].rx, bus->rx_expected);
+
+	return 0;
+}
+
+int tmc9660_bus_set_baud(struct tmc9660_bus *bus, uint32_t baud)
+{
+	ARG_UNUSED(bus);
+	ARG_UNUSED(baud);
+
+	/* Fixed clock from spi-max-frequency; there is no ladder to climb */
+	return -ENOTSUP;
+}
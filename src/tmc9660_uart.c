@@ -0,0 +1,270 @@
+/*
+ * TMC9660 Transport Layer - UART Backend
+ *
+ * Async path: the reply buffer is armed with uart_rx_enable() before the
+ * request goes out with uart_tx(), both via DMA. The UART callback gives
+ * a semaphore once the RX buffer is full and the receiver has stopped,
+ * so a TMC9660 exchange costs one context switch instead of a poll loop.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "tmc9660_bus.h"
+#include "tmc9660.h"
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/linker/section_tags.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+LOG_MODULE_DECLARE(tmc9660, CONFIG_SEGMENT_TMC9660_LOG_LEVEL);
+
+/* Time allowed for the receiver to report UART_RX_DISABLED after an abort */
+#define TMC9660_BUS_DISABLE_TIMEOUT_MS 5
+
+static const struct device *const bus_uarts[TMC9660_NUM_MOTORS] = {
+	[TMC9660_MOTOR_A] = DEVICE_DT_GET(DT_ALIAS(tmc9660a)),
+	[TMC9660_MOTOR_B] = DEVICE_DT_GET(DT_ALIAS(tmc9660b)),
+	[TMC9660_MOTOR_C] = DEVICE_DT_GET(DT_ALIAS(tmc9660c)),
+};
+
+/* Resolve the motor's UART and read its start rate */
+static int bus_bind(struct tmc9660_bus *bus, uint8_t index)
+{
+	struct uart_config cfg;
+
+	if (index >= TMC9660_NUM_MOTORS) {
+		return -EINVAL;
+	}
+
+	bus->dev = bus_uarts[index];
+	bus->index = index;
+	bus->rx_expected = 0;
+
+	if (!device_is_ready(bus->dev)) {
+		return -ENODEV;
+	}
+
+	bus->rate = (uart_config_get(bus->dev, &cfg) == 0) ? cfg.baudrate : TMC9660_BAUD_DEFAULT;
+
+	return 0;
+}
+
+#ifdef CONFIG_UART_ASYNC_API
+
+/*
+ * DMA buffers. The H7 data cache is not coherent with DMA, so these live
+ * in the non-cacheable region (CONFIG_NOCACHE_MEMORY).
+ */
+struct tmc9660_bus_dma {
+	uint8_t tx[TMC9660_BUS_MAX_XFER];
+	uint8_t rx[TMC9660_BUS_MAX_XFER];
+};
+
+static struct tmc9660_bus_dma dma_bufs[TMC9660_NUM_MOTORS] __nocache;
+
+static void bus_uart_callback(const struct device *dev, struct uart_event *evt,
+			      void *user_data)
+{
+	struct tmc9660_bus *bus = user_data;
+
+	ARG_UNUSED(dev);
+
+	switch (evt->type) {
+	case UART_TX_DONE:
+		k_sem_give(&bus->tx_done);
+		break;
+
+	case UART_TX_ABORTED:
+		bus->tx_err = -EIO;
+		k_sem_give(&bus->tx_done);
+		break;
+
+	case UART_RX_RDY:
+		bus->rx_len += evt->data.rx.len;
+		break;
+
+	case UART_RX_STOPPED:
+		/* Framing/parity/overrun error - RX_DISABLED follows */
+		bus->rx_err = -EIO;
+		break;
+
+	case UART_RX_DISABLED:
+		k_sem_give(&bus->rx_done);
+		break;
+
+	case UART_RX_BUF_REQUEST:
+		/* Single-buffer reception: let the receiver stop when full */
+	case UART_RX_BUF_RELEASED:
+	default:
+		break;
+	}
+}
+
+int tmc9660_bus_init(struct tmc9660_bus *bus, uint8_t index)
+{
+	int ret;
+
+	ret = bus_bind(bus, index);
+	if (ret < 0) {
+		return ret;
+	}
+
+	k_sem_init(&bus->tx_done, 0, 1);
+	k_sem_init(&bus->rx_done, 0, 1);
+
+	ret = uart_callback_set(bus->dev, bus_uart_callback, bus);
+	if (ret < 0) {
+		LOG_ERR("UART %s: async API unavailable: %d (check dmas in overlay)",
+			bus->dev->name, ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+int tmc9660_bus_start(struct tmc9660_bus *bus, const uint8_t *tx, size_t tx_len,
+		      size_t rx_len)
+{
+	struct tmc9660_bus_dma *dma = &dma_bufs[bus->index];
+	int ret;
+
+	if (tx_len > TMC9660_BUS_MAX_XFER || rx_len == 0 || rx_len > TMC9660_BUS_MAX_XFER) {
+		return -EINVAL;
+	}
+
+	k_sem_reset(&bus->tx_done);
+	k_sem_reset(&bus->rx_done);
+	bus->rx_len = 0;
+	bus->rx_err = 0;
+	bus->tx_err = 0;
+	bus->rx_expected = rx_len;
+
+	/* Arm the receiver first so the reply can never outrun us */
+	ret = uart_rx_enable(bus->dev, dma->rx, rx_len, SYS_FOREVER_US);
+	if (ret < 0) {
+		return ret;
+	}
+
+	memcpy(dma->tx, tx, tx_len);
+
+	ret = uart_tx(bus->dev, dma->tx, tx_len, SYS_FOREVER_US);
+	if (ret < 0) {
+		uart_rx_disable(bus->dev);
+		k_sem_take(&bus->rx_done, K_MSEC(TMC9660_BUS_DISABLE_TIMEOUT_MS));
+		return ret;
+	}
+
+	return 0;
+}
+
+int tmc9660_bus_finish(struct tmc9660_bus *bus, uint8_t *rx, k_timeout_t timeout)
+{
+	struct tmc9660_bus_dma *dma = &dma_bufs[bus->index];
+
+	if (k_sem_take(&bus->tx_done, timeout) < 0) {
+		uart_tx_abort(bus->dev);
+		uart_rx_disable(bus->dev);
+		k_sem_take(&bus->rx_done, K_MSEC(TMC9660_BUS_DISABLE_TIMEOUT_MS));
+		return -ETIMEDOUT;
+	}
+
+	if (k_sem_take(&bus->rx_done, timeout) < 0) {
+		/* No (complete) reply - stop the receiver before the next exchange */
+		uart_rx_disable(bus->dev);
+		k_sem_take(&bus->rx_done, K_MSEC(TMC9660_BUS_DISABLE_TIMEOUT_MS));
+		return -ETIMEDOUT;
+	}
+
+	if (bus->tx_err < 0) {
+		return bus->tx_err;
+	}
+
+	if (bus->rx_err < 0) {
+		return bus->rx_err;
+	}
+
+	if (bus->rx_len < bus->rx_expected) {
+		return -EIO;
+	}
+
+	memcpy(rx, dma->rx, bus->rx_expected);
+
+	return 0;
+}
+
+#else /* !CONFIG_UART_ASYNC_API */
+
+/* Polled fallback - used when the async UART API is not configured */
+
+int tmc9660_bus_init(struct tmc9660_bus *bus, uint8_t index)
+{
+	return bus_bind(bus, index);
+}
+
+int tmc9660_bus_start(struct tmc9660_bus *bus, const uint8_t *tx, size_t tx_len,
+		      size_t rx_len)
+{
+	uint8_t discard;
+
+	if (tx_len > TMC9660_BUS_MAX_XFER || rx_len == 0 || rx_len > TMC9660_BUS_MAX_XFER) {
+		return -EINVAL;
+	}
+
+	/* Drop stale bytes from an earlier, timed-out exchange */
+	while (uart_poll_in(bus->dev, &discard) == 0) {
+	}
+
+	bus->rx_expected = rx_len;
+
+	for (size_t i = 0; i < tx_len; i++) {
+		uart_poll_out(bus->dev, tx[i]);
+	}
+
+	return 0;
+}
+
+int tmc9660_bus_finish(struct tmc9660_bus *bus, uint8_t *rx, k_timeout_t timeout)
+{
+	k_timepoint_t end = sys_timepoint_calc(timeout);
+
+	for (size_t i = 0; i < bus->rx_expected; i++) {
+		while (uart_poll_in(bus->dev, &rx[i]) != 0) {
+			if (sys_timepoint_expired(end)) {
+				return -ETIMEDOUT;
+			}
+			k_sleep(K_USEC(100));
+		}
+	}
+
+	return 0;
+}
+
+#endif /* CONFIG_UART_ASYNC_API */
+
+int tmc9660_bus_set_baud(struct tmc9660_bus *bus, uint32_t baud)
+{
+	struct uart_config cfg;
+	int ret;
+
+	ret = uart_config_get(bus->dev, &cfg);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (cfg.baudrate == baud) {
+		bus->rate = baud;
+		return 0;
+	}
+
+	/* The receiver is idle between exchanges, so the UART can be reprogrammed */
+	cfg.baudrate = baud;
+	ret = uart_configure(bus->dev, &cfg);
+	if (ret < 0) {
+		return ret;
+	}
+
+	bus->rate = baud;
+	return 0;
+}
@@ -0,0 +1,364 @@
+/*
+ * Event Trace Implementation
+ *
+ * Recording (trace.h) claims a slot by incrementing the head; the slot is
+ * the event number modulo the power-of-two ring size, so the oldest event
+ * is overwritten without any further bookkeeping.
+ *
+ * Everything else runs on the trace work queue. TRACE_CONTROL actions
+ * are posted as request bits and the handler owns the dump and live
+ * cursors. A dump pauses recording and then reads the head: every thread
+ * that records outranks the work queue, so none can be half way through
+ * an event at that point. Dump packets go only to the master that asked
+ * for the dump, with network_send_tcp_client(). That call never blocks
+ * and never cuts a packet; while the master's send buffer is full the
+ * handler retries the same packet TRACE_RETRY_MS later.
+ *
+ * The live stream reads behind the head without pausing and keeps one
+ * packet clear of the writers; anything older when it falls behind is
+ * skipped and reported as lost. Its own sends show up as UDP_SEND events.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "trace.h"
+#include "config.h"
+#include "crc16.h"
+#include "network.h"
+#include "timesync.h"
+#include "log_ratelimit.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include <errno.h>
+
+LOG_MODULE_REGISTER(trace, CONFIG_SEGMENT_TRACE_LOG_LEVEL);
+
+static trace_stats_t stats;
+static struct k_spinlock stats_lock;
+
+#if defined(CONFIG_SEGMENT_TRACE)
+
+#define TRACE_RING_MASK (CONFIG_SEGMENT_TRACE_EVENTS - 1)
+
+BUILD_ASSERT(CONFIG_SEGMENT_TRACE_EVENTS > 2 * TRACE_MAX_EVENTS,
+	     "Trace ring must hold more than two packets");
+BUILD_ASSERT(sizeof(trace_event_t) == 8, "Trace events are 8 bytes on the wire");
+BUILD_ASSERT(TRACE_MAX_SIZE <= NETWORK_TCP_MAX_SIZE, "TRACE packets must fit a TCP send");
+
+struct trace_ring trace_ring __aligned(8);
+
+/* Requests from trace_control() */
+#define TRACE_REQ_DUMP       BIT(0)
+#define TRACE_REQ_LIVE_START BIT(1)
+#define TRACE_REQ_LIVE_STOP  BIT(2)
+#define TRACE_REQ_CLEAR      BIT(3)
+
+K_THREAD_STACK_DEFINE(trace_workq_stack, TRACE_THREAD_STACK_SIZE);
+static struct k_work_q trace_workq;
+static struct k_work_delayable trace_work;
+static atomic_t requests = ATOMIC_INIT(0);
+static atomic_t request_client = ATOMIC_INIT(-1);  /* Master that asked for the dump */
+static bool running;
+
+/* Work queue only */
+static uint8_t my_segment_id;
+static uint32_t oldest;          /* First event after the last CLEAR */
+static bool dumping;
+static int dump_client;
+static uint32_t dump_next;
+static uint32_t dump_end;
+static uint32_t dump_retries;
+static bool live;
+static uint32_t live_next;
+static uint8_t packet[TRACE_MAX_SIZE] __aligned(4);
+
+static void trace_count(uint32_t *counter, uint32_t n)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	*counter += n;
+	k_spin_unlock(&stats_lock, key);
+}
+
+static uint32_t trace_cycles_per_sec(void)
+{
+#if defined(CONFIG_CORTEX_M_DWT)
+	return SystemCoreClock;
+#else
+	return sys_clock_hw_cycles_per_sec();
+#endif
+}
+
+/**
+ * Build a TRACE packet from count events starting at event first
+ *
+ * @return Packet length including the CRC
+ */
+static size_t trace_build(uint32_t first, uint8_t count, uint8_t flags, uint32_t lost)
+{
+	trace_packet_header_t *hdr = (trace_packet_header_t *)packet;
+	trace_event_t *events = (trace_event_t *)(packet + sizeof(*hdr));
+	size_t len = sizeof(*hdr) + count * sizeof(trace_event_t);
+
+	hdr->magic_header = PACKET_MAGIC_STM32_TO_MASTER;
+	hdr->packet_type = FEEDBACK_TRACE;
+	hdr->segment_id = my_segment_id;
+	hdr->first_event = first;
+	hdr->ref_cycles = trace_cycles();
+	hdr->ref_time_ms = timesync_now_ms();
+	hdr->cycles_per_sec = trace_cycles_per_sec();
+	hdr->event_count = count;
+	hdr->flags = flags;
+	hdr->lost = (uint16_t)MIN(lost, UINT16_MAX);
+
+	for (uint8_t i = 0; i < count; i++) {
+		events[i] = trace_ring.events[(first + i) & TRACE_RING_MASK];
+	}
+
+	uint16_t crc = crc16_ccitt_calc(packet, len);
+
+	packet[len++] = crc & 0xFF;
+	packet[len++] = crc >> 8;
+
+	return len;
+}
+
+static void trace_dump_begin(void)
+{
+	trace_ring.paused = true;
+	dump_client = (int)atomic_get(&request_client);
+
+	/* No recording thread can be mid-event while this one runs */
+	dump_end = (uint32_t)atomic_get(&trace_ring.head);
+	dump_next = (dump_end - oldest > CONFIG_SEGMENT_TRACE_EVENTS) ?
+		    dump_end - CONFIG_SEGMENT_TRACE_EVENTS : oldest;
+	dump_retries = 0;
+	dumping = true;
+
+	LOG_INF("Dumping %u events", dump_end - dump_next);
+}
+
+static void trace_dump_end(void)
+{
+	dumping = false;
+	trace_ring.paused = false;
+}
+
+/**
+ * Send dump packets until the dump is complete
+ *
+ * @return false if the TCP send buffer is full (call again later)
+ */
+static bool trace_dump(void)
+{
+	while (1) {
+		uint32_t left = dump_end - dump_next;
+		uint8_t count = (uint8_t)MIN(left, TRACE_MAX_EVENTS);
+		uint8_t flags = (count == left) ? TRACE_FLAG_LAST : 0;
+		size_t len = trace_build(dump_next, count, flags, 0);
+		int ret = network_send_tcp_client(dump_client, packet, len);
+
+		if (ret == -EAGAIN) {
+			if (++dump_retries < TRACE_DUMP_TIMEOUT_MS / TRACE_RETRY_MS) {
+				return false;
+			}
+			ret = -ETIMEDOUT;
+		}
+
+		if (ret < 0) {
+			LOG_WRN_RL("Trace dump aborted: %d", ret);
+			trace_count(&stats.send_errors, 1);
+			break;
+		}
+
+		trace_count(&stats.sent, 1);
+		dump_retries = 0;
+		dump_next += count;
+
+		if (flags & TRACE_FLAG_LAST) {
+			trace_count(&stats.dumps, 1);
+			break;
+		}
+	}
+
+	trace_dump_end();
+
+	return true;
+}
+
+/* Send the events recorded since the last call over UDP */
+static void trace_live(void)
+{
+	uint32_t head = (uint32_t)atomic_get(&trace_ring.head);
+	uint32_t lost = 0;
+
+	/* Stay a packet clear of the writers; older unsent events are gone */
+	if (head - live_next > CONFIG_SEGMENT_TRACE_EVENTS - TRACE_MAX_EVENTS) {
+		uint32_t next = head - (CONFIG_SEGMENT_TRACE_EVENTS - TRACE_MAX_EVENTS);
+
+		lost = next - live_next;
+		live_next = next;
+		trace_count(&stats.lost, lost);
+	}
+
+	while (live_next != head) {
+		uint8_t count = (uint8_t)MIN(head - live_next, TRACE_MAX_EVENTS);
+		size_t len = trace_build(live_next, count, TRACE_FLAG_LIVE, lost);
+
+		/* A lost datagram shows as a gap in the event numbers */
+		if (network_send_udp(packet, len) < 0) {
+			trace_count(&stats.send_errors, 1);
+		} else {
+			trace_count(&stats.sent, 1);
+		}
+
+		live_next += count;
+		lost = 0;
+	}
+}
+
+static void trace_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	atomic_val_t req = atomic_clear(&requests);
+
+	if (req & TRACE_REQ_CLEAR) {
+		oldest = (uint32_t)atomic_get(&trace_ring.head);
+		live_next = oldest;
+	}
+
+	if ((req & TRACE_REQ_LIVE_START) && !live) {
+		live = true;
+		live_next = (uint32_t)atomic_get(&trace_ring.head);
+	}
+
+	if (req & TRACE_REQ_LIVE_STOP) {
+		live = false;
+	}
+
+	if ((req & TRACE_REQ_DUMP) && !dumping) {
+		trace_dump_begin();
+	}
+
+	if (dumping && !trace_dump()) {
+		k_work_schedule_for_queue(&trace_workq, &trace_work, K_MSEC(TRACE_RETRY_MS));
+		return;
+	}
+
+	if (live) {
+		trace_live();
+		k_work_schedule_for_queue(&trace_workq, &trace_work, K_MSEC(TRACE_LIVE_PERIOD_MS));
+	}
+}
+
+int trace_start(uint8_t segment_id)
+{
+	const struct k_work_queue_config cfg = { .name = "trace" };
+
+	if (running) {
+		return -EALREADY;
+	}
+
+	my_segment_id = segment_id;
+
+#if defined(CONFIG_CORTEX_M_DWT)
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+#if defined(__CORTEX_M) && (__CORTEX_M == 7U)
+	/* Cortex-M7 DWT is write-locked after reset */
+	DWT->LAR = 0xC5ACCE55;
+#endif
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+	k_work_init_delayable(&trace_work, trace_work_handler);
+	k_work_queue_start(&trace_workq, trace_workq_stack,
+			   K_THREAD_STACK_SIZEOF(trace_workq_stack),
+			   K_PRIO_PREEMPT(TRACE_THREAD_PRIORITY), &cfg);
+	running = true;
+
+	return 0;
+}
+
+int trace_control(uint8_t action, int client)
+{
+	atomic_val_t req;
+
+	switch (action) {
+	case TRACE_ACTION_DUMP:
+		/* The dump goes back on the requesting connection */
+		if (client < 0) {
+			return -ENOTCONN;
+		}
+		req = TRACE_REQ_DUMP;
+		break;
+	case TRACE_ACTION_LIVE_START:
+		req = TRACE_REQ_LIVE_START;
+		break;
+	case TRACE_ACTION_LIVE_STOP:
+		req = TRACE_REQ_LIVE_STOP;
+		break;
+	case TRACE_ACTION_CLEAR:
+		req = TRACE_REQ_CLEAR;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (!running) {
+		return -ENOTSUP;
+	}
+
+	if (req == TRACE_REQ_DUMP) {
+		atomic_set(&request_client, client);
+	}
+
+	atomic_or(&requests, req);
+	k_work_reschedule_for_queue(&trace_workq, &trace_work, K_NO_WAIT);
+
+	return 0;
+}
+
+static uint32_t trace_recorded(void)
+{
+	return (uint32_t)atomic_get(&trace_ring.head);
+}
+
+#else /* !CONFIG_SEGMENT_TRACE */
+
+int trace_start(uint8_t segment_id)
+{
+	ARG_UNUSED(segment_id);
+
+	return -ENOTSUP;
+}
+
+int trace_control(uint8_t action, int client)
+{
+	ARG_UNUSED(action);
+	ARG_UNUSED(client);
+
+	return -ENOTSUP;
+}
+
+static uint32_t trace_recorded(void)
+{
+	return 0;
+}
+
+#endif /* CONFIG_SEGMENT_TRACE */
+
+void trace_get_stats(trace_stats_t *out)
+{
+	if (!out) {
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	*out = stats;
+	k_spin_unlock(&stats_lock, key);
+
+	out->recorded = trace_recorded();
+}
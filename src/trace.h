@@ -0,0 +1,144 @@
+/*
+ * Event Trace - Phase 10
+ * Timestamped binary events in a RAM ring, for offline timing analysis
+ *
+ * The hot paths (packet reception and dispatch, control ticks, TMC9660
+ * exchanges, IMU reads, UDP sends) call trace_record(), which is inline
+ * and costs a few cycles: one atomic increment to claim a slot, a read
+ * of the DWT cycle counter and two stores. Nothing is formatted on
+ * target. The ring keeps the newest CONFIG_SEGMENT_TRACE_EVENTS events.
+ *
+ * TRACE_CONTROL (0x0F) dumps the ring over TCP to the master that asked,
+ * with recording paused so the dump is one consistent window, or streams
+ * new events live over UDP to the active master, both as TRACE (0x08)
+ * packets sent from a low-priority work queue.
+ * tools/trace_decoder.py turns them into a timeline and latency figures.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "packet.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(CONFIG_CORTEX_M_DWT)
+#include <cmsis_core.h>
+#endif
+
+/* Event IDs (trace_event_t.id) and their arguments */
+enum trace_event_id {
+	TRACE_EVT_PKT_RX = 1,     /* arg8: TRACE_TRANSPORT_*, arg16: bytes received */
+	TRACE_EVT_PKT_DISPATCH,   /* arg8: packet type, arg16: length */
+	TRACE_EVT_PKT_DONE,       /* arg8: packet type, arg16: 0 or 1 if rejected */
+	TRACE_EVT_CTRL_START,     /* arg8: timer expiries (>1: missed), arg16: tick */
+	TRACE_EVT_CTRL_END,       /* arg16: tick */
+	TRACE_EVT_TMC_START,      /* arg8: motor, arg16: command */
+	TRACE_EVT_TMC_DONE,       /* arg8: motor, arg16: 0 or -errno (int16) */
+	TRACE_EVT_IMU_READ,       /* arg8: 0 or 1 if failed, arg16: FIFO words (1 polled) */
+	TRACE_EVT_UDP_SEND,       /* arg8: packet type, arg16: bytes or -errno (int16) */
+};
+
+/* TRACE_EVT_PKT_RX transports */
+#define TRACE_TRANSPORT_TCP 0
+#define TRACE_TRANSPORT_UDP 1
+
+/* Statistics */
+typedef struct {
+	uint32_t recorded;       /* Events recorded since boot */
+	uint32_t dumps;          /* Completed dumps */
+	uint32_t sent;           /* TRACE packets sent */
+	uint32_t send_errors;    /* Failed sends (dump aborted, live packet lost) */
+	uint32_t lost;           /* Live events overwritten before they were sent */
+} trace_stats_t;
+
+#if defined(CONFIG_SEGMENT_TRACE)
+/* The ring (trace.c); record through trace_record() only */
+struct trace_ring {
+	atomic_t head;           /* Number of the next event */
+	bool paused;             /* Set while a dump reads the ring */
+	trace_event_t events[CONFIG_SEGMENT_TRACE_EVENTS];
+};
+
+extern struct trace_ring trace_ring;
+#endif
+
+/**
+ * Current trace timestamp
+ *
+ * @return CPU cycle counter (DWT), else the kernel cycle counter
+ */
+static inline uint32_t trace_cycles(void)
+{
+#if defined(CONFIG_CORTEX_M_DWT)
+	return DWT->CYCCNT;
+#else
+	return k_cycle_get_32();
+#endif
+}
+
+/**
+ * Record an event
+ * Safe from any thread or ISR. Compiles to nothing without
+ * CONFIG_SEGMENT_TRACE.
+ *
+ * @param id Event ID (TRACE_EVT_*)
+ * @param arg8 First argument (see enum trace_event_id)
+ * @param arg16 Second argument
+ */
+static inline void trace_record(uint8_t id, uint8_t arg8, uint16_t arg16)
+{
+#if defined(CONFIG_SEGMENT_TRACE)
+	BUILD_ASSERT((CONFIG_SEGMENT_TRACE_EVENTS & (CONFIG_SEGMENT_TRACE_EVENTS - 1)) == 0,
+		     "Trace ring size must be a power of two");
+
+	if (trace_ring.paused) {
+		return;
+	}
+
+	uint32_t n = (uint32_t)atomic_inc(&trace_ring.head);
+	trace_event_t *e = &trace_ring.events[n & (CONFIG_SEGMENT_TRACE_EVENTS - 1)];
+
+	e->cycles = trace_cycles();
+	e->id = id;
+	e->arg8 = arg8;
+	e->arg16 = arg16;
+#else
+	ARG_UNUSED(id);
+	ARG_UNUSED(arg8);
+	ARG_UNUSED(arg16);
+#endif
+}
+
+/**
+ * Start the trace sender and the cycle counter
+ * Events are recorded from boot; they read cycle 0 until this runs.
+ *
+ * @param segment_id This segment's ID (for packet headers)
+ * @return 0 on success, -ENOTSUP without CONFIG_SEGMENT_TRACE, -EALREADY if running
+ */
+int trace_start(uint8_t segment_id);
+
+/**
+ * Handle a TRACE_CONTROL action
+ * Returns at once; the work is done by the trace work queue.
+ *
+ * @param action TRACE_ACTION_*
+ * @param client Requesting master (network_command_client()), -1 for UDP
+ * @return 0 on success, -EINVAL for an unknown action, -ENOTSUP if not
+ *         running, -ENOTCONN for a dump requested over UDP
+ */
+int trace_control(uint8_t action, int client);
+
+/**
+ * Get trace statistics
+ *
+ * @param stats Output: statistics snapshot
+ */
+void trace_get_stats(trace_stats_t *stats);
+
+#endif /* TRACE_H */
@@ -0,0 +1,74 @@
+/*
+ * Trajectory Evaluation - Phase 6
+ * Septic polynomial position/velocity/acceleration/jerk for 3 motors
+ *
+ * pos(t) = a0 + a1*t + ... + a7*t^7, t normalized 0.0 - 1.0 over duration_ms
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "packet.h"
+#include <stdint.h>
+
+#define TRAJECTORY_NUM_MOTORS 3
+#define TRAJECTORY_NUM_COEFFS 8
+
+/*
+ * Segment prepared for evaluation
+ * Derivative polynomials are precomputed and already scaled to real time
+ * (mm/s, mm/s², mm/s³). Coefficients are stored [power][motor] so each
+ * Horner step loads the three motors from consecutive words.
+ */
+typedef struct {
+	float pos[8][TRAJECTORY_NUM_MOTORS];   /* mm */
+	float vel[7][TRAJECTORY_NUM_MOTORS];   /* mm/s */
+	float acc[6][TRAJECTORY_NUM_MOTORS];   /* mm/s² */
+	float jerk[5][TRAJECTORY_NUM_MOTORS];  /* mm/s³ */
+	uint32_t trajectory_id;
+	uint32_t start_ms;
+	uint32_t duration_ms;
+	float inv_duration_ms;                 /* 1 / duration_ms */
+} trajectory_segment_t;
+
+/* Evaluated set point for all motors */
+typedef struct {
+	float position[TRAJECTORY_NUM_MOTORS];      /* mm */
+	float velocity[TRAJECTORY_NUM_MOTORS];      /* mm/s */
+	float acceleration[TRAJECTORY_NUM_MOTORS];  /* mm/s² */
+	float jerk[TRAJECTORY_NUM_MOTORS];          /* mm/s³ */
+} trajectory_point_t;
+
+/**
+ * Convert a trajectory packet into an evaluation-ready segment
+ * Done once per segment, not per tick.
+ *
+ * @param seg Output: prepared segment
+ * @param pkt Received trajectory packet
+ * @return 0 on success, -EINVAL if duration is zero
+ */
+int trajectory_prepare(trajectory_segment_t *seg, const trajectory_packet_t *pkt);
+
+/**
+ * Evaluate position, velocity, acceleration and jerk of all motors
+ *
+ * @param seg Prepared segment
+ * @param t Normalized time (0.0 - 1.0)
+ * @param out Output: set point
+ */
+void trajectory_evaluate(const trajectory_segment_t *seg, float t, trajectory_point_t *out);
+
+/**
+ * Evaluate a segment at an absolute time
+ * Time before start or after the end is clamped to the segment bounds.
+ *
+ * @param seg Prepared segment
+ * @param now_ms Current time (ms since boot)
+ * @param out Output: set point
+ */
+void trajectory_evaluate_at(const trajectory_segment_t *seg, uint32_t now_ms,
+			    trajectory_point_t *out);
+
+#endif /* TRAJECTORY_H */
@@ -0,0 +1,120 @@
+/*
+ * Trajectory Rolling Buffer Implementation - Phase 6
+ *
+ * Head and tail run over [0, 2 * TRAJECTORY_BUFFER_SIZE) so a full ring
+ * can be told apart from an empty one without sacrificing a slot, and the
+ * buffer size does not have to be a power of two.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "trajectory_buffer.h"
+#include "config.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef CONFIG_DCACHE_LINE_SIZE
+#define TRAJ_CACHE_LINE CONFIG_DCACHE_LINE_SIZE
+#else
+#define TRAJ_CACHE_LINE 32  /* Cortex-M7 L1 line size */
+#endif
+
+#define TRAJ_INDEX_RANGE (2U * TRAJECTORY_BUFFER_SIZE)
+
+/* One preallocated slot, padded to whole cache lines */
+typedef struct {
+	trajectory_packet_t pkt;
+} __aligned(TRAJ_CACHE_LINE) traj_slot_t;
+
+/*
+ * Producer and consumer indices sit on separate cache lines so the two
+ * threads never write the same line.
+ */
+static struct {
+	atomic_t head __aligned(TRAJ_CACHE_LINE);  /* Next slot to write (producer) */
+	atomic_t overruns;                         /* Producer-owned */
+	atomic_t tail __aligned(TRAJ_CACHE_LINE);  /* Next slot to read (consumer) */
+	traj_slot_t slots[TRAJECTORY_BUFFER_SIZE];
+} ring;
+
+static inline uint32_t traj_next(uint32_t index)
+{
+	return (index + 1U == TRAJ_INDEX_RANGE) ? 0U : index + 1U;
+}
+
+static inline uint32_t traj_slot(uint32_t index)
+{
+	return (index >= TRAJECTORY_BUFFER_SIZE) ? index - TRAJECTORY_BUFFER_SIZE : index;
+}
+
+static inline uint32_t traj_count(uint32_t head, uint32_t tail)
+{
+	return (head >= tail) ? head - tail : head + TRAJ_INDEX_RANGE - tail;
+}
+
+void trajectory_buffer_init(void)
+{
+	atomic_set(&ring.head, 0);
+	atomic_set(&ring.tail, 0);
+	atomic_set(&ring.overruns, 0);
+}
+
+int trajectory_buffer_push(const trajectory_packet_t *pkt)
+{
+	uint32_t head = (uint32_t)atomic_get(&ring.head);
+	uint32_t tail = (uint32_t)atomic_get(&ring.tail);
+
+	if (traj_count(head, tail) >= TRAJECTORY_BUFFER_SIZE) {
+		atomic_inc(&ring.overruns);
+		return -ENOBUFS;
+	}
+
+	memcpy(&ring.slots[traj_slot(head)].pkt, pkt, sizeof(*pkt));
+
+	/* Publish: atomic store orders the slot write before the index update */
+	atomic_set(&ring.head, (atomic_val_t)traj_next(head));
+
+	return 0;
+}
+
+const trajectory_packet_t *trajectory_buffer_peek(void)
+{
+	uint32_t tail = (uint32_t)atomic_get(&ring.tail);
+	uint32_t head = (uint32_t)atomic_get(&ring.head);
+
+	if (head == tail) {
+		return NULL;
+	}
+
+	return &ring.slots[traj_slot(tail)].pkt;
+}
+
+void trajectory_buffer_pop(void)
+{
+	uint32_t tail = (uint32_t)atomic_get(&ring.tail);
+	uint32_t head = (uint32_t)atomic_get(&ring.head);
+
+	if (head == tail) {
+		return;
+	}
+
+	/* Slot is handed back to the producer only after we are done with it */
+	atomic_set(&ring.tail, (atomic_val_t)traj_next(tail));
+}
+
+uint32_t trajectory_buffer_count(void)
+{
+	return traj_count((uint32_t)atomic_get(&ring.head), (uint32_t)atomic_get(&ring.tail));
+}
+
+bool trajectory_buffer_is_empty(void)
+{
+	return atomic_get(&ring.head) == atomic_get(&ring.tail);
+}
+
+uint32_t trajectory_buffer_overruns(void)
+{
+	return (uint32_t)atomic_get(&ring.overruns);
+}
@@ -0,0 +1,69 @@
+/*
+ * Trajectory Rolling Buffer - Phase 6
+ * Lock-free single-producer / single-consumer ring of trajectory segments
+ *
+ * Producer: network thread (packet_handle_trajectory)
+ * Consumer: control loop thread
+ *
+ * Neither side ever blocks or takes a lock; each index is written by
+ * exactly one side and published with an atomic store.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TRAJECTORY_BUFFER_H
+#define TRAJECTORY_BUFFER_H
+
+#include "packet.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Reset the buffer to empty
+ * Only call while neither producer nor consumer is active.
+ */
+void trajectory_buffer_init(void);
+
+/**
+ * Append a segment (producer side)
+ *
+ * @param pkt Trajectory packet to copy into the next free slot
+ * @return 0 on success, -ENOBUFS if the buffer is full
+ */
+int trajectory_buffer_push(const trajectory_packet_t *pkt);
+
+/**
+ * Get the oldest segment without removing it (consumer side)
+ * The slot stays valid until trajectory_buffer_pop() is called.
+ *
+ * @return Pointer to the oldest segment, NULL if the buffer is empty
+ */
+const trajectory_packet_t *trajectory_buffer_peek(void);
+
+/**
+ * Release the oldest segment (consumer side)
+ */
+void trajectory_buffer_pop(void);
+
+/**
+ * Get number of queued segments
+ *
+ * @return Segments currently in the buffer
+ */
+uint32_t trajectory_buffer_count(void);
+
+/**
+ * Check if the buffer is empty
+ *
+ * @return true if no segments are queued
+ */
+bool trajectory_buffer_is_empty(void);
+
+/**
+ * Get number of segments dropped because the buffer was full
+ *
+ * @return Overrun count since boot
+ */
+uint32_t trajectory_buffer_overruns(void);
+
+#endif /* TRAJECTORY_BUFFER_H */
@@ -0,0 +1,378 @@
+/*
+ * Multicast Trajectory Channel Implementation
+ *
+ * Sequence tracking and the hold queue are only touched by the network
+ * server thread (multicast socket and TCP dispatch); the statistics are
+ * also read by main, under stats_lock.
+ *
+ * Resent segments arrive through the normal TCP path, which hands them
+ * to trajectory_mcast_unicast(); it queues them and counts them against
+ * the outstanding NACK. They are queued ahead of the held slices, so
+ * the trajectory buffer stays in time order.
+ *
+ * A missing frame can arrive twice: late on multicast and again as the
+ * TCP resend, and a datagram can be duplicated. Late frames are only
+ * taken for NACKed sequences not received yet, and no segment is queued
+ * that does not start after the newest one already queued.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "trajectory_mcast.h"
+#include "packet.h"
+#include "network.h"
+#include "timesync.h"
+#include "crc16.h"
+#include "log_ratelimit.h"
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include <errno.h>
+
+LOG_MODULE_DECLARE(net_srv, CONFIG_SEGMENT_NET_LOG_LEVEL);
+
+#define TRAJ_MCAST_HOLD_DEPTH      2     /* Slices held while a resend is outstanding */
+#define TRAJ_MCAST_RESEND_MS       100   /* Wait for the resend (frames are 200 ms apart) */
+#define TRAJ_MCAST_START_MARGIN_MS 20    /* Release a held slice this long before it starts */
+#define TRAJ_MCAST_MAX_NACK        16    /* Larger gaps are stale: resynchronise instead */
+#define TRAJ_MCAST_MISSING_BITS    32    /* NACKed sequences tracked */
+#define TRAJ_MCAST_REPEAT_MS       5000  /* Older TCP segments: a new timeline, not a repeat */
+
+BUILD_ASSERT(TRAJ_MCAST_MAX_NACK <= TRAJ_MCAST_MISSING_BITS, "A NACK must fit the missing set");
+
+/* Sequence tracking */
+static bool have_sequence;
+static uint32_t next_sequence;
+
+/* NACKed frames not received yet: bit i is sequence missing_first + i */
+static uint32_t missing_first;
+static uint32_t missing;
+
+/* Start of the newest segment queued, from either path */
+static bool have_last_start;
+static uint32_t last_start;
+
+/* Outstanding resend and the slices waiting behind it */
+static uint32_t resend_pending;
+static uint32_t resend_deadline_ms;
+static trajectory_packet_t held[TRAJ_MCAST_HOLD_DEPTH];
+static uint32_t held_count;
+
+static trajectory_mcast_stats_t stats;
+static struct k_spinlock stats_lock;
+
+static void traj_mcast_count(uint32_t *counter, uint32_t n)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	*counter += n;
+	k_spin_unlock(&stats_lock, key);
+}
+
+static void traj_mcast_note_start(const trajectory_packet_t *pkt)
+{
+	last_start = pkt->start_timestamp;
+	have_last_start = true;
+}
+
+/* Starts no later than a segment already queued (0 ms back: same start) */
+static bool traj_mcast_is_repeat(const trajectory_packet_t *pkt, uint32_t window_ms)
+{
+	uint32_t back = last_start - pkt->start_timestamp;
+
+	return have_last_start && (int32_t)back >= 0 && back <= window_ms;
+}
+
+static void traj_mcast_queue(const trajectory_packet_t *pkt)
+{
+	packet_handle_trajectory(pkt);
+	traj_mcast_note_start(pkt);
+	traj_mcast_count(&stats.slices, 1);
+}
+
+/* Queue everything held, in arrival order, and stop waiting */
+static void traj_mcast_release(void)
+{
+	for (uint32_t i = 0; i < held_count; i++) {
+		traj_mcast_queue(&held[i]);
+	}
+	held_count = 0;
+	resend_pending = 0;
+	missing = 0;
+}
+
+/* One missing segment has arrived (late frame or TCP resend) */
+static void traj_mcast_resent(void)
+{
+	traj_mcast_count(&stats.retransmits, 1);
+
+	if (--resend_pending == 0) {
+		traj_mcast_release();
+	}
+}
+
+/* Add NACKed sequences; ones that no longer fit the window are given up */
+static void traj_mcast_add_missing(uint32_t first, uint32_t count)
+{
+	if (missing == 0) {
+		missing_first = first;
+	}
+
+	uint32_t end = first + count - missing_first;
+
+	if (end > TRAJ_MCAST_MISSING_BITS) {
+		uint32_t shift = end - TRAJ_MCAST_MISSING_BITS;
+
+		missing = (shift < 32) ? missing >> shift : 0;
+		missing_first += shift;
+	}
+
+	for (uint32_t seq = first; seq != first + count; seq++) {
+		missing |= BIT(seq - missing_first);
+	}
+}
+
+/* Take a late frame's sequence out of the missing set */
+static bool traj_mcast_take_missing(uint32_t sequence)
+{
+	uint32_t bit = sequence - missing_first;
+
+	if (bit >= TRAJ_MCAST_MISSING_BITS || !(missing & BIT(bit))) {
+		return false;
+	}
+
+	missing &= ~BIT(bit);
+
+	return true;
+}
+
+static void traj_mcast_hold(const trajectory_packet_t *pkt)
+{
+	if (held_count == TRAJ_MCAST_HOLD_DEPTH) {
+		/* Waited two frames already: give up on the resend */
+		traj_mcast_count(&stats.timeouts, 1);
+		traj_mcast_release();
+		traj_mcast_queue(pkt);
+		return;
+	}
+
+	held[held_count++] = *pkt;
+}
+
+static void traj_mcast_gap(uint32_t first, uint32_t count)
+{
+	multicast_nack_packet_t nack;
+
+	traj_mcast_count(&stats.gaps, 1);
+	traj_mcast_count(&stats.lost, count);
+
+	if (count > TRAJ_MCAST_MAX_NACK) {
+		/* Long outage: the missing segments are over by now */
+		LOG_WRN_RL("Multicast: %u frames lost, resynchronising", count);
+		traj_mcast_release();
+		return;
+	}
+
+	LOG_WRN_RL("Multicast: frames %u-%u lost", first, first + count - 1);
+
+	nack.magic_header = PACKET_MAGIC_STM32_TO_MASTER;
+	nack.packet_type = FEEDBACK_MULTICAST_NACK;
+	nack.segment_id = packet_get_segment_id();
+	nack.first_sequence = first;
+	nack.count = (uint16_t)count;
+	nack.crc16 = crc16_ccitt_calc((uint8_t *)&nack, sizeof(nack) - 2);
+
+	/* No TCP master, no resend: nothing to wait for */
+	if (network_send_tcp((const uint8_t *)&nack, sizeof(nack)) < 0) {
+		return;
+	}
+
+	resend_pending += count;
+	resend_deadline_ms = timesync_now_ms() + TRAJ_MCAST_RESEND_MS;
+	traj_mcast_add_missing(first, count);
+}
+
+/* This segment's slice: an exact match wins over a 0xFF slice */
+static const uint8_t *traj_mcast_find_slice(const uint8_t *slices, uint8_t count)
+{
+	uint8_t id = packet_get_segment_id();
+	const uint8_t *all = NULL;
+
+	for (uint8_t i = 0; i < count; i++) {
+		const uint8_t *slice = slices + i * sizeof(multicast_trajectory_slice_t);
+
+		if (slice[0] == id) {
+			return slice;
+		}
+		if (slice[0] == 0xFF && all == NULL) {
+			all = slice;
+		}
+	}
+
+	return all;
+}
+
+static void traj_mcast_to_packet(const multicast_trajectory_header_t *hdr,
+				 const uint8_t *slice_data, trajectory_packet_t *pkt)
+{
+	multicast_trajectory_slice_t slice;
+
+	memcpy(&slice, slice_data, sizeof(slice));
+
+	pkt->magic_header = PACKET_MAGIC_MASTER_TO_STM32;
+	pkt->packet_type = CMD_TRAJECTORY;
+	pkt->segment_id = packet_get_segment_id();
+	pkt->trajectory_id = slice.trajectory_id;
+	pkt->start_timestamp = hdr->start_timestamp;
+	pkt->duration_ms = hdr->duration_ms;
+	memcpy(pkt->motor_1_coeffs, slice.motor_1_coeffs, sizeof(pkt->motor_1_coeffs));
+	memcpy(pkt->motor_2_coeffs, slice.motor_2_coeffs, sizeof(pkt->motor_2_coeffs));
+	memcpy(pkt->motor_3_coeffs, slice.motor_3_coeffs, sizeof(pkt->motor_3_coeffs));
+	pkt->crc16 = 0;                  /* Never goes on the wire */
+}
+
+int trajectory_mcast_receive(const uint8_t *data, size_t length)
+{
+	multicast_trajectory_header_t hdr;
+	trajectory_packet_t pkt;
+
+	if (length < sizeof(hdr) + sizeof(multicast_trajectory_slice_t) + 2) {
+		traj_mcast_count(&stats.invalid, 1);
+		return -EINVAL;
+	}
+
+	memcpy(&hdr, data, sizeof(hdr));
+
+	if (hdr.magic_header != PACKET_MAGIC_MASTER_TO_STM32 ||
+	    hdr.packet_type != CMD_MULTICAST_TRAJECTORY ||
+	    hdr.slice_count == 0 || hdr.slice_count > MULTICAST_MAX_SLICES ||
+	    length != sizeof(hdr) + hdr.slice_count * sizeof(multicast_trajectory_slice_t) + 2 ||
+	    !crc16_verify(data, length)) {
+		traj_mcast_count(&stats.invalid, 1);
+		return -EINVAL;
+	}
+
+	traj_mcast_count(&stats.frames, 1);
+
+	const uint8_t *slice = traj_mcast_find_slice(data + sizeof(hdr), hdr.slice_count);
+	int32_t ahead = (int32_t)(hdr.sequence - next_sequence);
+
+	if (have_sequence && ahead < 0) {
+		/* Reordered: useful only if NACKed, not received, and not resent yet */
+		if (!traj_mcast_take_missing(hdr.sequence) || !slice) {
+			traj_mcast_count(&stats.late, 1);
+			return 0;
+		}
+
+		traj_mcast_to_packet(&hdr, slice, &pkt);
+
+		if (traj_mcast_is_repeat(&pkt, UINT32_MAX)) {
+			traj_mcast_count(&stats.late, 1);
+			return 0;
+		}
+
+		traj_mcast_queue(&pkt);
+		traj_mcast_resent();
+		return 0;
+	}
+
+	if (have_sequence && ahead > 0) {
+		traj_mcast_gap(next_sequence, (uint32_t)ahead);
+	}
+	next_sequence = hdr.sequence + 1;
+	have_sequence = true;
+
+	if (!slice) {
+		return 0;
+	}
+
+	traj_mcast_to_packet(&hdr, slice, &pkt);
+
+	if (resend_pending > 0 || held_count > 0) {
+		traj_mcast_hold(&pkt);
+	} else {
+		traj_mcast_queue(&pkt);
+	}
+
+	return 0;
+}
+
+int trajectory_mcast_unicast(const trajectory_packet_t *pkt)
+{
+	/* Already queued from a late frame, or a resend that came too late */
+	if (have_sequence && traj_mcast_is_repeat(pkt, TRAJ_MCAST_REPEAT_MS)) {
+		traj_mcast_count(&stats.late, 1);
+		return -EALREADY;
+	}
+
+	packet_handle_trajectory(pkt);
+	traj_mcast_note_start(pkt);
+
+	if (resend_pending == 0) {
+		return 0;
+	}
+
+	/* Only segments before the held ones can be resends */
+	if (held_count > 0 &&
+	    (int32_t)(pkt->start_timestamp - held[0].start_timestamp) >= 0) {
+		return 0;
+	}
+
+	traj_mcast_resent();
+
+	return 0;
+}
+
+/* Next hold deadline (only meaningful while waiting) */
+static uint32_t traj_mcast_deadline(void)
+{
+	uint32_t deadline = resend_deadline_ms;
+
+	if (held_count > 0) {
+		uint32_t start = held[0].start_timestamp - TRAJ_MCAST_START_MARGIN_MS;
+
+		if ((int32_t)(start - deadline) < 0) {
+			deadline = start;
+		}
+	}
+
+	return deadline;
+}
+
+void trajectory_mcast_tick(void)
+{
+	if (resend_pending == 0 && held_count == 0) {
+		return;
+	}
+
+	if ((int32_t)(timesync_now_ms() - traj_mcast_deadline()) < 0) {
+		return;
+	}
+
+	if (held_count > 0) {
+		traj_mcast_count(&stats.timeouts, 1);
+	}
+	traj_mcast_release();
+}
+
+int trajectory_mcast_poll_timeout(void)
+{
+	if (resend_pending == 0 && held_count == 0) {
+		return -1;
+	}
+
+	int32_t wait = (int32_t)(traj_mcast_deadline() - timesync_now_ms());
+
+	return MAX(wait, 0);
+}
+
+void trajectory_mcast_get_stats(trajectory_mcast_stats_t *out)
+{
+	if (!out) {
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	*out = stats;
+	k_spin_unlock(&stats_lock, key);
+}
@@ -0,0 +1,83 @@
+/*
+ * Multicast Trajectory Channel - Phase 7
+ * One MULTICAST_TRAJECTORY frame per tick for all segments
+ *
+ * The master sends one UDP multicast frame with a slice per segment
+ * instead of a TCP TRAJECTORY to each segment. Every controller keeps
+ * its own slice and hands it to the trajectory buffer like a TCP
+ * segment.
+ *
+ * Frames are numbered. A gap is reported to the masters with a
+ * MULTICAST_NACK on TCP, and the master resends this segment's
+ * missing slices as TRAJECTORY packets. Because the trajectory buffer
+ * is a FIFO, slices received after the gap are held back until the
+ * resent segments have arrived, the resend times out, or the held
+ * slice is about to start - whichever comes first.
+ *
+ * Everything runs in the network server thread.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TRAJECTORY_MCAST_H
+#define TRAJECTORY_MCAST_H
+
+#include "packet.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/* Multicast channel statistics */
+typedef struct {
+	uint32_t frames;            /* Valid frames received */
+	uint32_t slices;            /* Own slices handed to the trajectory buffer */
+	uint32_t invalid;           /* Bad length, magic or CRC */
+	uint32_t gaps;              /* Sequence gaps (NACKs sent) */
+	uint32_t lost;              /* Frames reported missing */
+	uint32_t retransmits;       /* Resent segments received before the timeout */
+	uint32_t timeouts;          /* Held slices released without the resend */
+	uint32_t late;              /* Old or duplicate frames and repeated resends dropped */
+} trajectory_mcast_stats_t;
+
+/**
+ * Handle a datagram received on the multicast socket
+ *
+ * @param data Received datagram
+ * @param length Length of datagram
+ * @return 0 on success, -EINVAL if the frame was invalid
+ */
+int trajectory_mcast_receive(const uint8_t *data, size_t length);
+
+/**
+ * Queue a TRAJECTORY received over TCP
+ * While a resend is outstanding it counts as one of the missing
+ * segments, and the held slices follow it once all have arrived. A
+ * segment that does not start after the newest one queued (a missing
+ * frame that already arrived late, or a resend after the hold gave up)
+ * is dropped.
+ *
+ * @param pkt Trajectory from the master
+ * @return 0 if queued, -EALREADY if dropped as a repeat
+ */
+int trajectory_mcast_unicast(const trajectory_packet_t *pkt);
+
+/**
+ * Release held slices whose wait has expired
+ * Call after every poll wake-up.
+ */
+void trajectory_mcast_tick(void);
+
+/**
+ * Get the poll timeout until the next hold deadline
+ *
+ * @return Milliseconds to wait, -1 if nothing is held
+ */
+int trajectory_mcast_poll_timeout(void);
+
+/**
+ * Get multicast channel statistics
+ *
+ * @param stats Output: current statistics
+ */
+void trajectory_mcast_get_stats(trajectory_mcast_stats_t *stats);
+
+#endif /* TRAJECTORY_MCAST_H */
@@ -0,0 +1,460 @@
+/*
+ * Hot-Path Benchmarks - Cycle counts of the per-packet and per-tick code
+ *
+ * Each case is timed individually with the DWT cycle counter, with
+ * interrupts locked unless the case has to block (UART round trip).
+ * The cost of an empty measurement is subtracted. Results are printed
+ * as one JSON object per line between a "start" and a "done" record,
+ * for tools/bench_compare.py.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <cmsis_core.h>
+#include <string.h>
+#include "config.h"
+#include "packet.h"
+#include "crc16.h"
+#include "crc.h"
+#include "madgwick.h"
+#include "tmc9660.h"
+#include "estop.h"
+#include "encoder.h"
+#include "capgrid.h"
+#include "trace.h"
+#include "trajectory_buffer.h"
+
+#define BENCH_ITERATIONS      1000
+#define BENCH_UART_ITERATIONS 100   /* ~1.4 ms each at 115200 baud */
+
+#define BENCH_SEGMENT_ID 1
+
+typedef struct {
+	const char *name;
+	int (*run)(void);        /* Timed; negative return fails the case */
+	void (*setup)(void);     /* Untimed, before each iteration (optional) */
+	uint32_t iterations;
+	bool blocking;           /* Run with interrupts enabled */
+} bench_case_t;
+
+typedef struct {
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+	uint32_t count;
+} bench_result_t;
+
+static uint32_t overhead_cycles;
+
+/* Results of pure functions go here so they are not optimized away */
+static volatile uint32_t sink;
+
+/* ========================================
+ * Cycle counter
+ * ======================================== */
+
+static void bench_dwt_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+#if defined(__CORTEX_M) && (__CORTEX_M == 7U)
+	/* Cortex-M7 DWT is write-locked after reset */
+	DWT->LAR = 0xC5ACCE55;
+#endif
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t bench_cycles(void)
+{
+	return DWT->CYCCNT;
+}
+
+/* ========================================
+ * Fixtures
+ * ======================================== */
+
+static madgwick_t filter;
+static motor_state_packet_t motor_state;
+static motor_sample_t compact_samples[COMPACT_MAX_SAMPLES];
+static uint8_t compact_buf[COMPACT_MAX_SIZE];
+static uint8_t crc_buf[sizeof(trajectory_packet_t)];
+static uint16_t grid_raw[CAPACITIVE_GRID_POINTS] __aligned(4);
+static uint16_t grid_baseline[CAPACITIVE_GRID_POINTS] __aligned(4);
+static uint16_t grid_out[CAPACITIVE_GRID_POINTS] __aligned(4);
+
+static trajectory_packet_t trajectory_pkt;
+static emergency_stop_packet_t estop_pkt;
+static start_homing_packet_t homing_pkt;
+static jog_motor_packet_t jog_pkt;
+static set_mode_packet_t set_mode_pkt;
+static set_zero_offset_packet_t zero_offset_pkt;
+
+/* Fill header and CRC of a command packet */
+static void bench_seal(void *pkt, size_t len, uint8_t type)
+{
+	uint8_t *p = pkt;
+
+	p[0] = PACKET_MAGIC_MASTER_TO_STM32 & 0xFF;
+	p[1] = PACKET_MAGIC_MASTER_TO_STM32 >> 8;
+	p[2] = type;
+	p[3] = BENCH_SEGMENT_ID;
+
+	uint16_t crc = crc16_ccitt_calc(p, len - 2);
+
+	p[len - 2] = crc & 0xFF;
+	p[len - 1] = crc >> 8;
+}
+
+static void bench_fixtures_init(void)
+{
+	madgwick_init(&filter, 100.0f, 0.1f);
+
+	for (size_t i = 0; i < sizeof(crc_buf); i++) {
+		crc_buf[i] = (uint8_t)(i * 37 + 11);
+	}
+
+	trajectory_pkt.trajectory_id = 1;
+	trajectory_pkt.duration_ms = 200;
+	for (int i = 0; i < 8; i++) {
+		trajectory_pkt.motor_1_coeffs[i] = 0.5f * i;
+		trajectory_pkt.motor_2_coeffs[i] = -0.25f * i;
+		trajectory_pkt.motor_3_coeffs[i] = 0.125f * i;
+	}
+	bench_seal(&trajectory_pkt, sizeof(trajectory_pkt), CMD_TRAJECTORY);
+
+	estop_pkt.stop_reason = 0x01;
+	bench_seal(&estop_pkt, sizeof(estop_pkt), CMD_EMERGENCY_STOP);
+
+	homing_pkt.homing_mode = 0x02;
+	bench_seal(&homing_pkt, sizeof(homing_pkt), CMD_START_HOMING);
+
+	jog_pkt.motor_id = 1;
+	jog_pkt.mode = 0x01;
+	jog_pkt.value = 1.5f;
+	jog_pkt.speed_percent = 10;
+	bench_seal(&jog_pkt, sizeof(jog_pkt), CMD_JOG_MOTOR);
+
+	/* IDLE: OPERATION would also clear the E-stop latch */
+	set_mode_pkt.mode = MODE_IDLE;
+	bench_seal(&set_mode_pkt, sizeof(set_mode_pkt), CMD_SET_MODE);
+
+	bench_seal(&zero_offset_pkt, sizeof(zero_offset_pkt), CMD_SET_ZERO_OFFSET);
+
+	/* A smooth move: every sample after the first is delta encoded */
+	for (int n = 0; n < COMPACT_MAX_SAMPLES; n++) {
+		motor_sample_t *s = &compact_samples[n];
+
+		s->timestamp = 10 * n;
+		for (int i = 0; i < 3; i++) {
+			s->position[i] = 5.0f + 0.02f * n;
+			s->velocity[i] = 2.0f;
+			s->acceleration[i] = 0.1f * n;
+			s->current[i] = 0.5f;
+			s->imu[i] = 0.01f * i;
+		}
+		s->status_flags = STATUS_TRAJECTORY_EXECUTING;
+	}
+
+	/* Some points touched, some at or below the baseline */
+	for (int i = 0; i < CAPACITIVE_GRID_POINTS; i++) {
+		grid_baseline[i] = 1000 + 3 * i;
+		grid_raw[i] = grid_baseline[i] + ((i % 7) * 11) - 20;
+	}
+}
+
+/* ========================================
+ * Cases
+ * ======================================== */
+
+static int bench_empty(void)
+{
+	return 0;
+}
+
+static int bench_madgwick_update(void)
+{
+	madgwick_update(&filter, 0.01f, -0.02f, 0.005f, 0.02f, 0.01f, 0.98f);
+	return 0;
+}
+
+static int bench_madgwick_get_euler(void)
+{
+	float roll, pitch, yaw;
+
+	madgwick_get_euler(&filter, &roll, &pitch, &yaw);
+	sink = (uint32_t)(roll + pitch + yaw);
+	return 0;
+}
+
+static int bench_crc16_7(void)
+{
+	sink = crc16_ccitt_calc(crc_buf, 7);
+	return 0;
+}
+
+static int bench_crc16_26(void)
+{
+	sink = crc16_ccitt_calc(crc_buf, 26);
+	return 0;
+}
+
+static int bench_crc16_112(void)
+{
+	sink = crc16_ccitt_calc(crc_buf, sizeof(crc_buf));
+	return 0;
+}
+
+static int bench_crc8_tmc(void)
+{
+	sink = crc_tmc8(crc_buf, TMC9660_MSG_SIZE - 1);
+	return 0;
+}
+
+static int bench_parse(const void *pkt, size_t len)
+{
+	int ret = packet_parse_command(pkt, len);
+
+	return (ret < 0) ? ret : 0;
+}
+
+static int bench_parse_trajectory(void)
+{
+	return bench_parse(&trajectory_pkt, sizeof(trajectory_pkt));
+}
+
+static int bench_parse_emergency_stop(void)
+{
+	return bench_parse(&estop_pkt, sizeof(estop_pkt));
+}
+
+static int bench_parse_start_homing(void)
+{
+	return bench_parse(&homing_pkt, sizeof(homing_pkt));
+}
+
+static int bench_parse_jog_motor(void)
+{
+	return bench_parse(&jog_pkt, sizeof(jog_pkt));
+}
+
+static int bench_parse_set_mode(void)
+{
+	return bench_parse(&set_mode_pkt, sizeof(set_mode_pkt));
+}
+
+static int bench_parse_set_zero_offset(void)
+{
+	return bench_parse(&zero_offset_pkt, sizeof(zero_offset_pkt));
+}
+
+static int bench_build_motor_state(void)
+{
+	packet_build_motor_state(&motor_state, BENCH_SEGMENT_ID);
+	return 0;
+}
+
+static int bench_build_motor_state_compact(void)
+{
+	sink = packet_build_motor_state_compact(compact_buf, compact_samples,
+						COMPACT_MAX_SAMPLES, 10, BENCH_SEGMENT_ID, 0);
+	return 0;
+}
+
+/* Per-tick cost: three timer reads, M/T velocity and the filter update */
+static int bench_encoder_sample(void)
+{
+	encoder_sample();
+	return 0;
+}
+
+/* Whole grid: baseline subtraction and threshold */
+static int bench_capgrid_process(void)
+{
+	capgrid_process(grid_raw, grid_baseline, CAPGRID_THRESHOLD, grid_out);
+	sink = grid_out[CAPACITIVE_GRID_POINTS - 1];
+	return 0;
+}
+
+/* One trace event: slot claim, cycle counter, stores */
+static int bench_trace_record(void)
+{
+	trace_record(TRACE_EVT_CTRL_START, 1, 0);
+	return 0;
+}
+
+static int bench_tmc9660_no_op(void)
+{
+	return tmc9660_no_op(TMC9660_MOTOR_A);
+}
+
+/* Shadow hit: the setup read fetches the word once, later ones are cached */
+static void bench_setup_config_cached(void)
+{
+	uint32_t value;
+
+	tmc9660_read_config(TMC9660_MOTOR_A, 0, &value);
+}
+
+static int bench_tmc9660_read_config_cached(void)
+{
+	uint32_t value;
+	int ret = tmc9660_read_config(TMC9660_MOTOR_A, 0, &value);
+
+	sink = value;
+	return ret;
+}
+
+/* An empty buffer each time, so every push takes the normal path */
+static void bench_setup_trajectory(void)
+{
+	trajectory_buffer_init();
+}
+
+/*
+ * Order matters: SET_MODE runs before EMERGENCY_STOP, which stays
+ * latched for the rest of the run.
+ */
+static const bench_case_t cases[] = {
+	{ "madgwick_update", bench_madgwick_update, NULL, BENCH_ITERATIONS, false },
+	{ "madgwick_get_euler", bench_madgwick_get_euler, NULL, BENCH_ITERATIONS, false },
+	{ "crc16_ccitt_calc_7", bench_crc16_7, NULL, BENCH_ITERATIONS, false },
+	{ "crc16_ccitt_calc_26", bench_crc16_26, NULL, BENCH_ITERATIONS, false },
+	{ "crc16_ccitt_calc_112", bench_crc16_112, NULL, BENCH_ITERATIONS, false },
+	{ "crc_tmc8_7", bench_crc8_tmc, NULL, BENCH_ITERATIONS, false },
+	{ "parse_trajectory", bench_parse_trajectory, bench_setup_trajectory,
+	  BENCH_ITERATIONS, false },
+	{ "parse_start_homing", bench_parse_start_homing, NULL, BENCH_ITERATIONS, false },
+	{ "parse_jog_motor", bench_parse_jog_motor, NULL, BENCH_ITERATIONS, false },
+	{ "parse_set_mode", bench_parse_set_mode, NULL, BENCH_ITERATIONS, false },
+	{ "parse_set_zero_offset", bench_parse_set_zero_offset, NULL, BENCH_ITERATIONS, false },
+	{ "parse_emergency_stop", bench_parse_emergency_stop, NULL, BENCH_ITERATIONS, false },
+	{ "build_motor_state", bench_build_motor_state, NULL, BENCH_ITERATIONS, false },
+	{ "build_motor_state_compact_4", bench_build_motor_state_compact, NULL,
+	  BENCH_ITERATIONS, false },
+	{ "encoder_sample", bench_encoder_sample, NULL, BENCH_ITERATIONS, false },
+	{ "capgrid_process_168", bench_capgrid_process, NULL, BENCH_ITERATIONS, false },
+	{ "trace_record", bench_trace_record, NULL, BENCH_ITERATIONS, false },
+	{ "tmc9660_no_op", bench_tmc9660_no_op, NULL, BENCH_UART_ITERATIONS, true },
+	{ "tmc9660_read_config_cached", bench_tmc9660_read_config_cached,
+	  bench_setup_config_cached, BENCH_ITERATIONS, true },
+};
+
+/* ========================================
+ * Runner
+ * ======================================== */
+
+static int bench_run(const bench_case_t *bc, bench_result_t *res)
+{
+	res->min = UINT32_MAX;
+	res->max = 0;
+	res->total = 0;
+	res->count = 0;
+
+	for (uint32_t i = 0; i < bc->iterations; i++) {
+		unsigned int key = 0;
+		uint32_t start, end;
+		int ret;
+
+		if (bc->setup) {
+			bc->setup();
+		}
+
+		if (!bc->blocking) {
+			key = irq_lock();
+		}
+
+		start = bench_cycles();
+		ret = bc->run();
+		end = bench_cycles();
+
+		if (!bc->blocking) {
+			irq_unlock(key);
+		}
+
+		if (ret < 0) {
+			return ret;
+		}
+
+		uint32_t cycles = end - start;
+
+		cycles = (cycles > overhead_cycles) ? cycles - overhead_cycles : 0;
+		res->min = MIN(res->min, cycles);
+		res->max = MAX(res->max, cycles);
+		res->total += cycles;
+		res->count++;
+	}
+
+	return 0;
+}
+
+/* Smallest cost of timing an empty case */
+static void bench_calibrate(void)
+{
+	const bench_case_t empty = { "empty", bench_empty, NULL, BENCH_ITERATIONS, false };
+	bench_result_t res;
+
+	overhead_cycles = 0;
+	bench_run(&empty, &res);
+	overhead_cycles = res.min;
+}
+
+int main(void)
+{
+	bench_result_t res;
+	int failed = 0;
+
+	bench_dwt_init();
+	bench_calibrate();
+	bench_fixtures_init();
+
+	packet_set_segment_id(BENCH_SEGMENT_ID);
+	estop_init();
+	tmc9660_init_all();
+	encoder_init();
+
+	printk("{\"suite\":\"hot_paths\",\"event\":\"start\",\"board\":\"%s\","
+	       "\"cpu_hz\":%u,\"crc\":\"%s\",\"overhead_cycles\":%u}\n",
+	       CONFIG_BOARD, sys_clock_hw_cycles_per_sec(),
+	       IS_ENABLED(CONFIG_SEGMENT_CRC_HW) ? "hw" : "table", overhead_cycles);
+
+	for (size_t i = 0; i < ARRAY_SIZE(cases); i++) {
+		const bench_case_t *bc = &cases[i];
+
+		if ((bc->run == bench_tmc9660_no_op || bc->run == bench_tmc9660_read_config_cached) &&
+		    !tmc9660_is_ready(TMC9660_MOTOR_A)) {
+			printk("{\"bench\":\"%s\",\"skipped\":\"not_ready\"}\n", bc->name);
+			continue;
+		}
+
+		if (bc->run == bench_trace_record && !IS_ENABLED(CONFIG_SEGMENT_TRACE)) {
+			printk("{\"bench\":\"%s\",\"skipped\":\"disabled\"}\n", bc->name);
+			continue;
+		}
+
+		if (bc->run == bench_encoder_sample && !encoder_is_ready()) {
+			printk("{\"bench\":\"%s\",\"skipped\":\"not_ready\"}\n", bc->name);
+			continue;
+		}
+
+		int ret = bench_run(bc, &res);
+
+		if (ret < 0) {
+			printk("{\"bench\":\"%s\",\"error\":%d}\n", bc->name, ret);
+			failed++;
+			continue;
+		}
+
+		printk("{\"bench\":\"%s\",\"iterations\":%u,\"min\":%u,\"avg\":%u,"
+		       "\"max\":%u,\"unit\":\"cycles\"}\n",
+		       bc->name, res.count, res.min,
+		       (uint32_t)(res.total / res.count), res.max);
+	}
+
+	estop_clear();
+
+	printk("{\"suite\":\"hot_paths\",\"event\":\"done\",\"failed\":%d}\n", failed);
+
+	return 0;
+}
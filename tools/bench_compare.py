@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""
+Hot-Path Benchmark Comparison Tool
+
+Extracts the JSON result lines printed by tests/benchmarks/hot_paths from
+a console log and compares them with a saved baseline.
+
+Usage:
+    python3 bench_compare.py console.log --save baseline.json
+    python3 bench_compare.py console.log --baseline baseline.json
+    python3 bench_compare.py console.log --baseline baseline.json --threshold 5
+
+Exit status is 1 if any benchmark's average got slower than the baseline
+by more than the threshold, failed on target, or the run did not finish.
+"""
+
+import argparse
+import json
+import sys
+
+
+def parse_log(lines):
+    """Collect start record and per-benchmark results from console output"""
+    start = None
+    done = None
+    results = {}
+
+    for line in lines:
+        # Console may prefix lines (timestamps, serial tools): find the object
+        pos = line.find('{')
+        if pos < 0:
+            continue
+        try:
+            record = json.loads(line[pos:])
+        except ValueError:
+            continue
+
+        if record.get('suite') == 'hot_paths':
+            if record.get('event') == 'start':
+                start = record
+                results = {}
+            elif record.get('event') == 'done':
+                done = record
+        elif 'bench' in record:
+            results[record['bench']] = record
+
+    return start, done, results
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare hot-path benchmark results')
+    parser.add_argument('log', help='Console log of the benchmark run (- for stdin)')
+    parser.add_argument('--baseline', help='Baseline results (JSON) to compare against')
+    parser.add_argument('--save', help='Write results of this run as a new baseline')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='Allowed slowdown of the average in percent (default 10)')
+    args = parser.parse_args()
+
+    if args.log == '-':
+        start, done, results = parse_log(sys.stdin)
+    else:
+        with open(args.log, encoding='utf-8', errors='replace') as f:
+            start, done, results = parse_log(f)
+
+    if start is None or done is None:
+        print("Error: no complete benchmark run found in log")
+        return 1
+
+    cpu_hz = start.get('cpu_hz', 0)
+    print(f"Board: {start.get('board')}, CPU: {cpu_hz / 1e6:.0f} MHz, "
+          f"CRC: {start.get('crc')}, overhead: {start.get('overhead_cycles')} cycles")
+
+    baseline = {}
+    if args.baseline:
+        with open(args.baseline, encoding='utf-8') as f:
+            baseline = json.load(f).get('results', {})
+
+    failed = done.get('failed', 0) > 0
+    print(f"\n{'benchmark':<24} {'min':>8} {'avg':>8} {'max':>8} {'avg us':>8} {'vs base':>8}")
+
+    for name, r in results.items():
+        if 'error' in r:
+            print(f"{name:<24} ERROR {r['error']}")
+            failed = True
+            continue
+        if 'skipped' in r:
+            print(f"{name:<24} skipped ({r['skipped']})")
+            continue
+
+        avg_us = r['avg'] * 1e6 / cpu_hz if cpu_hz else 0.0
+        delta = ''
+        base = baseline.get(name)
+        if base and 'avg' in base and base['avg'] > 0:
+            change = (r['avg'] - base['avg']) * 100.0 / base['avg']
+            delta = f"{change:+.1f}%"
+            if change > args.threshold:
+                delta += ' !'
+                failed = True
+
+        print(f"{name:<24} {r['min']:>8} {r['avg']:>8} {r['max']:>8} {avg_us:>8.2f} {delta:>8}")
+
+    if args.save:
+        with open(args.save, 'w', encoding='utf-8') as f:
+            json.dump({'start': start, 'results': results}, f, indent=2)
+        print(f"\nSaved baseline to {args.save}")
+
+    if failed:
+        print("\nFAILED: regression or on-target error")
+        return 1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+"""
+Per-Module Footprint Report
+
+Reads the GNU ld map of a Zephyr build (build/zephyr/zephyr.map) and
+lists ROM and RAM per firmware source file (app library) and per library
+for everything else, broken down by memory region, so the placement of
+the control path in DTCM/ITCM (CONFIG_SEGMENT_TCM) can be checked.
+
+ROM counts code and constants plus the flash image of initialised data
+and of code copied to RAM/ITCM at boot. RAM counts everything that lives
+in a writable region at run time, thread stacks included.
+
+Usage:
+    python3 footprint_report.py build/zephyr/zephyr.map
+    python3 footprint_report.py build/zephyr/zephyr.map --app --top 20
+    python3 footprint_report.py build/zephyr/zephyr.map --json footprint.json
+
+Also available as a build target: west build -t footprint_modules
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+from collections import defaultdict
+
+# Output sections that take no memory on target
+SKIP_OUTPUT = re.compile(r'^(\.debug|\.comment|\.ARM\.attributes|\.stab|\.note|/DISCARD/)')
+
+HEX = r'0x([0-9a-fA-F]+)'
+RE_REGION = re.compile(r'^(\S+)\s+' + HEX + r'\s+' + HEX + r'(?:\s+(\S+))?\s*$')
+RE_OUTPUT = re.compile(r'^(\S+)\s+' + HEX + r'\s+' + HEX + r'(?:\s+load address ' + HEX + r')?')
+RE_OUTPUT_NAME = re.compile(r'^(\S+)\s*$')
+RE_INPUT = re.compile(r'^ (\S+)\s+' + HEX + r'\s+' + HEX + r'\s+(\S.*)$')
+RE_INPUT_NAME = re.compile(r'^ (\S+)\s*$')
+RE_INPUT_CONT = re.compile(r'^\s+' + HEX + r'\s+' + HEX + r'\s+(\S.*)$')
+RE_MEMBER = re.compile(r'^(.*?)([^/\\]+)\.a\((.+)\)$')
+
+
+class Region:
+    def __init__(self, name, origin, length, attrs):
+        self.name = name
+        self.origin = origin
+        self.end = origin + length
+        attrs = (attrs or '').lower()
+        # Flash is executable and not writable; fall back to the name
+        self.rom = ('x' in attrs and 'w' not in attrs) or \
+            any(k in name.upper() for k in ('FLASH', 'ROM'))
+
+    def contains(self, addr):
+        return self.origin <= addr < self.end
+
+
+def module_name(obj, by_object):
+    """control.c for the app library, the library name for the rest"""
+    m = RE_MEMBER.match(obj.strip())
+    if m:
+        lib, member = m.group(2), m.group(3)
+        member = re.sub(r'\.(c|cpp|S)?\.?obj$|\.o$', '', member)
+        if lib == 'libapp':
+            return member if member.endswith(('.c', '.cpp', '.S')) else member + '.c'
+        lib = lib[3:] if lib.startswith('lib') else lib
+        return f"{lib}({member})" if by_object else lib
+    base = os.path.basename(obj.strip())
+    return re.sub(r'\.(c|S)\.obj$|\.obj$|\.o$', '', base)
+
+
+def parse_map(lines):
+    """Regions and (output, input section, vma, size, object, load) tuples"""
+    regions = []
+    sections = []
+    state = 'start'
+    out_name = None
+    out_load = None
+    out_vma = None
+    pending_input = None
+    pending_output = None
+
+    for raw in lines:
+        line = raw.rstrip('\n')
+
+        if state == 'start':
+            if line.startswith('Memory Configuration'):
+                state = 'regions'
+            continue
+
+        if state == 'regions':
+            if line.startswith('Linker script and memory map'):
+                state = 'map'
+                continue
+            m = RE_REGION.match(line)
+            if m and m.group(1) not in ('Name', '*default*'):
+                regions.append(Region(m.group(1), int(m.group(2), 16),
+                                      int(m.group(3), 16), m.group(4)))
+            continue
+
+        # Output section header, possibly on two lines when the name is long
+        if pending_output is not None:
+            m = re.match(r'^\s+' + HEX + r'\s+' + HEX + r'(?:\s+load address ' + HEX + r')?', line)
+            if m:
+                out_name = pending_output
+                out_vma = int(m.group(1), 16)
+                out_load = int(m.group(3), 16) if m.group(3) else None
+                pending_output = None
+                continue
+            pending_output = None
+
+        if line and not line[0].isspace():
+            m = RE_OUTPUT.match(line)
+            if m:
+                out_name = m.group(1)
+                out_vma = int(m.group(2), 16)
+                out_load = int(m.group(4), 16) if m.group(4) else None
+                continue
+            m = RE_OUTPUT_NAME.match(line)
+            if m and not line.startswith(('LOAD ', 'OUTPUT(')):
+                pending_output = m.group(1)
+            continue
+
+        if out_name is None or SKIP_OUTPUT.match(out_name):
+            pending_input = None
+            continue
+
+        if pending_input is not None:
+            m = RE_INPUT_CONT.match(line)
+            pending = pending_input
+            pending_input = None
+            if m:
+                vma, size = int(m.group(1), 16), int(m.group(2), 16)
+                sections.append((out_name, pending, vma, size, m.group(3), out_vma, out_load))
+                continue
+
+        m = RE_INPUT.match(line)
+        if m:
+            name = m.group(1)
+            if name.startswith('*'):
+                continue
+            vma, size = int(m.group(2), 16), int(m.group(3), 16)
+            sections.append((out_name, name, vma, size, m.group(4), out_vma, out_load))
+            continue
+
+        m = RE_INPUT_NAME.match(line)
+        if m and not m.group(1).startswith('*'):
+            pending_input = m.group(1)
+
+    return regions, sections
+
+
+def region_of(regions, addr):
+    for r in regions:
+        if r.contains(addr):
+            return r
+    return None
+
+
+def summarize(regions, sections, by_object):
+    modules = defaultdict(lambda: {'rom': 0, 'ram': 0, 'regions': defaultdict(int)})
+    objects = []
+
+    for out_name, name, vma, size, obj, out_vma, out_load in sections:
+        if size == 0 or obj.startswith('linker stubs'):
+            continue
+        region = region_of(regions, vma)
+        if region is None:
+            continue
+
+        mod = modules[module_name(obj, by_object)]
+        mod['regions'][region.name] += size
+
+        if region.rom:
+            mod['rom'] += size
+            continue
+
+        mod['ram'] += size
+        load_region = region_of(regions, out_load) if out_load is not None else None
+        if load_region is not None and load_region.rom and out_load != out_vma:
+            # Initial contents copied from flash at boot
+            mod['rom'] += size
+        objects.append((size, name, module_name(obj, by_object), region.name))
+
+    return modules, objects
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Per-module RAM/ROM from a linker map')
+    parser.add_argument('map', help='Linker map (build/zephyr/zephyr.map)')
+    parser.add_argument('--app', action='store_true', help='Only the firmware source files')
+    parser.add_argument('--by-object', action='store_true',
+                        help='Break libraries down into object files')
+    parser.add_argument('--top', type=int, default=0,
+                        help='Also list the N largest RAM objects (stacks, buffers)')
+    parser.add_argument('--json', help='Write the per-module numbers to this file')
+    args = parser.parse_args()
+
+    with open(args.map, encoding='utf-8', errors='replace') as f:
+        regions, sections = parse_map(f)
+
+    if not regions:
+        print("Error: no memory configuration in map file")
+        return 1
+
+    modules, objects = summarize(regions, sections, args.by_object)
+
+    if args.app:
+        app = {n for n in modules if n.endswith(('.c', '.cpp', '.S'))}
+        modules = {n: m for n, m in modules.items() if n in app}
+        objects = [o for o in objects if o[2] in app]
+
+    used = [r.name for r in regions if any(m['regions'].get(r.name) for m in modules.values())]
+    width = max([24] + [len(n) for n in modules])
+
+    print(f"{'module':<{width}} {'ROM':>8} {'RAM':>8}  " + ' '.join(f"{r:>8}" for r in used))
+    total_rom = total_ram = 0
+    total_regions = defaultdict(int)
+    for name, m in sorted(modules.items(), key=lambda kv: -(kv[1]['rom'] + kv[1]['ram'])):
+        total_rom += m['rom']
+        total_ram += m['ram']
+        for r in used:
+            total_regions[r] += m['regions'].get(r, 0)
+        print(f"{name:<{width}} {m['rom']:>8} {m['ram']:>8}  " +
+              ' '.join(f"{m['regions'].get(r, 0):>8}" for r in used))
+    print(f"{'total':<{width}} {total_rom:>8} {total_ram:>8}  " +
+          ' '.join(f"{total_regions[r]:>8}" for r in used))
+
+    if args.top > 0:
+        print(f"\n{'largest RAM objects':<40} {'bytes':>8}  {'region':<8} module")
+        for size, name, mod, region in sorted(objects, reverse=True)[:args.top]:
+            print(f"{name[:40]:<40} {size:>8}  {region:<8} {mod}")
+
+    if args.json:
+        out = {name: {'rom': m['rom'], 'ram': m['ram'], 'regions': dict(m['regions'])}
+               for name, m in modules.items()}
+        with open(args.json, 'w', encoding='utf-8') as f:
+            json.dump(out, f, indent=2, sort_keys=True)
+        print(f"\nWrote {args.json}")
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,673 @@
+#!/usr/bin/env python3
+"""
+Segment Controller Load Generator
+
+Drives several segment controllers at once with the production traffic
+mix and reports latency, loss and jitter per segment:
+
+    - TCP TRAJECTORY commands at a fixed rate (5-50 Hz)
+    - UDP EMERGENCY_STOP probes, each cleared again with SET_MODE OPERATION
+    - 100 Hz MOTOR_STATE feedback (UDP) and 1 Hz DIAGNOSTICS (TCP) received
+    - TIME_SYNC_REQUEST answered, so all segments share this host's clock
+      (time.monotonic(), in µs); the sync error reported in
+      DIAGNOSTICS_EXT is summarized per segment
+    - With --multicast, one MULTICAST_TRAJECTORY frame per tick for all
+      segments instead of TCP TRAJECTORY, with MULTICAST_NACK answered
+      by resending the missing segments over TCP
+
+Latency is measured end to end through the firmware: from sending a
+command to the first MOTOR_STATE showing its effect (E-stop flag set for
+the UDP E-stop, cleared for the TCP SET_MODE). Feedback is sent every
+10 ms, so the figures include up to one feedback period.
+
+Usage:
+    python3 load_generator.py                          # .100-.107, 10 Hz, 60 s
+    python3 load_generator.py --rate 50 --duration 300
+    python3 load_generator.py 192.168.1.100 192.168.1.101 --json result.json
+    python3 load_generator.py --multicast --rate 5
+
+Note: the firmware sends MOTOR_STATE to the TCP client's address and port,
+so each segment gets a UDP socket bound to the local port of its TCP
+connection.
+"""
+
+import argparse
+import collections
+import ipaddress
+import json
+import selectors
+import socket
+import struct
+import sys
+import threading
+import time
+
+# Network configuration (network.h)
+TCP_PORT = 5000
+UDP_PORT = 6000
+DEFAULT_IP_START = '192.168.1.100'
+DEFAULT_IP_END = '192.168.1.107'
+MCAST_GROUP = '239.255.60.1'     # CONFIG_SEGMENT_TRAJ_MULTICAST_GROUP
+MCAST_PORT = 6001                # CONFIG_SEGMENT_TRAJ_MULTICAST_PORT
+MCAST_HISTORY = 16               # Frames kept for resends (firmware NACK limit)
+
+MAGIC_MASTER_TO_STM32 = 0xAA55
+MAGIC_STM32_TO_MASTER = 0xBB55
+
+CMD_TRAJECTORY = 0x01
+CMD_EMERGENCY_STOP = 0x02
+CMD_SET_MODE = 0x08
+CMD_TIME_SYNC_REPLY = 0x0B
+CMD_MULTICAST_TRAJECTORY = 0x0C
+
+FEEDBACK_MOTOR_STATE = 0x01
+FEEDBACK_DIAGNOSTICS = 0x03
+FEEDBACK_DIAGNOSTICS_EXT = 0x04
+FEEDBACK_TIME_SYNC_REQUEST = 0x06
+FEEDBACK_MULTICAST_NACK = 0x07
+
+MODE_OPERATION = 0x03
+STATUS_E_STOP_ACTIVE = 1 << 0
+
+# Feedback packet sizes on the TCP stream
+FEEDBACK_SIZES = {
+    FEEDBACK_DIAGNOSTICS: 22,
+    FEEDBACK_DIAGNOSTICS_EXT: 110,
+    FEEDBACK_MULTICAST_NACK: 12,
+}
+TIME_SYNC_REQUEST_SIZE = 18
+MOTOR_STATE_SIZE = 83
+MOTOR_STATE_PERIOD_MS = 10
+CLOCK_STEP_MS = 60000   # Larger device timestamp jumps are clock steps
+
+# E-stop reason used for probes (distinguishable in the firmware log)
+ESTOP_REASON_LOAD_TEST = 0x7F
+
+# ==================================================
+# CRC16-CCITT (firmware variant)
+# ==================================================
+
+def crc16(data: bytes) -> int:
+    """
+    CRC16-CCITT as computed by the firmware (Zephyr crc16_ccitt with seed
+    0xFFFF): polynomial 0x1021 processed LSB first; check value 0x6F91.
+    """
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            if crc & 1:
+                crc = (crc >> 1) ^ 0x8408
+            else:
+                crc >>= 1
+    return crc
+
+
+def seal(body: bytes) -> bytes:
+    """Append little-endian CRC16 to a packet body"""
+    return body + struct.pack('<H', crc16(body))
+
+
+def crc_ok(packet: bytes) -> bool:
+    return crc16(packet[:-2]) == struct.unpack('<H', packet[-2:])[0]
+
+# ==================================================
+# PACKET BUILDERS
+# ==================================================
+
+def build_trajectory(segment_id: int, trajectory_id: int, start_ms: int, duration_ms: int) -> bytes:
+    """Hold-position trajectory (all coefficients zero)"""
+    body = struct.pack('<HBBIIH', MAGIC_MASTER_TO_STM32, CMD_TRAJECTORY, segment_id,
+                       trajectory_id & 0xFFFFFFFF, start_ms & 0xFFFFFFFF, duration_ms)
+    body += struct.pack('<24f', *([0.0] * 24))
+    return seal(body)
+
+
+def build_multicast_trajectory(sequence: int, start_ms: int, duration_ms: int, slices) -> bytes:
+    """Hold-position frame; slices is a list of (segment_id, trajectory_id)"""
+    body = struct.pack('<HBBIIHBB', MAGIC_MASTER_TO_STM32, CMD_MULTICAST_TRAJECTORY, 0xFF,
+                       sequence & 0xFFFFFFFF, start_ms & 0xFFFFFFFF, duration_ms, len(slices), 0)
+    for segment_id, trajectory_id in slices:
+        body += struct.pack('<BI', segment_id, trajectory_id & 0xFFFFFFFF)
+        body += struct.pack('<24f', *([0.0] * 24))
+    return seal(body)
+
+
+def build_emergency_stop(segment_id: int, reason: int) -> bytes:
+    return seal(struct.pack('<HBBB', MAGIC_MASTER_TO_STM32, CMD_EMERGENCY_STOP, segment_id, reason))
+
+
+def build_set_mode(segment_id: int, mode: int) -> bytes:
+    return seal(struct.pack('<HBBB', MAGIC_MASTER_TO_STM32, CMD_SET_MODE, segment_id, mode))
+
+
+def master_clock_us() -> int:
+    """Shared clock the segments synchronise to"""
+    return time.monotonic_ns() // 1000
+
+
+def build_time_sync_reply(segment_id: int, sequence: int, origin_us: int, receive_us: int) -> bytes:
+    return seal(struct.pack('<HBBHQQQ', MAGIC_MASTER_TO_STM32, CMD_TIME_SYNC_REPLY, segment_id,
+                            sequence, origin_us, receive_us, master_clock_us()))
+
+# ==================================================
+# STATISTICS
+# ==================================================
+
+def percentile(values, p):
+    if not values:
+        return None
+    ordered = sorted(values)
+    index = min(len(ordered) - 1, max(0, int(round(p / 100.0 * (len(ordered) - 1)))))
+    return ordered[index]
+
+
+def summarize(values):
+    if not values:
+        return {'count': 0}
+    return {
+        'count': len(values),
+        'min': min(values),
+        'p50': percentile(values, 50),
+        'p90': percentile(values, 90),
+        'p99': percentile(values, 99),
+        'max': max(values),
+    }
+
+
+class SegmentStats:
+    def __init__(self):
+        self.trajectories_sent = 0
+        self.tcp_send_errors = 0
+        self.estops_sent = 0
+        self.estop_timeouts = 0
+        self.clear_timeouts = 0
+        self.estop_latency_ms = []
+        self.clear_latency_ms = []
+
+        self.motor_state_rx = 0
+        self.motor_state_crc_errors = 0
+        self.motor_state_lost = 0
+        self.motor_state_interval_ms = []   # Host arrival intervals
+        self.device_interval_ms = []        # Device timestamp deltas
+
+        self.tcp_rx_packets = 0
+        self.tcp_crc_errors = 0
+        self.tcp_resync_bytes = 0
+        self.device_errors_first = None
+        self.device_errors_last = None
+
+        self.sync_replies = 0
+        self.sync_state = None
+        self.sync_offset_us = []            # |offset| from DIAGNOSTICS_EXT
+
+        self.nacks_rx = 0                   # MULTICAST_NACK received
+        self.frames_nacked = 0
+        self.resent = 0                     # Segments resent over TCP
+
+    def report(self):
+        rx_total = self.motor_state_rx + self.motor_state_crc_errors
+        expected = self.motor_state_rx + self.motor_state_lost
+        jitter = [abs(i - MOTOR_STATE_PERIOD_MS) for i in self.motor_state_interval_ms]
+        device_errors = None
+        if self.device_errors_first is not None:
+            device_errors = (self.device_errors_last - self.device_errors_first) & 0xFFFF
+
+        return {
+            'trajectories_sent': self.trajectories_sent,
+            'tcp_send_errors': self.tcp_send_errors,
+            'estops_sent': self.estops_sent,
+            'estop_timeouts': self.estop_timeouts,
+            'clear_timeouts': self.clear_timeouts,
+            'estop_latency_ms': summarize(self.estop_latency_ms),
+            'set_mode_latency_ms': summarize(self.clear_latency_ms),
+            'motor_state_rx': self.motor_state_rx,
+            'motor_state_lost': self.motor_state_lost,
+            'motor_state_loss_pct': (100.0 * self.motor_state_lost / expected) if expected else None,
+            'motor_state_crc_error_pct': (100.0 * self.motor_state_crc_errors / rx_total) if rx_total else None,
+            'motor_state_jitter_ms': summarize(jitter),
+            'device_interval_ms': summarize(self.device_interval_ms),
+            'tcp_rx_packets': self.tcp_rx_packets,
+            'tcp_crc_errors': self.tcp_crc_errors,
+            'tcp_resync_bytes': self.tcp_resync_bytes,
+            'device_error_count_delta': device_errors,
+            'sync_replies': self.sync_replies,
+            'sync_state': self.sync_state,
+            'sync_offset_us': summarize(self.sync_offset_us),
+            'nacks_rx': self.nacks_rx,
+            'frames_nacked': self.frames_nacked,
+            'resent': self.resent,
+        }
+
+# ==================================================
+# MULTICAST SENDER
+# ==================================================
+
+class MulticastSender(threading.Thread):
+    """
+    One MULTICAST_TRAJECTORY frame per tick for every segment seen so far
+    (segment IDs learnt from MOTOR_STATE; a single 0xFF slice while none
+    are known). Start times are on the shared clock, so this needs the
+    segments synchronised to this host.
+    """
+
+    def __init__(self, args, workers, stop_event: threading.Event):
+        super().__init__(name='multicast', daemon=True)
+        self.args = args
+        self.workers = workers
+        self.stop_event = stop_event
+        self.sequence = 0
+        self.trajectory_id = 0
+        self.frames_sent = 0
+        self.history = collections.OrderedDict()   # sequence -> {segment_id: trajectory}
+        self.lock = threading.Lock()
+
+    def slice_ids(self):
+        ids = sorted({w.device_segment_id for w in self.workers if w.device_segment_id})
+        return ids[:8] or [0xFF]
+
+    def send_frame(self, sock):
+        period_ms = int(1000 / self.args.rate)
+        start_ms = master_clock_us() // 1000 + self.args.lead_ms
+        self.sequence += 1
+        slices = []
+        with self.lock:
+            frame = {}
+            for segment_id in self.slice_ids():
+                self.trajectory_id += 1
+                slices.append((segment_id, self.trajectory_id))
+                frame[segment_id] = (self.trajectory_id, start_ms, period_ms)
+            self.history[self.sequence] = frame
+            while len(self.history) > MCAST_HISTORY:
+                self.history.popitem(last=False)
+        sock.sendto(build_multicast_trajectory(self.sequence, start_ms, period_ms, slices),
+                    (MCAST_GROUP, MCAST_PORT))
+        self.frames_sent += 1
+
+    def resend(self, segment_id: int, first: int, count: int):
+        """Trajectories the segment missed, oldest first"""
+        out = []
+        with self.lock:
+            for seq in range(first, first + count):
+                frame = self.history.get(seq & 0xFFFFFFFF, {})
+                t = frame.get(segment_id, frame.get(0xFF))
+                if t is not None:
+                    out.append(t)
+        return out
+
+    def run(self):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+        period = 1.0 / self.args.rate
+        next_frame = time.monotonic()
+        try:
+            while not self.stop_event.wait(max(0.0, next_frame - time.monotonic())):
+                self.send_frame(sock)
+                next_frame += period
+                if next_frame < time.monotonic():
+                    next_frame = time.monotonic() + period
+        finally:
+            sock.close()
+
+# ==================================================
+# PER-SEGMENT WORKER
+# ==================================================
+
+class SegmentWorker(threading.Thread):
+    """Traffic and measurements for one segment controller"""
+
+    ESTOP_TIMEOUT_S = 1.0
+
+    def __init__(self, ip: str, args, stop_event: threading.Event):
+        super().__init__(name=f'segment-{ip}', daemon=True)
+        self.ip = ip
+        self.args = args
+        self.stop_event = stop_event
+        self.stats = SegmentStats()
+        self.error = None
+
+        self.tcp_buf = b''
+        self.trajectory_id = 0
+        self.device_segment_id = 0
+        self.mcast = None                   # MulticastSender in --multicast mode
+        self.last_device_ts = None
+        self.last_device_ts_host = None
+        self.last_rx_host = None
+
+        # E-stop probe state: None, 'stopping' or 'clearing'
+        self.probe_state = None
+        self.probe_sent = 0.0
+        self.estop_active = None
+
+    # ---------- setup ----------
+
+    def connect(self):
+        # UDP socket first, so its port can be given to the TCP connection
+        self.udp = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.udp.bind(('', 0))
+        local_port = self.udp.getsockname()[1]
+
+        self.tcp = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.tcp.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.tcp.bind(('', local_port))
+        self.tcp.settimeout(5.0)
+        self.tcp.connect((self.ip, TCP_PORT))
+        self.tcp.setblocking(False)
+        self.udp.setblocking(False)
+
+    # ---------- transmit ----------
+
+    def device_now_ms(self, host_now):
+        if self.last_device_ts is None:
+            return 0
+        return int(self.last_device_ts + (host_now - self.last_device_ts_host) * 1000.0)
+
+    def send_tcp(self, packet: bytes) -> bool:
+        try:
+            self.tcp.sendall(packet)
+            return True
+        except (BlockingIOError, OSError):
+            self.stats.tcp_send_errors += 1
+            return False
+
+    def send_trajectory(self, host_now):
+        period_ms = int(1000 / self.args.rate)
+        start_ms = self.device_now_ms(host_now) + self.args.lead_ms
+        self.trajectory_id += 1
+        pkt = build_trajectory(self.args.segment_id, self.trajectory_id, start_ms, period_ms)
+        if self.send_tcp(pkt):
+            self.stats.trajectories_sent += 1
+
+    def start_estop_probe(self, host_now):
+        pkt = build_emergency_stop(self.args.segment_id, ESTOP_REASON_LOAD_TEST)
+        self.udp.sendto(pkt, (self.ip, UDP_PORT))
+        self.stats.estops_sent += 1
+        self.probe_state = 'stopping'
+        self.probe_sent = host_now
+
+    def start_clear(self, host_now):
+        self.send_tcp(build_set_mode(self.args.segment_id, MODE_OPERATION))
+        self.probe_state = 'clearing'
+        self.probe_sent = host_now
+
+    # ---------- receive ----------
+
+    def on_time_sync_request(self, packet: bytes, receive_us: int):
+        if len(packet) != TIME_SYNC_REQUEST_SIZE or not crc_ok(packet):
+            return
+        _, _, segment_id, sequence, _, _, origin_us = struct.unpack_from('<HBBHBBQ', packet, 0)
+        reply = build_time_sync_reply(segment_id, sequence, origin_us, receive_us)
+        self.udp.sendto(reply, (self.ip, UDP_PORT))
+        self.stats.sync_replies += 1
+
+    def on_motor_state(self, packet: bytes, host_now):
+        if len(packet) != MOTOR_STATE_SIZE or packet[2] != FEEDBACK_MOTOR_STATE:
+            return
+        if not crc_ok(packet):
+            self.stats.motor_state_crc_errors += 1
+            return
+
+        s = self.stats
+        device_ts = struct.unpack_from('<I', packet, 4)[0]
+        status = packet[-3]
+        s.motor_state_rx += 1
+        self.device_segment_id = packet[3]
+
+        if self.last_rx_host is not None:
+            s.motor_state_interval_ms.append((host_now - self.last_rx_host) * 1000.0)
+        if self.last_device_ts is not None:
+            delta = (device_ts - self.last_device_ts) & 0xFFFFFFFF
+            if delta > CLOCK_STEP_MS:
+                # Segment clock stepped to ours (time sync): not a gap
+                delta = MOTOR_STATE_PERIOD_MS
+            s.device_interval_ms.append(delta)
+            missing = int(round(delta / MOTOR_STATE_PERIOD_MS)) - 1
+            if missing > 0:
+                s.motor_state_lost += missing
+
+        self.last_rx_host = host_now
+        self.last_device_ts = device_ts
+        self.last_device_ts_host = host_now
+
+        self.estop_active = bool(status & STATUS_E_STOP_ACTIVE)
+        latency = (host_now - self.probe_sent) * 1000.0
+        if self.probe_state == 'stopping' and self.estop_active:
+            s.estop_latency_ms.append(latency)
+            self.start_clear(host_now)
+        elif self.probe_state == 'clearing' and not self.estop_active:
+            s.clear_latency_ms.append(latency)
+            self.probe_state = None
+
+    def on_tcp_data(self, data: bytes):
+        self.tcp_buf += data
+        s = self.stats
+
+        while len(self.tcp_buf) >= 3:
+            magic = self.tcp_buf[0] | (self.tcp_buf[1] << 8)
+            size = FEEDBACK_SIZES.get(self.tcp_buf[2])
+            if magic != MAGIC_STM32_TO_MASTER or size is None:
+                self.tcp_buf = self.tcp_buf[1:]
+                s.tcp_resync_bytes += 1
+                continue
+            if len(self.tcp_buf) < size:
+                break
+
+            packet = self.tcp_buf[:size]
+            if not crc_ok(packet):
+                s.tcp_crc_errors += 1
+                self.tcp_buf = self.tcp_buf[1:]
+                continue
+
+            self.tcp_buf = self.tcp_buf[size:]
+            s.tcp_rx_packets += 1
+            if packet[2] == FEEDBACK_DIAGNOSTICS:
+                error_count = struct.unpack_from('<H', packet, 16)[0]
+                if s.device_errors_first is None:
+                    s.device_errors_first = error_count
+                s.device_errors_last = error_count
+            elif packet[2] == FEEDBACK_DIAGNOSTICS_EXT:
+                s.sync_state = packet[9]
+                if s.sync_state == 1:
+                    offset_us = struct.unpack_from('<i', packet, 96)[0]
+                    s.sync_offset_us.append(abs(offset_us))
+            elif packet[2] == FEEDBACK_MULTICAST_NACK and self.mcast is not None:
+                first, count = struct.unpack_from('<IH', packet, 4)
+                s.nacks_rx += 1
+                s.frames_nacked += count
+                for trajectory_id, start_ms, duration_ms in self.mcast.resend(packet[3], first, count):
+                    if self.send_tcp(build_trajectory(self.args.segment_id, trajectory_id,
+                                                      start_ms, duration_ms)):
+                        s.resent += 1
+
+    # ---------- main loop ----------
+
+    def run(self):
+        try:
+            self.connect()
+        except OSError as e:
+            self.error = f'connect failed: {e}'
+            return
+
+        sel = selectors.DefaultSelector()
+        sel.register(self.tcp, selectors.EVENT_READ, 'tcp')
+        sel.register(self.udp, selectors.EVENT_READ, 'udp')
+
+        # Start in OPERATION so trajectories are executed
+        self.send_tcp(build_set_mode(self.args.segment_id, MODE_OPERATION))
+
+        period = 1.0 / self.args.rate
+        next_traj = time.monotonic()
+        next_probe = time.monotonic() + self.args.estop_interval if self.args.estop_interval > 0 else None
+
+        try:
+            while not self.stop_event.is_set():
+                now = time.monotonic()
+                deadlines = [next_traj]
+                if next_probe is not None:
+                    deadlines.append(next_probe)
+                timeout = max(0.0, min(deadlines) - now)
+
+                for key, _ in sel.select(timeout):
+                    host_now = time.monotonic()
+                    if key.data == 'udp':
+                        while True:
+                            try:
+                                data, _ = self.udp.recvfrom(2048)
+                            except BlockingIOError:
+                                break
+                            if len(data) > 2 and data[2] == FEEDBACK_TIME_SYNC_REQUEST:
+                                if self.args.time_sync:
+                                    self.on_time_sync_request(data, master_clock_us())
+                                continue
+                            self.on_motor_state(data, host_now)
+                    else:
+                        try:
+                            data = self.tcp.recv(4096)
+                        except BlockingIOError:
+                            continue
+                        if not data:
+                            self.error = 'TCP connection closed by segment'
+                            return
+                        self.on_tcp_data(data)
+
+                now = time.monotonic()
+                if now >= next_traj and self.mcast is None:
+                    self.send_trajectory(now)
+                    next_traj += period
+                    if next_traj < now:
+                        # Fell behind (host overload): do not burst to catch up
+                        next_traj = now + period
+
+                if self.probe_state is not None and now - self.probe_sent > self.ESTOP_TIMEOUT_S:
+                    if self.probe_state == 'stopping':
+                        self.stats.estop_timeouts += 1
+                    else:
+                        self.stats.clear_timeouts += 1
+                    self.start_clear(now)
+
+                if next_probe is not None and now >= next_probe:
+                    if self.probe_state is None:
+                        self.start_estop_probe(now)
+                    next_probe = now + self.args.estop_interval
+        except OSError as e:
+            self.error = str(e)
+        finally:
+            # Leave the segment running (clears any probe still latched)
+            self.send_tcp(build_set_mode(self.args.segment_id, MODE_OPERATION))
+            sel.close()
+            self.tcp.close()
+            self.udp.close()
+
+# ==================================================
+# REPORT
+# ==================================================
+
+def fmt(summary, key):
+    value = summary.get(key)
+    return '-' if value is None else f'{value:.1f}'
+
+
+def print_report(results):
+    print(f"\n{'segment':<16} {'traj':>6} {'fb rx':>7} {'loss%':>6} {'crc%':>5} "
+          f"{'jit p99':>7} {'estop p50/p99/max ms':>22} {'tcp p50/p99 ms':>15} {'dev err':>7} "
+          f"{'sync p99 us':>11}")
+    for ip, r in results.items():
+        if 'error' in r:
+            print(f"{ip:<16} ERROR: {r['error']}")
+            continue
+        e = r['estop_latency_ms']
+        c = r['set_mode_latency_ms']
+        j = r['motor_state_jitter_ms']
+        loss = '-' if r['motor_state_loss_pct'] is None else f"{r['motor_state_loss_pct']:.2f}"
+        crc = '-' if r['motor_state_crc_error_pct'] is None else f"{r['motor_state_crc_error_pct']:.2f}"
+        dev_err = '-' if r['device_error_count_delta'] is None else str(r['device_error_count_delta'])
+        sync = fmt(r['sync_offset_us'], 'p99') if r['sync_state'] == 1 else 'unsynced'
+
+        print(f"{ip:<16} {r['trajectories_sent']:>6} {r['motor_state_rx']:>7} {loss:>6} {crc:>5} "
+              f"{fmt(j, 'p99'):>7} "
+              f"{fmt(e, 'p50') + '/' + fmt(e, 'p99') + '/' + fmt(e, 'max'):>22} "
+              f"{fmt(c, 'p50') + '/' + fmt(c, 'p99'):>15} {dev_err:>7} {sync:>11}")
+        problems = []
+        if r['tcp_send_errors']:
+            problems.append(f"{r['tcp_send_errors']} TCP send errors")
+        if r['estop_timeouts'] or r['clear_timeouts']:
+            problems.append(f"{r['estop_timeouts']} E-stop / {r['clear_timeouts']} clear timeouts")
+        if r['tcp_crc_errors'] or r['tcp_resync_bytes']:
+            problems.append(f"{r['tcp_crc_errors']} TCP CRC errors, {r['tcp_resync_bytes']} resync bytes")
+        if r['nacks_rx']:
+            problems.append(f"{r['nacks_rx']} NACKs ({r['frames_nacked']} frames), {r['resent']} resent")
+        if problems:
+            print(f"{'':<16} " + '; '.join(problems))
+
+
+def default_ips():
+    start = ipaddress.IPv4Address(DEFAULT_IP_START)
+    end = ipaddress.IPv4Address(DEFAULT_IP_END)
+    return [str(ipaddress.IPv4Address(a)) for a in range(int(start), int(end) + 1)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Load generator for segment controllers')
+    parser.add_argument('ips', nargs='*', help=f'Segment IPs (default {DEFAULT_IP_START}-{DEFAULT_IP_END})')
+    parser.add_argument('--rate', type=float, default=10.0, help='TRAJECTORY rate in Hz (5-50, default 10)')
+    parser.add_argument('--duration', type=float, default=60.0, help='Test duration in seconds (default 60)')
+    parser.add_argument('--estop-interval', type=float, default=5.0,
+                        help='Seconds between E-stop probes, 0 to disable (default 5)')
+    parser.add_argument('--lead-ms', type=int, default=50,
+                        help='Trajectory start time ahead of the segment clock (default 50)')
+    parser.add_argument('--segment-id', type=lambda v: int(v, 0), default=0xFF,
+                        help='Segment ID in commands (default 0xFF = any)')
+    parser.add_argument('--no-time-sync', dest='time_sync', action='store_false',
+                        help='Do not answer TIME_SYNC_REQUEST (segments keep their boot clock)')
+    parser.add_argument('--multicast', action='store_true',
+                        help=f'Send trajectories as MULTICAST_TRAJECTORY to {MCAST_GROUP}:{MCAST_PORT}')
+    parser.add_argument('--json', help='Write per-segment results to this file')
+    args = parser.parse_args()
+
+    if not 5.0 <= args.rate <= 50.0:
+        parser.error('--rate must be between 5 and 50 Hz')
+    if args.multicast and not args.time_sync:
+        parser.error('--multicast needs time sync (start times are on the shared clock)')
+
+    ips = args.ips or default_ips()
+    stop_event = threading.Event()
+    workers = [SegmentWorker(ip, args, stop_event) for ip in ips]
+    mcast = None
+    if args.multicast:
+        mcast = MulticastSender(args, workers, stop_event)
+        for w in workers:
+            w.mcast = mcast
+
+    print(f"Load test: {len(ips)} segments, trajectories at {args.rate:g} Hz, "
+          f"E-stop probe every {args.estop_interval:g} s, {args.duration:g} s")
+    for w in workers:
+        w.start()
+    if mcast is not None:
+        mcast.start()
+
+    try:
+        time.sleep(args.duration)
+    except KeyboardInterrupt:
+        print("\nInterrupted, stopping")
+    stop_event.set()
+    for w in workers:
+        w.join(timeout=5.0)
+
+    results = {}
+    for w in workers:
+        results[w.ip] = {'error': w.error} if w.error else w.stats.report()
+
+    print_report(results)
+    if mcast is not None:
+        print(f"\nMulticast: {mcast.frames_sent} frames to {MCAST_GROUP}:{MCAST_PORT}")
+
+    if args.json:
+        with open(args.json, 'w', encoding='utf-8') as f:
+            json.dump({'args': vars(args), 'results': results}, f, indent=2)
+        print(f"\nWrote {args.json}")
+
+    return 1 if any('error' in r for r in results.values()) else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
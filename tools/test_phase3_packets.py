@@ -31,11 +31,25 @@ CMD_START_HOMING = 0x03
 CMD_JOG_MOTOR = 0x07
 CMD_SET_MODE = 0x08
 CMD_SET_ZERO_OFFSET = 0x09
+CMD_SET_FEEDBACK_FORMAT = 0x0A
+CMD_TIME_SYNC_REPLY = 0x0B
 
 # Feedback packet types (STM32 → Master)
 FEEDBACK_MOTOR_STATE = 0x01
 FEEDBACK_CAPACITIVE_GRID = 0x02
 FEEDBACK_DIAGNOSTICS = 0x03
+FEEDBACK_DIAGNOSTICS_EXT = 0x04
+FEEDBACK_MOTOR_STATE_COMPACT = 0x05
+FEEDBACK_TIME_SYNC_REQUEST = 0x06
+
+# Motor state formats (SET_FEEDBACK_FORMAT)
+FEEDBACK_FORMAT_FULL = 0x01
+FEEDBACK_FORMAT_COMPACT = 0x02
+
+# Compact motor state encoding
+COMPACT_COUNTS_PER_MM = 14400.0
+COMPACT_SAMPLE_KEY = 0x01
+COMPACT_SAMPLE_DELTA = 0x02
 
 # Operating modes
 MODE_IDLE = 0x01
@@ -111,6 +125,22 @@ def build_set_mode(segment_id: int, mode: int) -> bytes:
     packet = packet[:-2] + struct.pack('<H', crc)
     return packet
 
+def build_set_feedback_format(segment_id: int, fmt: int, batch: int = 1) -> bytes:
+    """
+    Build SET_FEEDBACK_FORMAT packet (8 bytes)
+    fmt: FEEDBACK_FORMAT_FULL or FEEDBACK_FORMAT_COMPACT, batch: 1-4 samples per datagram
+    """
+    packet = struct.pack('<HBBBBxx',
+        MAGIC_MASTER_TO_STM32,    # magic_header
+        CMD_SET_FEEDBACK_FORMAT,  # packet_type
+        segment_id,               # segment_id
+        fmt,                      # format
+        batch                     # batch
+    )
+    crc = crc16_ccitt(packet[:-2])
+    packet = packet[:-2] + struct.pack('<H', crc)
+    return packet
+
 def build_start_homing(segment_id: int, homing_mode: int = 0x01) -> bytes:
     """
     Build START_HOMING packet (7 bytes)
@@ -231,10 +261,64 @@ def parse_motor_state(packet: bytes) -> Optional[dict]:
         'status_flags': data[22]
     }
 
+def parse_motor_state_compact(packet: bytes) -> Optional[dict]:
+    """Parse MOTOR_STATE_COMPACT feedback packet (1-4 samples, 64-214 bytes)"""
+    if len(packet) < 14 or packet[2] != FEEDBACK_MOTOR_STATE_COMPACT:
+        print("Error: Not a MOTOR_STATE_COMPACT packet")
+        return None
+
+    if not verify_crc(packet):
+        print("Error: CRC check failed for MOTOR_STATE_COMPACT packet")
+        return None
+
+    _, _, segment_id, timestamp, sequence, count, period_ms = \
+        struct.unpack_from('<HBBIHBB', packet, 0)
+
+    samples = []
+    pos = vel = acc = None
+    offset = 12
+    for n in range(count):
+        kind = packet[offset]
+        if kind == COMPACT_SAMPLE_KEY:
+            f = struct.unpack_from('<BB9i6h', packet, offset)
+            pos, vel, acc = list(f[2:5]), list(f[5:8]), list(f[8:11])
+            offset += 50
+        elif kind == COMPACT_SAMPLE_DELTA and pos is not None:
+            f = struct.unpack_from('<BB15h', packet, offset)
+            pos = [p + d for p, d in zip(pos, f[2:5])]
+            vel = [v + d for v, d in zip(vel, f[5:8])]
+            acc = [a + d for a, d in zip(acc, f[8:11])]
+            offset += 32
+        else:
+            print(f"Error: Bad sample kind 0x{kind:02X} in MOTOR_STATE_COMPACT")
+            return None
+
+        current, imu = f[-6:-3], f[-3:]
+        samples.append({
+            'timestamp': timestamp + n * period_ms,
+            'status_flags': f[1],
+            'position': [p / COMPACT_COUNTS_PER_MM for p in pos],          # mm
+            'velocity': [v / COMPACT_COUNTS_PER_MM for v in vel],          # mm/s
+            'acceleration': [a / COMPACT_COUNTS_PER_MM for a in acc],      # mm/s²
+            'current': [c / 1000.0 for c in current],                      # A
+            'imu': {'roll': imu[0] / 1e4, 'pitch': imu[1] / 1e4, 'yaw': imu[2] / 1e4}
+        })
+
+    if offset != len(packet) - 2:
+        print(f"Error: MOTOR_STATE_COMPACT length {len(packet)} does not match samples")
+        return None
+
+    return {
+        'segment_id': segment_id,
+        'timestamp': timestamp,
+        'sequence': sequence,
+        'samples': samples
+    }
+
 def parse_diagnostics(packet: bytes) -> Optional[dict]:
-    """Parse DIAGNOSTICS feedback packet (26 bytes)"""
-    if len(packet) != 26:
-        print(f"Error: Expected 26 bytes for DIAGNOSTICS, got {len(packet)}")
+    """Parse DIAGNOSTICS feedback packet (22 bytes)"""
+    if len(packet) != 22:
+        print(f"Error: Expected 22 bytes for DIAGNOSTICS, got {len(packet)}")
         return None
 
     if not verify_crc(packet):
@@ -242,7 +326,7 @@ def parse_diagnostics(packet: bytes) -> Optional[dict]:
         return None
 
     # Unpack the packet
-    data = struct.unpack('<HBBIffHBBxx', packet[:-2])
+    data = struct.unpack('<HBBIffHBB', packet[:-2])
 
     return {
         'magic_header': data[0],
@@ -256,6 +340,41 @@ def parse_diagnostics(packet: bytes) -> Optional[dict]:
         'cpu_usage': data[8]
     }
 
+def parse_diagnostics_ext(packet: bytes) -> Optional[dict]:
+    """Parse DIAGNOSTICS_EXT feedback packet (110 bytes)"""
+    if len(packet) != 110:
+        print(f"Error: Expected 110 bytes for DIAGNOSTICS_EXT, got {len(packet)}")
+        return None
+
+    if not verify_crc(packet):
+        print("Error: CRC check failed for DIAGNOSTICS_EXT packet")
+        return None
+
+    data = struct.unpack('<HBBIBB2xIIHHH5H8IffffHHIIiIi', packet[:-2])
+
+    return {
+        'segment_id': data[2],
+        'timestamp': data[3],
+        'cpu_usage': data[4],
+        'sync_state': data[5],
+        'control_cycles': data[6],
+        'missed_deadlines': data[7],
+        'exec_avg_us': data[8],
+        'exec_max_us': data[9],
+        'jitter_max_us': data[10],
+        'stack_unused': list(data[11:16]),
+        'exec_hist': list(data[16:24]),
+        'stm32_temp': data[24],
+        'tmc9660_temp_reserved': list(data[25:28]),  # Always NaN
+        'estop_count': data[28],
+        'estop_max_latency_us': data[29],
+        'feedback_sent': data[30],
+        'feedback_dropped': data[31],
+        'sync_offset_us': data[32],
+        'sync_delay_us': data[33],
+        'sync_rate_ppb': data[34]
+    }
+
 # ==================================================
 # TEST FUNCTIONS
 # ==================================================
@@ -311,7 +430,7 @@ def test_set_mode(ip_address: str, mode: int = MODE_IDLE):
             if len(data) > 0:
                 print(f"Received response: {len(data)} bytes")
                 # Try to parse as diagnostics
-                if len(data) == 26:
+                if len(data) == 22:
                     diag = parse_diagnostics(data)
                     if diag:
                         print(f"DIAGNOSTICS: Segment {diag['segment_id']}, Temp: {diag['stm32_temp']:.1f}°C, CPU: {diag['cpu_usage']}%")
@@ -347,17 +466,41 @@ def test_receive_diagnostics(ip_address: str, duration: int = 5):
                 packet_count += 1
                 print(f"\nReceived packet #{packet_count}: {len(data)} bytes")
 
+                # DIAGNOSTICS_EXT follows DIAGNOSTICS and may arrive in the same read
+                ext = None
+                if len(data) == 22 + 110 and data[22 + 2] == FEEDBACK_DIAGNOSTICS_EXT:
+                    ext = parse_diagnostics_ext(data[22:])
+                    data = data[:22]
+
                 # Try to parse
-                if len(data) == 26:
+                if len(data) == 22:
                     diag = parse_diagnostics(data)
                     if diag:
                         print(f"  Segment ID: {diag['segment_id']}")
                         print(f"  Timestamp: {diag['timestamp']} ms")
-                        print(f"  TMC9660 Temp: {diag['tmc9660_temp_avg']:.1f}°C")
                         print(f"  STM32 Temp: {diag['stm32_temp']:.1f}°C")
                         print(f"  Error Count: {diag['error_count']}")
                         print(f"  Last Error: 0x{diag['last_error_code']:02X}")
                         print(f"  CPU Usage: {diag['cpu_usage']}%")
+                    if ext:
+                        print(f"  Control: {ext['control_cycles']} cycles, "
+                              f"{ext['missed_deadlines']} missed, "
+                              f"exec {ext['exec_avg_us']}/{ext['exec_max_us']} us (avg/max)")
+                        print(f"  Exec histogram: {ext['exec_hist']}")
+                        print(f"  Stack free: {ext['stack_unused']} bytes")
+                        print(f"  E-stop: {ext['estop_count']}, max latency {ext['estop_max_latency_us']} us")
+                        print(f"  Time sync: state {ext['sync_state']}, offset {ext['sync_offset_us']} us, "
+                              f"delay {ext['sync_delay_us']} us, rate {ext['sync_rate_ppb']} ppb")
+                elif len(data) == 110 and data[2] == FEEDBACK_DIAGNOSTICS_EXT:
+                    ext = parse_diagnostics_ext(data)
+                    if ext:
+                        print(f"  DIAGNOSTICS_EXT: CPU {ext['cpu_usage']}%, "
+                              f"stack free {ext['stack_unused']} bytes")
+                elif len(data) >= 14 and data[2] == FEEDBACK_MOTOR_STATE_COMPACT:
+                    compact = parse_motor_state_compact(data)
+                    if compact:
+                        print(f"  MOTOR_STATE_COMPACT #{compact['sequence']}: "
+                              f"{len(compact['samples'])} samples")
                 elif len(data) == 83:
                     motor_state = parse_motor_state(data)
                     if motor_state:
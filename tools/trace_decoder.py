@@ -0,0 +1,536 @@
+#!/usr/bin/env python3
+"""
+Event Trace Decoder
+
+Fetches the firmware's event trace (CONFIG_SEGMENT_TRACE) and turns it
+into a timeline and timing figures:
+
+    - control tick execution time, period and missed deadlines
+    - TMC9660 exchange latency per motor, with failures
+    - command dispatch time per packet type, packets received per transport
+    - IMU reads (FIFO words per burst, failures, interval)
+    - UDP sends per packet type, with errors
+
+Captures are saved as the raw TRACE packets, so they can be decoded again
+later (--save, then "decode"), e.g. to compare runs.
+
+Usage:
+    python3 trace_decoder.py dump 192.168.1.100 --save run1.trace
+    python3 trace_decoder.py live 192.168.1.100 --duration 10 --save run2.trace
+    python3 trace_decoder.py decode run1.trace --timeline --csv run1.csv
+    python3 trace_decoder.py clear 192.168.1.100
+
+Event times are on the segment's shared clock (ms, as in packet
+timestamps), reconstructed from the 32-bit cycle counter and the
+reference taken when each packet was sent. An event recorded more than
+one counter wrap (about 8.9 s at 480 MHz) before its packet was sent is
+placed a multiple of that too late; the ring only covers that long on an
+idle segment.
+"""
+
+import argparse
+import csv
+import socket
+import struct
+import sys
+import time
+from collections import defaultdict
+
+# Network configuration (network.h)
+TCP_PORT = 5000
+
+MAGIC_MASTER_TO_STM32 = 0xAA55
+MAGIC_STM32_TO_MASTER = 0xBB55
+
+CMD_TRACE_CONTROL = 0x0F
+FEEDBACK_TRACE = 0x08
+
+TRACE_ACTION_DUMP = 0x01
+TRACE_ACTION_LIVE_START = 0x02
+TRACE_ACTION_LIVE_STOP = 0x03
+TRACE_ACTION_CLEAR = 0x04
+
+TRACE_FLAG_LIVE = 0x01
+TRACE_FLAG_LAST = 0x02
+
+TRACE_HEADER = struct.Struct('<HBBIIIIBBH')   # trace_packet_header_t, 24 bytes
+TRACE_EVENT = struct.Struct('<IBBH')          # trace_event_t, 8 bytes
+
+# Other feedback on the TCP stream, skipped while waiting for a dump
+TCP_FEEDBACK_SIZES = {
+    0x03: 22,    # DIAGNOSTICS
+    0x04: 110,   # DIAGNOSTICS_EXT
+    0x07: 12,    # MULTICAST_NACK
+}
+
+# Event IDs (src/trace.h)
+EVT_PKT_RX = 1
+EVT_PKT_DISPATCH = 2
+EVT_PKT_DONE = 3
+EVT_CTRL_START = 4
+EVT_CTRL_END = 5
+EVT_TMC_START = 6
+EVT_TMC_DONE = 7
+EVT_IMU_READ = 8
+EVT_UDP_SEND = 9
+
+EVENT_NAMES = {
+    EVT_PKT_RX: 'PKT_RX',
+    EVT_PKT_DISPATCH: 'PKT_DISPATCH',
+    EVT_PKT_DONE: 'PKT_DONE',
+    EVT_CTRL_START: 'CTRL_START',
+    EVT_CTRL_END: 'CTRL_END',
+    EVT_TMC_START: 'TMC_START',
+    EVT_TMC_DONE: 'TMC_DONE',
+    EVT_IMU_READ: 'IMU_READ',
+    EVT_UDP_SEND: 'UDP_SEND',
+}
+
+TRANSPORTS = {0: 'TCP', 1: 'UDP'}
+
+PACKET_NAMES = {
+    0x01: 'TRAJECTORY', 0x02: 'EMERGENCY_STOP', 0x03: 'START_HOMING',
+    0x07: 'JOG_MOTOR', 0x08: 'SET_MODE', 0x09: 'SET_ZERO_OFFSET',
+    0x0A: 'SET_FEEDBACK_FORMAT', 0x0B: 'TIME_SYNC_REPLY',
+    0x0C: 'MULTICAST_TRAJECTORY', 0x0F: 'TRACE_CONTROL',
+}
+
+FEEDBACK_NAMES = {
+    0x01: 'MOTOR_STATE', 0x02: 'CAPACITIVE_GRID', 0x03: 'DIAGNOSTICS',
+    0x04: 'DIAGNOSTICS_EXT', 0x05: 'MOTOR_STATE_COMPACT',
+    0x06: 'TIME_SYNC_REQUEST', 0x07: 'MULTICAST_NACK', 0x08: 'TRACE',
+}
+
+MOTORS = 'ABC'
+
+# ==================================================
+# CRC16-CCITT (firmware variant)
+# ==================================================
+
+def crc16(data: bytes) -> int:
+    """
+    CRC16-CCITT as computed by the firmware (Zephyr crc16_ccitt with seed
+    0xFFFF): polynomial 0x1021 processed LSB first; check value 0x6F91.
+    """
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            if crc & 1:
+                crc = (crc >> 1) ^ 0x8408
+            else:
+                crc >>= 1
+    return crc
+
+
+def crc_ok(packet: bytes) -> bool:
+    return crc16(packet[:-2]) == struct.unpack('<H', packet[-2:])[0]
+
+
+def build_trace_control(segment_id: int, action: int) -> bytes:
+    body = struct.pack('<HBBB', MAGIC_MASTER_TO_STM32, CMD_TRACE_CONTROL, segment_id, action)
+    return body + struct.pack('<H', crc16(body))
+
+# ==================================================
+# PACKETS
+# ==================================================
+
+def trace_packet_size(buf: bytes) -> int:
+    """Length of the TRACE packet at the start of buf (header needed)"""
+    return TRACE_HEADER.size + buf[20] * TRACE_EVENT.size + 2
+
+
+class TracePacket:
+    def __init__(self, data: bytes):
+        (_, _, self.segment_id, self.first_event, self.ref_cycles, self.ref_time_ms,
+         self.cycles_per_sec, self.count, self.flags, self.lost) = TRACE_HEADER.unpack_from(data)
+        self.events = [TRACE_EVENT.unpack_from(data, TRACE_HEADER.size + i * TRACE_EVENT.size)
+                       for i in range(self.count)]
+
+
+def split_packets(data: bytes):
+    """TRACE packets from a capture, or from the TCP stream"""
+    packets = []
+    resync = 0
+    pos = 0
+
+    while len(data) - pos >= 4:
+        magic = struct.unpack_from('<H', data, pos)[0]
+        ptype = data[pos + 2]
+
+        if magic != MAGIC_STM32_TO_MASTER:
+            pos += 1
+            resync += 1
+            continue
+
+        if ptype == FEEDBACK_TRACE:
+            if len(data) - pos < TRACE_HEADER.size:
+                break
+            size = trace_packet_size(data[pos:])
+        elif ptype in TCP_FEEDBACK_SIZES:
+            size = TCP_FEEDBACK_SIZES[ptype]
+        else:
+            pos += 1
+            resync += 1
+            continue
+
+        if len(data) - pos < size:
+            break
+
+        packet = data[pos:pos + size]
+        if not crc_ok(packet):
+            pos += 1
+            resync += 1
+            continue
+
+        if ptype == FEEDBACK_TRACE:
+            packets.append(packet)
+        pos += size
+
+    return packets, data[pos:], resync
+
+# ==================================================
+# CAPTURE
+# ==================================================
+
+def connect(ip: str) -> socket.socket:
+    sock = socket.create_connection((ip, TCP_PORT), timeout=5.0)
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    return sock
+
+
+def capture_dump(ip: str, segment_id: int, timeout: float) -> list:
+    """Request a dump and read TRACE packets until the last one"""
+    sock = connect(ip)
+    sock.sendall(build_trace_control(segment_id, TRACE_ACTION_DUMP))
+
+    packets = []
+    buf = b''
+    complete = False
+    deadline = time.monotonic() + timeout
+
+    while not complete and time.monotonic() < deadline:
+        sock.settimeout(max(0.1, deadline - time.monotonic()))
+        try:
+            data = sock.recv(65536)
+        except socket.timeout:
+            break
+        if not data:
+            break
+
+        found, buf, _ = split_packets(buf + data)
+        packets.extend(found)
+        complete = any(TracePacket(p).flags & TRACE_FLAG_LAST for p in found)
+
+    if not complete:
+        print("Warning: dump incomplete (no last packet)", file=sys.stderr)
+
+    sock.close()
+    return packets
+
+
+def capture_live(ip: str, segment_id: int, duration: float) -> list:
+    """Stream for duration seconds; the segment sends UDP to our TCP address"""
+    sock = connect(ip)
+    udp = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    udp.bind(('', sock.getsockname()[1]))
+    udp.settimeout(0.2)
+
+    sock.sendall(build_trace_control(segment_id, TRACE_ACTION_LIVE_START))
+
+    packets = []
+    end = time.monotonic() + duration
+    try:
+        while time.monotonic() < end:
+            try:
+                data, _ = udp.recvfrom(2048)
+            except socket.timeout:
+                continue
+            if (len(data) >= TRACE_HEADER.size + 2 and data[2] == FEEDBACK_TRACE and
+                    struct.unpack_from('<H', data)[0] == MAGIC_STM32_TO_MASTER and
+                    trace_packet_size(data) == len(data) and crc_ok(data)):
+                packets.append(data)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        sock.sendall(build_trace_control(segment_id, TRACE_ACTION_LIVE_STOP))
+        udp.close()
+        sock.close()
+
+    return packets
+
+# ==================================================
+# DECODING
+# ==================================================
+
+def decode_events(packets: list):
+    """
+    Events in number order as (number, time_ms, id, arg8, arg16), plus the
+    number of events missing between the first and the last one
+    """
+    events = {}
+
+    for raw in packets:
+        pkt = TracePacket(raw)
+        hz = pkt.cycles_per_sec or 1
+        for i, (cycles, eid, arg8, arg16) in enumerate(pkt.events):
+            age = ((pkt.ref_cycles - cycles) & 0xFFFFFFFF) / hz
+            events[(pkt.first_event + i) & 0xFFFFFFFF] = (pkt.ref_time_ms - age * 1000.0,
+                                                          eid, arg8, arg16)
+
+    if not events:
+        return [], 0
+
+    # Event numbers wrap at 2^32: then the oldest is the smallest upper-half one
+    numbers = sorted(events)
+    if numbers[-1] - numbers[0] > 0x80000000:
+        base = min(n for n in numbers if n >= 0x80000000)
+        numbers.sort(key=lambda n: (n - base) & 0xFFFFFFFF)
+
+    span = ((numbers[-1] - numbers[0]) & 0xFFFFFFFF) + 1
+    ordered = [(n,) + events[n] for n in numbers]
+
+    return ordered, span - len(ordered)
+
+
+def signed16(v: int) -> int:
+    return v - 0x10000 if v & 0x8000 else v
+
+
+class Series:
+    """Durations in µs"""
+    def __init__(self):
+        self.values = []
+
+    def add(self, v):
+        self.values.append(v)
+
+    def line(self, label: str) -> str:
+        if not self.values:
+            return f"  {label:<28} -"
+        v = sorted(self.values)
+        p99 = v[min(len(v) - 1, int(len(v) * 0.99))]
+        return (f"  {label:<28} n={len(v):<6} min={v[0]:8.1f} avg={sum(v) / len(v):8.1f} "
+                f"p99={p99:8.1f} max={v[-1]:8.1f} us")
+
+
+def summarize(events: list, missing: int, lost: int):
+    tick_exec = Series()
+    tick_period = Series()
+    missed = 0
+    tick_start = None
+    last_tick_start = None
+
+    tmc = defaultdict(Series)
+    tmc_open = {}
+    tmc_errors = defaultdict(int)
+
+    dispatch = defaultdict(Series)
+    dispatch_open = None
+    rejected = defaultdict(int)
+    rx = defaultdict(int)
+    rx_bytes = defaultdict(int)
+
+    imu_interval = Series()
+    imu_words = 0
+    imu_reads = 0
+    imu_errors = 0
+    last_imu = None
+
+    udp_sent = defaultdict(int)
+    udp_errors = defaultdict(int)
+
+    for _, t, eid, arg8, arg16 in events:
+        us = t * 1000.0
+
+        if eid == EVT_CTRL_START:
+            if last_tick_start is not None:
+                tick_period.add(us - last_tick_start)
+            last_tick_start = us
+            tick_start = (arg16, us)
+            if arg8 > 1:
+                missed += arg8 - 1
+        elif eid == EVT_CTRL_END:
+            if tick_start is not None and tick_start[0] == arg16:
+                tick_exec.add(us - tick_start[1])
+            tick_start = None
+        elif eid == EVT_TMC_START:
+            tmc_open[arg8] = us
+        elif eid == EVT_TMC_DONE:
+            start = tmc_open.pop(arg8, None)
+            if start is not None:
+                tmc[arg8].add(us - start)
+            if signed16(arg16) < 0:
+                tmc_errors[arg8] += 1
+        elif eid == EVT_PKT_RX:
+            rx[arg8] += 1
+            rx_bytes[arg8] += arg16
+        elif eid == EVT_PKT_DISPATCH:
+            dispatch_open = (arg8, us)
+        elif eid == EVT_PKT_DONE:
+            if dispatch_open is not None and dispatch_open[0] == arg8:
+                dispatch[arg8].add(us - dispatch_open[1])
+            if arg16:
+                rejected[arg8] += 1
+            dispatch_open = None
+        elif eid == EVT_IMU_READ:
+            imu_reads += 1
+            if arg8:
+                imu_errors += 1
+            else:
+                imu_words += arg16
+            if last_imu is not None:
+                imu_interval.add(us - last_imu)
+            last_imu = us
+        elif eid == EVT_UDP_SEND:
+            if signed16(arg16) < 0:
+                udp_errors[arg8] += 1
+            else:
+                udp_sent[arg8] += 1
+
+    if events:
+        duration = events[-1][1] - events[0][1]
+        print(f"{len(events)} events over {duration:.1f} ms "
+              f"({missing} missing, {lost} reported lost by the segment)")
+    else:
+        print("No events")
+        return
+
+    print("\nControl loop")
+    print(tick_exec.line("tick execution"))
+    print(tick_period.line("tick period"))
+    print(f"  {'missed deadlines':<28} {missed}")
+
+    print("\nTMC9660 exchanges")
+    for motor in sorted(set(tmc) | set(tmc_errors)):
+        name = MOTORS[motor] if motor < len(MOTORS) else str(motor)
+        print(tmc[motor].line(f"motor {name}") + f"  errors={tmc_errors[motor]}")
+
+    print("\nCommands")
+    for transport in sorted(rx):
+        print(f"  {'received ' + TRANSPORTS.get(transport, str(transport)):<28} "
+              f"{rx[transport]} reads, {rx_bytes[transport]} bytes")
+    for ptype in sorted(set(dispatch) | set(rejected)):
+        name = PACKET_NAMES.get(ptype, f"0x{ptype:02X}")
+        print(dispatch[ptype].line(name) + f"  rejected={rejected[ptype]}")
+
+    print("\nIMU")
+    print(f"  {'reads':<28} {imu_reads} ({imu_errors} failed, {imu_words} FIFO words)")
+    print(imu_interval.line("read interval"))
+
+    print("\nUDP sends")
+    for ptype in sorted(set(udp_sent) | set(udp_errors)):
+        name = FEEDBACK_NAMES.get(ptype, f"0x{ptype:02X}")
+        print(f"  {name:<28} sent={udp_sent[ptype]} errors={udp_errors[ptype]}")
+
+
+def describe(eid: int, arg8: int, arg16: int) -> str:
+    if eid == EVT_PKT_RX:
+        return f"{TRANSPORTS.get(arg8, arg8)} {arg16} bytes"
+    if eid in (EVT_PKT_DISPATCH, EVT_PKT_DONE):
+        name = PACKET_NAMES.get(arg8, f"0x{arg8:02X}")
+        if eid == EVT_PKT_DISPATCH:
+            return f"{name} {arg16} bytes"
+        return f"{name} {'rejected' if arg16 else 'ok'}"
+    if eid == EVT_CTRL_START:
+        return f"tick {arg16}" + (f" ({arg8 - 1} missed)" if arg8 > 1 else "")
+    if eid == EVT_CTRL_END:
+        return f"tick {arg16}"
+    if eid == EVT_TMC_START:
+        return f"motor {MOTORS[arg8] if arg8 < 3 else arg8} cmd 0x{arg16:02X}"
+    if eid == EVT_TMC_DONE:
+        return f"motor {MOTORS[arg8] if arg8 < 3 else arg8} result {signed16(arg16)}"
+    if eid == EVT_IMU_READ:
+        return f"{arg16} words" + (" failed" if arg8 else "")
+    if eid == EVT_UDP_SEND:
+        return f"{FEEDBACK_NAMES.get(arg8, f'0x{arg8:02X}')} {signed16(arg16)}"
+    return f"arg8={arg8} arg16={arg16}"
+
+
+def print_timeline(events: list):
+    prev = None
+    for number, t, eid, arg8, arg16 in events:
+        delta = '' if prev is None else f"+{(t - prev) * 1000.0:9.1f} us"
+        print(f"{number:>10} {t:14.3f} ms {delta:>14}  {EVENT_NAMES.get(eid, eid):<13} "
+              f"{describe(eid, arg8, arg16)}")
+        prev = t
+
+
+def write_csv(events: list, path: str):
+    with open(path, 'w', newline='', encoding='utf-8') as f:
+        w = csv.writer(f)
+        w.writerow(['event', 'time_ms', 'id', 'name', 'arg8', 'arg16'])
+        for number, t, eid, arg8, arg16 in events:
+            w.writerow([number, f"{t:.4f}", eid, EVENT_NAMES.get(eid, ''), arg8, arg16])
+    print(f"\nWrote {path}")
+
+# ==================================================
+# MAIN
+# ==================================================
+
+def main():
+    parser = argparse.ArgumentParser(description='Segment controller event trace decoder')
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    for name, text in (('dump', 'Fetch the trace ring over TCP'),
+                       ('live', 'Stream new events over UDP'),
+                       ('clear', 'Forget the recorded events')):
+        p = sub.add_parser(name, help=text)
+        p.add_argument('ip', help='Segment IP address')
+        p.add_argument('--segment', type=int, default=0xFF,
+                       help='Segment ID in the command (informational)')
+        if name != 'clear':
+            p.add_argument('--save', help='Write the raw TRACE packets to this file')
+            p.add_argument('--timeline', action='store_true', help='Print every event')
+            p.add_argument('--csv', help='Write the events to this CSV file')
+        if name == 'dump':
+            p.add_argument('--timeout', type=float, default=5.0, help='Seconds to wait')
+        if name == 'live':
+            p.add_argument('--duration', type=float, default=10.0, help='Seconds to stream')
+
+    p = sub.add_parser('decode', help='Decode a saved capture')
+    p.add_argument('file', help='Capture written with --save')
+    p.add_argument('--timeline', action='store_true', help='Print every event')
+    p.add_argument('--csv', help='Write the events to this CSV file')
+
+    args = parser.parse_args()
+
+    if args.command == 'clear':
+        sock = connect(args.ip)
+        sock.sendall(build_trace_control(args.segment, TRACE_ACTION_CLEAR))
+        sock.close()
+        print("Trace cleared")
+        return 0
+
+    if args.command == 'decode':
+        with open(args.file, 'rb') as f:
+            packets, rest, resync = split_packets(f.read())
+        if rest or resync:
+            print(f"Warning: {len(rest) + resync} bytes of the capture not decodable",
+                  file=sys.stderr)
+    elif args.command == 'dump':
+        packets = capture_dump(args.ip, args.segment, args.timeout)
+    else:
+        packets = capture_live(args.ip, args.segment, args.duration)
+
+    if getattr(args, 'save', None):
+        with open(args.save, 'wb') as f:
+            f.write(b''.join(packets))
+        print(f"Saved {len(packets)} packets to {args.save}")
+
+    lost = sum(TracePacket(p).lost for p in packets)
+    events, missing = decode_events(packets)
+
+    if args.timeline:
+        print_timeline(events)
+        print()
+    summarize(events, missing, lost)
+
+    if args.csv:
+        write_csv(events, args.csv)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())